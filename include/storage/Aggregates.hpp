@@ -0,0 +1,454 @@
+#pragma once
+
+#include <span>
+#include <tuple>
+#include <vector>
+#include <thread>
+#include <limits>
+#include <cstdint>
+#include <algorithm>
+
+#include <storage/Utils.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LIBSTORAGE_HAVE_AVX2 1
+#else
+#define LIBSTORAGE_HAVE_AVX2 0
+#endif
+
+/*
+Aggregates - push-down kernels over stored columns, run directly on the mapped memory.
+Kernels take contiguous arrays: columns of ColumnarSequenceStorage, or spans of SequenceStorage<double>::query().
+double kernels use AVX2 when the cpu has it, other types are left to the compiler.
+Column aggregates collect one span per chunk and run the kernel on chunks in parallel.
+Vectorized sums add in a different order than a plain loop, results may differ in the last bits.
+*/
+
+namespace aggregate{
+
+enum class Cmp{
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual,
+    Equal,
+    NotEqual,
+};
+
+template<typename T>
+static inline bool compare(const T &a, Cmp cmp, const T &b){
+    switch(cmp){
+        case Cmp::Less:
+            return a < b;
+        case Cmp::LessEqual:
+            return a <= b;
+        case Cmp::Greater:
+            return a > b;
+        case Cmp::GreaterEqual:
+            return a >= b;
+        case Cmp::Equal:
+            return a == b;
+        default:
+            return a != b;
+    }
+}
+
+template<typename T>
+using accumulator_t = std::conditional_t<std::is_floating_point_v<T>, double,
+                      std::conditional_t<std::is_signed_v<T>, int64_t, uint64_t>>;
+
+template<typename T>
+static inline accumulator_t<T> sum_sw(std::span<const T> v){
+    accumulator_t<T> s{};
+    for(auto x: v){
+        s += x;
+    }
+    return s;
+}
+template<typename T>
+static inline T min_sw(std::span<const T> v){
+    T m = std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+    for(auto x: v){
+        m = std::min(m, x);
+    }
+    return m;
+}
+template<typename T>
+static inline T max_sw(std::span<const T> v){
+    T m = std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest();
+    for(auto x: v){
+        m = std::max(m, x);
+    }
+    return m;
+}
+template<typename T, typename U>
+static inline double dot_sw(std::span<const T> a, std::span<const U> b){
+    double s = 0;
+    for(size_t i = 0; i < a.size(); i++){
+        s += static_cast<double>(a[i]) * static_cast<double>(b[i]);
+    }
+    return s;
+}
+template<typename T>
+static inline size_t count_sw(std::span<const T> v, Cmp cmp, const T &value){
+    size_t n = 0;
+    for(auto x: v){
+        n += compare(x, cmp, value);
+    }
+    return n;
+}
+
+#if LIBSTORAGE_HAVE_AVX2
+//4 independent accumulators hide the add latency
+__attribute__((target("avx2")))
+static inline double sum_avx2(const double *p, size_t n){
+    __m256d s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16){
+        s0 = _mm256_add_pd(s0, _mm256_loadu_pd(p + i));
+        s1 = _mm256_add_pd(s1, _mm256_loadu_pd(p + i + 4));
+        s2 = _mm256_add_pd(s2, _mm256_loadu_pd(p + i + 8));
+        s3 = _mm256_add_pd(s3, _mm256_loadu_pd(p + i + 12));
+    }
+    for(; i + 4 <= n; i += 4){
+        s0 = _mm256_add_pd(s0, _mm256_loadu_pd(p + i));
+    }
+    alignas(32) double lanes[4];
+    _mm256_store_pd(lanes, _mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+    double s = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for(; i < n; i++){
+        s += p[i];
+    }
+    return s;
+}
+template<bool MIN>
+__attribute__((target("avx2")))
+static inline double minmax_avx2(const double *p, size_t n){
+    double init = MIN ? std::numeric_limits<double>::infinity() : -std::numeric_limits<double>::infinity();
+    __m256d m0 = _mm256_set1_pd(init), m1 = m0;
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        if constexpr (MIN){
+            m0 = _mm256_min_pd(m0, _mm256_loadu_pd(p + i));
+            m1 = _mm256_min_pd(m1, _mm256_loadu_pd(p + i + 4));
+        } else {
+            m0 = _mm256_max_pd(m0, _mm256_loadu_pd(p + i));
+            m1 = _mm256_max_pd(m1, _mm256_loadu_pd(p + i + 4));
+        }
+    }
+    alignas(32) double lanes[8];
+    _mm256_store_pd(lanes, m0);
+    _mm256_store_pd(lanes + 4, m1);
+    double m = init;
+    for(auto l: lanes){
+        m = MIN ? std::min(m, l) : std::max(m, l);
+    }
+    for(; i < n; i++){
+        m = MIN ? std::min(m, p[i]) : std::max(m, p[i]);
+    }
+    return m;
+}
+__attribute__((target("avx2")))
+static inline double dot_avx2(const double *a, const double *b, size_t n){
+    __m256d s0 = _mm256_setzero_pd(), s1 = s0;
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+    }
+    alignas(32) double lanes[4];
+    _mm256_store_pd(lanes, _mm256_add_pd(s0, s1));
+    double s = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for(; i < n; i++){
+        s += a[i] * b[i];
+    }
+    return s;
+}
+template<int PREDICATE>
+__attribute__((target("avx2")))
+static inline size_t count_avx2_impl(const double *p, size_t n, double value){
+    __m256d v = _mm256_set1_pd(value);
+    size_t count = 0;
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4){
+        count += __builtin_popcount(_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(p + i), v, PREDICATE)));
+    }
+    //ordered predicates are false for NaN, same as the scalar comparison; NEQ_UQ is true, same as !=
+    for(; i < n; i++){
+        switch(PREDICATE){
+            case _CMP_LT_OQ:
+                count += p[i] < value;
+                break;
+            case _CMP_LE_OQ:
+                count += p[i] <= value;
+                break;
+            case _CMP_GT_OQ:
+                count += p[i] > value;
+                break;
+            case _CMP_GE_OQ:
+                count += p[i] >= value;
+                break;
+            case _CMP_EQ_OQ:
+                count += p[i] == value;
+                break;
+            default:
+                count += p[i] != value;
+        }
+    }
+    return count;
+}
+static inline size_t count_avx2(const double *p, size_t n, Cmp cmp, double value){
+    switch(cmp){
+        case Cmp::Less:
+            return count_avx2_impl<_CMP_LT_OQ>(p, n, value);
+        case Cmp::LessEqual:
+            return count_avx2_impl<_CMP_LE_OQ>(p, n, value);
+        case Cmp::Greater:
+            return count_avx2_impl<_CMP_GT_OQ>(p, n, value);
+        case Cmp::GreaterEqual:
+            return count_avx2_impl<_CMP_GE_OQ>(p, n, value);
+        case Cmp::Equal:
+            return count_avx2_impl<_CMP_EQ_OQ>(p, n, value);
+        default:
+            return count_avx2_impl<_CMP_NEQ_UQ>(p, n, value);
+    }
+}
+
+static inline bool have_avx2(){
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+}
+#endif
+
+/* Kernels over one contiguous array */
+
+template<typename T>
+static inline accumulator_t<T> sum(std::span<const T> v){
+#if LIBSTORAGE_HAVE_AVX2
+    if constexpr (std::is_same_v<T, double>){
+        if(have_avx2()) [[likely]]{
+            return sum_avx2(v.data(), v.size());
+        }
+    }
+#endif
+    return sum_sw(v);
+}
+//+inf (or max) for an empty array
+template<typename T>
+static inline T min(std::span<const T> v){
+#if LIBSTORAGE_HAVE_AVX2
+    if constexpr (std::is_same_v<T, double>){
+        if(have_avx2()) [[likely]]{
+            return minmax_avx2<true>(v.data(), v.size());
+        }
+    }
+#endif
+    return min_sw(v);
+}
+//-inf (or lowest) for an empty array
+template<typename T>
+static inline T max(std::span<const T> v){
+#if LIBSTORAGE_HAVE_AVX2
+    if constexpr (std::is_same_v<T, double>){
+        if(have_avx2()) [[likely]]{
+            return minmax_avx2<false>(v.data(), v.size());
+        }
+    }
+#endif
+    return max_sw(v);
+}
+//sum of a[i] * b[i], arrays of the same size
+template<typename T, typename U>
+static inline double dot(std::span<const T> a, std::span<const U> b){
+#if LIBSTORAGE_HAVE_AVX2
+    if constexpr (std::is_same_v<T, double> && std::is_same_v<U, double>){
+        if(have_avx2()) [[likely]]{
+            return dot_avx2(a.data(), b.data(), a.size());
+        }
+    }
+#endif
+    return dot_sw(a, b);
+}
+//number of elements x with "x cmp value"
+template<typename T>
+static inline size_t count_where(std::span<const T> v, Cmp cmp, const T &value){
+#if LIBSTORAGE_HAVE_AVX2
+    if constexpr (std::is_same_v<T, double>){
+        if(have_avx2()) [[likely]]{
+            return count_avx2(v.data(), v.size(), cmp, value);
+        }
+    }
+#endif
+    return count_sw(v, cmp, value);
+}
+
+struct VWAP{
+    double notional{0}; //sum of price * volume
+    double volume{0};
+
+    VWAP &operator+=(const VWAP &other){
+        notional += other.notional;
+        volume += other.volume;
+        return *this;
+    }
+    double value() const{
+        return volume != 0 ? notional / volume : 0;
+    }
+};
+template<typename P, typename V>
+static inline VWAP vwap(std::span<const P> price, std::span<const V> volume){
+    return VWAP{dot(price, volume), static_cast<double>(sum(volume))};
+}
+
+struct OHLC{
+    uint64_t time; //bucket start
+    double open;
+    double high;
+    double low;
+    double close;
+    double volume;
+};
+//bar of the same bucket as out.back() is merged into it
+static inline void append_bar(std::vector<OHLC> &out, const OHLC &bar){
+    if(!out.empty() && out.back().time == bar.time){
+        auto &last = out.back();
+        last.high = std::max(last.high, bar.high);
+        last.low = std::min(last.low, bar.low);
+        last.close = bar.close;
+        last.volume += bar.volume;
+    } else {
+        out.push_back(bar);
+    }
+}
+//appends bars of interval to out for time-sorted records. The first bar is merged into out.back()
+//when it is the same bucket, so consecutive chunks can be fed one by one
+template<typename K, typename P, typename V>
+static inline void resample(std::span<const K> time, std::span<const P> price, std::span<const V> volume,
+                            uint64_t interval, std::vector<OHLC> &out){
+    ASSERT_ON(interval == 0);
+    for(size_t i = 0; i < time.size();){
+        uint64_t bucket = static_cast<uint64_t>(time[i]) / interval * interval;
+        size_t j = std::lower_bound(time.begin() + i, time.end(), static_cast<K>(bucket + interval)) - time.begin();
+        size_t n = j - i;
+        OHLC bar{bucket, static_cast<double>(price[i]), static_cast<double>(max(price.subspan(i, n))),
+                 static_cast<double>(min(price.subspan(i, n))), static_cast<double>(price[j - 1]),
+                 static_cast<double>(sum(volume.subspan(i, n)))};
+        append_bar(out, bar);
+        i = j;
+    }
+}
+
+/* Column aggregates over a ColumnarSequenceStorage */
+
+//calls f(i) for i in [0, n) on up to threads threads, 0 - one per cpu
+template<typename F>
+static inline void parallel_for(size_t n, F &&f, size_t threads = 0){
+    if(threads == 0){
+        threads = std::max(1U, std::thread::hardware_concurrency());
+    }
+    threads = std::min(threads, n);
+    if(threads <= 1){
+        for(size_t i = 0; i < n; i++){
+            f(i);
+        }
+        return;
+    }
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    auto run = [&f, n, threads](size_t t){
+        for(size_t i = t; i < n; i += threads){
+            f(i);
+        }
+    };
+    for(size_t t = 1; t < threads; t++){
+        workers.emplace_back(run, t);
+    }
+    run(0);
+    for(auto &w: workers){
+        w.join();
+    }
+}
+
+//spans of columns I... for records [start, end), one tuple per chunk. Storage is accessed only here,
+//so kernels can run on the spans from other threads
+template<size_t ...I, typename Seq>
+static inline auto column_spans(Seq &seq, size_t start, size_t end){
+    std::vector<std::tuple<std::span<const typename Seq::template Column<I>>...>> spans;
+    seq.template scan_columns<I...>(start, end, [&spans](size_t, auto... columns){
+        spans.emplace_back(columns...);
+    });
+    return spans;
+}
+
+template<size_t I, typename Seq>
+static inline auto column_sum(Seq &seq, size_t start, size_t end, size_t threads = 0){
+    auto spans = column_spans<I>(seq, start, end);
+    std::vector<accumulator_t<typename Seq::template Column<I>>> partial(spans.size());
+    parallel_for(spans.size(), [&](size_t c){ partial[c] = sum(std::get<0>(spans[c])); }, threads);
+    accumulator_t<typename Seq::template Column<I>> s{};
+    for(auto p: partial){
+        s += p;
+    }
+    return s;
+}
+template<size_t I, typename Seq>
+static inline auto column_min(Seq &seq, size_t start, size_t end, size_t threads = 0){
+    using T = typename Seq::template Column<I>;
+    auto spans = column_spans<I>(seq, start, end);
+    std::vector<T> partial(spans.size());
+    parallel_for(spans.size(), [&](size_t c){ partial[c] = min(std::get<0>(spans[c])); }, threads);
+    return min(std::span<const T>{partial});
+}
+template<size_t I, typename Seq>
+static inline auto column_max(Seq &seq, size_t start, size_t end, size_t threads = 0){
+    using T = typename Seq::template Column<I>;
+    auto spans = column_spans<I>(seq, start, end);
+    std::vector<T> partial(spans.size());
+    parallel_for(spans.size(), [&](size_t c){ partial[c] = max(std::get<0>(spans[c])); }, threads);
+    return max(std::span<const T>{partial});
+}
+template<size_t I, typename Seq>
+static inline size_t column_count_where(Seq &seq, size_t start, size_t end, Cmp cmp,
+                                        const typename Seq::template Column<I> &value, size_t threads = 0){
+    auto spans = column_spans<I>(seq, start, end);
+    std::vector<size_t> partial(spans.size());
+    parallel_for(spans.size(), [&](size_t c){ partial[c] = count_where(std::get<0>(spans[c]), cmp, value); }, threads);
+    size_t n = 0;
+    for(auto p: partial){
+        n += p;
+    }
+    return n;
+}
+//P - price column, V - volume column
+template<size_t P, size_t V, typename Seq>
+static inline VWAP column_vwap(Seq &seq, size_t start, size_t end, size_t threads = 0){
+    auto spans = column_spans<P, V>(seq, start, end);
+    std::vector<VWAP> partial(spans.size());
+    parallel_for(spans.size(), [&](size_t c){ partial[c] = vwap(std::get<0>(spans[c]), std::get<1>(spans[c])); }, threads);
+    VWAP r;
+    for(auto &p: partial){
+        r += p;
+    }
+    return r;
+}
+//K - time column, P - price column, V - volume column. Chunks are resampled in parallel, bars split
+//by a chunk boundary are merged
+template<size_t K, size_t P, size_t V, typename Seq>
+static inline std::vector<OHLC> column_resample(Seq &seq, size_t start, size_t end, uint64_t interval, size_t threads = 0){
+    ASSERT_ON(interval == 0);
+    auto spans = column_spans<K, P, V>(seq, start, end);
+    std::vector<std::vector<OHLC>> partial(spans.size());
+    parallel_for(spans.size(), [&](size_t c){
+        resample(std::get<0>(spans[c]), std::get<1>(spans[c]), std::get<2>(spans[c]), interval, partial[c]);
+    }, threads);
+    std::vector<OHLC> out;
+    for(auto &bars: partial){
+        for(auto &bar: bars){
+            append_bar(out, bar);
+        }
+    }
+    return out;
+}
+
+}
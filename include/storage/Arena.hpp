@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+/*
+Metadata arena - one memory resource for the whole metadata graph of a storage
+(address mapping, free lists, id tables). Nodes are carved out of large chunks and
+recycled by size class, the whole arena is released at once in destructor.
+
+Deserializers of allocator-aware(std::pmr) containers take their memory from
+deserialize_resource(), which is set for the current thread with DeserializeResourceScope.
+*/
+
+class MetadataArena{
+    static constexpr size_t INITIAL_SIZE = (1UL << 16);
+
+    std::pmr::monotonic_buffer_resource chunks;
+    std::pmr::unsynchronized_pool_resource pool;
+public:
+    MetadataArena(std::pmr::memory_resource *upstream = std::pmr::new_delete_resource()):
+        chunks(INITIAL_SIZE, upstream), pool(&chunks) {}
+    MetadataArena(const MetadataArena &) = delete;
+    MetadataArena &operator=(const MetadataArena &) = delete;
+
+    std::pmr::memory_resource *resource(){
+        return &pool;
+    }
+};
+
+static inline std::pmr::memory_resource *&current_deserialize_resource(){
+    static thread_local std::pmr::memory_resource *resource{nullptr};
+    return resource;
+}
+
+//resource for containers created by deserializers on this thread
+static inline std::pmr::memory_resource *deserialize_resource(){
+    auto resource = current_deserialize_resource();
+    return resource ? resource : std::pmr::get_default_resource();
+}
+
+class DeserializeResourceScope{
+    std::pmr::memory_resource *prev;
+public:
+    DeserializeResourceScope(std::pmr::memory_resource *resource): prev(current_deserialize_resource()) {
+        current_deserialize_resource() = resource;
+    }
+    DeserializeResourceScope(const DeserializeResourceScope &) = delete;
+    DeserializeResourceScope &operator=(const DeserializeResourceScope &) = delete;
+    ~DeserializeResourceScope(){
+        current_deserialize_resource() = prev;
+    }
+};
+
+template<typename T>
+concept CPmrAllocatorAware = std::uses_allocator_v<T, std::pmr::polymorphic_allocator<std::byte>>;
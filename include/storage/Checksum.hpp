@@ -0,0 +1,180 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define LIBSTORAGE_HAVE_SSE42_CRC 1
+#else
+#define LIBSTORAGE_HAVE_SSE42_CRC 0
+#endif
+
+enum class StorageChecksum{
+    None,
+    CRC32C, //per-extent, updated on commit, verified on first readb
+    Default = None,
+};
+
+namespace crc32c{
+
+static constexpr uint32_t POLY = 0x82F63B78; //Castagnoli, reflected
+
+constexpr std::array<uint32_t, 256> make_table(){
+    std::array<uint32_t, 256> table{};
+    for(uint32_t i = 0; i < 256; i++){
+        uint32_t crc = i;
+        for(int j = 0; j < 8; j++){
+            crc = (crc >> 1) ^ (POLY & (0U - (crc & 1)));
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+static constexpr std::array<uint32_t, 256> TABLE = make_table();
+
+static inline uint32_t extend_sw(uint32_t crc, const void *data, size_t size){
+    auto p = static_cast<const uint8_t *>(data);
+    crc = ~crc;
+    for(size_t i = 0; i < size; i++){
+        crc = TABLE[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+#if LIBSTORAGE_HAVE_SSE42_CRC
+//raw crc state update, no pre/post inversion
+__attribute__((target("sse4.2")))
+static inline uint64_t update_hw(uint64_t crc, const uint8_t *p, size_t size){
+    for(; size >= sizeof(uint64_t); size -= sizeof(uint64_t), p += sizeof(uint64_t)){
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        crc = _mm_crc32_u64(crc, v);
+    }
+    uint32_t crc32 = static_cast<uint32_t>(crc);
+    for(; size > 0; size--, p++){
+        crc32 = _mm_crc32_u8(crc32, *p);
+    }
+    return crc32;
+}
+
+//crc32 instruction has latency 3 and throughput 1, so we run 3 independent streams
+//over adjacent STREAM_SIZE blocks and combine them with "append STREAM_SIZE zeros" operator
+static constexpr size_t STREAM_SIZE = 512;
+
+struct ShiftTable{
+    uint32_t t[4][256];
+    uint32_t operator()(uint32_t crc) const{
+        return t[0][crc & 0xFF] ^ t[1][(crc >> 8) & 0xFF] ^ t[2][(crc >> 16) & 0xFF] ^ t[3][crc >> 24];
+    }
+};
+
+__attribute__((target("sse4.2")))
+static inline ShiftTable make_shift_table(){
+    static const uint8_t zeros[STREAM_SIZE] = {};
+    ShiftTable st;
+    uint32_t basis[32];
+    //shift operator is linear, compute it for every bit and combine
+    for(int bit = 0; bit < 32; bit++){
+        basis[bit] = update_hw(1U << bit, zeros, STREAM_SIZE);
+    }
+    for(int k = 0; k < 4; k++){
+        for(uint32_t byte = 0; byte < 256; byte++){
+            uint32_t v = 0;
+            for(int bit = 0; bit < 8; bit++){
+                if(byte & (1U << bit)){
+                    v ^= basis[k * 8 + bit];
+                }
+            }
+            st.t[k][byte] = v;
+        }
+    }
+    return st;
+}
+
+__attribute__((target("sse4.2")))
+static inline uint32_t extend_hw(uint32_t crc, const void *data, size_t size){
+    static const ShiftTable shift = make_shift_table();
+    auto p = static_cast<const uint8_t *>(data);
+    uint64_t crc0 = ~crc;
+    for(; size >= 3 * STREAM_SIZE; size -= 3 * STREAM_SIZE, p += 3 * STREAM_SIZE){
+        uint64_t crc1 = 0, crc2 = 0;
+        for(size_t i = 0; i < STREAM_SIZE; i += sizeof(uint64_t)){
+            uint64_t v0, v1, v2;
+            memcpy(&v0, p + i, sizeof(v0));
+            memcpy(&v1, p + STREAM_SIZE + i, sizeof(v1));
+            memcpy(&v2, p + 2 * STREAM_SIZE + i, sizeof(v2));
+            crc0 = _mm_crc32_u64(crc0, v0);
+            crc1 = _mm_crc32_u64(crc1, v1);
+            crc2 = _mm_crc32_u64(crc2, v2);
+        }
+        crc0 = shift(shift(static_cast<uint32_t>(crc0)) ^ static_cast<uint32_t>(crc1)) ^ static_cast<uint32_t>(crc2);
+    }
+    return ~static_cast<uint32_t>(update_hw(crc0, p, size));
+}
+
+static inline bool have_hw(){
+    static const bool has = __builtin_cpu_supports("sse4.2");
+    return has;
+}
+#endif
+
+//crc of data appended to previous crc, start with 0
+static inline uint32_t extend(uint32_t crc, const void *data, size_t size){
+#if LIBSTORAGE_HAVE_SSE42_CRC
+    if(have_hw()) [[likely]]{
+        return extend_hw(crc, data, size);
+    }
+#endif
+    return extend_sw(crc, data, size);
+}
+
+static inline uint32_t value(const void *data, size_t size){
+    return extend(0, data, size);
+}
+
+//a * b modulo POLY, both are bit-reflected polynomials, a != 0
+constexpr uint32_t multiply(uint32_t a, uint32_t b){
+    uint32_t m = 1U << 31, p = 0;
+    for(;;){
+        if(a & m){
+            p ^= b;
+            if((a & (m - 1)) == 0){
+                break;
+            }
+        }
+        m >>= 1;
+        b = (b >> 1) ^ (POLY & (0U - (b & 1)));
+    }
+    return p;
+}
+constexpr std::array<uint32_t, 32> make_power_table(){
+    //x^(2^k) modulo POLY, x^1 is 1 << 30 reflected
+    std::array<uint32_t, 32> table{};
+    table[0] = 1U << 30;
+    for(size_t k = 1; k < table.size(); k++){
+        table[k] = multiply(table[k - 1], table[k - 1]);
+    }
+    return table;
+}
+static constexpr std::array<uint32_t, 32> POWER_TABLE = make_power_table();
+
+//raw crc state after size zero bytes, O(log size). crc is linear, so crc(A) ^ crc(B) of equal
+//length messages is the raw crc of A ^ B, and a difference inside a message is shifted by the bytes after it
+constexpr uint32_t shift(uint32_t crc, size_t size){
+    uint32_t power = 1U << 31; //x^0
+    for(size_t k = 3; size != 0; size >>= 1, k++){
+        if(size & 1){
+            power = multiply(POWER_TABLE[k & 31], power);
+        }
+    }
+    return multiply(power, crc);
+}
+
+//crc of A followed by B from crc of A, crc of B and size of B
+constexpr uint32_t combine(uint32_t crc_a, uint32_t crc_b, size_t size_b){
+    return shift(crc_a, size_b) ^ crc_b;
+}
+
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <span>
+#include <array>
+#include <tuple>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+
+#include <storage/Utils.hpp>
+#include <storage/StorageUtils.hpp>
+#include <storage/DataStorage.hpp>
+#include <storage/SerializeImpl.hpp>
+#include <storage/Serialize.hpp>
+
+/*
+Columnar sequence storage - append-only sequence of aggregates, stored column by column.
+Chunk of CHUNK_RECORDS records: [field 0 x CHUNK_RECORDS][field 1 x CHUNK_RECORDS]...
+Every column starts at COLUMN_ALIGN, so a scan over one or two fields reads contiguous aligned arrays
+and leaves other columns untouched. Fields are found with aggregate_tie().
+*/
+
+template<typename T>
+concept CColumnarRecord = std::is_aggregate_v<T> && std::is_trivially_copyable_v<T>;
+
+//offset of every column inside a chunk, last entry is the chunk size
+template<typename Fields, size_t RECORDS, size_t ALIGN, size_t ...I>
+constexpr std::array<size_t, sizeof...(I) + 1> columnar_offsets(std::index_sequence<I...>){
+    std::array<size_t, sizeof...(I)> sizes{sizeof(std::tuple_element_t<I, Fields>)...};
+    std::array<size_t, sizeof...(I) + 1> offsets{};
+    for(size_t i = 0; i < sizes.size(); i++){
+        offsets[i + 1] = offsets[i] + (sizes[i] * RECORDS + ALIGN - 1) / ALIGN * ALIGN;
+    }
+    return offsets;
+}
+
+template<CColumnarRecord T, CStorage Storage, size_t CHUNK_RECORDS = (1UL << 14)>
+class ColumnarSequenceStorage{
+public:
+    using Fields = aggregate_fields_t<T>;
+    static constexpr size_t COLUMNS = std::tuple_size_v<Fields>;
+    template<size_t I>
+    using Column = std::tuple_element_t<I, Fields>;
+    static constexpr size_t COLUMN_ALIGN = 64;
+private:
+    static constexpr auto OFFSETS = columnar_offsets<Fields, CHUNK_RECORDS, COLUMN_ALIGN>(std::make_index_sequence<COLUMNS>{});
+public:
+    static constexpr size_t CHUNK_BYTES = OFFSETS[COLUMNS];
+
+    //full record view over the columns of a chunk, fields are read in place
+    class RowView{
+        const uint8_t *base;
+        size_t offset;
+    public:
+        RowView(const void *base, size_t offset): base(static_cast<const uint8_t *>(base)), offset(offset) {}
+
+        template<size_t I>
+        const Column<I> &get() const{
+            return reinterpret_cast<const Column<I> *>(base + OFFSETS[I])[offset];
+        }
+        T value() const{
+            return [this]<size_t ...I>(std::index_sequence<I...>){
+                return T{get<I>()...};
+            }(std::make_index_sequence<COLUMNS>{});
+        }
+        operator T() const{
+            return value();
+        }
+    };
+private:
+    Storage &storage;
+    std::vector<StorageAddress> chunks;
+    size_t count{0};
+
+    //writable tail chunk, committed on flush() or when the next chunk is started
+    StorageBuffer<> tail;
+    bool tail_dirty{false};
+
+    ColumnarSequenceStorage(Storage &storage, std::vector<StorageAddress> &&chunks, size_t count):
+        storage(storage), chunks(std::move(chunks)), count(count) {}
+
+    StorageAddress alloc_chunk(){
+        auto addr = storage.get_random_address(CHUNK_BYTES + COLUMN_ALIGN - 1);
+        //map the whole chunk at once, columns are filled in place
+        initialize_zero(storage, addr);
+        //memory is never moved, so the padding stays valid after reopen
+        auto ptr = reinterpret_cast<uintptr_t>(storage.readb(addr).get());
+        return addr.subrange((COLUMN_ALIGN - ptr % COLUMN_ALIGN) % COLUMN_ALIGN, CHUNK_BYTES);
+    }
+    StorageBuffer<> &tail_buffer(){
+        size_t c = count / CHUNK_RECORDS;
+        if(c == chunks.size()){
+            flush();
+            chunks.push_back(alloc_chunk());
+            tail = storage.writeb(chunks.back());
+        } else if(tail.get() == nullptr){
+            tail = storage.writeb(chunks[c]);
+        }
+        return tail;
+    }
+    static void write_record(const StorageBuffer<> &buf, size_t offset, const T &t){
+        auto fields = aggregate_tie(t);
+        [&]<size_t ...I>(std::index_sequence<I...>){
+            ((buf.template get<Column<I>>(OFFSETS[I])[offset] = std::get<I>(fields)), ...);
+        }(std::make_index_sequence<COLUMNS>{});
+    }
+    template<size_t I>
+    static void write_column(const StorageBuffer<> &buf, size_t offset, std::span<const T> ts){
+        auto *dst = buf.template get<Column<I>>(OFFSETS[I]) + offset;
+        for(size_t j = 0; j < ts.size(); j++){
+            dst[j] = std::get<I>(aggregate_tie(ts[j]));
+        }
+    }
+    //records of chunk c, tail chunk is committed first so checksummed storages verify it
+    StorageBufferRO<> chunk_buffer(size_t c){
+        if(tail_dirty && c == chunks.size() - 1){
+            flush();
+        }
+        return storage.readb(chunks[c]);
+    }
+public:
+    ColumnarSequenceStorage(Storage &storage, [[maybe_unused]] const StorageAddress &base): ColumnarSequenceStorage(storage) {}
+    ColumnarSequenceStorage(Storage &storage): storage(storage) {}
+    ColumnarSequenceStorage(const ColumnarSequenceStorage &) = delete;
+    ColumnarSequenceStorage(ColumnarSequenceStorage &&other):
+        storage(other.storage), chunks(std::move(other.chunks)), count(other.count),
+        tail(other.tail), tail_dirty(other.tail_dirty) {
+        other.tail_dirty = false;
+    }
+    ~ColumnarSequenceStorage(){
+        flush();
+    }
+
+    size_t size() const{
+        return count;
+    }
+
+    //returns index of the record
+    size_t append(const T &t){
+        auto &buf = tail_buffer();
+        write_record(buf, count % CHUNK_RECORDS, t);
+        tail_dirty = true;
+        return count++;
+    }
+    //returns index of the first record, records are transposed column by column
+    size_t append_range(std::span<const T> ts){
+        size_t first = count;
+        size_t i = 0;
+        while(i < ts.size()){
+            auto &buf = tail_buffer();
+            size_t offset = count % CHUNK_RECORDS;
+            size_t n = std::min(ts.size() - i, CHUNK_RECORDS - offset);
+            [&]<size_t ...I>(std::index_sequence<I...>){
+                (write_column<I>(buf, offset, ts.subspan(i, n)), ...);
+            }(std::make_index_sequence<COLUMNS>{});
+            count += n;
+            tail_dirty = true;
+            i += n;
+        }
+        return first;
+    }
+    //commit appended records
+    void flush(){
+        if(tail_dirty){
+            storage.commit(tail);
+            tail_dirty = false;
+            //next append takes the buffer again, so checksummed storages see the change
+            tail = StorageBuffer<>{};
+        }
+    }
+
+    T get(size_t index){
+        return row(index).value();
+    }
+    //view stays valid while the storage is open, chunks are never moved
+    RowView row(size_t index){
+        ASSERT_ON(index >= count);
+        auto buf = chunk_buffer(index / CHUNK_RECORDS);
+        return RowView{buf.get(), index % CHUNK_RECORDS};
+    }
+
+    //calls f(first index, std::span<const Column<I>>...) once per chunk for records [start, end).
+    //only the requested columns are read
+    template<size_t ...I, typename F>
+    void scan_columns(size_t start, size_t end, F &&f){
+        static_assert(sizeof...(I) > 0, "no columns to scan");
+        end = std::min(end, count);
+        for(size_t i = start; i < end;){
+            size_t c = i / CHUNK_RECORDS;
+            auto buf = chunk_buffer(c);
+            size_t offset = i % CHUNK_RECORDS;
+            size_t n = std::min(end, (c + 1) * CHUNK_RECORDS) - i;
+            f(i, std::span<const Column<I>>{buf.template get<Column<I>>(OFFSETS[I]) + offset, n}...);
+            storage.commit(buf);
+            i += n;
+        }
+    }
+    //calls f(index, const RowView &) for records [start, end)
+    template<typename F>
+    void scan(size_t start, size_t end, F &&f){
+        end = std::min(end, count);
+        for(size_t i = start; i < end;){
+            size_t c = i / CHUNK_RECORDS;
+            auto buf = chunk_buffer(c);
+            size_t chunk_end = std::min(end, (c + 1) * CHUNK_RECORDS);
+            for(; i < chunk_end; i++){
+                f(i, RowView{buf.get(), i % CHUNK_RECORDS});
+            }
+            storage.commit(buf);
+        }
+    }
+
+    /* Serialize */
+
+    Result serializeImpl(StorageBuffer<> &buffer) const {
+        //appended records must be committed, serialize is const
+        ASSERT_ON(tail_dirty);
+        size_t offset = 0;
+        return SerializeSequentially(buffer, offset, count, chunks);
+    }
+    static ColumnarSequenceStorage deserializeImpl(const StorageBufferRO<> &buffer, Storage &storage) {
+        size_t offset = 0;
+        auto buf = buffer;
+        auto [count, chunks] = DeserializeSequentially<size_t, std::vector<StorageAddress>>(buf, offset);
+        return ColumnarSequenceStorage{storage, std::move(chunks), count};
+    }
+    static ColumnarSequenceStorage deserializeImpl(const StorageBufferRO<> &) { throw std::bad_function_call(); };
+
+    size_t getSizeImpl() const {
+        return SizeAccumulate(count, chunks);
+    }
+};
@@ -0,0 +1,377 @@
+#pragma once
+
+#include <tuple>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include <storage/DataStorage.hpp>
+#include <storage/Serialize.hpp>
+#include <storage/Epoch.hpp>
+
+/*
+Concurrent multi-level key map - many reader threads resolve catalog keys while a writer adds entries.
+Entries live in a persistent B+ tree ordered by the full key: nodes are immutable once published,
+a writer copies the path from the root to the changed leaf and publishes the new root with one atomic store.
+Readers never lock or write shared memory, they pin an epoch (a store to their own slot), load the root
+and see a consistent snapshot. Replaced nodes are retired and freed by EpochManager once no reader can see them.
+Writers are serialized by a mutex, shared subtrees are not copied, so an update costs O(FANOUT * depth).
+Nodes are not merged on delete, empty ones are removed.
+*/
+template <CSerializable Value, CSerializable ...Keys>
+class ConcurrentMultiLevelKeyMap{
+public:
+    static constexpr size_t LEVELS = sizeof...(Keys);
+    static constexpr size_t FANOUT = 32;
+    using Key = std::tuple<Keys...>;
+private:
+    struct Node{
+        bool leaf;
+        std::vector<Key> keys;          //leaf: entry keys, inner: first key of children[1..]
+        std::vector<Value> values;      //leaf only
+        std::vector<const Node *> children; //inner only
+    };
+
+    std::unique_ptr<EpochManager> epochs{new EpochManager{}};
+    std::atomic<const Node *> root{nullptr};
+    std::atomic<size_t> count{0};
+    mutable std::mutex write_mutex;
+
+    //three-way compare of the first N levels
+    template <size_t N, size_t I = 0, typename A, typename B>
+    static int compare(const A &a, const B &b){
+        if constexpr(I == N){
+            return 0;
+        } else {
+            if(std::get<I>(a) < std::get<I>(b)) return -1;
+            if(std::get<I>(b) < std::get<I>(a)) return 1;
+            return compare<N, I + 1>(a, b);
+        }
+    }
+    //child which may hold the key
+    static size_t child_index(const Node *node, const Key &key){
+        return std::upper_bound(node->keys.begin(), node->keys.end(), key) - node->keys.begin();
+    }
+    static const Value *find(const Node *node, const Key &key){
+        if(!node){
+            return nullptr;
+        }
+        while(!node->leaf){
+            node = node->children[child_index(node, key)];
+        }
+        auto it = std::lower_bound(node->keys.begin(), node->keys.end(), key);
+        if(it == node->keys.end() || *it != key){
+            return nullptr;
+        }
+        return &node->values[it - node->keys.begin()];
+    }
+    //f(const Key &, const Value &) for entries starting with prefix in key order, false from f stops
+    template <size_t N, typename Prefix, typename F>
+    static bool scan(const Node *node, const Prefix &prefix, F &f){
+        if(node->leaf){
+            auto it = std::partition_point(node->keys.begin(), node->keys.end(),
+                                           [&](const Key &k){ return compare<N>(k, prefix) < 0; });
+            for(; it != node->keys.end(); ++it){
+                if(compare<N>(*it, prefix) != 0){
+                    return false;
+                }
+                if(!f(static_cast<const Key &>(*it), node->values[it - node->keys.begin()])){
+                    return false;
+                }
+            }
+            return true;
+        }
+        //children before the first separator not below the prefix hold only smaller keys
+        size_t i = std::partition_point(node->keys.begin(), node->keys.end(),
+                                        [&](const Key &k){ return compare<N>(k, prefix) < 0; }) - node->keys.begin();
+        for(; i < node->children.size(); i++){
+            if(i > 0 && compare<N>(node->keys[i - 1], prefix) > 0){
+                return false;
+            }
+            if(!scan<N>(node->children[i], prefix, f)){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //writer side, called under write_mutex
+
+    //copy of node with the entry inserted, right and separator are set when the copy was split
+    Node *insert(const Node *node, const Key &key, const Value &value, Node *&right, Key &separator){
+        auto *copy = new Node{*node};
+        if(copy->leaf){
+            size_t pos = std::lower_bound(copy->keys.begin(), copy->keys.end(), key) - copy->keys.begin();
+            copy->keys.insert(copy->keys.begin() + pos, key);
+            copy->values.insert(copy->values.begin() + pos, value);
+        } else {
+            size_t i = child_index(copy, key);
+            Node *child_right = nullptr;
+            Key child_separator;
+            copy->children[i] = insert(copy->children[i], key, value, child_right, child_separator);
+            if(child_right){
+                copy->keys.insert(copy->keys.begin() + i, std::move(child_separator));
+                copy->children.insert(copy->children.begin() + i + 1, child_right);
+            }
+        }
+        epochs->retire(node);
+
+        if(copy->leaf && copy->keys.size() > FANOUT){
+            size_t mid = copy->keys.size() / 2;
+            right = new Node{true, {copy->keys.begin() + mid, copy->keys.end()},
+                             {copy->values.begin() + mid, copy->values.end()}, {}};
+            copy->keys.resize(mid);
+            copy->values.resize(mid);
+            separator = right->keys.front();
+        } else if(!copy->leaf && copy->children.size() > FANOUT){
+            //middle separator moves up
+            size_t mid = copy->keys.size() / 2;
+            right = new Node{false, {copy->keys.begin() + mid + 1, copy->keys.end()}, {},
+                             {copy->children.begin() + mid + 1, copy->children.end()}};
+            separator = std::move(copy->keys[mid]);
+            copy->keys.resize(mid);
+            copy->children.resize(mid + 1);
+        }
+        return copy;
+    }
+    //copy of node without the entry, nullptr if it became empty
+    Node *erase(const Node *node, const Key &key){
+        auto *copy = new Node{*node};
+        epochs->retire(node);
+        if(copy->leaf){
+            size_t pos = std::lower_bound(copy->keys.begin(), copy->keys.end(), key) - copy->keys.begin();
+            copy->keys.erase(copy->keys.begin() + pos);
+            copy->values.erase(copy->values.begin() + pos);
+            if(copy->keys.empty()){
+                delete copy;
+                return nullptr;
+            }
+            return copy;
+        }
+        size_t i = child_index(copy, key);
+        Node *child = erase(copy->children[i], key);
+        if(child){
+            copy->children[i] = child;
+            return copy;
+        }
+        copy->children.erase(copy->children.begin() + i);
+        if(!copy->keys.empty()){
+            copy->keys.erase(copy->keys.begin() + (i > 0 ? i - 1 : 0));
+        }
+        if(copy->children.empty()){
+            delete copy;
+            return nullptr;
+        }
+        return copy;
+    }
+    void publish(const Node *new_root){
+        //seq_cst pairs with EpochManager::pin(), see there
+        root.store(new_root, std::memory_order_seq_cst);
+        epochs->reclaim();
+    }
+    static void destroy(const Node *node){
+        if(!node){
+            return;
+        }
+        for(auto *child: node->children){
+            destroy(child);
+        }
+        delete node;
+    }
+    //tree over entries sorted by key, leaves and inner nodes are filled to FANOUT
+    static const Node *build(std::vector<Key> &&keys, std::vector<Value> &&values){
+        if(keys.empty()){
+            return nullptr;
+        }
+        std::vector<const Node *> level;
+        std::vector<Key> firsts;
+        for(size_t i = 0; i < keys.size(); i += FANOUT){
+            size_t end = std::min(keys.size(), i + FANOUT);
+            firsts.push_back(keys[i]);
+            level.push_back(new Node{true, {std::make_move_iterator(keys.begin() + i), std::make_move_iterator(keys.begin() + end)},
+                                     {std::make_move_iterator(values.begin() + i), std::make_move_iterator(values.begin() + end)}, {}});
+        }
+        while(level.size() > 1){
+            std::vector<const Node *> parents;
+            std::vector<Key> parent_firsts;
+            for(size_t i = 0; i < level.size(); i += FANOUT){
+                size_t end = std::min(level.size(), i + FANOUT);
+                parent_firsts.push_back(firsts[i]);
+                parents.push_back(new Node{false, {firsts.begin() + i + 1, firsts.begin() + end}, {},
+                                           {level.begin() + i, level.begin() + end}});
+            }
+            level = std::move(parents);
+            firsts = std::move(parent_firsts);
+        }
+        return level.front();
+    }
+public:
+    /*
+    Reader handle, one per thread. Takes an epoch slot for its lifetime, every call reads a consistent snapshot.
+    Pointers and references passed to scan() callbacks are valid during the callback only.
+    */
+    class Reader{
+        const ConcurrentMultiLevelKeyMap *map;
+        size_t slot;
+    public:
+        Reader(const ConcurrentMultiLevelKeyMap &map): map(&map), slot(map.epochs->acquire_slot()) {}
+        Reader(const Reader &) = delete;
+        ~Reader(){
+            map->epochs->release_slot(slot);
+        }
+
+        bool has(const Keys&... keys) const{
+            auto guard = map->epochs->pin(slot);
+            return find(map->root.load(std::memory_order_seq_cst), Key{keys...}) != nullptr;
+        }
+        std::pair<bool, Value> get(const Keys&... keys) const{
+            auto guard = map->epochs->pin(slot);
+            auto *value = find(map->root.load(std::memory_order_seq_cst), Key{keys...});
+            if(!value){
+                return {false, Value{}};
+            }
+            return {true, *value};
+        }
+        //f(const Key &, const Value &) for entries starting with prefix, in key order
+        template <typename F, typename ...Prefix>
+        void scan(F &&f, const Prefix&... prefix) const{
+            auto guard = map->epochs->pin(slot);
+            auto *node = map->root.load(std::memory_order_seq_cst);
+            if(!node){
+                return;
+            }
+            auto stop = [&](const Key &key, const Value &value){
+                f(key, value);
+                return true;
+            };
+            ConcurrentMultiLevelKeyMap::scan<sizeof...(Prefix)>(node, std::forward_as_tuple(prefix...), stop);
+        }
+        //distinct keys of the level after the prefix, in order
+        template <typename ...Prefix>
+        auto list(const Prefix&... prefix) const{
+            constexpr size_t N = sizeof...(Prefix);
+            static_assert(N < LEVELS);
+            std::vector<std::tuple_element_t<N, Key>> keys;
+            scan([&](const Key &key, const Value &){
+                if(keys.empty() || keys.back() != std::get<N>(key)){
+                    keys.push_back(std::get<N>(key));
+                }
+            }, prefix...);
+            return keys;
+        }
+    };
+
+    ConcurrentMultiLevelKeyMap() {}
+    ConcurrentMultiLevelKeyMap(const ConcurrentMultiLevelKeyMap &) = delete;
+    //only while no readers or writers use other
+    ConcurrentMultiLevelKeyMap(ConcurrentMultiLevelKeyMap &&other):
+        epochs(std::move(other.epochs)), root(other.root.exchange(nullptr)), count(other.count.exchange(0)) {
+        other.epochs.reset(new EpochManager{});
+    }
+    ~ConcurrentMultiLevelKeyMap(){
+        destroy(root.load());
+    }
+
+    Reader reader() const{
+        return Reader{*this};
+    }
+    size_t size() const{
+        return count.load(std::memory_order_relaxed);
+    }
+
+    //existing entry is kept
+    Result add(const Keys&... keys, const Value &value){
+        Key key{keys...};
+        std::lock_guard lock{write_mutex};
+        auto *old_root = root.load(std::memory_order_relaxed);
+        if(!old_root){
+            publish(new Node{true, {key}, {value}, {}});
+            count.fetch_add(1, std::memory_order_relaxed);
+            return Result::Success;
+        }
+        if(find(old_root, key)){
+            return Result::Success;
+        }
+        Node *right = nullptr;
+        Key separator;
+        Node *new_root = insert(old_root, key, value, right, separator);
+        if(right){
+            new_root = new Node{false, {std::move(separator)}, {}, {new_root, right}};
+        }
+        count.fetch_add(1, std::memory_order_relaxed);
+        publish(new_root);
+        return Result::Success;
+    }
+    Result del(const Keys&... keys){
+        Key key{keys...};
+        std::lock_guard lock{write_mutex};
+        auto *old_root = root.load(std::memory_order_relaxed);
+        if(!find(old_root, key)){
+            return Result::Failure;
+        }
+        Node *new_root = erase(old_root, key);
+        //fresh root with a single child is dropped, nodes below may be shared with readers
+        if(new_root && !new_root->leaf && new_root->children.size() == 1){
+            auto *child = new_root->children.front();
+            delete new_root;
+            new_root = const_cast<Node *>(child);
+        }
+        count.fetch_sub(1, std::memory_order_relaxed);
+        publish(new_root);
+        return Result::Success;
+    }
+    //retired nodes not freed yet, because readers may still see them
+    size_t pending_reclaim() const{
+        std::lock_guard lock{write_mutex};
+        return epochs->pending();
+    }
+
+    //entries in key order, written under the writer lock so no node is freed meanwhile
+    Result serializeImpl(StorageBuffer<> &buffer) const {
+        std::lock_guard lock{write_mutex};
+        size_t offset = 0;
+        SerializeSequentially(buffer, offset, count.load());
+        if(auto *node = root.load()){
+            auto f = [&](const Key &key, const Value &value){
+                SerializeSequentially(buffer, offset, std::make_pair(key, value));
+                return true;
+            };
+            scan<0>(node, std::tuple<>{}, f);
+        }
+        return Result::Success;
+    }
+    static ConcurrentMultiLevelKeyMap<Value, Keys...>
+    deserializeImpl(const StorageBufferRO<> &buffer) {
+        ConcurrentMultiLevelKeyMap<Value, Keys...> map;
+        size_t offset = 0;
+        auto buf = buffer;
+
+        auto [num] = DeserializeSequentially<size_t>(buf, offset);
+        std::vector<Key> keys;
+        std::vector<Value> values;
+        keys.reserve(num);
+        values.reserve(num);
+        for(size_t i = 0; i < num; i++){
+            auto [val] = DeserializeSequentially<std::pair<Key, Value>>(buf, offset);
+            keys.push_back(std::move(val.first));
+            values.push_back(std::move(val.second));
+        }
+        map.root.store(build(std::move(keys), std::move(values)));
+        map.count.store(num);
+        return map;
+    }
+    size_t getSizeImpl() const {
+        std::lock_guard lock{write_mutex};
+        size_t sum = szeimpl::size(count.load());
+        if(auto *node = root.load()){
+            auto f = [&](const Key &key, const Value &value){
+                sum += szeimpl::size(std::make_pair(key, value));
+                return true;
+            };
+            scan<0>(node, std::tuple<>{}, f);
+        }
+        return sum;
+    }
+};
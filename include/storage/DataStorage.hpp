@@ -3,6 +3,10 @@
 #include <type_traits>
 #include <functional>
 #include <memory>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <optional>
 
 #include <storage/Utils.hpp>
 #include <storage/StorageUtils.hpp>
@@ -105,54 +109,6 @@ static inline Result initialize_zero(Storage &storage, const StorageAddress &add
     return storage.commit(buf);
 }
 
-#if 0
-template <std::size_t...Idxs>
-constexpr auto substring_as_array(std::string_view str, std::index_sequence<Idxs...>)
-{
-  return std::array{str[Idxs]..., '\n'};
-}
-
-template <typename T>
-constexpr auto type_name_array()
-{
-#if defined(__clang__)
-  constexpr auto prefix   = std::string_view{"[T = "};
-  constexpr auto suffix   = std::string_view{"]"};
-  constexpr auto function = std::string_view{std::source_location{}.function_name()};
-#elif defined(__GNUC__)
-  constexpr auto prefix   = std::string_view{"with T = "};
-  constexpr auto suffix   = std::string_view{"]"};
-  constexpr auto function = std::string_view{std::source_location{}.function_name()};
-#elif defined(_MSC_VER)
-  constexpr auto prefix   = std::string_view{"type_name_array<"};
-  constexpr auto suffix   = std::string_view{">(void)"};
-  constexpr auto function = std::string_view{std::source_location{}.function_name()};
-#else
-# error Unsupported compiler
-#endif
-
-  constexpr auto start = function.find(prefix) + prefix.size();
-  constexpr auto end = function.rfind(suffix);
-
-  static_assert(start < end);
-
-  constexpr auto name = function.substr(start, (end - start));
-  return substring_as_array(name, std::make_index_sequence<name.size()>{});
-}
-
-template <typename T>
-struct type_name_holder {
-  static inline constexpr auto value = type_name_array<T>();
-};
-
-template <typename T>
-constexpr auto type_name() -> std::string_view
-{
-  constexpr auto& value = type_name_holder<T>::value;
-  return std::string_view{value.data(), value.size()};
-}
-#endif
-
 //template<typename T = void>
 struct StaticHeader{
     uint64_t magic;
@@ -161,22 +117,27 @@ struct StaticHeader{
 };
 
 template<typename T>
-constexpr uint32_t make_magic(){
-    //TODO use typename and constexpr hash function. problem is to make it consistent
-    return 0xDEEFAB;
+constexpr uint64_t make_magic(){
+    return stable_type_fingerprint<T>();
 }
 
-template<typename T, uint32_t STORAGE_MAGIC = make_magic<T>()>
+/*
+Object in a versioned schema block: fingerprint of T::TYPE_NAME, T::SCHEMA_VERSION, the object.
+Neither changes with the compiler or the layout of T, so T stays readable as long as its name does.
+Blocks of other types are rejected, whole blocks can be skipped by SkipSchema() without reading T.
+*/
+template<typename T>
 class TypedObject{
     T object;
 public:
+    static constexpr uint64_t STORAGE_MAGIC = make_magic<T>();
     //we assume address already contains the object
 
-    TypedObject(T &&t, uint32_t magic = STORAGE_MAGIC):
+    TypedObject(T &&t, uint64_t magic = STORAGE_MAGIC):
             object(std::forward<T>(t)) {
-        if (verify(magic)){
+        if (!verify(magic)){
             throw std::invalid_argument("Incorrect magic " + std::to_string(magic) + " != " +
-                                        std::to_string(STORAGE_MAGIC) + " for expected type " + typeid(T).name());
+                                        std::to_string(STORAGE_MAGIC) + " for expected type " + std::string{type_name<T>()});
         }
     }
 
@@ -187,48 +148,110 @@ public:
     T &get(){ return object; }
     const T &get() const { return object; }
 
-    static constexpr bool verify(uint32_t magic) {
+    static constexpr bool verify(uint64_t magic) {
         return STORAGE_MAGIC == magic;
     }
 
     Result serializeImpl(StorageBuffer<> &buffer) const {
-        Result res = Result::Success;
         size_t offset = 0;
-        return SerializeSequentially(buffer, offset, STORAGE_MAGIC, object);
+        return SerializeSchema<T>(buffer, offset, schema_version<T>(), object);
     }
-    template<typename ...Args, typename ...Args2>
-    static TypedObject deserializeImpl(const StorageBufferRO<> &buffer, Args2& ...args2, Args& ...args) {
+    //stored object of another type is an error, it must not be replaced with an empty one
+    template<typename ...Args>
+    static TypedObject deserializeImpl(const StorageBufferRO<> &buffer, Args& ...args) {
         size_t offset = 0;
         auto buf = buffer;
 
-        auto [magic] = DeserializeSequentially<uint32_t>(buf, offset);
-        if(!verify(magic)){
-            return TypedObject{std::forward<Args2 &>(args2)...};
-        }
-
-        auto [object] = DeserializeSequentially<T>(buf, offset, std::forward<Args &>(args)...);
+        auto [header, object] = DeserializeSchema<T, T>(buf, offset, args...);
 
-        return TypedObject{object};
+        return TypedObject{std::move(object)};
     }
-    static TypedObject deserializeImpl(const StorageBufferRO<> &) { throw std::bad_function_call(); };
 
-    constexpr size_t getSizeImpl() const {
-        return szeimpl::size(uint32_t{}) + szeimpl::size(object);
+    size_t getSizeImpl() const {
+        return SchemaSize<T>(object);
     }
 };
 
+//byte ranges of the serialized object, offset and size
+using DirtyRanges = std::vector<std::pair<size_t, size_t>>;
+
+/*
+Opt-in dirty tracking for StoredObject. dirty_ranges() returns ranges of the serialized form changed
+since clear_dirty(), or nullopt if the layout changed and the whole object has to be written.
+serializeRangeImpl() writes serialized bytes [offset, offset + buffer.size()) of the object.
+*/
+template<typename T>
+concept CDirtyTracked = requires(const T &t, T &mut, StorageBuffer<> &buffer, size_t offset){
+    { t.dirty_ranges() } -> std::same_as<std::optional<DirtyRanges>>;
+    { t.serializeRangeImpl(buffer, offset) } -> std::same_as<Result>;
+    { mut.clear_dirty() };
+};
+
+/*
+Object stored at its own address. sync() writes it back if get() was called.
+Types implementing CDirtyTracked write only the ranges they report, without serializing the rest.
+Other objects of at least IMAGE_MIN_SIZE bytes are serialized and compared with the bytes written
+last, only blocks which differ are committed, so changing one field or a few elements of a large
+object writes only them. The last written bytes are captured on first get(), objects only read do
+not keep them. This saves bytes written, not CPU: the whole object is still serialized and compared,
+and a modified object keeps a second copy of its serialized bytes until it is destroyed.
+Smaller objects are rewritten whole, a copy would cost more than it saves.
+Object outgrowing its address grows it with expand_address, the address stays the same.
+*/
 template<CSerializable T, size_t DEFAULT_ALLOC_SIZE = (1UL << 20)>
 class StoredObject{
 protected:
+    static constexpr size_t DIRTY_BLOCK = 64;
+    static constexpr size_t IMAGE_MIN_SIZE = 4 * DIRTY_BLOCK;
+
     StorageAddress address;
     bool modified;
+    //address contains the object as of the last sync
+    bool stored;
     T object;
+    //bytes as last written, empty if not captured
+    std::vector<std::byte> image;
+
+    static std::vector<std::byte> serialize_image(const T &t){
+        std::vector<std::byte> bytes(szeimpl::size(t));
+        StorageBuffer<> buffer{bytes.data(), bytes.size(), bytes.size()};
+        szeimpl::s(t, buffer);
+        return bytes;
+    }
+    template<CStorage Storage>
+    size_t write(Storage &storage, const StorageAddress &addr, const std::byte *data, size_t size){
+        auto buffer = storage.writeb(addr);
+        memcpy(buffer.get(), data, size);
+        storage.commit(buffer);
+        return size;
+    }
+    //blocks of bytes which differ from image, returns bytes written
+    template<CStorage Storage>
+    size_t write_changes(Storage &storage, const std::vector<std::byte> &bytes){
+        size_t written = 0;
+        size_t start = bytes.size();
+        for(size_t offset = 0; offset < bytes.size(); offset += DIRTY_BLOCK){
+            size_t size = std::min(DIRTY_BLOCK, bytes.size() - offset);
+            bool dirty = offset + size > image.size() || memcmp(bytes.data() + offset, image.data() + offset, size) != 0;
+            if(dirty && start == bytes.size()){
+                start = offset;
+            } else if(!dirty && start != bytes.size()){
+                written += write(storage, address.subrange(start, offset - start), bytes.data() + start, offset - start);
+                start = bytes.size();
+            }
+        }
+        if(start != bytes.size()){
+            written += write(storage, address.subrange(start, bytes.size() - start), bytes.data() + start, bytes.size() - start);
+        }
+        return written;
+    }
 public:
     //assuming address already contains an object
     template<CStorage Storage, typename ...Args>
     StoredObject(const StorageAddress &address, Storage &storage, Args... args):
         address(address),
         modified{false},
+        stored{true},
         object(deserialize<T>(storage, address, std::forward<Args>(args)...)) {}
 
     //newly created object
@@ -236,6 +259,7 @@ public:
     StoredObject(T &&t, Storage &storage):
         address(storage.template get_random_address(DEFAULT_ALLOC_SIZE)),
         modified{true},
+        stored{false},
         object(std::forward<T>(t)) {}
 
     //newly created object in-place
@@ -243,17 +267,67 @@ public:
     StoredObject(Storage &storage, Args& ...args):
         address(storage.template get_random_address(DEFAULT_ALLOC_SIZE)),
         modified{true},
+        stored{false},
         object(std::forward<Args &>(args)...) {}
 
-    T &get(){ modified = true; return object; }
+    T &get(){
+        if constexpr (!CDirtyTracked<T>){
+            if(!modified && stored && image.empty() && szeimpl::size(object) >= IMAGE_MIN_SIZE){
+                //as stored, before it is changed
+                image = serialize_image(object);
+            }
+        }
+        modified = true;
+        return object;
+    }
     const T &get() const { return object; }
+    const StorageAddress &getAddress() const { return address; }
 
+    //writes changes since last sync, returns bytes written
     template<CStorage Storage>
-    void sync(Storage &storage){
-        if(modified){
-            modified = false;
-            serialize(storage, object, address);
+    size_t sync(Storage &storage){
+        if(!modified){
+            return 0;
+        }
+        modified = false;
+        if constexpr (CDirtyTracked<T>){
+            if(stored){
+                if(auto ranges = object.dirty_ranges()){
+                    size_t written = 0;
+                    for(auto [offset, size]: *ranges){
+                        auto buffer = storage.writeb(address.subrange(offset, size));
+                        object.serializeRangeImpl(buffer, offset);
+                        storage.commit(buffer);
+                        written += size;
+                    }
+                    object.clear_dirty();
+                    return written;
+                }
+            }
+        }
+        auto bytes = serialize_image(object);
+        if(bytes.size() > address.size){
+            //at least doubles, so growing objects are not expanded on every sync
+            size_t grow = std::max(bytes.size() - address.size, address.size);
+            storage.expand_address(address, grow);
+            address.size += grow;
+        }
+        size_t written;
+        if(image.empty()){
+            //first write maps the whole address as one extent
+            written = write(storage, address, bytes.data(), bytes.size());
+        } else {
+            written = write_changes(storage, bytes);
+        }
+        stored = true;
+        if constexpr (CDirtyTracked<T>){
+            object.clear_dirty();
+        } else if(bytes.size() >= IMAGE_MIN_SIZE){
+            image = std::move(bytes);
+        } else {
+            image.clear();
         }
+        return written;
     }
     //TODO add copy, move, compare, hash
 
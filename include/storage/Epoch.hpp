@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include <storage/Utils.hpp>
+
+/*
+Epoch based reclamation - readers pin the global epoch while they hold pointers into a shared
+structure, writer retires objects it unlinked together with the current epoch and advances it.
+Object is freed once every pinned reader has a later epoch, so no reader can still reach it.
+Readers take one of MAX_READERS slots for their lifetime, pin()/unpin is a store to own slot.
+retire() and reclaim() are called by one writer at a time.
+*/
+class EpochManager{
+public:
+    static constexpr size_t MAX_READERS = 128;
+private:
+    static constexpr uint64_t IDLE = std::numeric_limits<uint64_t>::max();
+    //own cache line, so readers don't share lines
+    struct alignas(64) Slot{
+        std::atomic<uint64_t> epoch{IDLE};
+        std::atomic<bool> used{false};
+    };
+    struct Retired{
+        uint64_t epoch;
+        void *ptr;
+        void (*free)(void *);
+    };
+    std::atomic<uint64_t> global{0};
+    std::unique_ptr<Slot[]> slots{new Slot[MAX_READERS]};
+    std::vector<Retired> retired;
+public:
+    //reader is in the critical section while Guard lives
+    class Guard{
+        Slot *slot;
+    public:
+        Guard(Slot *slot): slot(slot) {}
+        Guard(const Guard &) = delete;
+        ~Guard(){
+            slot->epoch.store(IDLE, std::memory_order_release);
+        }
+    };
+
+    EpochManager() {}
+    EpochManager(const EpochManager &) = delete;
+    ~EpochManager(){
+        for(auto &r: retired){
+            r.free(r.ptr);
+        }
+    }
+
+    size_t acquire_slot(){
+        for(size_t i = 0; i < MAX_READERS; i++){
+            bool expected = false;
+            if(!slots[i].used.load(std::memory_order_relaxed) &&
+                slots[i].used.compare_exchange_strong(expected, true, std::memory_order_acquire)){
+                return i;
+            }
+        }
+        ASSERT_ON_MSG(true, "no free reader slots");
+        return MAX_READERS;
+    }
+    void release_slot(size_t slot){
+        slots[slot].used.store(false, std::memory_order_release);
+    }
+    //shared pointers loaded after pin() stay valid until the guard is destroyed
+    Guard pin(size_t slot){
+        //seq_cst: either the writer sees this epoch or the reader sees the newly published pointers
+        slots[slot].epoch.store(global.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+        return Guard{&slots[slot]};
+    }
+
+    //t is no longer reachable from the shared structure
+    template<typename T>
+    void retire(const T *t){
+        retired.push_back(Retired{global.load(std::memory_order_relaxed), const_cast<T *>(t),
+                                  [](void *p){ delete static_cast<T *>(p); }});
+    }
+    //advances the epoch and frees what no pinned reader can see, returns number of freed objects
+    size_t reclaim(){
+        global.fetch_add(1, std::memory_order_seq_cst);
+        uint64_t min_epoch = IDLE;
+        for(size_t i = 0; i < MAX_READERS; i++){
+            min_epoch = std::min(min_epoch, slots[i].epoch.load(std::memory_order_seq_cst));
+        }
+        auto it = std::partition(retired.begin(), retired.end(), [&](const Retired &r){ return r.epoch >= min_epoch; });
+        size_t freed = retired.end() - it;
+        for(auto r = it; r != retired.end(); ++r){
+            r->free(r->ptr);
+        }
+        retired.erase(it, retired.end());
+        return freed;
+    }
+    size_t pending() const{
+        return retired.size();
+    }
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include <storage/Utils.hpp>
+#include <storage/Checksum.hpp>
+#include <storage/StorageUtils.hpp>
+
+/*
+Sorted extent array - persisted form of an interval map, queried in place.
+[Extent 0][Extent 1]...[Extent N-1], sorted by start, non-overlapping.
+[crc 0]...[crc C-1] - crc32c of every CHUNK extents, verified on first access to the chunk.
+
+Chunk c owns key range [extents[c * CHUNK].start, extents[(c + 1) * CHUNK].start),
+first chunk owns everything below, last chunk everything above.
+*/
+
+struct Extent{
+    uint64_t start;
+    uint64_t end; //inclusive
+    size_t offset;
+};
+
+class ExtentArrayView{
+    StorageBufferRO<> extents{nullptr, 0};
+    StorageBufferRO<> crcs{nullptr, 0};
+    size_t count{0};
+public:
+    static constexpr size_t CHUNK = 256;
+    static constexpr size_t NO_CHUNK = static_cast<size_t>(-1);
+
+    ExtentArrayView() {}
+    ExtentArrayView(const StorageBufferRO<> &extents, const StorageBufferRO<> &crcs, size_t count):
+        extents(extents), crcs(crcs), count(count) {
+        ASSERT_ON(extents.size() < count * sizeof(Extent));
+        ASSERT_ON(crcs.size() < chunks_for(count) * sizeof(uint32_t));
+    }
+
+    static constexpr size_t chunks_for(size_t count){
+        return (count + CHUNK - 1) / CHUNK;
+    }
+    static constexpr size_t bytes_for(size_t count){
+        return count * sizeof(Extent) + chunks_for(count) * sizeof(uint32_t);
+    }
+
+    size_t size() const{
+        return count;
+    }
+    size_t chunks() const{
+        return chunks_for(count);
+    }
+    //may be unaligned inside the file
+    Extent at(size_t i) const{
+        ASSERT_ON(i >= count);
+        Extent e;
+        memcpy(&e, extents.get(i * sizeof(Extent)), sizeof(e));
+        return e;
+    }
+    uint64_t first_key(size_t c) const{
+        return at(c * CHUNK).start;
+    }
+    //[begin, end) extent indexes of chunk c
+    std::pair<size_t, size_t> chunk_range(size_t c) const{
+        return {c * CHUNK, std::min((c + 1) * CHUNK, count)};
+    }
+    size_t chunk_of(uint64_t key) const{
+        if(count == 0){
+            return NO_CHUNK;
+        }
+        //last chunk with first_key <= key
+        size_t lo = 0, hi = chunks();
+        while(hi - lo > 1){
+            size_t mid = lo + (hi - lo) / 2;
+            if(first_key(mid) <= key){
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+    //extent of chunk c containing key
+    bool find(size_t c, uint64_t key, Extent &e) const{
+        auto [lo, hi] = chunk_range(c);
+        if(key < at(lo).start){
+            return false;
+        }
+        //last extent with start <= key
+        while(hi - lo > 1){
+            size_t mid = lo + (hi - lo) / 2;
+            if(at(mid).start <= key){
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        e = at(lo);
+        return key <= e.end;
+    }
+    bool verify(size_t c) const{
+        auto [lo, hi] = chunk_range(c);
+        uint32_t crc;
+        memcpy(&crc, crcs.get(c * sizeof(uint32_t)), sizeof(crc));
+        return crc32c::value(extents.get(lo * sizeof(Extent)), (hi - lo) * sizeof(Extent)) == crc;
+    }
+
+    //writes count extents produced by next() in the layout above
+    template<typename F>
+    static Result write(StorageBuffer<> &buffer, size_t &offset, size_t count, F &&next){
+        ASSERT_ON(offset + bytes_for(count) > buffer.allocated());
+        size_t crc_offset = offset + count * sizeof(Extent);
+        uint32_t crc = 0;
+        for(size_t i = 0; i < count; i++){
+            Extent e = next();
+            memcpy(buffer.get(offset), &e, sizeof(e));
+            crc = crc32c::extend(crc, &e, sizeof(e));
+            offset += sizeof(e);
+            if((i + 1) % CHUNK == 0 || i + 1 == count){
+                memcpy(buffer.get(crc_offset), &crc, sizeof(crc));
+                crc_offset += sizeof(crc);
+                crc = 0;
+            }
+        }
+        offset = crc_offset;
+        return Result::Success;
+    }
+};
@@ -1,70 +1,133 @@
 #pragma once
 
 #include <concepts>
+#include <vector>
+#include <unordered_map>
 
 #include <storage/Utils.hpp>
 #include <storage/StorageUtils.hpp>
-#include <storage/ObjectInstanceStorage.hpp>
+#include <storage/SerializeImpl.hpp>
+#include <storage/DataStorage.hpp>
+#include <storage/Serialize.hpp>
+#include <storage/ObjectStorage.hpp>
+
+template<typename T>
+concept CFixedSizeObject = std::is_trivially_copyable_v<T> || CSerializableFixedSize<T>;
+
+template<CFixedSizeObject T>
+constexpr size_t fixed_object_size(){
+    if constexpr (CSerializableFixedSize<T>){
+        return T{}.getSizeImpl();
+    } else {
+        return sizeof(T);
+    }
+}
 
 //where to store all objects, without moving existing objects(which will invalidate runtime)
-template<size_t TSize, CStorage Storage, AllocationPattern A, size_t MAX_OBJS>
+//bucket b keeps FIRST_ENTRIES << b objects, so index -> (bucket, offset) is one clz
+//buckets start at TAlign aligned memory
+template<size_t TSize, size_t TAlign, CStorage Storage, size_t MAX_OBJS>
 class ObjectAddressStorage{
     Storage &storage;
 
     std::vector<StorageAddress> buckets;
-    static constexpr size_t DEFAULT_ENTRIES = (1 << 4); //16
-public:
-    ObjectAddressStorage(Storage &storage): storage(storage) {
-        //get(DEFAULT_ENTRIES - 1);
+    static constexpr size_t FIRST_BITS = 4;
+    static constexpr size_t FIRST_ENTRIES = (1 << FIRST_BITS); //16
+
+    static std::pair<size_t, size_t> locate(size_t index){
+        //e.g. index 20 -> 36 = 0b100100 -> bucket 1, offset 4
+        size_t shifted = index + FIRST_ENTRIES;
+        size_t bucket = MostSignificantBitSet(shifted) - FIRST_BITS;
+        return {bucket, shifted - (FIRST_ENTRIES << bucket)};
+    }
+    void alloc_buckets(size_t bucket){
+        for(size_t i = buckets.size(); i <= bucket; i++){
+            size_t size = (FIRST_ENTRIES << i) * TSize;
+            auto addr = storage.get_random_address(size + TAlign - 1);
+            //map the whole bucket at once, so objects can be written in any order
+            initialize_zero(storage, addr);
+            //memory is never moved, so the padding stays valid after reopen
+            auto ptr = reinterpret_cast<uintptr_t>(storage.readb(addr).get());
+            buckets.push_back(addr.subrange((TAlign - ptr % TAlign) % TAlign, size));
+        }
     }
+public:
+    ObjectAddressStorage(Storage &storage): storage(storage) {}
+    ObjectAddressStorage(Storage &storage, std::vector<StorageAddress> &&buckets):
+        storage(storage), buckets(std::move(buckets)) {}
 
     //get address from existing base, or allocate new
     StorageAddress get(size_t index) {
         ASSERT_ON(index >= MAX_OBJS);
-        //get most significant bit. e.g. 3 -> 0b11 -> 0b10 -> index 1 -> bucket 1
-        auto bucket = MostSignificantBitSet(index);
-        //check if bucket doesn't exist. if not, fill all buckets up to this one
-        if(bucket >= buckets.size()){
-            for(size_t i = buckets.size(); i <= bucket; i++){
-                size_t count = (1 << i);
-                buckets.push_back(storage.get_random_address(count * TSize))
-            }
+        auto [bucket, offset] = locate(index);
+        if(bucket >= buckets.size()) [[unlikely]]{
+            alloc_buckets(bucket);
         }
-        auto base = buckets[bucket];
-        auto offset = index & ~(1 << bucket);
-        return base.subrange(offset * TSize, TSize);
+        return buckets[bucket].subrange(offset * TSize, TSize);
     }
     void clear(){
         for(size_t i = 0; i < buckets.size(); i++){
             storage.erase(buckets[i]);
         }
         buckets.clear();
-        //get(DEFAULT_ENTRIES - 1);
     }
-    //TODO serialize impl
+
+    Result serializeImpl(StorageBuffer<> &buffer) const {
+        return szeimpl::s(buckets, buffer);
+    }
+    static ObjectAddressStorage deserializeImpl(const StorageBufferRO<> &buffer, Storage &storage) {
+        return ObjectAddressStorage{storage, szeimpl::d<std::vector<StorageAddress>>(buffer)};
+    }
+    static ObjectAddressStorage deserializeImpl(const StorageBufferRO<> &) { throw std::bad_function_call(); };
+    size_t getSizeImpl() const {
+        return szeimpl::size(buckets);
+    }
 };
 
 //TOOD implement random and range trackers
 template<AllocationPattern A, size_t MAX_OBJS>
-requires std::is_same<A, AllocationPattern::Sequential>
+requires (A == AllocationPattern::Sequential)
 class ObjectAllocationTracker{
-    /*struct AllocatedBucketL{
-        size_t offset;
-        size_t size;
-        std::vector<bool> bits;
-        std::vector<AllocatedBucketL> allocated;
-    };*/
     std::vector<bool> allocated;
+    size_t count{0};
 public:
-    void allocate(size_t index){
+    ObjectAllocationTracker() {}
+    ObjectAllocationTracker(std::vector<bool> &&allocated, size_t end): allocated(std::move(allocated)) {
+        //serialized bitmap is padded
+        this->allocated.resize(end);
+        for(bool a: this->allocated){
+            count += a;
+        }
+    }
+
+    bool has(size_t index) const{
+        return index < allocated.size() && allocated[index];
+    }
+    //returns true if it was not allocated
+    bool allocate(size_t index){
+        ASSERT_ON(index >= MAX_OBJS);
         if(index >= allocated.size()){
             allocated.resize(index + 1);
         }
+        bool was = allocated[index];
         allocated[index] = true;
+        count += !was;
+        return !was;
     }
-    void deallocate(size_t index){
-        ASSERT_ON(index >= allocated.size());
+    //returns true if it was allocated
+    bool deallocate(size_t index){
+        if(!has(index)){
+            return false;
+        }
         allocated[index] = false;
+        count--;
+        return true;
+    }
+    size_t size() const{
+        return count;
+    }
+    size_t next_index() const{
+        return allocated.size();
     }
     template<typename F>
     void for_each(F &f) const{
@@ -76,65 +139,213 @@ public:
     }
     void clear(){
         allocated.clear();
+        count = 0;
+    }
+
+    Result serializeImpl(StorageBuffer<> &buffer) const {
+        size_t offset = 0;
+        return SerializeSequentially(buffer, offset, allocated.size(), allocated);
+    }
+    static ObjectAllocationTracker deserializeImpl(const StorageBufferRO<> &buffer) {
+        size_t offset = 0;
+        auto buf = buffer;
+        auto [end, allocated] = DeserializeSequentially<size_t, std::vector<bool>>(buf, offset);
+        return ObjectAllocationTracker{std::move(allocated), end};
+    }
+    size_t getSizeImpl() const {
+        return SizeAccumulate(allocated.size(), allocated);
     }
-    //TODO serialize impl
 };
 
-//TODO special case for trivially copyable to instantiate at the memory with const or not
 //TODO specialize MAX_OBJS in range < 1K, < 10K etc.
 
-template<CSerializable T, CStorage Storage, AllocationPattern A, size_t MAX_OBJS>
-requires CSerializableFixedSize<T>
+//Implements CObjectStorageImpl for objects of the same serialized size.
+//Address of an object is computed from its index, there is no per-object address map.
+//CInPlaceObject objects are not deserialized: getRef()/getCRef() point to the storage memory,
+//changes made through getRef() are written to the storage and committed with commit(index)
+template<CFixedSizeObject T, CStorage Storage, AllocationPattern A, size_t MAX_OBJS>
 class ObjectStorageImpl{
-    static constexpr size_t TSize = sizeof(T);
+    static constexpr bool IN_PLACE = CInPlaceObject<T>;
+    static constexpr size_t TSize = fixed_object_size<T>();
+    static constexpr size_t TAlign = IN_PLACE ? alignof(T) : 1;
+    using AddressStorage = ObjectAddressStorage<TSize, TAlign, Storage, MAX_OBJS>;
+    using AllocationTracker = ObjectAllocationTracker<A, MAX_OBJS>;
+    struct NoCache{};
+    using ObjectCache = std::conditional_t<IN_PLACE, NoCache, std::unordered_map<size_t, T>>;
 
     Storage &storage;
-    ObjectAddressStorage<TSize, Storage, A, MAX_OBJS> addr_storage;
-    ObjectInstanceStorage<T, A, MAX_OBJS> obj_storage;
-    ObjectAllocationTracker<A, MAX_OBJS> obj_alloc;
+    AddressStorage addr_storage;
+    AllocationTracker obj_alloc;
+    [[no_unique_address]] ObjectCache objects; //Keep and getRef()
 
-    size_t obj_count{0};
+    ObjectStorageImpl(Storage &storage, AddressStorage &&addr_storage, AllocationTracker &&obj_alloc):
+        storage(storage), addr_storage(std::move(addr_storage)), obj_alloc(std::move(obj_alloc)) {}
 public:
-    ObjectStorageImpl(){}
+    static constexpr std::string_view TYPE_NAME = "FixedSizeObjectStorage";
+    static constexpr ObjectStorageAccess DefaultAccess = ObjectStorageAccess::Once;
 
-    //get instance
-    T &get(size_t index, bool nocache = false){ //question is how long do we keep the reference if nocache = true. maybe list of pending operations
+    //buckets are allocated on demand, base is not needed
+    ObjectStorageImpl(Storage &storage, [[maybe_unused]] const StorageAddress &base): ObjectStorageImpl(storage) {}
+    ObjectStorageImpl(Storage &storage): storage(storage), addr_storage(storage) {}
+
+    bool has(size_t index) const{
+        return obj_alloc.has(index);
+    }
+    size_t size() const{
+        return obj_alloc.size();
     }
 
-    //delete instance
-    void clear(size_t index){
+    template <ObjectStorageAccess Access = DefaultAccess>
+    T get(size_t index){
+        if constexpr (IN_PLACE){
+            return getCRef(index);
+        } else {
+            ASSERT_ON(!has(index));
+            auto it = objects.find(index);
+            if(it != objects.end()){
+                return it->second;
+            }
+            auto t = deserialize<T>(storage, addr_storage.get(index));
+            if constexpr (Access == ObjectStorageAccess::Keep){
+                objects.emplace(index, t);
+            }
+            return t;
+        }
+    }
+    //implies Keep. changes are persisted by commit(index), without it they may be lost
+    //and checksummed storages don't cover them until the next checkpoint
+    template <ObjectStorageAccess Access = DefaultAccess>
+    T &getRef(size_t index){
+        ASSERT_ON(!has(index));
+        if constexpr (IN_PLACE){
+            return *reinterpret_cast<T *>(storage.writeb(addr_storage.get(index)).get());
+        } else {
+            auto it = objects.find(index);
+            if(it == objects.end()){
+                it = objects.emplace(index, deserialize<T>(storage, addr_storage.get(index))).first;
+            }
+            return it->second;
+        }
+    }
+    template <ObjectStorageAccess Access = DefaultAccess>
+    const T &getCRef(size_t index){
+        if constexpr (IN_PLACE){
+            ASSERT_ON(!has(index));
+            return *reinterpret_cast<const T *>(storage.readb(addr_storage.get(index)).get());
+        } else {
+            return getRef<Access>(index);
+        }
+    }
+    //commit changes made through getRef()
+    Result commit(size_t index){
+        ASSERT_ON(!has(index));
+        if constexpr (IN_PLACE){
+            return storage.commit(storage.writeb(addr_storage.get(index)));
+        } else {
+            auto it = objects.find(index);
+            if(it != objects.end()){
+                auto addr = addr_storage.get(index);
+                serialize<StorageAddress>(storage, it->second, addr);
+            }
+            return Result::Success;
+        }
     }
 
-    //add object at index
-    void put(auto t, size_t index){
-        ASSERT_ON(obj_count >= MAX_OBJS); //no more, full TODO maybe return normal error
-        if(addr.size() <= index){
-            addr.resize(index + 1);
+    //bucket space of the object is kept for the next put()
+    void clear(size_t index){
+        if constexpr (!IN_PLACE){
+            objects.erase(index);
         }
-        auto &a = addr[index];
-        if(!a.is_null()){
-            //do something with old object, like destroy instance etc.
+        obj_alloc.deallocate(index);
+    }
+    void clear(size_t start, size_t end){
+        for(size_t i = start; i <= end; i++){
+            clear(i);
         }
-        //serialize object
-        a = serialize<StorageAddress>(t, storage, a.second);
     }
 
+    //add object at index
+    template <ObjectStorageAccess Access = DefaultAccess>
+    void put(const T &t, size_t index){
+        obj_alloc.allocate(index);
+        auto addr = addr_storage.get(index);
+        if constexpr (IN_PLACE){
+            auto buf = storage.writeb(addr);
+            memcpy(buf.get(), &t, TSize);
+            storage.commit(buf);
+        } else {
+            objects.erase(index);
+            ASSERT_ON(szeimpl::size(t) != TSize); //serialized size has changed
+            serialize<StorageAddress>(storage, t, addr);
+            if constexpr (Access == ObjectStorageAccess::Keep){
+                objects.emplace(index, t);
+            }
+        }
+    }
     //add object, return index
-    size_t put(auto t){
-        ASSERT_ON(obj_count >= MAX_OBJS); //no more, full TODO maybe return normal error
+    template <ObjectStorageAccess Access = DefaultAccess>
+    size_t put(const T &t){
+        size_t index = obj_alloc.next_index();
+        put<Access>(t, index);
+        return index;
     }
 
-    //delete object
-    void del(size_t index){
+    //objects changed by f are committed
+    template<typename F>
+    requires COSForEachCallable<F, T>
+    void for_each(size_t start, size_t end, F &f){
+        for(size_t i = start; i <= end; i++){
+            if(!has(i))
+                continue;
+            f(i, getRef(i));
+            commit(i);
+        }
+    }
+    template<typename F>
+    requires COSForEachCallable<F, const T>
+    void for_each(size_t start, size_t end, F &f){
+        for(size_t i = start; i <= end; i++){
+            if(!has(i))
+                continue;
+            f(i, getCRef(i));
+        }
+    }
+    template<typename F>
+    requires COSForEachEmptyCallable<F, T>
+    size_t for_each_empty(size_t start, size_t end, F &f){
+        size_t count = 0;
+        for(size_t i = start; i <= end; i++){
+            if(has(i))
+                continue;
+            count++;
+            put(f(i), i);
+        }
+        return count;
     }
 
-    //has object
-    bool has(size_t index) const{
+    /* Serialize */
 
+    Result serializeImpl(StorageBuffer<> &buffer) const {
+        size_t offset = 0;
+        return SerializeSequentially(buffer, offset, addr_storage, obj_alloc);
+    }
+    static ObjectStorageImpl deserializeImpl(const StorageBufferRO<> &buffer, Storage &storage) {
+        size_t offset = 0;
+        auto buf = buffer;
+        auto [addr_storage] = DeserializeSequentially<AddressStorage>(buf, offset, storage);
+        auto [obj_alloc] = DeserializeSequentially<AllocationTracker>(buf, offset);
+        return ObjectStorageImpl{storage, std::move(addr_storage), std::move(obj_alloc)};
+    }
+    static ObjectStorageImpl deserializeImpl(const StorageBufferRO<> &) { throw std::bad_function_call(); };
+
+    size_t getSizeImpl() const {
+        return SizeAccumulate(addr_storage, obj_alloc);
     }
-//TODO serialize etc.
 };
 
+template<typename T, typename Storage, size_t MAX_OBJS = std::numeric_limits<size_t>::max()>
+using FixedSizeObjectStorage = ObjectStorageImpl<T, Storage, AllocationPattern::Sequential, MAX_OBJS>;
+
 /*
 template<typename T>
 class SimpleObjectStorage{
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <set>
+#include <array>
+#include <tuple>
+#include <vector>
+#include <variant>
+
+#include <storage/VirtualFileCatalog.hpp>
+#include <storage/UniqueID.hpp>
+
+/*
+Catalog with secondary indexes - reverse lookups without scanning the whole catalog:
+which keys point to a value or a range of values (e.g. everything stored in one DataStorage
+or in an address range of it), and which keys have a given key on level I (e.g. all tickers of
+a resolution). Indexes are ordered sets of (index key, stored catalog key), maintained on
+add/set/del and persisted after the catalog, so lookups are O(log n + matches) after load too.
+Values are modified through set() only, there is no getRef(), the value index has to see every change.
+*/
+
+//ordered key of a value in the value index, specialize for values without operator<
+template <typename V>
+struct CatalogValueKey{
+    static const V &get(const V &v){
+        return v;
+    }
+};
+//by address, so an address range finds everything stored in it
+template <>
+struct CatalogValueKey<StorageAddress>{
+    static uint64_t get(const StorageAddress &v){
+        return v.addr;
+    }
+};
+//by storage id
+template <typename T>
+struct CatalogValueKey<UniqueIDPtr<T>>{
+    static uint32_t get(const UniqueIDPtr<T> &v){
+        return v.getID();
+    }
+};
+
+//selects the indexes: by value if BY_VALUE, by the key of level I for every I in Levels
+template <bool BY_VALUE, size_t ...Levels>
+struct CatalogIndexes{};
+
+//position of level I in Levels
+template <size_t I, size_t ...Levels>
+constexpr size_t catalog_index_position(){
+    std::array<size_t, sizeof...(Levels)> levels{Levels...};
+    for(size_t pos = 0; pos < levels.size(); pos++){
+        if(levels[pos] == I){
+            return pos;
+        }
+    }
+    return levels.size();
+}
+
+template <typename Indexes, CSerializable Value, CSerializable ...Keys>
+class IndexedMultiLevelKeyMap;
+
+template <bool BY_VALUE, size_t ...Levels, CSerializable Value, CSerializable ...Keys>
+class IndexedMultiLevelKeyMap<CatalogIndexes<BY_VALUE, Levels...>, Value, Keys...>{
+    using MLKM = SimpleMultiLevelKeyMap<Value, Keys...>;
+    using Codec = typename MLKM::Codec;
+    using StoredKey = typename Codec::StoredKey;
+public:
+    //indexes are not part of the fingerprint, a catalog is opened with the indexes it was written with
+    static constexpr std::string_view TYPE_NAME = "IndexedVirtualFileCatalog";
+    static constexpr size_t LEVELS = sizeof...(Keys);
+    using Key = typename MLKM::Key;
+    template <size_t I>
+    using LevelKey = typename MLKM::template LevelKey<I>;
+    using ValueKey = std::remove_cvref_t<decltype(CatalogValueKey<Value>::get(std::declval<const Value &>()))>;
+private:
+    static_assert(((Levels < LEVELS) && ...), "indexed level out of range");
+
+    //(index key, catalog key) ordered by index key first, looked up by the index key alone
+    struct IndexLess{
+        using is_transparent = void;
+        template <typename A, typename B>
+        bool operator()(const std::pair<A, B> &a, const std::pair<A, B> &b) const{
+            return a < b;
+        }
+        template <typename A, typename B>
+        bool operator()(const std::pair<A, B> &a, const A &b) const{
+            return a.first < b;
+        }
+        template <typename A, typename B>
+        bool operator()(const A &a, const std::pair<A, B> &b) const{
+            return a < b.first;
+        }
+    };
+    template <typename K>
+    using Index = std::set<std::pair<K, StoredKey>, IndexLess>;
+    using ValueIndex = std::conditional_t<BY_VALUE, Index<ValueKey>, std::monostate>;
+    template <size_t I>
+    using LevelIndex = Index<typename Codec::template LevelStoredKey<I>>;
+
+    MLKM mlkm;
+    ValueIndex by_value;
+    std::tuple<LevelIndex<Levels>...> by_level;
+
+    template <size_t I>
+    auto &level_index(){
+        constexpr size_t pos = catalog_index_position<I, Levels...>();
+        static_assert(pos < sizeof...(Levels), "level is not indexed");
+        return std::get<pos>(by_level);
+    }
+    template <size_t I>
+    const auto &level_index() const{
+        return const_cast<IndexedMultiLevelKeyMap &>(*this).template level_index<I>();
+    }
+    void index(const StoredKey &stored, const Value &value){
+        if constexpr(BY_VALUE){
+            by_value.emplace(CatalogValueKey<Value>::get(value), stored);
+        }
+        (level_index<Levels>().emplace(std::get<Levels>(stored), stored), ...);
+    }
+    void unindex(const StoredKey &stored, const Value &value){
+        if constexpr(BY_VALUE){
+            by_value.erase(std::make_pair(CatalogValueKey<Value>::get(value), stored));
+        }
+        (level_index<Levels>().erase(std::make_pair(std::get<Levels>(stored), stored)), ...);
+    }
+    StoredKey stored_key(const Keys&... keys) const{
+        StoredKey stored;
+        mlkm.key_codec().find_stored(stored, keys...);
+        return stored;
+    }
+    //entries of the level index with key k
+    template <size_t I>
+    auto level_range(const LevelKey<I> &k) const{
+        const auto &index = level_index<I>();
+        typename Codec::template LevelStoredKey<I> stored;
+        if constexpr(is_interned_key_v<LevelKey<I>>){
+            auto id = mlkm.key_codec().dict.find(k);
+            if(!id){
+                return std::make_pair(index.end(), index.end());
+            }
+            stored = *id;
+        } else {
+            stored = k;
+        }
+        return index.equal_range(stored);
+    }
+    template <typename It>
+    std::vector<Key> decode(It begin, It end) const{
+        std::vector<Key> keys;
+        for(; begin != end; ++begin){
+            mlkm.key_codec().decode(keys.emplace_back(), begin->second);
+        }
+        return keys;
+    }
+    template <typename I>
+    static void serialize_index(StorageBuffer<> &buffer, size_t &offset, const I &index){
+        SerializeSequentially(buffer, offset, index.size());
+        for(auto &e: index){
+            SerializeSequentially(buffer, offset, e);
+        }
+    }
+    template <typename I>
+    static void deserialize_index(StorageBufferRO<> &buf, size_t &offset, I &index){
+        auto [num] = DeserializeSequentially<size_t>(buf, offset);
+        for(size_t i = 0; i < num; i++){
+            auto [e] = DeserializeSequentially<typename I::value_type>(buf, offset);
+            //stored in order
+            index.emplace_hint(index.end(), std::move(e));
+        }
+    }
+    template <typename I>
+    static size_t index_size(const I &index){
+        size_t sum = szeimpl::size(index.size());
+        for(auto &e: index){
+            sum += szeimpl::size(e);
+        }
+        return sum;
+    }
+public:
+    IndexedMultiLevelKeyMap() {}
+    IndexedMultiLevelKeyMap(MLKM &&mlkm): mlkm(std::move(mlkm)) {}
+
+    size_t size() const{
+        return mlkm.size();
+    }
+    //existing entry is kept
+    Result add(const Keys&... keys, const Value &value){
+        size_t before = mlkm.size();
+        Result res = mlkm.add(keys..., value);
+        if(mlkm.size() != before){
+            index(stored_key(keys...), value);
+        }
+        return res;
+    }
+    //adds or replaces the entry
+    Result set(const Keys&... keys, const Value &value){
+        auto [found, v] = mlkm.getRef(keys...);
+        if(!found){
+            return add(keys..., value);
+        }
+        auto stored = stored_key(keys...);
+        unindex(stored, *v);
+        *v = value;
+        index(stored, value);
+        return Result::Success;
+    }
+    void del(const Keys&... keys){
+        auto [found, v] = mlkm.getRef(keys...);
+        if(found){
+            unindex(stored_key(keys...), *v);
+            mlkm.del(keys...);
+        }
+    }
+    bool has(const Keys&... keys){
+        return mlkm.has(keys...);
+    }
+    std::pair<bool, Value> get(const Keys&... keys){
+        return mlkm.get(keys...);
+    }
+    template <typename ...Prefix>
+    auto list(const Prefix&... prefix){
+        return mlkm.list(prefix...);
+    }
+    //f(const Key &, const Value &) for every entry under the prefix, in key order
+    template <typename F, typename ...Prefix>
+    void scan(F &&f, const Prefix&... prefix) const{
+        mlkm.scan(std::forward<F>(f), prefix...);
+    }
+
+    //keys of entries with the value
+    std::vector<Key> keys_of(const Value &value) const requires BY_VALUE{
+        auto [begin, end] = by_value.equal_range(CatalogValueKey<Value>::get(value));
+        return decode(begin, end);
+    }
+    //keys of entries with value key in [lo, hi), e.g. stored in an address range. ordered by value key
+    std::vector<Key> keys_in(const ValueKey &lo, const ValueKey &hi) const requires BY_VALUE{
+        return decode(by_value.lower_bound(lo), by_value.lower_bound(hi));
+    }
+    //removes entries with value key in [lo, hi), e.g. before their storage is dropped. returns number removed
+    size_t del_in(const ValueKey &lo, const ValueKey &hi) requires BY_VALUE{
+        size_t removed = 0;
+        for(auto &key: keys_in(lo, hi)){
+            std::apply([&](const auto&... k){ del(k...); }, key);
+            removed++;
+        }
+        return removed;
+    }
+    //keys of entries with key k on level I
+    template <size_t I>
+    std::vector<Key> keys_with(const LevelKey<I> &k) const{
+        auto [begin, end] = level_range<I>(k);
+        return decode(begin, end);
+    }
+    template <size_t I>
+    size_t count_with(const LevelKey<I> &k) const{
+        auto [begin, end] = level_range<I>(k);
+        return std::distance(begin, end);
+    }
+
+    //CSerializableImpl: catalog, [value index], level indexes
+    Result serializeImpl(StorageBuffer<> &buffer) const {
+        size_t offset = 0;
+        SerializeSequentially(buffer, offset, mlkm);
+        if constexpr(BY_VALUE){
+            serialize_index(buffer, offset, by_value);
+        }
+        std::apply([&](const auto&... index){ (serialize_index(buffer, offset, index), ...); }, by_level);
+        return Result::Success;
+    }
+    static IndexedMultiLevelKeyMap deserializeImpl(const StorageBufferRO<> &buffer) {
+        size_t offset = 0;
+        auto buf = buffer;
+
+        auto [mlkm] = DeserializeSequentially<MLKM>(buf, offset);
+        IndexedMultiLevelKeyMap map{std::move(mlkm)};
+        if constexpr(BY_VALUE){
+            deserialize_index(buf, offset, map.by_value);
+        }
+        std::apply([&](auto&... index){ (deserialize_index(buf, offset, index), ...); }, map.by_level);
+        return map;
+    }
+    //as a TypedObject in AutoStoredObject, which passes the storage
+    template <CStorage Storage>
+    static IndexedMultiLevelKeyMap deserializeImpl(const StorageBufferRO<> &buffer, Storage &) {
+        return deserializeImpl(buffer);
+    }
+    size_t getSizeImpl() const {
+        size_t sum = szeimpl::size(mlkm);
+        if constexpr(BY_VALUE){
+            sum += index_size(by_value);
+        }
+        std::apply([&](const auto&... index){ ((sum += index_size(index)), ...); }, by_level);
+        return sum;
+    }
+};
+
+template <CStorage Storage, typename Indexes, CSerializable Value, CSerializable ...Keys>
+using IndexedVirtualFileCatalog = AutoStoredObject<TypedObject<IndexedMultiLevelKeyMap<Indexes, Value, Keys...>>, Storage>;
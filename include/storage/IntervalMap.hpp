@@ -1,6 +1,7 @@
 #pragma once
 
 #include <map>
+#include <memory_resource>
 #include <tuple>
 #include <ranges>
 
@@ -41,12 +42,12 @@ class Merge<T>{
 //what we need: 1) merge for ObjectInstanceRange, 2) size_t in SimpleStorage.hpp
 
 //whole interval has the same value
-template<typename K, typename V>
+template<typename K, typename V, typename Alloc = std::allocator<std::pair<const K, std::pair<K, V>>>>
 class IntervalMap{
-    std::map<K, std::pair<K, V>> m; //[start] -> (end, V)
-    using M_TYPE = decltype(m);
+    using M_TYPE = std::map<K, std::pair<K, V>, std::less<K>, Alloc>;
+    M_TYPE m; //[start] -> (end, V)
 
-    IntervalMap(std::map<K, std::pair<K, V>> &&m): m(m) {}
+    IntervalMap(M_TYPE &&m): m(std::move(m)) {}
 
     template<typename T>
     T next(const T &t){
@@ -255,6 +256,7 @@ public:
     using ConstIntervalResult = IntervalResultImpl<typename M_TYPE::const_iterator>;
     using IntervalResult = IntervalResultImpl<std::ranges::iterator_t<M_TYPE>>;
     IntervalMap(){}
+    IntervalMap(const Alloc &alloc): m(alloc) {}
 
     //merge<V> -> merge(V&v1_dst, V&&v2), mergeN(V&v1_dst, std::vector<V> &vec)
     //set(): do merge, extend, set
@@ -295,6 +297,14 @@ public:
             it++;
         }
     }
+    //intervals intersecting [start, end], ordered by start
+    auto intersecting(const K &start, const K &end) const -> std::ranges::subrange<typename M_TYPE::const_iterator>{
+        auto it = m.upper_bound(start);
+        if(it != m.begin() && !(std::prev(it)->second.first < start)){
+            --it;
+        }
+        return {it, m.upper_bound(end)};
+    }
 /*
     template<typename F>
     void del_foreach(const K &start, const K &end, F &&f) {
@@ -355,7 +365,6 @@ public:
             //okay, continue updating range and value
         }
         K old_end = iv_end;
-        iv_result.value() += new_end - iv_end;
         iv_result.end() = new_end;
         f(iv_result, old_end, new_end);
 
@@ -394,16 +403,26 @@ public:
     void clear(){
         m.clear();
     }
+    size_t size() const{
+        return m.size();
+    }
+    //ordered by start, value_type is (start, (end, V))
+    auto begin() const{
+        return m.begin();
+    }
+    auto end() const{
+        return m.end();
+    }
 
     Result serializeImpl(StorageBuffer<> &buffer) const {
         ASSERT_ON(getSizeImpl() > buffer.allocated());
         size_t offset = 0;
         return SerializeSequentially(buffer, offset, m);
     }
-    static IntervalMap<K, V> deserializeImpl(const StorageBufferRO<> &buffer) {
+    static IntervalMap deserializeImpl(const StorageBufferRO<> &buffer) {
         auto buf = buffer;
         size_t offset = 0;
-        auto [m] = DeserializeSequentially<std::map<K, std::pair<K, V>>>(buf, offset);
+        auto [m] = DeserializeSequentially<M_TYPE>(buf, offset);
         
         return IntervalMap{std::move(m)};
     }
@@ -411,3 +430,6 @@ public:
         return szeimpl::size(m);
     }
 };
+
+template<typename K, typename V>
+using PmrIntervalMap = IntervalMap<K, V, std::pmr::polymorphic_allocator<std::pair<const K, std::pair<K, V>>>>;
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <stdexcept>
+#include <vector>
+
+#include <storage/Utils.hpp>
+#include <storage/Checksum.hpp>
+#include <storage/StorageUtils.hpp>
+
+/*
+Metadata log - append-only journal of metadata operations made after the last snapshot.
+Operations are deterministic, so replaying them on top of the snapshot rebuilds the same state.
+
+[MetadataLogBatch][MetadataLogRecord]...[MetadataLogBatch][MetadataLogRecord]...
+One batch is appended per checkpoint, crc32c covers the records of the batch.
+*/
+
+enum class MetadataOp: uint64_t{
+    Alloc,          //addr, size
+    AllocUnmapped,  //addr, size
+    Lookup,         //addr, size; lookup() that mapped an unmapped range
+    Del,            //addr, size
+    Expand,         //addr, size, arg = expand size
+    ChecksumSet,    //addr, size, arg = crc
+    ChecksumDrop,   //addr, size
+};
+
+struct MetadataLogRecord{
+    MetadataOp op;
+    uint64_t addr;
+    uint64_t size;
+    uint64_t arg;
+};
+
+struct MetadataLogBatch{
+    uint64_t count;
+    uint32_t crc;
+    uint32_t reserved;
+};
+
+class MetadataLog{
+    std::pmr::vector<MetadataLogRecord> pending;
+public:
+    MetadataLog(std::pmr::memory_resource *resource = std::pmr::get_default_resource()): pending(resource) {}
+
+    void append(MetadataOp op, uint64_t addr, uint64_t size, uint64_t arg = 0){
+        pending.push_back(MetadataLogRecord{op, addr, size, arg});
+    }
+    bool empty() const{
+        return pending.empty();
+    }
+    void clear(){
+        pending.clear();
+    }
+    //bytes flush() is going to write
+    size_t batch_size() const{
+        return pending.empty() ? 0 : sizeof(MetadataLogBatch) + pending.size() * sizeof(MetadataLogRecord);
+    }
+
+    //write pending records as one batch, buffer.allocated() >= batch_size()
+    Result flush(StorageBuffer<> &buffer){
+        if(pending.empty()){
+            return Result::Success;
+        }
+        ASSERT_ON(buffer.allocated() < batch_size());
+        size_t records_size = pending.size() * sizeof(MetadataLogRecord);
+        MetadataLogBatch batch{pending.size(), crc32c::value(pending.data(), records_size), 0};
+        memcpy(buffer.get(), &batch, sizeof(batch));
+        memcpy(buffer.get(sizeof(batch)), pending.data(), records_size);
+        pending.clear();
+        return Result::Success;
+    }
+
+    //calls f(const MetadataLogRecord &) for every record in buffer, throws on corrupted batch
+    template<typename F>
+    static void replay(const StorageBufferRO<> &buffer, F &&f){
+        size_t offset = 0;
+        while(offset < buffer.size()){
+            MetadataLogBatch batch;
+            ASSERT_ON(offset + sizeof(batch) > buffer.size());
+            memcpy(&batch, buffer.get(offset), sizeof(batch));
+            offset += sizeof(batch);
+            size_t records_size = batch.count * sizeof(MetadataLogRecord);
+            if(records_size > buffer.size() - offset || crc32c::value(buffer.get(offset), records_size) != batch.crc){
+                LOG_ERROR("MetadataLog: checksum mismatch in batch at %lu", offset - sizeof(batch));
+                throw std::runtime_error("MetadataLog: corrupted batch");
+            }
+            for(size_t i = 0; i < batch.count; i++, offset += sizeof(MetadataLogRecord)){
+                MetadataLogRecord rec;
+                memcpy(&rec, buffer.get(offset), sizeof(rec));
+                f(rec);
+            }
+        }
+    }
+};
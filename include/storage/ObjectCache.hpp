@@ -0,0 +1,307 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <bit>
+
+#include <storage/Utils.hpp>
+#include <storage/StorageHelpers.hpp>
+
+/*
+Object cache - bounded cache of immutable object instances shared by readers, W-TinyLFU policy.
+New objects enter a small LRU window, objects leaving the window compete with the LRU object
+of the main segment by estimated access frequency. Main segment is a segmented LRU:
+probation for objects seen once in main, protected for objects hit again.
+
+Memory budget is in bytes, callers provide the size of every object.
+*/
+
+//approximate access frequency of object indexes, 4 rows of saturating 4 bit counters (stored in bytes)
+class FrequencySketch{
+    static constexpr size_t ROWS = 4;
+    static constexpr uint8_t MAX_COUNT = 15;
+    static constexpr uint64_t SEEDS[ROWS] = {
+        0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL};
+
+    std::vector<uint8_t> table;
+    size_t mask{0};
+    size_t samples{0};
+    size_t sample_limit{0};
+
+    size_t slot(size_t row, size_t key) const{
+        uint64_t h = (key + 1) * SEEDS[row];
+        h ^= h >> 32;
+        return row * (mask + 1) + (h & mask);
+    }
+    //halve all counters, so old popularity fades
+    void age(){
+        for(auto &c: table){
+            c >>= 1;
+        }
+        samples /= 2;
+    }
+public:
+    FrequencySketch(size_t entries = 0){
+        resize(entries);
+    }
+    void resize(size_t entries){
+        size_t width = std::max<size_t>(16, std::bit_ceil(entries));
+        table.assign(ROWS * width, 0);
+        mask = width - 1;
+        samples = 0;
+        sample_limit = 10 * width;
+    }
+    void increment(size_t key){
+        for(size_t r = 0; r < ROWS; r++){
+            auto &c = table[slot(r, key)];
+            c += (c < MAX_COUNT);
+        }
+        if(++samples >= sample_limit){
+            age();
+        }
+    }
+    uint8_t estimate(size_t key) const{
+        uint8_t count = MAX_COUNT;
+        for(size_t r = 0; r < ROWS; r++){
+            count = std::min(count, table[slot(r, key)]);
+        }
+        return count;
+    }
+};
+
+struct ObjectCacheMetrics{
+    size_t hits{0};
+    size_t misses{0};
+    size_t inserts{0};
+    size_t evictions{0};
+    size_t rejections{0}; //lost admission to a more frequent object, or larger than budget
+    size_t bytes{0};
+    size_t entries{0};
+    size_t budget{0};
+
+    double hit_rate() const{
+        return (hits + misses) ? static_cast<double>(hits) / (hits + misses) : 0.0;
+    }
+};
+
+template<typename T>
+class ObjectCache{
+    enum class Segment{
+        Window,
+        Probation,
+        Protected,
+    };
+    struct Entry{
+        size_t index;
+        std::shared_ptr<const T> value;
+        size_t charge;
+        Segment segment;
+    };
+    using List = std::list<Entry>;
+    using Iterator = typename List::iterator;
+
+    static constexpr size_t WINDOW_PERCENT = 1;
+    static constexpr size_t PROTECTED_PERCENT = 80; //of main
+    static constexpr size_t ENTRY_OVERHEAD = sizeof(Entry) + 4 * sizeof(void *); //list node, index slot, control block
+
+    //MRU at front
+    List window;
+    List probation;
+    List protect;
+    IndexCache<Iterator> entries;
+    FrequencySketch sketch;
+
+    size_t budget{0};
+    size_t window_budget{0};
+    size_t protected_budget{0};
+    size_t window_bytes{0};
+    size_t main_bytes{0};
+    size_t protected_bytes{0};
+    ObjectCacheMetrics stats;
+
+    List &list_of(Segment s){
+        switch(s){
+            case Segment::Window:
+                return window;
+            case Segment::Probation:
+                return probation;
+            default:
+                return protect;
+        }
+    }
+    void move(Iterator it, Segment to){
+        auto charge = it->charge;
+        switch(it->segment){
+            case Segment::Window:
+                window_bytes -= charge;
+                break;
+            case Segment::Protected:
+                protected_bytes -= charge;
+                [[fallthrough]];
+            case Segment::Probation:
+                main_bytes -= charge;
+                break;
+        }
+        switch(to){
+            case Segment::Window:
+                window_bytes += charge;
+                break;
+            case Segment::Protected:
+                protected_bytes += charge;
+                [[fallthrough]];
+            case Segment::Probation:
+                main_bytes += charge;
+                break;
+        }
+        list_of(to).splice(list_of(to).begin(), list_of(it->segment), it);
+        it->segment = to;
+    }
+    void remove(Iterator it){
+        switch(it->segment){
+            case Segment::Window:
+                window_bytes -= it->charge;
+                break;
+            case Segment::Protected:
+                protected_bytes -= it->charge;
+                [[fallthrough]];
+            case Segment::Probation:
+                main_bytes -= it->charge;
+                break;
+        }
+        entries.erase(it->index);
+        list_of(it->segment).erase(it);
+    }
+    void evict(Iterator it){
+        stats.evictions++;
+        remove(it);
+    }
+    void demote_protected(){
+        while(protected_bytes > protected_budget && !protect.empty()){
+            move(std::prev(protect.end()), Segment::Probation);
+        }
+    }
+    //main LRU object, other than candidate
+    Iterator main_victim(Iterator candidate){
+        if(!probation.empty() && std::prev(probation.end()) != candidate){
+            return std::prev(probation.end());
+        }
+        if(!protect.empty()){
+            return std::prev(protect.end());
+        }
+        return candidate;
+    }
+    //objects leaving the window are admitted to main only if they are accessed more often than the main LRU object
+    void trim(){
+        while(window_bytes > window_budget && !window.empty()){
+            auto candidate = std::prev(window.end());
+            move(candidate, Segment::Probation);
+            while(main_bytes > budget - std::min(budget, window_bytes)){
+                auto victim = main_victim(candidate);
+                if(victim == candidate || sketch.estimate(candidate->index) <= sketch.estimate(victim->index)){
+                    stats.rejections++;
+                    evict(candidate);
+                    break;
+                }
+                evict(victim);
+            }
+        }
+        while(window_bytes + main_bytes > budget){
+            if(!probation.empty()){
+                evict(std::prev(probation.end()));
+            } else if(!protect.empty()){
+                evict(std::prev(protect.end()));
+            } else {
+                evict(std::prev(window.end()));
+            }
+        }
+    }
+public:
+    ObjectCache(size_t budget = 0){
+        set_budget(budget);
+    }
+    //cached objects are not part of the state, a copy starts empty with the same budget
+    ObjectCache(const ObjectCache &other): ObjectCache(other.budget) {}
+    ObjectCache(ObjectCache &&other) = default;
+    ObjectCache &operator=(const ObjectCache &other){
+        if(this != &other){
+            clear();
+            set_budget(other.budget);
+        }
+        return *this;
+    }
+    ObjectCache &operator=(ObjectCache &&other) = default;
+
+    void set_budget(size_t bytes){
+        budget = bytes;
+        window_budget = budget * WINDOW_PERCENT / 100;
+        protected_budget = (budget - window_budget) * PROTECTED_PERCENT / 100;
+        sketch.resize(budget / (ENTRY_OVERHEAD + sizeof(T)));
+        demote_protected();
+        trim();
+    }
+
+    //records the access, returns nullptr on miss
+    std::shared_ptr<const T> find(size_t index){
+        sketch.increment(index);
+        auto found = entries.find(index);
+        if(!found){
+            stats.misses++;
+            return nullptr;
+        }
+        stats.hits++;
+        auto it = *found;
+        switch(it->segment){
+            case Segment::Window:
+                window.splice(window.begin(), window, it);
+                break;
+            case Segment::Probation:
+                move(it, Segment::Protected);
+                demote_protected();
+                break;
+            case Segment::Protected:
+                protect.splice(protect.begin(), protect, it);
+                break;
+        }
+        return it->value;
+    }
+    //charge - memory used by the object in bytes
+    void insert(size_t index, std::shared_ptr<const T> value, size_t charge){
+        charge += ENTRY_OVERHEAD;
+        erase(index);
+        if(charge > budget){
+            stats.rejections++;
+            return;
+        }
+        stats.inserts++;
+        window.push_front(Entry{index, std::move(value), charge, Segment::Window});
+        window_bytes += charge;
+        entries.emplace(index, window.begin());
+        trim();
+    }
+    void erase(size_t index){
+        if(auto found = entries.find(index)){
+            remove(*found);
+        }
+    }
+    void clear(){
+        window.clear();
+        probation.clear();
+        protect.clear();
+        entries.clear();
+        window_bytes = main_bytes = protected_bytes = 0;
+    }
+
+    ObjectCacheMetrics metrics() const{
+        auto m = stats;
+        m.bytes = window_bytes + main_bytes;
+        m.entries = entries.size();
+        m.budget = budget;
+        return m;
+    }
+    void reset_metrics(){
+        stats = ObjectCacheMetrics{};
+    }
+};
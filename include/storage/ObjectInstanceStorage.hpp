@@ -1,8 +1,9 @@
 #pragma once
 
-#include <deque>
+#include <bit>
+#include <array>
+#include <memory>
 #include <vector>
-#include <map>
 
 #include <storage/StorageUtils.hpp>
 #include <storage/IntervalMap.hpp>
@@ -18,179 +19,222 @@ Two different implementations:
 
 
 //where to keep all the instances
-//two pools: one we allocate the range, another is where we allocate single instance
-template<typename T, AllocationPattern A = AllocationPattern::Default, size_t MAX_OBJS = std::numeric_limits<size_t>::max()>
+//indexes are dense like object indexes, a directory indexed by index >> SLAB_BITS points to slabs
+//of SLAB_SIZE contiguous slots, so get() is one lookup in the directory and one in the slab.
+//the directory grows to the largest index, slabs are allocated on first use and released when empty
+template<typename T, size_t MAX_OBJS = std::numeric_limits<size_t>::max()>
 //requires CSerializableFixedSize<T>
 class ObjectInstanceStorage{
-    class ObjectInstanceRange{
-        size_t range_start;
-        size_t size;
-        std::deque<T> instance_vector;
-        std::vector<bool> deleted;
-    public:
-        bool operator==(const ObjectInstanceRange &other) const {
-            return range_start == other.range_start && size == other.size;
-        }
-        ObjectInstanceRange(size_t range_start, size_t range_end):
-                            range_start(range_start), size(range_end - range_start + 1) {}
-        bool has(size_t index) const{
-            return (index < size) && (deleted.size() <= index || !deleted[index]);
-        }
-        void del(size_t index){
-            del_range(index, index);
+    static constexpr size_t SLAB_BITS = 8;
+    static constexpr size_t SLAB_SIZE = 1UL << SLAB_BITS;
+    static constexpr size_t SLAB_MASK = SLAB_SIZE - 1;
+
+    //contiguous slots, objects are constructed in place
+    class ObjectInstanceSlab{
+        static constexpr size_t WORD_BITS = 64;
+        size_t alive{0};
+        T *slots;
+        std::array<uint64_t, SLAB_SIZE / WORD_BITS> alive_bits{};
+
+        bool is_alive(size_t index) const{
+            return (alive_bits[index / WORD_BITS] >> (index % WORD_BITS)) & 1;
         }
-        void del_range(size_t start, size_t end){
-            ASSERT_ON(start > end);
-            ASSERT_ON(end >= size);
-            if(end == size - 1){
-                instance_vector.erase(instance_vector.begin() + start, instance_vector.end());
+        //alive bits of word w within [start, end]
+        static uint64_t word_mask(size_t w, size_t start, size_t end){
+            uint64_t mask = ~0ULL;
+            if(w == start / WORD_BITS){
+                mask &= ~0ULL << (start % WORD_BITS);
             }
-            if(deleted.size() <= end){
-                deleted.resize(end + 1, false);
-            }
-            for(size_t i = start; i <= end; i++){
-                deleted[i] = true;
-                auto tmpobj{std::move(instance_vector[i])};
+            if(w == end / WORD_BITS){
+                mask &= ~0ULL >> (WORD_BITS - 1 - end % WORD_BITS);
             }
+            return mask;
         }
-        void add(size_t index, T &&t){
-            auto ret_lambda = [t = std::forward<T>(t)](size_t, size_t){ return t; };
-            add_range(index, index, ret_lambda);
+    public:
+        ObjectInstanceSlab(): slots(std::allocator<T>{}.allocate(SLAB_SIZE)) {}
+        ObjectInstanceSlab(const ObjectInstanceSlab &) = delete;
+        ObjectInstanceSlab &operator=(const ObjectInstanceSlab &) = delete;
+        ~ObjectInstanceSlab(){
+            clear();
+            std::allocator<T>{}.deallocate(slots, SLAB_SIZE);
         }
-        template<typename F>
-        void add(size_t index, F &f){
-            add_range(index, index, f);
+
+        size_t size_alive() const{
+            return alive;
+        }
+        T *get(size_t index){
+            return is_alive(index) ? slots + index : nullptr;
         }
+        //result of f() is constructed directly in the slot, alive object is replaced
         template<typename F>
-        void add_range(size_t start, size_t end, F &f){
-            ASSERT_ON(start > end);
-            ASSERT_ON(end >= size);
-            if(deleted.size() <= end){
-                deleted.resize(end + 1, false);
+        T &emplace_with(size_t index, F &&f){
+            ASSERT_ON(index >= SLAB_SIZE);
+            if(is_alive(index)){
+                destroy(index);
             }
-            //size=0, [2, 3]: [0],[1]; [2],[3]
-            //size=0, [0, 2]: tmp_end=0; [0],[1],[2]; end=0;
-            //size=0, [0, 3]: tmp_end=0; [0],[1],[2],[3];
-            //size=1, [0, 3]: tmp_end=1; [1],[2],[3]; end=0
-            if(instance_vector.size() < start){
-                //if we haven't allocated up to this range yet, do it in one go
-                for(size_t i = instance_vector.size(); i < start; i++){
-                    instance_vector.emplace_back(f(range_start, i));
-                    deleted[i] = false;
-                }
-            } else {
-                if(instance_vector.size() < end - 1) {
-                    //fill the tail
-                    auto tmp_end = instance_vector.size();
-                    for(size_t i = tmp_end; i <= end; i++){
-                        instance_vector.emplace_back(f(range_start, i));
-                        deleted[i] = false;
+            T *t = ::new (static_cast<void *>(slots + index)) T(f());
+            alive_bits[index / WORD_BITS] |= 1ULL << (index % WORD_BITS);
+            alive++;
+            return *t;
+        }
+        void destroy(size_t index){
+            destroy_range(index, index);
+        }
+        //[start, end], a word of slots at a time
+        void destroy_range(size_t start, size_t end){
+            ASSERT_ON(start > end);
+            ASSERT_ON(end >= SLAB_SIZE);
+            for(size_t w = start / WORD_BITS; w <= end / WORD_BITS; w++){
+                uint64_t mask = word_mask(w, start, end);
+                uint64_t bits = alive_bits[w] & mask;
+                alive -= std::popcount(bits);
+                alive_bits[w] &= ~mask;
+                if constexpr(!std::is_trivially_destructible_v<T>){
+                    for(; bits != 0; bits &= bits - 1){
+                        std::destroy_at(slots + w * WORD_BITS + std::countr_zero(bits));
                     }
-                    if(tmp_end == 0)
-                        return;
-                    end = tmp_end - 1; //what if start = tmp_end = 0, end = 1 => expected 0 done after
                 }
             }
-            for(size_t i = start; i <= end; i++){
-                instance_vector[i] == std::move(f(range_start, i));
-                deleted[i] = false;
-            }
         }
-        std::pair<bool, T*> get(size_t index){
-            if(has(index)){
-                return std::make_pair(true, &instance_vector[index]);
-            } else {
-                return std::make_pair(false, nullptr);
+        bool any_alive(size_t start, size_t end) const{
+            for(size_t w = start / WORD_BITS; w <= end / WORD_BITS; w++){
+                if(alive_bits[w] & word_mask(w, start, end)){
+                    return true;
+                }
             }
+            return false;
         }
         void clear(){
-            instance_vector.clear();
-            deleted.clear();
+            if(alive != 0){
+                destroy_range(0, SLAB_SIZE - 1);
+            }
         }
     };
-    std::map<size_t, T> instance_map; //for single operations
-    IntervalMap<size_t, ObjectInstanceRange> instance_range; //for ranges operations: [start, end] -> (dequeue, size)
-    static constexpr size_t RANGE_THRESHOLD = 8;
+
+    std::vector<std::unique_ptr<ObjectInstanceSlab>> slabs; //by index >> SLAB_BITS, nullptr if empty
+    IntervalMap<size_t, bool> instance_range; //[start, end] of add_range(), overlapping and adjacent ones merged
+
+    ObjectInstanceSlab *find_slab(size_t index) const{
+        size_t s = index >> SLAB_BITS;
+        return s < slabs.size() ? slabs[s].get() : nullptr;
+    }
+    ObjectInstanceSlab &alloc_slab(size_t index){
+        ASSERT_ON(index >= MAX_OBJS);
+        size_t s = index >> SLAB_BITS;
+        if(s >= slabs.size()){
+            slabs.resize(std::bit_ceil(s + 1));
+        }
+        if(!slabs[s]){
+            slabs[s] = std::make_unique<ObjectInstanceSlab>();
+        }
+        return *slabs[s];
+    }
+    //calls f(slab, first, last) for allocated slabs in [start, end], first and last are slab offsets
+    template<typename F>
+    void for_each_slab(size_t start, size_t end, F &&f){
+        if(slabs.empty()){
+            return;
+        }
+        size_t last_slab = std::min(end >> SLAB_BITS, slabs.size() - 1);
+        for(size_t s = start >> SLAB_BITS; s <= last_slab; s++){
+            if(slabs[s]){
+                size_t first = s == (start >> SLAB_BITS) ? start & SLAB_MASK : 0;
+                size_t last = s == (end >> SLAB_BITS) ? end & SLAB_MASK : SLAB_MASK;
+                f(slabs[s], first, last);
+            }
+        }
+    }
+    bool any_alive(size_t start, size_t end){
+        bool found = false;
+        for_each_slab(start, end, [&](auto &slab, size_t first, size_t last){
+            found = found || slab->any_alive(first, last);
+        });
+        return found;
+    }
+    //ranges overlapping or adjacent to [start, end]
+    auto neighbour_ranges(size_t start, size_t end) const{
+        return instance_range.intersecting(start == 0 ? start : start - 1,
+                                           end == std::numeric_limits<size_t>::max() ? end : end + 1);
+    }
+    //one range over [start, end] and all of its neighbour ranges, objects stay in their slots
+    void merge_ranges(size_t start, size_t end){
+        std::vector<std::pair<size_t, size_t>> merged;
+        size_t lo = start, hi = end;
+        for(auto &[iv_start, iv]: neighbour_ranges(start, end)){
+            merged.emplace_back(iv_start, iv.first);
+            lo = std::min(lo, iv_start);
+            hi = std::max(hi, iv.first);
+        }
+        if(merged.size() == 1 && lo == merged[0].first && hi == merged[0].second){
+            //already covered by one range
+            return;
+        }
+        for(auto [iv_start, iv_end]: merged){
+            instance_range.del(iv_start, iv_end);
+        }
+        instance_range.insert(lo, hi, true);
+    }
 public:
     ObjectInstanceStorage(){}
+    ObjectInstanceStorage(const ObjectInstanceStorage &) = delete;
+    ObjectInstanceStorage(ObjectInstanceStorage &&) = default;
+
+    //creates f(start, index - start) for every index in [start, end], existing objects are replaced.
+    //overlapping and adjacent ranges are merged into one
     template<typename F>
-    void add_range(size_t start, size_t end, F &f){
-        auto size = end - start + 1;
-        if(instance_range.has(start, end)){
-            //TODO for all ranges in between, extend all current ranges and merge them into one
-            //handle simple case where we have only one 
-            //TODO visitor to merge ranges together
-            //extend existing range
-            ASSERT_ON(true);
-        } else if(size < RANGE_THRESHOLD){
-            for(size_t i = start; i <= end; i++){
-                auto [it, inserted] = instance_map.emplace(i, f(start, i - start));
-                ASSERT_ON(!inserted);
+    void add_range(size_t start, size_t end, F &&f){
+        ASSERT_ON(start > end);
+        merge_ranges(start, end);
+        for(size_t i = start; i <= end;){
+            auto &slab = alloc_slab(i);
+            size_t last = std::min(end, i | SLAB_MASK);
+            for(; i <= last; i++){
+                slab.emplace_with(i & SLAB_MASK, [&]{ return f(start, i - start); });
             }
-        } else {
-            ObjectInstanceRange ir{start, end};
-            ir.add_range(0, size - 1, f);
-            instance_range.insert(start, end, std::move(ir));
         }
     }
+    //existing object is replaced
     void add(size_t index, T &&t){
-        auto iv_result = instance_range.find(index);
-        if(iv_result.found()){
-            auto &v = iv_result.value();
-            auto [iv_start, iv_end] = iv_result.range();
-            size_t iv_index = index - iv_start;
-            v.add(iv_index, std::forward<T>(t));
-        } else {
-            auto [it, inserted] = instance_map.emplace(index, std::forward<T>(t));
-            ASSERT_ON(!inserted);
-        }
+        alloc_slab(index).emplace_with(index & SLAB_MASK, [&]{ return std::move(t); });
     }
     void del(size_t index){
         del_range(index, index);
     }
+    //slabs and ranges left without objects are released
     void del_range(size_t start, size_t end){
-        for(size_t i = start; i <= end; i++){
-            auto iv_result = instance_range.find(i);
-            if(iv_result.found()){
-                auto &v = iv_result.value();
-                auto [iv_start, iv_end] = iv_result.range();
-                size_t iv_index = i - iv_start;
-                v.del_range(iv_index, std::min(end, iv_end) - iv_start);
-                i = iv_end; //skip found range
+        ASSERT_ON(start > end);
+        for_each_slab(start, end, [](auto &slab, size_t first, size_t last){
+            slab->destroy_range(first, last);
+            if(slab->size_alive() == 0){
+                slab.reset();
             }
-            auto it = instance_map.find(i);
-            if(it != instance_map.end()){
-                instance_map.erase(it);
+        });
+        std::vector<std::pair<size_t, size_t>> emptied;
+        for(auto &[iv_start, iv]: instance_range.intersecting(start, end)){
+            if(!any_alive(iv_start, iv.first)){
+                emptied.emplace_back(iv_start, iv.first);
             }
         }
+        for(auto [iv_start, iv_end]: emptied){
+            instance_range.del(iv_start, iv_end);
+        }
     }
     std::pair<bool, T *> get(size_t index) {
-        auto it = instance_map.find(index);
-        if(it != instance_map.end()){
-            return std::make_pair(true, &it->second);
-        }
-        auto iv_result = instance_range.find(index);
-        if(iv_result.found()){
-            auto &v = iv_result.value();
-            auto [iv_start, iv_end] = iv_result.range();
-            size_t iv_index = index - iv_start;
-            return v.get(iv_index);
-        }
-        return std::make_pair(false, nullptr);
+        auto *slab = find_slab(index);
+        T *t = slab ? slab->get(index & SLAB_MASK) : nullptr;
+        return std::make_pair(t != nullptr, t);
     }
     bool has(size_t index) {
-        auto it = instance_map.find(index);
-        if(it != instance_map.end()){
-            return true;
-        }
-        auto iv_result = instance_range.find(index);
-        if (iv_result.found()) {
-            auto &v = iv_result.value();
-            auto [iv_start, iv_end] = iv_result.range();
-            size_t iv_index = index - iv_start;
-            return v.has(iv_index);
-        }
-        return false;
+        return get(index).first;
+    }
+    //number of ranges
+    size_t ranges() const{
+        return instance_range.size();
+    }
+    //destroys all objects, slabs are released at once
+    void clear(){
+        slabs.clear();
+        instance_range.clear();
     }
 };
 
@@ -56,12 +56,10 @@ concept CObjectStorage = requires(const T &t, T &t2, const U &u, const U &u2,
     //requires COSForEachIndexCallable<FI, T>;
 };
 
-constexpr uint32_t ObjectStorageMagic = 0x0B13C787;
-
 template<CSerializable T, template<typename, typename, size_t> typename ObjectStorageImpl,
     CStorage Storage, size_t MAX_OBJS = std::numeric_limits<size_t>::max()>
 requires CObjectStorage<ObjectStorageImpl<T, Storage, MAX_OBJS>, T, Storage, MAX_OBJS>
-using ObjectStorage = AutoStoredObject<TypedObject<ObjectStorageImpl<T, Storage, MAX_OBJS>, ObjectStorageMagic>, Storage, (1UL << 20)>;
+using ObjectStorage = AutoStoredObject<TypedObject<ObjectStorageImpl<T, Storage, MAX_OBJS>>, Storage, (1UL << 20)>;
 
 
 //TODO ObjexctStorage.cpp to test basic functionaliy without any assumptions on object origin and storage format.
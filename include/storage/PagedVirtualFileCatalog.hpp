@@ -0,0 +1,385 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include <storage/VirtualFileCatalog.hpp>
+
+/*
+Paged catalog - sorted catalog entries split into pages of up to PAGE_ENTRIES, every page stored
+at its own StorageAddress. Root keeps the dictionary of string keys and the first key of every page
+(a two-level B+ tree), so opening the catalog reads only the root.
+Pages are read on first access, changed pages are written back by sync(), clean pages stay untouched.
+Entries are ordered as in SimpleMultiLevelKeyMap, strings by value.
+*/
+template <CStorage Storage, CSerializable Value, CSerializable ...Keys>
+    requires std::is_default_constructible_v<Value>
+class PagedMultiLevelKeyMap{
+    using Codec = CatalogKeyCodec<Keys...>;
+public:
+    static constexpr std::string_view TYPE_NAME = "PagedVirtualFileCatalog";
+    static constexpr size_t LEVELS = sizeof...(Keys);
+    //page is split in two when it grows over it
+    static constexpr size_t PAGE_ENTRIES = 512;
+    using Key = typename Codec::Key;
+    template <size_t I>
+    using LevelKey = typename Codec::template LevelKey<I>;
+private:
+    using StoredKey = typename Codec::StoredKey;
+    template <size_t N>
+    using StoredPrefix = typename Codec::template StoredPrefix<N>;
+    using Entry = std::pair<StoredKey, Value>;
+
+    //sorted entries of one page
+    struct PageEntries{
+        std::vector<Entry> entries;
+
+        Result serializeImpl(StorageBuffer<> &buffer) const {
+            size_t offset = 0;
+            SerializeSequentially(buffer, offset, entries.size());
+            for(auto &e: entries){
+                SerializeSequentially(buffer, offset, e);
+            }
+            return Result::Success;
+        }
+        static PageEntries deserializeImpl(const StorageBufferRO<> &buffer) {
+            PageEntries page;
+            size_t offset = 0;
+            auto buf = buffer;
+            auto [num] = DeserializeSequentially<size_t>(buf, offset);
+            page.entries.reserve(num);
+            for(size_t i = 0; i < num; i++){
+                auto [e] = DeserializeSequentially<Entry>(buf, offset);
+                page.entries.push_back(std::move(e));
+            }
+            return page;
+        }
+        size_t getSizeImpl() const {
+            size_t sum = szeimpl::size(entries.size());
+            for(auto &e: entries){
+                sum += szeimpl::size(e);
+            }
+            return sum;
+        }
+    };
+    struct Page{
+        StoredKey first; //fence, keys of the page are >= first (page 0 takes everything below)
+        StorageAddress address; //empty until the page is written
+        std::unique_ptr<PageEntries> loaded; //nullptr until the page is read
+        bool dirty{false};
+    };
+
+    Storage &storage;
+    Codec codec;
+    std::vector<Page> pages;
+    std::vector<StorageAddress> released; //addresses of removed pages, erased on sync()
+    size_t count{0};
+    bool root_dirty{false};
+
+    PagedMultiLevelKeyMap(Storage &storage, Codec &&codec, std::vector<std::pair<StoredKey, StorageAddress>> &&directory, size_t count):
+        storage(storage), codec(std::move(codec)), count(count) {
+        pages.reserve(directory.size());
+        for(auto &[first, address]: directory){
+            pages.push_back(Page{first, address, nullptr, false});
+        }
+    }
+
+    //page that holds or would hold the key
+    template <size_t N, typename P>
+    size_t find_page(const P &key) const{
+        //first page with a fence above the key, pages before it start at or below the key
+        auto it = std::partition_point(pages.begin() + 1, pages.end(), [&](const Page &p){
+            return codec.template compare<N>(p.first, key) <= 0;
+        });
+        return it - pages.begin() - 1;
+    }
+    //first page that can hold a key with the prefix
+    template <size_t N, typename P>
+    size_t find_first_page(const P &prefix) const{
+        auto it = std::partition_point(pages.begin() + 1, pages.end(), [&](const Page &p){
+            return codec.template compare<N>(p.first, prefix) < 0;
+        });
+        return it - pages.begin() - 1;
+    }
+    std::vector<Entry> &entries(size_t i){
+        auto &page = pages[i];
+        if(!page.loaded){
+            if(page.address.size == 0){
+                page.loaded = std::make_unique<PageEntries>();
+            } else {
+                page.loaded = std::make_unique<PageEntries>(deserialize<PageEntries>(storage, page.address));
+            }
+        }
+        return page.loaded->entries;
+    }
+    //first entry of the page not below the key on N levels
+    template <size_t N, typename P>
+    auto lower_bound(std::vector<Entry> &e, const P &key) const{
+        return std::partition_point(e.begin(), e.end(), [&](const Entry &entry){
+            return codec.template compare<N>(entry.first, key) < 0;
+        });
+    }
+    Value *find(const StoredKey &key){
+        if(pages.empty()){
+            return nullptr;
+        }
+        auto &e = entries(find_page<LEVELS>(key));
+        auto it = lower_bound<LEVELS>(e, key);
+        if(it == e.end() || it->first != key){
+            return nullptr;
+        }
+        return &it->second;
+    }
+    void split(size_t i){
+        auto &e = entries(i);
+        size_t half = e.size() / 2;
+        auto upper = std::make_unique<PageEntries>();
+        upper->entries.assign(std::make_move_iterator(e.begin() + half), std::make_move_iterator(e.end()));
+        e.erase(e.begin() + half, e.end());
+        StoredKey first = upper->entries.front().first;
+        pages.insert(pages.begin() + i + 1, Page{first, StorageAddress{}, std::move(upper), true});
+    }
+    //calls f(const Entry &) for entries with the prefix, until f returns false
+    template <typename F, typename ...Prefix>
+    void scan_stored(F &&f, const Prefix&... prefix){
+        constexpr size_t N = sizeof...(Prefix);
+        StoredPrefix<N> stored;
+        if(pages.empty() || !codec.find_stored(stored, prefix...)){
+            return;
+        }
+        for(size_t i = find_first_page<N>(stored); i < pages.size(); i++){
+            auto &e = entries(i);
+            for(auto it = lower_bound<N>(e, stored); it != e.end(); ++it){
+                if(codec.template compare<N>(it->first, stored) != 0 || !f(*it)){
+                    return;
+                }
+            }
+        }
+    }
+public:
+    PagedMultiLevelKeyMap(Storage &storage): storage(storage) {}
+    PagedMultiLevelKeyMap(const PagedMultiLevelKeyMap &) = delete;
+    PagedMultiLevelKeyMap(PagedMultiLevelKeyMap &&) = default;
+
+    size_t size() const{
+        return count;
+    }
+    //pages read from the storage or created since open
+    size_t loaded_pages() const{
+        return std::count_if(pages.begin(), pages.end(), [](const Page &p){ return p.loaded != nullptr; });
+    }
+    size_t page_count() const{
+        return pages.size();
+    }
+    //existing entry is kept
+    Result add(const Keys&... keys, const Value &value){
+        auto stored = codec.intern(keys...);
+        if(pages.empty()){
+            pages.push_back(Page{stored, StorageAddress{}, std::make_unique<PageEntries>(), true});
+        }
+        size_t i = find_page<LEVELS>(stored);
+        auto &e = entries(i);
+        auto it = lower_bound<LEVELS>(e, stored);
+        if(it != e.end() && it->first == stored){
+            return Result::Success;
+        }
+        e.emplace(it, stored, value);
+        count++;
+        pages[i].dirty = true;
+        root_dirty = true;
+        if(e.size() > PAGE_ENTRIES){
+            split(i);
+        }
+        return Result::Success;
+    }
+    bool has(const Keys&... keys){
+        return get(keys...).first;
+    }
+    std::pair<bool, Value> get(const Keys&... keys){
+        StoredKey stored;
+        Value *v = codec.find_stored(stored, keys...) ? find(stored) : nullptr;
+        if(v == nullptr){
+            return std::make_pair(false, Value{});
+        }
+        return std::make_pair(true, *v);
+    }
+    //replaces value of an existing entry
+    Result set(const Keys&... keys, const Value &value){
+        StoredKey stored;
+        Value *v = codec.find_stored(stored, keys...) ? find(stored) : nullptr;
+        if(v == nullptr){
+            return Result::Failure;
+        }
+        *v = value;
+        pages[find_page<LEVELS>(stored)].dirty = true;
+        return Result::Success;
+    }
+    void del(const Keys&... keys){
+        StoredKey stored;
+        if(pages.empty() || !codec.find_stored(stored, keys...)){
+            return;
+        }
+        size_t i = find_page<LEVELS>(stored);
+        auto &e = entries(i);
+        auto it = lower_bound<LEVELS>(e, stored);
+        if(it == e.end() || it->first != stored){
+            return;
+        }
+        e.erase(it);
+        count--;
+        pages[i].dirty = true;
+        root_dirty = true;
+        if(e.empty() && pages.size() > 1){
+            if(pages[i].address.size != 0){
+                released.push_back(pages[i].address);
+            }
+            pages.erase(pages.begin() + i);
+        }
+    }
+
+    //keys of the next level under the prefix in key order, i.e. folder listing
+    template <typename ...Prefix>
+    std::vector<LevelKey<sizeof...(Prefix)>> list(const Prefix&... prefix){
+        constexpr size_t I = sizeof...(Prefix);
+        static_assert(I < LEVELS, "prefix has to leave at least one level");
+        std::vector<LevelKey<I>> keys;
+        Key key;
+        const Entry *last = nullptr;
+        scan_stored([&](const Entry &e){
+            if(last == nullptr || std::get<I>(last->first) != std::get<I>(e.first)){
+                codec.template set_key<I>(key, std::get<I>(e.first));
+                keys.push_back(std::get<I>(key));
+            }
+            last = &e;
+            return true;
+        }, prefix...);
+        return keys;
+    }
+    //calls f(const Key &, const Value &) in key order for every entry under the prefix, reads only pages of the prefix
+    template <typename F, typename ...Prefix>
+    void scan(F &&f, const Prefix&... prefix){
+        static_assert(sizeof...(Prefix) <= LEVELS);
+        Key key;
+        scan_stored([&](const Entry &e){
+            codec.decode(key, e.first);
+            f(static_cast<const Key &>(key), e.second);
+            return true;
+        }, prefix...);
+    }
+
+    //writes changed pages, returns whether the root changed since the last sync() and has to be serialized
+    bool sync(){
+        for(auto &page: pages){
+            if(page.dirty){
+                auto address = page.address;
+                sze::serialize(*page.loaded, storage, page.address);
+                //page outgrew its address and was moved, root has to point to the new one
+                if(page.address.addr != address.addr || page.address.size != address.size){
+                    root_dirty = true;
+                }
+                page.dirty = false;
+            }
+        }
+        for(auto &address: released){
+            storage.erase(address);
+        }
+        released.clear();
+        return std::exchange(root_dirty, false);
+    }
+    //drops clean pages from memory, they are read again on next access
+    void release(){
+        for(auto &page: pages){
+            if(!page.dirty){
+                page.loaded.reset();
+            }
+        }
+    }
+
+    //root: fingerprint, [dictionary if there are string keys], count, (first key, address) of every page
+    Result serializeImpl(StorageBuffer<> &buffer) const {
+        //pages are written by sync(), serialize is const
+        ASSERT_ON(std::any_of(pages.begin(), pages.end(), [](const Page &p){ return p.dirty; }));
+        size_t offset = 0;
+        SerializeSequentially(buffer, offset, make_magic<PagedMultiLevelKeyMap>());
+        if constexpr(Codec::INTERNED){
+            SerializeSequentially(buffer, offset, codec.dict);
+        }
+        SerializeSequentially(buffer, offset, count, pages.size());
+        for(auto &page: pages){
+            SerializeSequentially(buffer, offset, page.first, page.address);
+        }
+        return Result::Success;
+    }
+    static PagedMultiLevelKeyMap deserializeImpl(const StorageBufferRO<> &buffer, Storage &storage) {
+        size_t offset = 0;
+        auto buf = buffer;
+        auto [magic] = DeserializeSequentially<uint64_t>(buf, offset);
+        if(magic != make_magic<PagedMultiLevelKeyMap>()){
+            throw std::invalid_argument("Incorrect magic for expected type " + std::string{type_name<PagedMultiLevelKeyMap>()});
+        }
+        Codec codec;
+        if constexpr(Codec::INTERNED){
+            auto [dict] = DeserializeSequentially<StringDictionary>(buf, offset);
+            codec.dict = std::move(dict);
+        }
+        auto [count, num] = DeserializeSequentially<size_t, size_t>(buf, offset);
+        std::vector<std::pair<StoredKey, StorageAddress>> directory;
+        directory.reserve(num);
+        for(size_t i = 0; i < num; i++){
+            auto [first, address] = DeserializeSequentially<StoredKey, StorageAddress>(buf, offset);
+            directory.emplace_back(std::move(first), address);
+        }
+        return PagedMultiLevelKeyMap{storage, std::move(codec), std::move(directory), count};
+    }
+    static PagedMultiLevelKeyMap deserializeImpl(const StorageBufferRO<> &) { throw std::bad_function_call(); }
+    size_t getSizeImpl() const {
+        size_t sum = szeimpl::size(uint64_t{});
+        if constexpr(Codec::INTERNED){
+            sum += szeimpl::size(codec.dict);
+        }
+        sum += szeimpl::size(count) + szeimpl::size(pages.size());
+        for(auto &page: pages){
+            sum += szeimpl::size(page.first) + szeimpl::size(page.address);
+        }
+        return sum;
+    }
+};
+
+//catalog opened from its anchor address, changed pages and the root are written back on sync() and destruction.
+//anchor holds the address of the root, so it stays in place when the root is moved
+template <CStorage Storage, CSerializable Value, CSerializable ...Keys>
+class PagedVirtualFileCatalog{
+    using Map = PagedMultiLevelKeyMap<Storage, Value, Keys...>;
+    Storage &storage;
+    StorageAddress anchor;
+    StorageAddress root;
+    Map map;
+public:
+    //new catalog
+    PagedVirtualFileCatalog(Storage &storage): storage(storage), map(storage) {
+        sync();
+    }
+    //existing catalog, only the root is read
+    PagedVirtualFileCatalog(const StorageAddress &anchor, Storage &storage):
+        storage(storage), anchor(anchor), root(deserialize<StorageAddress>(storage, anchor)),
+        map(deserialize<Map>(storage, root, storage)) {}
+    PagedVirtualFileCatalog(const PagedVirtualFileCatalog &) = delete;
+    ~PagedVirtualFileCatalog(){
+        sync();
+    }
+
+    Map &get(){ return map; }
+    const StorageAddress &address() const{
+        return anchor;
+    }
+    void sync(){
+        if(map.sync() || root.size == 0){
+            auto old_root = root;
+            serialize(storage, map, root);
+            if(root.addr != old_root.addr || anchor.size == 0){
+                serialize(storage, root, anchor);
+            }
+        }
+    }
+};
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+#include <storage/Utils.hpp>
+#include <storage/StorageUtils.hpp>
+#include <storage/DataStorage.hpp>
+#include <storage/Serialize.hpp>
+#include <storage/TypeFingerprint.hpp>
+
+/*
+Persistent pointers - links between stored objects, kept as (storage id, address) and swizzled
+into an in-memory pointer on first dereference. PPtrTable owns the loaded objects, one instance
+per (storage id, address), so every pointer to an object gets the same instance and loading a
+graph with cycles terminates: loading an object reads its PPtr members without following them.
+sync() writes modified objects back one by one, PPtr members are written in persistent form,
+so cycles are not followed on write either. release() writes and drops every object, pointers
+held outside of the table are swizzled again on next use.
+
+Objects keep their address for life, links to them are stored in other objects. make() reserves
+space for growth, an object which outgrows its address asserts on sync().
+Objects with PPtr members get the table in deserializeImpl(buffer, PPtrTable<Storage> &).
+Not thread safe.
+*/
+
+template<CStorage Storage>
+class PPtrTable;
+
+template<typename T, CStorage Storage>
+class PPtr{
+    PPtrTable<Storage> *table{nullptr};
+    uint32_t storage_id{0};
+    StorageAddress address;
+    //swizzled pointer, valid while generation matches the table
+    mutable T *ptr{nullptr};
+    mutable uint64_t generation{0};
+
+    T *swizzle() const{
+        if(ptr == nullptr || generation != table->generation()) [[unlikely]]{
+            ASSERT_ON(table == nullptr || address.is_null());
+            ptr = table->template load<T>(storage_id, address);
+            generation = table->generation();
+        }
+        return ptr;
+    }
+public:
+    PPtr() {}
+    PPtr(PPtrTable<Storage> &table, uint32_t storage_id, const StorageAddress &address, T *ptr = nullptr):
+            table(&table), storage_id(storage_id), address(address), ptr(ptr), generation(table.generation()) {}
+
+    bool is_null() const { return address.is_null(); }
+    bool is_swizzled() const { return ptr != nullptr && table != nullptr && generation == table->generation(); }
+    uint32_t getStorageID() const { return storage_id; }
+    const StorageAddress &getAddress() const { return address; }
+
+    const T &get() const { return *swizzle(); }
+    //marks the object modified, it is written on next sync
+    T &get(){
+        T *t = swizzle();
+        table->touch(storage_id, address);
+        return *t;
+    }
+    const T &operator*() const { return get(); }
+    const T *operator->() const { return swizzle(); }
+
+    //same object, not necessarily the same table
+    bool operator==(const PPtr &other) const{
+        return storage_id == other.storage_id && address.addr == other.address.addr;
+    }
+
+    Result serializeImpl(StorageBuffer<> &buffer) const {
+        size_t offset = 0;
+        return SerializeSequentially(buffer, offset, storage_id, address);
+    }
+    static PPtr deserializeImpl(const StorageBufferRO<> &buffer, PPtrTable<Storage> &table) {
+        auto ptr = deserializeImpl(buffer);
+        ptr.table = &table;
+        return ptr;
+    }
+    //without a table, can not be dereferenced
+    static PPtr deserializeImpl(const StorageBufferRO<> &buffer) {
+        size_t offset = 0;
+        auto buf = buffer;
+        auto [storage_id, address] = DeserializeSequentially<uint32_t, StorageAddress>(buf, offset);
+        PPtr ptr;
+        ptr.storage_id = storage_id;
+        ptr.address = address;
+        return ptr;
+    }
+    size_t getSizeImpl() const {
+        return szeimpl::size(storage_id) + szeimpl::size(address);
+    }
+};
+
+template<CStorage Storage>
+class PPtrTable{
+    struct Key{
+        uint32_t storage_id;
+        uint64_t addr;
+        bool operator==(const Key &other) const = default;
+    };
+    struct KeyHash{
+        size_t operator()(const Key &k) const{
+            return std::hash<uint64_t>{}(k.addr * 31 + k.storage_id);
+        }
+    };
+    struct Entry{
+        void *object;
+        uint64_t type;
+        StorageAddress address;
+        bool modified;
+        void (*destroy)(void *object);
+        void (*write)(Storage &storage, const StorageAddress &address, const void *object);
+    };
+    std::unordered_map<uint32_t, Storage *> storages;
+    std::unordered_map<Key, Entry, KeyHash> objects;
+    uint64_t current_generation{1};
+
+    template<typename T>
+    static void destroy(void *object){
+        delete static_cast<T *>(object);
+    }
+    template<typename T>
+    static void write(Storage &storage, const StorageAddress &address, const void *object){
+        const T &t = *static_cast<const T *>(object);
+        ASSERT_ON_MSG(szeimpl::size(t) > address.size, "object outgrew its address");
+        auto buffer = storage.writeb(address);
+        szeimpl::s(t, buffer);
+        storage.commit(buffer);
+    }
+    template<typename T>
+    T *read(Storage &storage, const StorageAddress &address){
+        if constexpr(CDeserializableImpl1<T, PPtrTable &>){
+            return new T{deserialize<T>(storage, address, *this)};
+        } else {
+            return new T{deserialize<T>(storage, address)};
+        }
+    }
+    template<typename T>
+    T *insert(uint32_t storage_id, const StorageAddress &address, T *t, bool modified){
+        objects.emplace(Key{storage_id, address.addr}, Entry{t, type_name_fingerprint<T>(), address, modified, &destroy<T>, &write<T>});
+        return t;
+    }
+    void clear(){
+        for(auto &[key, e]: objects){
+            e.destroy(e.object);
+        }
+        objects.clear();
+    }
+public:
+    PPtrTable() {}
+    PPtrTable(const PPtrTable &) = delete;
+    //modified objects are not written, sync() explicitly
+    ~PPtrTable(){
+        clear();
+    }
+
+    //storage id as stored in PPtr, e.g. its id in StorageManager
+    void attach(uint32_t storage_id, Storage &storage){
+        storages[storage_id] = &storage;
+    }
+    Storage &storage(uint32_t storage_id){
+        auto it = storages.find(storage_id);
+        ASSERT_ON_MSG(it == storages.end(), "storage is not attached");
+        return *it->second;
+    }
+    //changes on release(), pointers swizzled before are stale
+    uint64_t generation() const { return current_generation; }
+    size_t loaded() const { return objects.size(); }
+
+    //new object with space for reserve bytes, written on next sync
+    template<typename T>
+    PPtr<T, Storage> make(uint32_t storage_id, T t, size_t reserve = 0){
+        auto address = storage(storage_id).get_random_address(std::max(szeimpl::size(t), reserve));
+        T *ptr = insert(storage_id, address, new T{std::move(t)}, true);
+        return PPtr<T, Storage>{*this, storage_id, address, ptr};
+    }
+    //object at address, read on first use
+    template<typename T>
+    T *load(uint32_t storage_id, const StorageAddress &address){
+        auto it = objects.find(Key{storage_id, address.addr});
+        if(it != objects.end()){
+            ASSERT_ON_MSG(it->second.type != type_name_fingerprint<T>(), "object has another type");
+            return static_cast<T *>(it->second.object);
+        }
+        return insert(storage_id, address, read<T>(storage(storage_id), address), false);
+    }
+    void touch(uint32_t storage_id, const StorageAddress &address){
+        auto it = objects.find(Key{storage_id, address.addr});
+        ASSERT_ON(it == objects.end());
+        it->second.modified = true;
+    }
+
+    //writes modified objects, returns how many
+    size_t sync(){
+        size_t written = 0;
+        for(auto &[key, e]: objects){
+            if(e.modified){
+                e.write(storage(key.storage_id), e.address, e.object);
+                e.modified = false;
+                written++;
+            }
+        }
+        return written;
+    }
+    //writes modified objects and unloads everything
+    size_t release(){
+        size_t written = sync();
+        clear();
+        current_generation++;
+        return written;
+    }
+};
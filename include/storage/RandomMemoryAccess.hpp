@@ -74,6 +74,17 @@ public:
 #ifdef __APPLE__
         ::lseek(fd, MAX_FILESIZE, SEEK_SET);
         ::write(fd, " ", 1);
+#else
+        //accessing mmap beyond EOF raises SIGBUS, grow the file sparsely up front
+        struct stat st;
+        if(::fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) < MAX_FILESIZE){
+            if(::ftruncate(fd, MAX_FILESIZE) != 0){
+                int e = errno;
+                LOG_ERROR("Failed to resize file %s with %s", filename.c_str(), strerror(e));
+                ::close(fd);
+                return Result::Failure;
+            }
+        }
 #endif
         //MAP_PRIVATE to enable Huge Pages
         membase = ::mmap(0, MAX_FILESIZE, PROT_READ | PROT_WRITE, MAP_FILE | MAP_SHARED | MAP_AUTOGROW, fd, 0);
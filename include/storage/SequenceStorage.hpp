@@ -0,0 +1,391 @@
+#pragma once
+
+#include <span>
+#include <iterator>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+#include <storage/Utils.hpp>
+#include <storage/StorageUtils.hpp>
+#include <storage/DataStorage.hpp>
+#include <storage/SerializeImpl.hpp>
+#include <storage/Serialize.hpp>
+#include <storage/FixedSizeObjectStorage.hpp>
+
+/*
+Sequence storage - append-only sequence of fixed-size records, addressed by index.
+Records are stored in chunks of CHUNK_BYTES, chunk c keeps records [c * CHUNK_RECORDS, (c + 1) * CHUNK_RECORDS).
+Index -> chunk is a division, no per-record metadata.
+
+Optional key (e.g. timestamp), non-decreasing in append order. In memory there is a zone map with min/max key
+of every chunk and every SPARSE_STRIDE-th key. Seek by key finds the chunk in the zone map (interpolation for
+arithmetic keys, then binary search), then searches at most SPARSE_STRIDE records of that chunk.
+A key range query reads only the chunks holding matching records.
+*/
+
+//no key, seek only by index
+struct SequenceNoKey{
+    template<typename T>
+    uint64_t operator()(const T &) const { return 0; }
+};
+
+template<CFixedSizeObject T, CStorage Storage, typename KeyF = SequenceNoKey, size_t CHUNK_BYTES = (1UL << 20)>
+class SequenceStorage{
+    static constexpr bool IN_PLACE = CInPlaceObject<T>;
+    static constexpr bool HAS_KEY = !std::is_same_v<KeyF, SequenceNoKey>;
+public:
+    using Key = std::invoke_result_t<KeyF, const T &>;
+    static constexpr size_t TSize = fixed_object_size<T>();
+    //chunks start at TAlign aligned memory, records are accessed in place
+    static constexpr size_t TAlign = IN_PLACE ? alignof(T) : 1;
+    static constexpr size_t CHUNK_RECORDS = CHUNK_BYTES / TSize;
+    static constexpr size_t SPARSE_STRIDE = 256;
+    static_assert(CHUNK_RECORDS > 0, "record doesn't fit in a chunk");
+
+    struct Zone{
+        Key min;
+        Key max;
+    };
+    //records of one chunk matching a query, in place
+    struct ChunkSpan{
+        size_t first; //index of records[0]
+        std::span<const T> records;
+    };
+    class RangeIterator;
+    class Range;
+private:
+    Storage &storage;
+    std::vector<StorageAddress> chunks;
+    std::vector<Zone> zones; //of every chunk
+    std::vector<Key> sparse_keys; //key of record i * SPARSE_STRIDE
+    size_t count{0};
+
+    //writable tail chunk, committed on flush() or when the next chunk is started
+    StorageBuffer<> tail;
+    bool tail_dirty{false};
+
+    SequenceStorage(Storage &storage, std::vector<StorageAddress> &&chunks, std::vector<Zone> &&zones,
+                    std::vector<Key> &&sparse_keys, size_t count):
+        storage(storage), chunks(std::move(chunks)), zones(std::move(zones)), sparse_keys(std::move(sparse_keys)),
+        count(count) {}
+
+    StorageAddress alloc_chunk(){
+        size_t size = CHUNK_RECORDS * TSize;
+        auto addr = storage.get_random_address(size + TAlign - 1);
+        //map the whole chunk at once, records are appended in place
+        initialize_zero(storage, addr);
+        //memory is never moved, so the padding stays valid after reopen
+        auto ptr = reinterpret_cast<uintptr_t>(storage.readb(addr).get());
+        return addr.subrange((TAlign - ptr % TAlign) % TAlign, size);
+    }
+    StorageBuffer<> &tail_buffer(){
+        size_t c = count / CHUNK_RECORDS;
+        if(c == chunks.size()){
+            flush();
+            chunks.push_back(alloc_chunk());
+            tail = storage.writeb(chunks.back());
+        } else if(tail.get() == nullptr){
+            tail = storage.writeb(chunks[c]);
+        }
+        return tail;
+    }
+    void write_record(void *dst, const T &t){
+        if constexpr (IN_PLACE){
+            memcpy(dst, &t, TSize);
+        } else {
+            StorageBuffer<> buf{dst, TSize, TSize};
+            szeimpl::s(t, buf);
+        }
+    }
+    static T read_record(const void *src){
+        if constexpr (IN_PLACE){
+            T t;
+            memcpy(&t, src, TSize);
+            return t;
+        } else {
+            return szeimpl::d<T>(StorageBufferRO<>{src, TSize});
+        }
+    }
+    //before the record is written, so a rejected record leaves no trace
+    void add_key(const T &t){
+        if constexpr (HAS_KEY){
+            Key key = KeyF{}(t);
+            ASSERT_ON(count != 0 && key < zones.back().max); //keys must not decrease
+            if(count % SPARSE_STRIDE == 0){
+                sparse_keys.push_back(key);
+            }
+            if(count % CHUNK_RECORDS == 0){
+                zones.push_back(Zone{key, key});
+            } else {
+                zones.back().max = key;
+            }
+        }
+    }
+    static Key key_at(const StorageBufferRO<> &buf, size_t offset){
+        if constexpr (IN_PLACE){
+            return KeyF{}(*static_cast<const T *>(buf.get(offset * TSize)));
+        } else {
+            return KeyF{}(read_record(buf.get(offset * TSize)));
+        }
+    }
+    //records of chunk c, tail chunk is committed first so checksummed storages verify it
+    StorageBufferRO<> chunk_buffer(size_t c){
+        if(tail_dirty && c == chunks.size() - 1){
+            flush();
+        }
+        return storage.readb(chunks[c]);
+    }
+public:
+    SequenceStorage(Storage &storage, [[maybe_unused]] const StorageAddress &base): SequenceStorage(storage) {}
+    SequenceStorage(Storage &storage): storage(storage) {}
+    SequenceStorage(const SequenceStorage &) = delete;
+    SequenceStorage(SequenceStorage &&other):
+        storage(other.storage), chunks(std::move(other.chunks)), zones(std::move(other.zones)),
+        sparse_keys(std::move(other.sparse_keys)), count(other.count), tail(other.tail), tail_dirty(other.tail_dirty) {
+        other.tail_dirty = false;
+    }
+    ~SequenceStorage(){
+        flush();
+    }
+
+    size_t size() const{
+        return count;
+    }
+
+    //returns index of the record
+    size_t append(const T &t){
+        add_key(t);
+        auto &buf = tail_buffer();
+        write_record(buf.get((count % CHUNK_RECORDS) * TSize), t);
+        tail_dirty = true;
+        return count++;
+    }
+    //returns index of the first record
+    size_t append_range(std::span<const T> ts){
+        size_t first = count;
+        size_t i = 0;
+        while(i < ts.size()){
+            auto &buf = tail_buffer();
+            size_t offset = count % CHUNK_RECORDS;
+            size_t n = std::min(ts.size() - i, CHUNK_RECORDS - offset);
+            if constexpr (IN_PLACE && !HAS_KEY){
+                memcpy(buf.get(offset * TSize), ts.data() + i, n * TSize);
+                count += n;
+            } else {
+                for(size_t j = 0; j < n; j++, count++){
+                    add_key(ts[i + j]);
+                    write_record(buf.get((offset + j) * TSize), ts[i + j]);
+                }
+            }
+            tail_dirty = true;
+            i += n;
+        }
+        return first;
+    }
+    //commit appended records
+    void flush(){
+        if(tail_dirty){
+            storage.commit(tail);
+            tail_dirty = false;
+            //next append takes the buffer again, so checksummed storages see the change
+            tail = StorageBuffer<>{};
+        }
+    }
+
+    T get(size_t index){
+        ASSERT_ON(index >= count);
+        auto buf = chunk_buffer(index / CHUNK_RECORDS);
+        return read_record(buf.get((index % CHUNK_RECORDS) * TSize));
+    }
+
+    //calls f(index, const T &) for records [start, end), chunk by chunk.
+    //for in-place records the reference points to the storage memory
+    template<typename F>
+    void scan(size_t start, size_t end, F &&f){
+        end = std::min(end, count);
+        for(size_t i = start; i < end;){
+            size_t c = i / CHUNK_RECORDS;
+            auto buf = chunk_buffer(c);
+            size_t chunk_end = std::min(end, (c + 1) * CHUNK_RECORDS);
+            for(; i < chunk_end; i++){
+                const void *src = buf.get((i % CHUNK_RECORDS) * TSize);
+                if constexpr (IN_PLACE){
+                    f(i, *static_cast<const T *>(src));
+                } else {
+                    f(i, read_record(src));
+                }
+            }
+            storage.commit(buf);
+        }
+    }
+
+    //first chunk with max key >= key, number of chunks if there is none
+    size_t find_chunk(const Key &key) const requires HAS_KEY {
+        size_t lo = 0, hi = zones.size();
+        if constexpr (std::is_arithmetic_v<Key>){
+            //keys like timestamps grow roughly linearly, a few interpolation steps narrow the search
+            for(size_t step = 0; step < 4 && hi - lo > 16; step++){
+                const Key &first = zones[lo].max, &last = zones[hi - 1].max;
+                size_t mid = lo;
+                if(key > last){
+                    mid = hi - 1;
+                } else if(key > first){
+                    double frac = static_cast<double>(key - first) / static_cast<double>(last - first);
+                    mid = std::min(hi - 1, lo + static_cast<size_t>(frac * (hi - 1 - lo)));
+                }
+                if(zones[mid].max < key){
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+        }
+        while(lo < hi){
+            size_t mid = lo + (hi - lo) / 2;
+            if(zones[mid].max < key){
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    //index of the first record with key >= key, size() if there is none.
+    //reads at most one chunk, the one holding the result
+    size_t lower_bound(const Key &key) requires HAS_KEY {
+        size_t c = find_chunk(key);
+        if(c == chunks.size()){
+            return count;
+        }
+        if(!(zones[c].min < key)){
+            return c * CHUNK_RECORDS;
+        }
+        //result is in chunk c, inside the sparse block before the first sparse key >= key
+        auto it = std::lower_bound(sparse_keys.begin(), sparse_keys.end(), key);
+        size_t block = it - sparse_keys.begin() - 1;
+        size_t lo = std::max(block * SPARSE_STRIDE, c * CHUNK_RECORDS);
+        size_t hi = std::min({(block + 1) * SPARSE_STRIDE, (c + 1) * CHUNK_RECORDS, count});
+        auto buf = chunk_buffer(c);
+        while(lo < hi){
+            size_t mid = lo + (hi - lo) / 2;
+            if(key_at(buf, mid % CHUNK_RECORDS) < key){
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        storage.commit(buf);
+        return lo;
+    }
+    //chunks with records in key range [from, to), iterated as ChunkSpan
+    Range query(const Key &from, const Key &to) requires (HAS_KEY && IN_PLACE) {
+        size_t start = lower_bound(from);
+        size_t end = std::max(start, lower_bound(to));
+        return Range{*this, start, end};
+    }
+    //calls f(index, const T &) for records with key in [from, to)
+    template<typename F>
+    void scan_keys(const Key &from, const Key &to, F &&f) requires HAS_KEY {
+        size_t start = lower_bound(from);
+        size_t end = lower_bound(to);
+        scan(start, end, std::forward<F>(f));
+    }
+
+    /* Serialize */
+
+    Result serializeImpl(StorageBuffer<> &buffer) const {
+        //appended records must be committed, serialize is const
+        ASSERT_ON(tail_dirty);
+        size_t offset = 0;
+        return SerializeSequentially(buffer, offset, count, chunks, zones, sparse_keys);
+    }
+    static SequenceStorage deserializeImpl(const StorageBufferRO<> &buffer, Storage &storage) {
+        size_t offset = 0;
+        auto buf = buffer;
+        auto [count, chunks, zones, sparse_keys] =
+            DeserializeSequentially<size_t, std::vector<StorageAddress>, std::vector<Zone>, std::vector<Key>>(buf, offset);
+        return SequenceStorage{storage, std::move(chunks), std::move(zones), std::move(sparse_keys), count};
+    }
+    static SequenceStorage deserializeImpl(const StorageBufferRO<> &) { throw std::bad_function_call(); };
+
+    size_t getSizeImpl() const {
+        return SizeAccumulate(count, chunks, zones, sparse_keys);
+    }
+};
+
+//yields one ChunkSpan per chunk, a chunk is read when the iterator reaches it
+template<CFixedSizeObject T, CStorage Storage, typename KeyF, size_t CHUNK_BYTES>
+class SequenceStorage<T, Storage, KeyF, CHUNK_BYTES>::RangeIterator{
+    SequenceStorage *seq;
+    size_t index;
+    size_t end;
+    ChunkSpan current;
+
+    void load(){
+        if(index >= end){
+            return;
+        }
+        size_t c = index / CHUNK_RECORDS;
+        size_t n = std::min(end, (c + 1) * CHUNK_RECORDS) - index;
+        auto buf = seq->chunk_buffer(c);
+        //mapping is never moved, the span outlives the buffer
+        current = ChunkSpan{index, std::span<const T>{buf.template get<T>((index % CHUNK_RECORDS) * TSize), n}};
+        seq->storage.commit(buf);
+    }
+public:
+    using value_type = ChunkSpan;
+    using difference_type = std::ptrdiff_t;
+
+    RangeIterator(): seq(nullptr), index(0), end(0), current{} {}
+    RangeIterator(SequenceStorage &seq, size_t start, size_t end): seq(&seq), index(start), end(end), current{} {
+        load();
+    }
+
+    const ChunkSpan &operator*() const{
+        return current;
+    }
+    const ChunkSpan *operator->() const{
+        return &current;
+    }
+    RangeIterator &operator++(){
+        index += current.records.size();
+        load();
+        return *this;
+    }
+    RangeIterator operator++(int){
+        auto it = *this;
+        ++*this;
+        return it;
+    }
+    bool operator==(std::default_sentinel_t) const{
+        return index >= end;
+    }
+};
+
+template<CFixedSizeObject T, CStorage Storage, typename KeyF, size_t CHUNK_BYTES>
+class SequenceStorage<T, Storage, KeyF, CHUNK_BYTES>::Range{
+    SequenceStorage &seq;
+    size_t start;
+    size_t finish;
+public:
+    Range(SequenceStorage &seq, size_t start, size_t finish): seq(seq), start(start), finish(finish) {}
+
+    //[first(), last()) record indexes
+    size_t first() const{
+        return start;
+    }
+    size_t last() const{
+        return finish;
+    }
+    size_t size() const{
+        return finish - start;
+    }
+    RangeIterator begin() const{
+        return RangeIterator{seq, start, finish};
+    }
+    std::default_sentinel_t end() const{
+        return {};
+    }
+};
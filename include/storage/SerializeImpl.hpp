@@ -6,6 +6,8 @@
 
 #include <storage/Utils.hpp>
 #include <storage/StorageUtils.hpp>
+#include <storage/TypeFingerprint.hpp>
+#include <storage/Arena.hpp>
 
 //#include <ObjectStorage.hpp>
 
@@ -72,6 +74,10 @@ concept CSerializableImpl = requires(const T &t, StorageBuffer<> &buffer,
     //{ T::deserializeImpl(ro_buffer, auto...) } -> std::same_as<T>;
 };
 
+//serialized form is the object representation, so it can be copied or used at its storage memory
+template<typename T>
+concept CInPlaceObject = std::is_trivially_copyable_v<T> && !CSerializableImpl<T>;
+
 template<typename T>
 concept CBuiltinSerializable = (std::is_same_v<T, std::string>
                                 || std::is_same_v<T, std::vector<bool>>
@@ -145,6 +151,13 @@ T d(const StorageBufferRO<U> &buffer, Args& ...args) {
         deserializeImpl(buffer.template cast<void>(), std::forward<Args &>(args)...).getObj();
 }
 
+//deserialize with all allocator-aware containers allocated from resource
+template<typename T, typename U, typename ...Args>
+T d(std::pmr::memory_resource *resource, const StorageBufferRO<U> &buffer, Args& ...args) {
+    DeserializeResourceScope scope{resource};
+    return d<T>(buffer, args...);
+}
+
 }
 
 /****************************************************/
@@ -167,8 +180,8 @@ constexpr size_t SizeAccumulate(const T &t){
 }
 
 template <CSerializable T, CSerializable ...Args>
-constexpr size_t SizeAccumulate(const T &t, Args... args){
-    return szeimpl::size(t) + SizeAccumulate(std::forward<Args>(args)...);
+constexpr size_t SizeAccumulate(const T &t, const Args &... args){
+    return szeimpl::size(t) + SizeAccumulate(args...);
 };
 
 template <CSerializable T>
@@ -178,7 +191,7 @@ Result SerializeOne(const StorageBuffer<> &buffer, size_t &offset, const T &t){
 }
 
 template <CSerializable ...Args>
-Result SerializeSequentially(const StorageBuffer<> &buffer, size_t &offset, Args... args){
+Result SerializeSequentially(const StorageBuffer<> &buffer, size_t &offset, const Args &... args){
     auto res = (SerializeOne(buffer, offset, args),...);
     return res;
 };
@@ -195,5 +208,6 @@ T DeserializeOne(StorageBufferRO<> &buf, size_t &offset, Args &... args){
 
 template <CSerializable ...Args, typename ...Args2>
 std::tuple<Args...> DeserializeSequentially(StorageBufferRO<> &buf, size_t &offset, Args2 &... args){
-    return std::make_tuple(DeserializeOne<Args>(buf, offset, std::forward<Args2 &>(args)...)...);
+    //braced init to force left-to-right evaluation order of DeserializeOne
+    return std::tuple<Args...>{DeserializeOne<Args>(buf, offset, std::forward<Args2 &>(args)...)...};
 };
@@ -8,6 +8,8 @@
 #include <bit>
 #include <ranges>
 #include <algorithm>
+#include <stdexcept>
+#include <string>
 
 #include <storage/SerializeImpl.hpp>
 
@@ -193,6 +195,44 @@ static U instantiate_from_tuple(T &&t){
     return instantiate_from_tuple_impl<U>(std::forward<T>(t), std::make_index_sequence<std::tuple_size<T>::value>());
 }
 
+//tuple of references to the fields of an aggregate, up to 8 fields
+template<typename T>
+requires std::is_aggregate_v<std::remove_cv_t<T>>
+constexpr auto aggregate_tie(T &t){
+    constexpr size_t N = fingerprint_detail::aggregate_field_count<std::remove_cv_t<T>>();
+    static_assert(N >= 1 && N <= 8, "aggregate_tie supports 1 to 8 fields");
+    if constexpr (N == 1){
+        auto &[a] = t;
+        return std::tie(a);
+    } else if constexpr (N == 2){
+        auto &[a, b] = t;
+        return std::tie(a, b);
+    } else if constexpr (N == 3){
+        auto &[a, b, c] = t;
+        return std::tie(a, b, c);
+    } else if constexpr (N == 4){
+        auto &[a, b, c, d] = t;
+        return std::tie(a, b, c, d);
+    } else if constexpr (N == 5){
+        auto &[a, b, c, d, e] = t;
+        return std::tie(a, b, c, d, e);
+    } else if constexpr (N == 6){
+        auto &[a, b, c, d, e, f] = t;
+        return std::tie(a, b, c, d, e, f);
+    } else if constexpr (N == 7){
+        auto &[a, b, c, d, e, f, g] = t;
+        return std::tie(a, b, c, d, e, f, g);
+    } else {
+        auto &[a, b, c, d, e, f, g, h] = t;
+        return std::tie(a, b, c, d, e, f, g, h);
+    }
+}
+//std::tuple<Fields...> of an aggregate
+template<typename ...F>
+std::tuple<std::remove_cvref_t<F>...> aggregate_fields_impl(std::tuple<F...>);
+template<typename T>
+using aggregate_fields_t = decltype(aggregate_fields_impl(aggregate_tie(std::declval<T &>())));
+
 /******************/
 
 template<CSerializable ...TArgs>
@@ -402,11 +442,19 @@ template<typename T>
 requires sized_forward_range<T> && CSerializable<std::ranges::range_value_t<T>>
 class BuiltinDeserializeImpl<T>: public BSIObjectWrapperDeserialize<T>{
     using U = std::ranges::range_value_t<T>;
+public:
+    static T make_container(){
+        if constexpr (CPmrAllocatorAware<T>){
+            return T{deserialize_resource()};
+        } else {
+            return T{};
+        }
+    }
 public:
     T getObj() const {
         size_t offset = 0;
         StorageBufferRO buf = this->buffer;
-        T r;
+        T r = make_container();
 
         auto [size] = DeserializeSequentially<std::ranges::range_size_t<T>>(buf, offset);
         
@@ -418,3 +466,96 @@ public:
         return r;
     }
 };
+
+/****************************************************/
+
+/*
+Versioned schema block:
+[SchemaHeader][field 0 size][field 0]...[field N-1 size][field N-1]
+
+Fields are only appended in newer versions, never reordered or removed.
+Reader of an older block gets default-constructed values for fields it doesn't have,
+reader of a newer block skips trailing fields it doesn't know by their size.
+Whole blocks can be skipped by header size without deserializing anything.
+Blocks are told apart by stable_type_fingerprint<T>(), version of T is T::SCHEMA_VERSION.
+*/
+struct SchemaHeader{
+    uint64_t fingerprint;
+    uint32_t version;
+    uint32_t fields;
+    uint64_t size; //payload size, not including header
+};
+using SchemaFieldSize = uint64_t;
+
+template <typename T>
+constexpr uint32_t schema_version(){
+    if constexpr (requires { { T::SCHEMA_VERSION } -> std::convertible_to<uint32_t>; }){
+        return T::SCHEMA_VERSION;
+    } else {
+        return 0;
+    }
+}
+
+template <typename T, CSerializable ...Args>
+size_t SchemaSize(const Args&... args){
+    return sizeof(SchemaHeader) + (0 + ... + (sizeof(SchemaFieldSize) + szeimpl::size(args)));
+}
+
+template <typename T, CSerializable ...Args>
+Result SerializeSchema(const StorageBuffer<> &buffer, size_t &offset, uint32_t version, const Args&... args){
+    SchemaHeader header{stable_type_fingerprint<T>(), version, sizeof...(Args), SchemaSize<T>(args...) - sizeof(SchemaHeader)};
+    Result res = SerializeOne(buffer, offset, header);
+    auto field = [&](const auto &arg){
+        Result size_res = SerializeOne(buffer, offset, SchemaFieldSize{szeimpl::size(arg)});
+        if(SerializeOne(buffer, offset, arg) != Result::Success || size_res != Result::Success){
+            res = Result::Failure;
+        }
+    };
+    (field(args), ...);
+    return res;
+}
+
+static inline SchemaHeader PeekSchema(const StorageBufferRO<> &buf){
+    return szeimpl::d<SchemaHeader>(buf);
+}
+
+//skip whole block without deserializing it
+static inline SchemaHeader SkipSchema(StorageBufferRO<> &buf, size_t &offset){
+    auto header = PeekSchema(buf);
+    size_t new_offset = 0;
+    buf = buf.advance_offset(new_offset, sizeof(SchemaHeader) + header.size);
+    offset += new_offset;
+    return header;
+}
+
+//args are passed to deserializeImpl of every field
+template <typename T, CSerializable ...Fields, typename ...Args>
+std::tuple<SchemaHeader, Fields...> DeserializeSchema(StorageBufferRO<> &buf, size_t &offset, Args& ...args){
+    auto header = PeekSchema(buf);
+    if(header.fingerprint != stable_type_fingerprint<T>()){
+        LOG_ERROR("Schema fingerprint mismatch %lx != %lx", header.fingerprint, stable_type_fingerprint<T>());
+        throw std::invalid_argument(std::string{"Schema fingerprint mismatch for "} + std::string{type_name<T>()});
+    }
+    size_t block_offset = sizeof(SchemaHeader);
+    auto block = buf.offset(0, sizeof(SchemaHeader) + header.size);
+    uint32_t index = 0;
+    auto field = [&]<typename U>() -> U{
+        if(index++ >= header.fields){
+            if constexpr (std::is_default_constructible_v<U>){
+                return U{}; //written by older version
+            } else {
+                throw std::invalid_argument(std::string{"Schema field missing for "} + std::string{type_name<T>()});
+            }
+        }
+        auto size = *block.template get<SchemaFieldSize>(block_offset);
+        block_offset += sizeof(SchemaFieldSize);
+        auto field_buf = block.offset_advance(block_offset, size);
+        return szeimpl::d<U>(field_buf, args...);
+    };
+    std::tuple<SchemaHeader, Fields...> t{header, field.template operator()<Fields>()...};
+
+    //fields written by newer version are skipped together with the block
+    SkipSchema(buf, offset);
+    return t;
+}
+
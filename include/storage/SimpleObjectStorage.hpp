@@ -1,5 +1,7 @@
 #pragma once
 
+#include <span>
+
 #include <storage/Utils.hpp>
 #include <storage/StorageUtils.hpp>
 #include <storage/StorageHelpers.hpp>
@@ -7,6 +9,7 @@
 #include <storage/SerializeImpl.hpp>
 #include <storage/Serialize.hpp>
 #include <storage/ObjectStorage.hpp>
+#include <storage/ObjectCache.hpp>
 
 
 //Implements CObjectStorageImpl
@@ -14,18 +17,21 @@
 template<typename T, typename Storage, size_t MAX_OBJS = std::numeric_limits<size_t>::max()>
 requires CStorage<Storage, T>
 class SimpleObjectStorage{
+    //first field of the serialized storage, bumped on every layout change
+    static constexpr uint32_t SOS_MAGIC = 0x50B5E003;
+
     Storage &storage;
     StorageAddress base;
-    StorageAddress tail_addr;
+    StorageAddress tail_addr; //unused rest of base, new objects are allocated from it
 
-    struct ObjState{
-        T obj;
-        ObjectStorageAccess access;
-    };
-    std::unordered_map<size_t, T> objects;
+    //Keep and getRef(). not bounded like cache: references to kept objects escape and changes
+    //made through them live only here, so objects stay until release() writes them back
+    IndexCache<T> objects;
+    ObjectCache<T> cache{DEFAULT_CACHE_SIZE}; //Caching and getShared()
     std::vector<bool> states;
-    std::unordered_map<size_t, StorageAddress> addresses;
+    ChunkedArray<StorageAddress> addresses; //by index, null if there is no object
     SetOrderedBySize<StorageAddress> unused_addresses;
+    std::map<uint64_t, size_t> batches; //extents written by put_range(), each is mapped as a whole
     size_t count;
     //max_obj_index
 
@@ -43,21 +49,32 @@ class SimpleObjectStorage{
         tail_addr = tail_addr.offset(size);
         return new_addr;
     }
+    bool hasAddr(size_t index) const{
+        return index < addresses.size() && !addresses[index].is_null();
+    }
     StorageAddress getAddrByIndex(size_t index){
-        auto it = addresses.find(index);
-        ASSERT_ON(it == addresses.end());
-        return it->second;
+        ASSERT_ON(!hasAddr(index));
+        return addresses[index];
     }
     void allocAddr(size_t index, const StorageAddress &addr){
-        addresses.emplace(index, addr);
+        if(index >= addresses.size()){
+            addresses.resize(index + 1);
+        }
+        addresses[index] = addr;
     }
     void delAddr(size_t index){
-        addresses.erase(index);
+        addresses[index].reset();
+    }
+    size_t countAddr() const{
+        size_t n = 0;
+        for(size_t i = 0; i < addresses.size(); i++){
+            n += !addresses[i].is_null();
+        }
+        return n;
     }
     StorageAddress allocAddrForIndex(size_t index, size_t size){
-        auto it = addresses.find(index);
-        if(it != addresses.end()){
-            auto old_addr = it->second;
+        if(hasAddr(index)){
+            auto old_addr = addresses[index];
             if(size < old_addr.size){
                 return old_addr;
             }
@@ -87,6 +104,13 @@ class SimpleObjectStorage{
         return index;
     }
     
+    static size_t cacheCharge(const T &t){
+        if constexpr (CInPlaceObject<T>){
+            return sizeof(T);
+        } else {
+            return sizeof(T) + sze::getSize<T>(t);
+        }
+    }
     void putImpl(const T &t, size_t index, bool check_index){
         if((check_index && !has(index)) || !check_index){
             count++;
@@ -97,18 +121,34 @@ class SimpleObjectStorage{
         serialize<StorageAddress>(storage, t, addr);
         //no need to keep in .object
     }
-    SimpleObjectStorage(Storage &storage, StorageAddress base, std::vector<bool> &&states,
-                        std::unordered_map<size_t, StorageAddress> addresses, SetOrderedBySize<StorageAddress> unused_addresses):
-        storage(storage), base(base), states(states), 
-        addresses(addresses), unused_addresses(unused_addresses), count{addresses.size()} {}
+    //end of the put_range() extent containing addr, or addr itself
+    uint64_t batchEnd(uint64_t addr) const{
+        auto it = batches.upper_bound(addr);
+        if(it == batches.begin()){
+            return addr;
+        }
+        it--;
+        return std::max(addr, it->first + it->second);
+    }
+    SimpleObjectStorage(Storage &storage, StorageAddress base, StorageAddress tail_addr, std::vector<bool> &&states,
+                        ChunkedArray<StorageAddress> &&addresses, SetOrderedBySize<StorageAddress> &&unused_addresses,
+                        std::map<uint64_t, size_t> &&batches):
+        storage(storage), base(base), tail_addr(tail_addr), states(std::move(states)),
+        addresses(std::move(addresses)), unused_addresses(std::move(unused_addresses)), batches(std::move(batches)),
+        count{countAddr()} {
+        //states are stored padded to 64 bits, new indexes continue after the last address
+        this->states.resize(this->addresses.size());
+    }
 public:
     SimpleObjectStorage(Storage &storage, const StorageAddress &base):
         storage(storage), base(base), tail_addr(base), count{0} {}
     SimpleObjectStorage(Storage &storage):
         SimpleObjectStorage(storage, storage.template get_random_address(DEFAULT_ALLOC_SIZE)) {}
 
+    static constexpr std::string_view TYPE_NAME = "SimpleObjectStorage";
     static constexpr ObjectStorageAccess DefaultAccess = ObjectStorageAccess::Once;
     static constexpr size_t DEFAULT_ALLOC_SIZE = (1UL << 20);
+    static constexpr size_t DEFAULT_CACHE_SIZE = (1UL << 24);
     bool has(size_t index) const {
         if (index >= states.size()){
             return false;
@@ -122,9 +162,11 @@ public:
     template <ObjectStorageAccess Access = DefaultAccess>
     T get(size_t index){
         ASSERT_ON(!has(index));
-        auto it = objects.find(index);
-        if (it != objects.end()){
-            return it->second;
+        if (auto cached = objects.find(index)){
+            return *cached;
+        }
+        if constexpr (Access == ObjectStorageAccess::Caching){
+            return *getShared(index);
         }
         auto addr = getAddrByIndex(index);
         auto t = deserialize<T>(storage, addr);
@@ -144,22 +186,60 @@ public:
     template <ObjectStorageAccess Access = DefaultAccess>
     T &getRef(size_t index){
         ASSERT_ON(!has(index));
-        auto it = objects.find(index);
-        if (it != objects.end()){
-            return it->second;
+        if (auto cached = objects.find(index)){
+            return *cached;
         }
         count++;
         setState(index, true);
+        cache.erase(index); //object becomes mutable
         auto addr = getAddrByIndex(index);
         auto t = deserialize<T>(storage, addr);
-        auto [it2, emplaced] = objects.emplace(index, t); //ideally we should add it to tmp_objects. question would be it's lifetime
+        auto [cached, emplaced] = objects.emplace(index, t); //ideally we should add it to tmp_objects. question would be it's lifetime
         //TODO throw if !emplaced
-        return it2->second;
+        return *cached;
     }
     template <ObjectStorageAccess Access = DefaultAccess>
     const T &getCRef(size_t index){
         return getRef<Access>(index);
     }
+    //immutable instance shared by all readers, kept in the bounded cache.
+    //objects kept with Keep/getRef() are returned as a snapshot and not cached
+    std::shared_ptr<const T> getShared(size_t index){
+        ASSERT_ON(!has(index));
+        if (auto kept = objects.find(index)){
+            return std::make_shared<const T>(*kept);
+        }
+        if (auto cached = cache.find(index)){
+            return cached;
+        }
+        auto t = std::make_shared<const T>(deserialize<T>(storage, getAddrByIndex(index)));
+        cache.insert(index, t, cacheCharge(*t));
+        return t;
+    }
+    //write a kept object back to storage and drop it, references from getRef() become invalid
+    void release(size_t index){
+        if(auto kept = objects.find(index)){
+            putImpl(*kept, index, true);
+            count -= objects.erase(index);
+        }
+    }
+    void release(size_t start, size_t end){
+        for(size_t i = start; i <= end; i++){
+            release(i);
+        }
+    }
+    size_t kept() const{
+        return objects.size();
+    }
+    void set_cache_size(size_t bytes){
+        cache.set_budget(bytes);
+    }
+    ObjectCacheMetrics cache_metrics() const{
+        return cache.metrics();
+    }
+    void reset_cache_metrics(){
+        cache.reset_metrics();
+    }
 
     void clear(size_t i){
         if(!has(i)){
@@ -167,10 +247,11 @@ public:
         }
         size_t count_erased = objects.erase(i);
         count -= count_erased;
+        cache.erase(i);
         setState(i, false);
-        auto it = addresses.find(i);
-        unused_addresses.add(it->second.size, it->second);
-        addresses.erase(it);
+        auto addr = getAddrByIndex(i);
+        unused_addresses.add(addr.size, addr);
+        delAddr(i);
     }
     void clear(size_t start, size_t end){
         for(size_t i = start; i <= end; i++){
@@ -186,11 +267,93 @@ public:
     template <ObjectStorageAccess Access = DefaultAccess>
     void put(const T &t, size_t index){
         objects.erase(index);
+        cache.erase(index);
         putImpl(t, index, true);
         if(Access == ObjectStorageAccess::Keep){
             objects.emplace(index, std::forward<const T &>(t));
         }
     }
+    //put objects at consecutive new indexes, returns index of the first one.
+    //all objects are serialized into one extent with a single writeb()
+    template <ObjectStorageAccess Access = DefaultAccess>
+    size_t put_range(std::span<const T> ts){
+        size_t first = states.size();
+        ASSERT_ON(first + ts.size() > MAX_OBJS);
+        if(ts.empty()){
+            return first;
+        }
+        size_t total = 0;
+        for(const auto &t: ts){
+            total += sze::getSize<T>(t);
+        }
+        auto range = getNewAddress(total);
+        auto buffer = storage.writeb(range);
+        if constexpr (CInPlaceObject<T>){
+            memcpy(buffer.get(), ts.data(), total);
+        }
+        addresses.resize(first + ts.size());
+        size_t offset = 0;
+        for(size_t i = 0; i < ts.size(); i++){
+            size_t size = sze::getSize<T>(ts[i]);
+            auto addr = range.subrange(offset, size);
+            auto buf = buffer.offset_advance(offset, size);
+            if constexpr (!CInPlaceObject<T>){
+                szeimpl::s(ts[i], buf);
+            }
+            addresses[first + i] = addr;
+            if(Access == ObjectStorageAccess::Keep){
+                objects.emplace(first + i, ts[i]);
+            }
+        }
+        storage.commit(buffer);
+        batches.emplace(range.addr, range.size);
+        states.resize(first + ts.size(), true);
+        count += ts.size();
+        return first;
+    }
+    //write existing objects from [start, end] to out, returns number of objects.
+    //objects stored next to each other in one put_range() extent are read with a single readb()
+    template<typename OutputIt>
+    size_t get_range(size_t start, size_t end, OutputIt out){
+        size_t found = 0;
+        size_t i = start;
+        while(i <= end){
+            if(!has(i)){
+                i++;
+                continue;
+            }
+            //extend the run while addresses are contiguous and inside one mapped extent
+            auto run = getAddrByIndex(i);
+            auto run_limit = batchEnd(run.addr);
+            size_t run_end = i;
+            while(run_end < end && has(run_end + 1)){
+                auto next = getAddrByIndex(run_end + 1);
+                if(next.addr != run.addr + run.size || next.addr + next.size > run_limit){
+                    break;
+                }
+                run.size += next.size;
+                run_end++;
+            }
+            auto buffer = storage.readb(run);
+            size_t offset = 0;
+            found += run_end - i + 1;
+            for(; i <= run_end; i++){
+                size_t size = CInPlaceObject<T> ? sizeof(T) : getAddrByIndex(i).size;
+                auto buf = buffer.offset_advance(offset, size);
+                if(auto cached = objects.find(i)){
+                    *out++ = *cached;
+                } else if constexpr (CInPlaceObject<T>){
+                    T t;
+                    memcpy(&t, buf.get(), sizeof(T));
+                    *out++ = t;
+                } else {
+                    *out++ = szeimpl::d<T>(buf);
+                }
+            }
+            storage.commit(buffer);
+        }
+        return found;
+    }
     /*
     template <ObjectStorageAccess Access = DefaultAccess>
     size_t put(T &&t){
@@ -243,23 +406,28 @@ public:
     /* Serialize */
 
     Result serializeImpl(StorageBuffer<> &buffer) const {
-        Result res = Result::Success;
         size_t offset = 0;
-
-        return SerializeSequentially(buffer, offset, base, states, addresses, unused_addresses);
+        return SerializeSequentially(buffer, offset, SOS_MAGIC, base, tail_addr, states, addresses, unused_addresses, batches);
     }
     static SimpleObjectStorage deserializeImpl(const StorageBufferRO<> &buffer, Storage &storage) {
         size_t offset = 0;
         auto buf = buffer;
-        auto [base, states, addresses, unused_addresses] = DeserializeSequentially<
-                StorageAddress, std::vector<bool>, std::unordered_map<size_t, StorageAddress>, SetOrderedBySize<StorageAddress>
+        auto [magic] = DeserializeSequentially<uint32_t>(buf, offset);
+        if(magic != SOS_MAGIC){
+            LOG_ERROR("SimpleObjectStorage: layout %x doesn't match %x", magic, SOS_MAGIC);
+            throw std::invalid_argument("Incorrect SimpleObjectStorage layout " + std::to_string(magic));
+        }
+        auto [base, tail_addr, states, addresses, unused_addresses, batches] = DeserializeSequentially<
+                StorageAddress, StorageAddress, std::vector<bool>, ChunkedArray<StorageAddress>, SetOrderedBySize<StorageAddress>,
+                std::map<uint64_t, size_t>
             >(buf, offset);
 
-        return SimpleObjectStorage<T, Storage>{storage, base, std::move(states), std::move(addresses), std::move(unused_addresses)};
+        return SimpleObjectStorage{storage, base, tail_addr, std::move(states), std::move(addresses), std::move(unused_addresses),
+            std::move(batches)};
     }
     static SimpleObjectStorage deserializeImpl(const StorageBufferRO<> &) { throw std::bad_function_call(); };
 
     size_t getSizeImpl() const {
-        return SizeAccumulate(base, states, addresses, unused_addresses);
+        return SizeAccumulate(SOS_MAGIC, base, tail_addr, states, addresses, unused_addresses, batches);
     }
 };
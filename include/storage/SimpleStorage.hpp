@@ -1,9 +1,23 @@
 #pragma once
 
 #include <map>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 
 #include <storage/Utils.hpp>
+#include <storage/Arena.hpp>
+#include <storage/Checksum.hpp>
 #include <storage/IntervalMap.hpp>
+#include <storage/ExtentArray.hpp>
+#include <storage/MetadataLog.hpp>
 #include <storage/StorageHelpers.hpp>
 #include <storage/SerializeImpl.hpp>
 #include <storage/DataStorage.hpp>
@@ -15,17 +29,85 @@
     start using -> lookup() -> alloc() -> add to intervals, find new range in empty or at the end
     using -> lookup() -> find in m
     expanding address -> expand() -> allocate new mapping alloc() or expand existing m entry
+
+    deserialized mapping keeps intervals in the serialized buffer(base, sorted extent array) and
+    looks them up in place. Chunk of the base is copied to intervals(overlay) before its key range
+    is modified, after that overlay owns the whole key range of the chunk.
+    Buffer has to outlive the mapping.
+
+    [meta crc][meta size][unmapped, empty, max, extents count][extent array]
 */
 class VirtAddressMapping{
 protected:
-    IntervalMap<uint64_t, size_t> intervals; //addr -> <offset, size>
-    std::map<uint64_t, size_t> unmapped;
-    SetOrderedBySize<size_t, size_t> empty;
+    //all nodes come from one memory resource, usually the storage's MetadataArena
+    PmrIntervalMap<uint64_t, size_t> intervals; //addr -> <offset, size>
+    std::pmr::map<uint64_t, size_t> unmapped;
+    PmrSetOrderedBySize<size_t, size_t> empty;
     std::pair<uint64_t, size_t> max; //virtaddr, offset
 
+    enum ChunkState: uint8_t{
+        Unverified,
+        Verified,
+        Faulted, //moved to intervals
+    };
+    ExtentArrayView base;
+    std::pmr::vector<uint8_t> chunk_state;
+    size_t base_live{0}; //extents in not faulted chunks
+
+    MetadataLog *log{nullptr}; //operations since the snapshot, not serialized
+
+    void journal(MetadataOp op, uint64_t addr, uint64_t size, uint64_t arg = 0){
+        if(log){
+            log->append(op, addr, size, arg);
+        }
+    }
+
     static constexpr size_t MIN_EMPTYSIZE = 16;
     static constexpr size_t UNMAPPED_OFFSET = std::numeric_limits<size_t>::max();
 
+    void verify_chunk(size_t c){
+        if(chunk_state[c] != Unverified){
+            return;
+        }
+        if(!base.verify(c)) [[unlikely]]{
+            LOG_ERROR("VirtAddressMapping: checksum mismatch in extent chunk %lu", c);
+            throw std::runtime_error("VirtAddressMapping: corrupted extent chunk");
+        }
+        chunk_state[c] = Verified;
+    }
+    //base chunk owning key, NO_CHUNK if it is owned by intervals
+    size_t base_chunk(uint64_t key){
+        auto c = base.chunk_of(key);
+        if(c == ExtentArrayView::NO_CHUNK || chunk_state[c] == Faulted){
+            return ExtentArrayView::NO_CHUNK;
+        }
+        verify_chunk(c);
+        return c;
+    }
+    void fault_chunk(size_t c){
+        verify_chunk(c);
+        auto [begin, end] = base.chunk_range(c);
+        for(size_t i = begin; i < end; i++){
+            auto e = base.at(i);
+            auto res = intervals.insert(e.start, e.end, e.offset);
+            ASSERT_ON(res != Result::Success);
+        }
+        base_live -= end - begin;
+        chunk_state[c] = Faulted;
+    }
+    //move all chunks owning [start, end] to intervals before modifying it
+    void fault(uint64_t start, uint64_t end){
+        if(base.size() == 0){
+            return;
+        }
+        auto c_end = base.chunk_of(end);
+        for(auto c = base.chunk_of(start); c <= c_end; c++){
+            if(chunk_state[c] != Faulted){
+                fault_chunk(c);
+            }
+        }
+    }
+
     size_t alloc_offset(size_t addr, size_t size){
         auto advance_offset = [](size_t &offset, size_t size) -> size_t{
                 auto old_offset = offset;
@@ -50,12 +132,32 @@ protected:
     static uint64_t size_from_start_end(uint64_t start, uint64_t end){
         return end - start + 1;
     }
+    size_t alloc_impl(uint64_t addr, size_t size){
+        fault(addr, end_offset(addr, size));
+        size_t offset = alloc_offset(addr, size);
+        auto res = intervals.insert(addr, end_offset(addr, size), offset);
+        ASSERT_ON(res != Result::Success);
+        return offset;
+    }
 public:
     static constexpr size_t DEFAULT_SIZE = 1024 * 1024;
     static constexpr size_t EXTRA_SPARE_SPACE = 1024;
 
+    VirtAddressMapping(std::pmr::memory_resource *resource = deserialize_resource()):
+        intervals(resource), unmapped(resource), empty(resource), max{}, chunk_state(resource) {}
+
     //lookup for mapping addres -> <offset, size>
     std::pair<size_t, size_t> lookup(uint64_t addr, size_t size, bool is_read_only = false) {
+        if(auto c = base_chunk(addr); c != ExtentArrayView::NO_CHUNK){
+            Extent e;
+            ASSERT_ON(!base.find(c, addr, e));
+            ASSERT_ON(e.end < end_offset(addr, size));
+            if(e.offset != UNMAPPED_OFFSET){
+                auto addr_offset = addr - e.start;
+                return std::make_pair(e.offset + addr_offset, size_from_start_end(e.start, e.end) - addr_offset);
+            }
+            fault_chunk(c);
+        }
         auto iv_result = intervals.find(addr);
         ASSERT_ON(!iv_result.found());
         auto [va_start, va_end] = iv_result.range();
@@ -67,6 +169,7 @@ public:
 
         if(mapped_offset == UNMAPPED_OFFSET){
             ASSERT_ON(is_read_only);
+            journal(MetadataOp::Lookup, addr, size);
             mapped_offset = alloc_offset(addr, size);
             iv_result.value() = mapped_offset;
             //map only [iv_start, iv_start + size)
@@ -91,20 +194,22 @@ public:
     }
     //alloc new range
     size_t alloc(uint64_t addr, size_t size){
-        size_t offset = alloc_offset(addr, size);
-        auto res = intervals.insert(addr, end_offset(addr, size), offset);
-        ASSERT_ON(res != Result::Success);
-        return offset;
+        journal(MetadataOp::Alloc, addr, size);
+        return alloc_impl(addr, size);
     }
 
     //when we get new addres, or delete range
     Result alloc_unmapped(uint64_t addr, size_t size){
+        journal(MetadataOp::AllocUnmapped, addr, size);
+        fault(addr, end_offset(addr, size));
         auto res = intervals.insert(addr, end_offset(addr, size), UNMAPPED_OFFSET);
         return res;
     }
 
     //unmap [addr, addr + size]
     Result del(uint64_t addr, size_t size){
+        journal(MetadataOp::Del, addr, size);
+        fault(addr, end_offset(addr, size));
         size_t count = 0;
         auto add_to_empty = [&]([[maybe_unused]] auto iv_result, uint64_t va_start, uint64_t va_end, size_t offset){
             auto va_size = size_from_start_end(va_start, va_end);
@@ -120,35 +225,93 @@ public:
 
         return res;
     }
+    //grow [addr, addr + size) in place, so it stays one extent: unmapped range grows while the next one
+    //is free, mapped range only at the end of the file. Failure if it can not
     Result expand(StorageAddress address, size_t size){
-        //allocate new range with StorageAddress{address.addr + addr.size, size};
-        if(max.first == address.addr + address.size){
-            //expand end of file
-            auto expand_offset = [this](decltype(intervals)::IntervalResult &iv_result, size_t old_end, size_t new_end){
-                if(!iv_result.found()){
-                    return;
-                }
-                auto offset = iv_result.value();
-                auto size = new_end - old_end;
-                offset += size;
-                max.first += size;
-                max.second += size;
-            };
-            auto res = intervals.expand(address.addr, end_offset(address.addr, address.size), expand_offset);
-            RET_ON_SUCCESS(res);
-            //failed to expand, just allocate new
+        journal(MetadataOp::Expand, address.addr, address.size, size);
+        fault(address.addr, end_offset(address.addr, address.size + size));
+        auto iv_result = intervals.find(address.addr);
+        RET_ON_FAIL(!iv_result.found());
+        auto new_end = end_offset(address.addr, address.size + size);
+        if(iv_result.range().second >= new_end){
+            return Result::Success;
+        }
+        bool is_mapped = iv_result.value() != UNMAPPED_OFFSET;
+        RET_ON_FAIL(is_mapped && max.first != address.addr + address.size);
+        auto expand_file = [this, is_mapped](auto &, uint64_t old_end, uint64_t new_end){
+            if(is_mapped){
+                max.first += new_end - old_end;
+                max.second += new_end - old_end;
+            }
+        };
+        return intervals.expand(address.addr, new_end, expand_file);
+    }
+
+    //record all following changes to log, nullptr to stop
+    void set_log(MetadataLog *new_log){
+        log = new_log;
+    }
+    //repeat logged operation, log has to be unset
+    void apply(const MetadataLogRecord &rec){
+        ASSERT_ON(log != nullptr);
+        switch(rec.op){
+        case MetadataOp::Alloc:
+            alloc(rec.addr, rec.size);
+            break;
+        case MetadataOp::AllocUnmapped:
+            alloc_unmapped(rec.addr, rec.size);
+            break;
+        case MetadataOp::Lookup:
+            lookup(rec.addr, rec.size);
+            break;
+        case MetadataOp::Del:
+            del(rec.addr, rec.size);
+            break;
+        case MetadataOp::Expand:
+            expand(StorageAddress{rec.addr, rec.size}, rec.arg);
+            break;
+        default:
+            ASSERT_ON_MSG(true, "not a mapping operation");
         }
-        //otherwise allocane new mapping
-        alloc(address.addr + address.size, size);
-        return Result::Success;
+    }
+
+    size_t extents() const{
+        return base_live + intervals.size();
     }
 
     //only sequential support
     Result serializeImpl(StorageBuffer<> &buffer) const{
         ASSERT_ON(getSizeImpl() > buffer.allocated());
         size_t offset = 0;
-
-        return SerializeSequentially(buffer, offset, intervals, unmapped, empty, max);
+        uint64_t count = extents();
+
+        SerializeSequentially(buffer, offset, uint32_t{0}, uint64_t{0});
+        size_t meta_start = offset;
+        SerializeSequentially(buffer, offset, unmapped, empty, max, count);
+        uint32_t meta_crc = crc32c::value(buffer.get(meta_start), offset - meta_start);
+        size_t header_offset = 0;
+        SerializeSequentially(buffer, header_offset, meta_crc, uint64_t{offset - meta_start});
+
+        //merge not faulted base chunks with intervals, both are sorted and don't overlap
+        size_t i = 0;
+        auto it = intervals.begin();
+        auto next = [&]() -> Extent {
+            while(i < base.size() && chunk_state[i / ExtentArrayView::CHUNK] == Faulted){
+                i = (i / ExtentArrayView::CHUNK + 1) * ExtentArrayView::CHUNK;
+            }
+            if(i < base.size() && (it == intervals.end() || base.at(i).start < it->first)){
+                if(i % ExtentArrayView::CHUNK == 0 && chunk_state[i / ExtentArrayView::CHUNK] == Unverified
+                        && !base.verify(i / ExtentArrayView::CHUNK)) [[unlikely]]{
+                    LOG_ERROR("VirtAddressMapping: checksum mismatch in extent chunk %lu", i / ExtentArrayView::CHUNK);
+                    throw std::runtime_error("VirtAddressMapping: corrupted extent chunk");
+                }
+                return base.at(i++);
+            }
+            Extent e{it->first, it->second.first, it->second.second};
+            it++;
+            return e;
+        };
+        return ExtentArrayView::write(buffer, offset, count, next);
     }
 
     static VirtAddressMapping deserializeImpl(const StorageBufferRO<> &buffer) {
@@ -157,46 +320,99 @@ public:
         size_t offset = 0;
         auto buf = buffer;
 
-        auto [intervals, unmapped, empty, max] = DeserializeSequentially<
-            decltype(vam.intervals), decltype(vam.unmapped), decltype(vam.empty), decltype(vam.max)
+        auto [meta_crc, meta_size] = DeserializeSequentially<uint32_t, uint64_t>(buf, offset);
+        if(meta_size > buffer.size() - offset || crc32c::value(buffer.get(offset), meta_size) != meta_crc){
+            LOG_ERROR("VirtAddressMapping: metadata checksum mismatch");
+            throw std::runtime_error("VirtAddressMapping: corrupted metadata");
+        }
+        auto [unmapped, empty, max, count] = DeserializeSequentially<
+            decltype(vam.unmapped), decltype(vam.empty), decltype(vam.max), uint64_t
         >(buf, offset);
 
-        vam.intervals = intervals;
-        vam.unmapped = unmapped;
-        vam.empty = empty;
+        vam.unmapped = std::move(unmapped);
+        vam.empty = std::move(empty);
         vam.max = max;
 
+        ASSERT_ON(offset + ExtentArrayView::bytes_for(count) > buffer.size());
+        size_t extents_size = count * sizeof(Extent);
+        vam.base = ExtentArrayView{buffer.offset(offset, extents_size),
+            buffer.offset(offset + extents_size, ExtentArrayView::bytes_for(count) - extents_size), count};
+        vam.chunk_state.assign(vam.base.chunks(), Unverified);
+        vam.base_live = count;
+
         return vam;
     }
 
     size_t getSizeImpl() const {
-        size_t size = 0;
-        size += szeimpl::size(intervals);
+        size_t size = szeimpl::size(uint32_t{0}) + szeimpl::size(uint64_t{0});
         size += szeimpl::size(unmapped);
         size += szeimpl::size(empty);
         size += szeimpl::size(max);
+        size += szeimpl::size(uint64_t{0});
+        size += ExtentArrayView::bytes_for(extents());
         return size;
     }
 };
 
-template<CRMA R>
+template<CRMA R, StorageChecksum C = StorageChecksum::Default>
 class SimpleStorage: public DataStorageBase{
     R rma;
 
     //address space => file mapping
-    //mapping -> at the end of the file when close
+    //mapping -> snapshot [mapping][checksums][spare][log] in one range, rewritten when the log is full
+    //changes since the snapshot -> appended to the log on checkpoint()
     //Short metadate in the beginning of the file of fixed size
-    static constexpr uint32_t MAGIC = 0xFE2B0CC7;
+    static constexpr uint32_t MAGIC = 0xFE2B0CCA;
+    static constexpr size_t LOG_MIN_CAPACITY = 512;
+    static constexpr size_t LOG_CAPACITY_RATIO = 4; //log capacity is 1/4 of the snapshot
     struct FileMetadata{
         uint32_t magic;
         RandomAddressRange<> ra;
         size_t va_offset, va_size;
         uint64_t va_addr;
         StorageAddress static_addr;
+        size_t va_used; //serialized mapping + checksums, without spare space
+        uint32_t va_crc; //checksums only, mapping verifies itself
+        size_t log_offset, log_capacity, log_used;
     };
     FileMetadata metadata;
 
-    VirtAddressMapping mapping;
+    MetadataArena arena; //must outlive mapping
+    VirtAddressMapping mapping{arena.resource()};
+    StorageAddress persisted_va; //range of the last snapshot, mapping reads it in place
+    MetadataLog log{arena.resource()};
+    bool journaling{false}; //only when there is a snapshot to replay the log on
+
+    //per-extent checksums: virtual address -> (size, crc32c)
+    //commit() folds the crc of the written range into the extent crc, so only written bytes are hashed.
+    //extents which can't be followed this way (merged with neighbours, several writes in flight,
+    //never committed) are checksummed once per checkpoint over the whole extent
+    enum ExtentState: uint8_t{
+        Unverified, //loaded from the file, verified on first access
+        Verified,   //memory matches crc, skip on readb
+        Committed,  //memory matches crc, not journaled yet
+        Pending,    //write in flight, crc is of the memory before it
+        Dirty,      //crc is stale, computed on checkpoint
+    };
+    struct ExtentChecksum{
+        size_t size;
+        uint32_t crc;
+        ExtentState state;
+    };
+    //writeb() not committed yet: crc of the bytes it replaces
+    struct PendingWrite{
+        const void *data;
+        uint64_t extent;
+        size_t offset, size;
+        uint32_t crc;
+    };
+    using ExtentChecksums = std::pmr::map<uint64_t, ExtentChecksum>;
+    ExtentChecksums checksums{arena.resource()};
+    std::pmr::vector<uint64_t> dirty{arena.resource()}; //extents to journal on checkpoint
+    std::pmr::vector<PendingWrite> pending{arena.resource()};
+    uint64_t scrub_cursor{0};
+
+    static constexpr bool HAS_CHECKSUM = (C == StorageChecksum::CRC32C);
 
     void init_simple_storage(size_t static_size){
         StorageBufferRO metadata_buf{rma.readb(0, sizeof(FileMetadata))};
@@ -214,11 +430,233 @@ class SimpleStorage: public DataStorageBase{
         } else {
             metadata = *fm;
             ASSERT_ON(metadata.static_addr.size < static_size);
-            StorageBufferRO vmap_buf{rma.readb(metadata.va_offset, metadata.va_size)};
-            mapping = szeimpl::d<decltype(mapping)>(vmap_buf);
-            mapping.del(metadata.va_addr, metadata.va_size);
+            load_snapshot();
+            for(auto &[addr, extent]: checksums){
+                extent.state = Unverified;
+            }
+            replay_log();
+            set_journaling(true);
         }
     }
+
+    /* Snapshot and log */
+
+    void set_journaling(bool on){
+        journaling = on;
+        mapping.set_log(on ? &log : nullptr);
+    }
+    void journal(MetadataOp op, uint64_t addr, uint64_t size, uint64_t arg = 0){
+        if(journaling){
+            log.append(op, addr, size, arg);
+        }
+    }
+    void write_metadata(){
+        StorageBuffer metadata_buf{rma.writeb(0, sizeof(FileMetadata))};
+        FileMetadata *fm = metadata_buf.template get<FileMetadata>();
+        *fm = metadata;
+    }
+    void load_snapshot(){
+        StorageBufferRO vmap_buf{rma.readb(metadata.va_offset, metadata.va_used)};
+        mapping = szeimpl::d<decltype(mapping)>(arena.resource(), vmap_buf);
+        size_t offset = szeimpl::size(mapping);
+        auto cs_buf = vmap_buf.offset(offset, metadata.va_used - offset);
+        if(crc32c::value(cs_buf.get(), cs_buf.size()) != metadata.va_crc){
+            LOG_ERROR("SimpleStorage: extent checksums mismatch");
+            throw std::runtime_error("SimpleStorage: corrupted extent checksums");
+        }
+        if constexpr (HAS_CHECKSUM){
+            //states are kept when the snapshot is reloaded, nothing is dirty after write_snapshot()
+            checksums = szeimpl::d<ExtentChecksums>(arena.resource(), cs_buf);
+        }
+        //freed by the next snapshot, after the new one is built
+        persisted_va = StorageAddress{metadata.va_addr, metadata.va_size};
+    }
+    void replay_log(){
+        ASSERT_ON(journaling);
+        MetadataLog::replay(rma.readb(metadata.log_offset, metadata.log_used), [this](const MetadataLogRecord &rec){
+            switch(rec.op){
+            case MetadataOp::ChecksumSet:
+                set_checksum(rec.addr, rec.size, static_cast<uint32_t>(rec.arg));
+                break;
+            case MetadataOp::ChecksumDrop:
+                drop_checksums(rec.addr, rec.size);
+                break;
+            default:
+                mapping.apply(rec);
+            }
+        });
+    }
+    //rewrite whole metadata, reload = keep using storage after that
+    void write_snapshot(bool reload){
+        update_checksums();
+        set_journaling(false);
+        log.clear();
+        if(!persisted_va.is_null()){
+            mapping.del(persisted_va.addr, persisted_va.size);
+        }
+        size_t cs_size = 0;
+        if constexpr (HAS_CHECKSUM){
+            cs_size = szeimpl::size(checksums);
+        }
+        size_t image_size = szeimpl::size(mapping) + cs_size + VirtAddressMapping::EXTRA_SPARE_SPACE;
+        metadata.log_capacity = std::max(LOG_MIN_CAPACITY, image_size / LOG_CAPACITY_RATIO);
+        metadata.va_size = image_size + metadata.log_capacity;
+        metadata.va_offset = mapping.alloc(metadata.va_addr, metadata.va_size);
+        //new range may reuse the old one which mapping still reads from, build it aside
+        size_t mapping_size = szeimpl::size(mapping);
+        ASSERT_ON(mapping_size + cs_size > image_size);
+        std::vector<char> vmap_mem(mapping_size + cs_size);
+        StorageBuffer vmap_buf{vmap_mem.data(), vmap_mem.size(), vmap_mem.size()};
+        szeimpl::s(mapping, vmap_buf);
+        metadata.va_used = mapping_size;
+        StorageBuffer cs_buf = vmap_buf.offset(metadata.va_used, cs_size);
+        if constexpr (HAS_CHECKSUM){
+            szeimpl::s(checksums, cs_buf);
+            metadata.va_used += cs_size;
+        }
+        metadata.va_crc = crc32c::value(cs_buf.get(), cs_size);
+        rma.write(metadata.va_offset, vmap_buf);
+        metadata.log_offset = metadata.va_offset + image_size;
+        metadata.log_used = 0;
+        write_metadata();
+
+        if(reload){
+            //old snapshot is free now, switch mapping to the new one
+            load_snapshot();
+            set_journaling(true);
+        }
+    }
+
+    /* Checksums */
+
+    //first extent overlapping addr
+    auto first_overlapping(uint64_t addr){
+        auto it = checksums.lower_bound(addr);
+        if(it != checksums.begin()){
+            auto prev = std::prev(it);
+            if(prev->first + prev->second.size > addr){
+                it = prev;
+            }
+        }
+        return it;
+    }
+    void drop_checksums(uint64_t addr, size_t size){
+        auto it = first_overlapping(addr);
+        while(it != checksums.end() && it->first < addr + size){
+            it = checksums.erase(it);
+        }
+    }
+    void set_checksum(uint64_t addr, size_t size, uint32_t crc){
+        drop_checksums(addr, size);
+        checksums.emplace(addr, ExtentChecksum{size, crc, Unverified});
+    }
+    uint32_t extent_crc(uint64_t addr, size_t size){
+        auto [offset, mapped_size] = mapping.lookup(addr, size, true);
+        ASSERT_ON(mapped_size < size);
+        auto buf = rma.readb(offset, size);
+        return crc32c::value(buf.get(), size);
+    }
+    bool verify_extent(uint64_t addr, size_t size, uint32_t crc){
+        return extent_crc(addr, size) == crc;
+    }
+    //whole extent, also when only a part of it is accessed
+    void verify_checksum(uint64_t addr, ExtentChecksum &extent){
+        if(extent.state != Unverified){
+            return;
+        }
+        if(!verify_extent(addr, extent.size, extent.crc)) [[unlikely]]{
+            LOG_ERROR("SimpleStorage: checksum mismatch at %lx size %lu", addr, extent.size);
+            throw std::runtime_error("SimpleStorage: checksum mismatch");
+        }
+        extent.state = Verified;
+    }
+    //verify all extents overlapping [addr, addr + size)
+    void verify_checksums(const StorageAddress &addr){
+        for(auto it = first_overlapping(addr.addr); it != checksums.end() && it->first < addr.addr + addr.size; it++){
+            verify_checksum(it->first, it->second);
+        }
+    }
+    //[addr, addr + size) mapped at data is about to change. a write inside of one extent keeps its range,
+    //otherwise extents overlapping it become one extent covering all of them.
+    //partly overwritten extents are verified first, otherwise a corruption in the unchanged part would get into the new crc
+    void mark_dirty(uint64_t addr, size_t size, const void *data){
+        auto it = first_overlapping(addr);
+        if(it != checksums.end() && it->first <= addr && it->first + it->second.size >= addr + size){
+            auto &extent = it->second;
+            bool whole = (size == extent.size);
+            if(extent.state == Pending){
+                extent.state = Dirty; //crc can't follow two writes in flight
+                return;
+            }
+            if(extent.state == Dirty && !whole){
+                return;
+            }
+            if(extent.state == Unverified || extent.state == Verified){
+                dirty.push_back(it->first);
+            }
+            if(whole){
+                //crc is of the written bytes only
+                extent.crc = 0;
+                pending.push_back(PendingWrite{data, addr, 0, size, 0});
+            } else {
+                verify_checksum(it->first, extent);
+                //memory still has the bytes being replaced
+                pending.push_back(PendingWrite{data, it->first, addr - it->first, size, crc32c::value(data, size)});
+            }
+            extent.state = Pending;
+            return;
+        }
+        uint64_t start = addr, end = addr + size;
+        while(it != checksums.end() && it->first < addr + size){
+            if(it->first < addr || it->first + it->second.size > addr + size){
+                verify_checksum(it->first, it->second);
+            }
+            start = std::min(start, it->first);
+            end = std::max(end, it->first + it->second.size);
+            it = checksums.erase(it);
+        }
+        if(start == addr && end == addr + size){
+            //nothing of the old extents is left, crc is of the written bytes only
+            checksums.emplace(start, ExtentChecksum{size, 0, Pending});
+            pending.push_back(PendingWrite{data, start, 0, size, 0});
+        } else {
+            checksums.emplace(start, ExtentChecksum{end - start, 0, Dirty});
+        }
+        dirty.push_back(start);
+    }
+    //write at data is committed, fold it into the crc of its extent
+    void commit_checksum(const void *data){
+        auto write = std::find_if(pending.rbegin(), pending.rend(), [data](const PendingWrite &w){ return w.data == data; });
+        if(write == pending.rend()){
+            return;
+        }
+        auto it = checksums.find(write->extent);
+        if(it != checksums.end() && it->second.state == Pending){
+            auto &extent = it->second;
+            uint32_t delta = write->crc ^ crc32c::value(data, write->size);
+            extent.crc ^= crc32c::shift(delta, extent.size - write->offset - write->size);
+            extent.state = Committed;
+        }
+        pending.erase(std::next(write).base());
+    }
+    //journal checksums of extents written since the previous call, before the metadata is persisted.
+    //only extents not followed by commit() are read here
+    void update_checksums(){
+        for(auto addr: dirty){
+            auto it = checksums.find(addr);
+            if(it == checksums.end() || it->second.state == Verified || it->second.state == Unverified){
+                continue; //erased, or listed twice
+            }
+            auto &[size, crc, state] = it->second;
+            if(state != Committed){
+                crc = extent_crc(addr, size);
+            }
+            state = Verified;
+            journal(MetadataOp::ChecksumSet, addr, size, crc);
+        }
+        dirty.clear();
+        pending.clear();
+    }
 public:
     SimpleStorage(R &&rma, size_t static_size, uint32_t id): DataStorageBase(id), rma(std::move(rma)) {
         init_simple_storage(static_size);
@@ -238,9 +676,22 @@ public:
         return StorageAddress{addr, size};
     }
 
-    // expand existing address range
+    // expand existing address range, returns the added part. address stays readable as one range:
+    // grown in place when possible, otherwise its data is moved to a new extent
     StorageAddress expand_address(const StorageAddress &address, size_t size)  {
-        mapping.expand(address, size);
+        if(mapping.expand(address, size) != Result::Success){
+            std::vector<std::byte> data(address.size);
+            {
+                auto buffer = readb(address);
+                memcpy(data.data(), buffer.get(), address.size);
+                commit(buffer);
+            }
+            erase(address);
+            ASSERT_ON(mapping.expand(address, size) != Result::Success);
+            auto buffer = writeb(StorageAddress{address.addr, address.size + size});
+            memcpy(buffer.get(), data.data(), address.size);
+            commit(buffer);
+        }
         return StorageAddress{address.addr + address.size, size};
     }
 
@@ -249,10 +700,21 @@ public:
         LOG_INFO("Storage::write [%lu,%lu]", offset, size);
         ASSERT_ON(size < buffer.size());
         ASSERT_ON(offset == 0);
+        if constexpr (HAS_CHECKSUM){
+            auto memory = rma.readb(offset, buffer.size());
+            mark_dirty(addr.addr, buffer.size(), memory.get());
+            auto res = rma.write(offset, buffer);
+            commit_checksum(memory.get());
+            return res;
+        }
         return rma.write(offset, buffer);
     }
     Result erase(const StorageAddress &addr) {
         //stub, no implementation
+        if constexpr (HAS_CHECKSUM){
+            journal(MetadataOp::ChecksumDrop, addr.addr, addr.size);
+            drop_checksums(addr.addr, addr.size);
+        }
         return mapping.del(addr.addr, addr.size);
     }
 	template<typename T>
@@ -266,23 +728,37 @@ public:
         ASSERT_ON(size > addr.size);
         ASSERT_ON(addr.size > buffer.allocated());
         ASSERT_ON(offset == 0);
-        return rma.read(offset, addr.size, buffer);
+        auto res = rma.read(offset, addr.size, buffer);
+        if constexpr (HAS_CHECKSUM){
+            verify_checksums(addr);
+        }
+        return res;
     }
 
     StorageBuffer<> writeb(const StorageAddress &addr) {
         auto [offset, size] = mapping.lookup(addr.addr, addr.size);
         ASSERT_ON(size < addr.size);
         ASSERT_ON(offset == 0);
-        return rma.writeb(offset, addr.size);
+        auto buffer = rma.writeb(offset, addr.size);
+        if constexpr (HAS_CHECKSUM){
+            mark_dirty(addr.addr, addr.size, buffer.get());
+        }
+        return buffer;
     }
     StorageBufferRO<> readb(const StorageAddress &addr) {
         auto [offset, size] = mapping.lookup(addr.addr, addr.size, true);
         ASSERT_ON(size < addr.size);
         ASSERT_ON(offset == 0);
-        return rma.readb(offset, addr.size);
+        auto buffer = rma.readb(offset, addr.size);
+        if constexpr (HAS_CHECKSUM){
+            verify_checksums(addr);
+        }
+        return buffer;
     }
     Result commit([[maybe_unused]] const StorageBuffer<> &buffer) {
-        //stub, no implementation
+        if constexpr (HAS_CHECKSUM){
+            commit_checksum(buffer.get());
+        }
         return Result::Success;
     }
     Result commit([[maybe_unused]] const StorageBufferRO<> &buffer) {
@@ -290,32 +766,133 @@ public:
         return Result::Success;
     }
 
+    //verify up to max_extents checksummed extents, resuming where the previous call stopped.
+    //calls f(StorageAddress) for every corrupted extent, returns number of extents checked.
+    //extents with a write in flight or a stale crc are skipped, they are checksummed on checkpoint
+    //storage is not thread-safe, caller is responsible to serialize scrub() with other access
+    template<typename F>
+    size_t scrub(size_t max_extents, F &&f){
+        size_t checked = 0;
+        if constexpr (HAS_CHECKSUM){
+            max_extents = std::min(max_extents, checksums.size()); //at most one pass per call
+            auto it = checksums.lower_bound(scrub_cursor);
+            for(; checked < max_extents; checked++){
+                if(it == checksums.end()){
+                    it = checksums.begin();
+                }
+                auto [size, crc, state] = it->second;
+                if(state != Pending && state != Dirty && !verify_extent(it->first, size, crc)){
+                    LOG_ERROR("SimpleStorage: scrub found corrupted extent at %lx size %lu", it->first, size);
+                    f(StorageAddress{it->first, size});
+                }
+                it++;
+                scrub_cursor = (it == checksums.end()) ? 0 : it->first;
+            }
+        }
+        return checked;
+    }
+    size_t scrub(size_t max_extents){
+        return scrub(max_extents, [](const StorageAddress &){});
+    }
+
+    //persist metadata changes made since the previous checkpoint.
+    //appends them to the log, O(changes); rewrites the snapshot when the log is full
+    Result checkpoint(){
+        update_checksums();
+        size_t batch_size = log.batch_size();
+        if(persisted_va.is_null() || metadata.log_used + batch_size > metadata.log_capacity){
+            write_snapshot(true);
+            return Result::Success;
+        }
+        if(batch_size != 0){
+            StorageBuffer log_buf{rma.writeb(metadata.log_offset + metadata.log_used, batch_size)};
+            RET_ON_FAILURE(log.flush(log_buf));
+            metadata.log_used += batch_size;
+        }
+        write_metadata();
+        return Result::Success;
+    }
+    //merge the log into a new snapshot
+    Result compact(){
+        write_snapshot(true);
+        return Result::Success;
+    }
+
     ~SimpleStorage(){
         //serialize to rma
-        metadata.va_size = szeimpl::size(mapping) + VirtAddressMapping::EXTRA_SPARE_SPACE;
-        metadata.va_offset = mapping.alloc(metadata.va_addr, metadata.va_size);
-        StorageBuffer vmap_buf{rma.writeb(metadata.va_offset, metadata.va_size)};
-        szeimpl::s(mapping, vmap_buf);
-
-        StorageBuffer metadata_buf{rma.writeb(0, sizeof(FileMetadata))};
-        FileMetadata *fm = metadata_buf.template get<FileMetadata>();
-        *fm = metadata;
+        update_checksums();
+        if(persisted_va.is_null() || metadata.log_used + log.batch_size() > metadata.log_capacity){
+            write_snapshot(false);
+        } else {
+            checkpoint();
+        }
         //commit
     }
 
     Result serializeImpl(StorageBuffer<> &buffer) const {
         return szeimpl::s(rma, buffer);
     }
-    static SimpleStorage<R> deserializeImpl(const StorageBufferRO<> &buffer, uint32_t id = DataStorageBase::UniqueIDInterface::DEFAULT) {
-        return SimpleStorage<R>{szeimpl::d<R>(buffer), id};
+    static SimpleStorage deserializeImpl(const StorageBufferRO<> &buffer, uint32_t id = DataStorageBase::UniqueIDInterface::DEFAULT) {
+        return SimpleStorage{szeimpl::d<R>(buffer), id};
     }
     size_t getSizeImpl() const{
         return szeimpl::size(rma);
     }
 };
 
+//periodically runs storage.scrub() on a separate thread.
+//lock must be held by everyone else accessing the storage
+template<typename Storage>
+class BackgroundScrubber{
+    Storage &storage;
+    std::mutex &lock;
+    std::function<void(const StorageAddress &)> on_corrupted;
+    std::chrono::milliseconds period;
+    size_t batch;
+
+    std::mutex wait_lock;
+    std::condition_variable cv;
+    bool stopped{false};
+    std::thread thread;
+
+    void run(){
+        std::unique_lock wl{wait_lock};
+        while(!cv.wait_for(wl, period, [this](){ return stopped; })){
+            std::lock_guard sl{lock};
+            storage.scrub(batch, on_corrupted);
+        }
+    }
+public:
+    BackgroundScrubber(Storage &storage, std::mutex &lock, std::function<void(const StorageAddress &)> on_corrupted,
+                        std::chrono::milliseconds period = std::chrono::milliseconds{100}, size_t batch = 64):
+        storage(storage), lock(lock), on_corrupted(std::move(on_corrupted)),
+        period(period), batch(batch), thread([this](){ run(); }) {}
+    BackgroundScrubber(const BackgroundScrubber &) = delete;
+    BackgroundScrubber &operator=(const BackgroundScrubber &) = delete;
+
+    void stop(){
+        {
+            std::lock_guard wl{wait_lock};
+            stopped = true;
+        }
+        cv.notify_all();
+        if(thread.joinable()){
+            thread.join();
+        }
+    }
+    ~BackgroundScrubber(){
+        stop();
+    }
+};
+
 template <size_t N>
 using SimpleFileStorage = SimpleStorage<FileRMA<N> >;
 
 template <size_t N>
 using SimpleRamStorage = SimpleStorage<MemoryRMA<N> >;
+
+template <size_t N>
+using CheckedFileStorage = SimpleStorage<FileRMA<N>, StorageChecksum::CRC32C>;
+
+template <size_t N>
+using CheckedRamStorage = SimpleStorage<MemoryRMA<N>, StorageChecksum::CRC32C>;
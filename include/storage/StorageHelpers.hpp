@@ -1,17 +1,24 @@
 #pragma once
 
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <optional>
 #include <tuple>
+#include <vector>
+#include <cstring>
 #include <storage/Utils.hpp>
 #include <storage/SerializeImpl.hpp>
 
 //TODO DefaultConstructible<T>
-template<typename T, typename SizeT = size_t>
+template<typename T, typename SizeT = size_t, typename Alloc = std::allocator<std::pair<const SizeT, T>>>
 class SetOrderedBySize{
-    std::multimap<SizeT, T> data;
-    SetOrderedBySize(std::multimap<SizeT, T> &&data): data(data) {}
+    using M_TYPE = std::multimap<SizeT, T, std::less<SizeT>, Alloc>;
+    M_TYPE data;
+    SetOrderedBySize(M_TYPE &&data): data(std::move(data)) {}
 public:
     SetOrderedBySize(){}
+    SetOrderedBySize(const Alloc &alloc): data(alloc) {}
     void add(SizeT size, const T &t){
         data.insert(std::make_pair(size, t));
     }
@@ -58,11 +65,11 @@ public:
         
         return SerializeSequentially(buffer, offset, data);
     }
-    static SetOrderedBySize<T> deserializeImpl(const StorageBufferRO<> &buffer) {
+    static SetOrderedBySize deserializeImpl(const StorageBufferRO<> &buffer) {
         auto buf = buffer;
         size_t offset = 0;
 
-        auto [data] = DeserializeSequentially<std::multimap<SizeT, T>>(buf, offset);
+        auto [data] = DeserializeSequentially<M_TYPE>(buf, offset);
 
         return SetOrderedBySize{std::move(data)};
     }
@@ -70,3 +77,197 @@ public:
         return szeimpl::size(data);
     }
 };
+
+template<typename T, typename SizeT = size_t>
+using PmrSetOrderedBySize = SetOrderedBySize<T, SizeT, std::pmr::polymorphic_allocator<std::pair<const SizeT, T>>>;
+
+//array split in fixed-size chunks, elements never move when the array grows.
+//serialized as [count][T]...[T], one memcpy per chunk
+template<typename T, size_t CHUNK_BITS = 10>
+class ChunkedArray{
+    static constexpr size_t CHUNK = (1UL << CHUNK_BITS);
+    std::vector<std::unique_ptr<T[]>> chunks;
+    size_t count{0};
+
+    void copy_from(const ChunkedArray &other){
+        resize(other.count);
+        for(size_t c = 0; c < chunks.size(); c++){
+            std::copy(other.chunks[c].get(), other.chunks[c].get() + CHUNK, chunks[c].get());
+        }
+    }
+public:
+    ChunkedArray() {}
+    ChunkedArray(const ChunkedArray &other){
+        copy_from(other);
+    }
+    ChunkedArray(ChunkedArray &&other) = default;
+    ChunkedArray &operator=(const ChunkedArray &other){
+        if(this != &other){
+            clear();
+            copy_from(other);
+        }
+        return *this;
+    }
+    ChunkedArray &operator=(ChunkedArray &&other) = default;
+
+    size_t size() const{
+        return count;
+    }
+    T &operator[](size_t i){
+        return chunks[i >> CHUNK_BITS][i & (CHUNK - 1)];
+    }
+    const T &operator[](size_t i) const{
+        return chunks[i >> CHUNK_BITS][i & (CHUNK - 1)];
+    }
+    //new elements are value-initialized. shrinking keeps the chunks and resets the dropped elements,
+    //so growing again doesn't bring them back
+    void resize(size_t n){
+        while(chunks.size() * CHUNK < n){
+            chunks.push_back(std::make_unique<T[]>(CHUNK));
+        }
+        for(size_t i = n; i < count; i++){
+            (*this)[i] = T{};
+        }
+        count = n;
+    }
+    void clear(){
+        chunks.clear();
+        count = 0;
+    }
+
+    Result serializeImpl(StorageBuffer<> &buffer) const requires std::is_trivially_copyable_v<T> {
+        ASSERT_ON(getSizeImpl() > buffer.allocated());
+        memcpy(buffer.get(), &count, sizeof(count));
+        size_t offset = sizeof(count);
+        for(size_t c = 0; c * CHUNK < count; c++){
+            size_t n = std::min(CHUNK, count - c * CHUNK);
+            memcpy(buffer.get(offset), chunks[c].get(), n * sizeof(T));
+            offset += n * sizeof(T);
+        }
+        return Result::Success;
+    }
+    static ChunkedArray deserializeImpl(const StorageBufferRO<> &buffer) requires std::is_trivially_copyable_v<T> {
+        ChunkedArray arr;
+        size_t n;
+        memcpy(&n, buffer.get(), sizeof(n));
+        ASSERT_ON(sizeof(n) + n * sizeof(T) > buffer.size());
+        arr.resize(n);
+        size_t offset = sizeof(n);
+        for(size_t c = 0; c * CHUNK < n; c++){
+            size_t chunk_n = std::min(CHUNK, n - c * CHUNK);
+            memcpy(arr.chunks[c].get(), buffer.get(offset), chunk_n * sizeof(T));
+            offset += chunk_n * sizeof(T);
+        }
+        return arr;
+    }
+    size_t getSizeImpl() const {
+        return sizeof(count) + count * sizeof(T);
+    }
+};
+
+//open addressing map of dense object indexes -> T, linear probing.
+//values are kept in a ChunkedArray, references stay valid until erase()
+template<typename T>
+class IndexCache{
+    static constexpr size_t EMPTY = std::numeric_limits<size_t>::max();
+    static constexpr size_t TOMBSTONE = EMPTY - 1;
+    static constexpr size_t MIN_SLOTS = 16;
+    struct Slot{
+        size_t index{EMPTY};
+        size_t value;
+    };
+    std::vector<Slot> slots;
+    ChunkedArray<std::optional<T>> values;
+    std::vector<size_t> free_values;
+    size_t used{0}; //including tombstones
+    size_t count{0};
+
+    size_t slot_of(size_t index) const{
+        //indexes are dense, neighbours go to neighbour slots. slots.size() is a power of 2
+        return index & (slots.size() - 1);
+    }
+    size_t find_slot(size_t index) const{
+        if(slots.empty()){
+            return EMPTY;
+        }
+        size_t mask = slots.size() - 1;
+        for(size_t s = slot_of(index);; s = (s + 1) & mask){
+            if(slots[s].index == index){
+                return s;
+            }
+            if(slots[s].index == EMPTY){
+                return EMPTY;
+            }
+        }
+    }
+    void rehash(size_t new_size){
+        std::vector<Slot> old(new_size);
+        std::swap(old, slots);
+        used = count;
+        size_t mask = slots.size() - 1;
+        for(auto &slot: old){
+            if(slot.index >= TOMBSTONE){
+                continue;
+            }
+            size_t s = slot_of(slot.index);
+            while(slots[s].index != EMPTY){
+                s = (s + 1) & mask;
+            }
+            slots[s] = slot;
+        }
+    }
+public:
+    size_t size() const{
+        return count;
+    }
+    T *find(size_t index){
+        size_t s = find_slot(index);
+        return (s == EMPTY) ? nullptr : &*values[slots[s].value];
+    }
+    //returns existing value if index is already in the cache
+    std::pair<T *, bool> emplace(size_t index, const T &t){
+        ASSERT_ON(index >= TOMBSTONE);
+        if(auto v = find(index)){
+            return {v, false};
+        }
+        if((used + 1) * 2 > slots.size()){
+            rehash(std::max(MIN_SLOTS, (count + 1) * 4 > slots.size() ? slots.size() * 2 : slots.size()));
+        }
+        size_t value;
+        if(!free_values.empty()){
+            value = free_values.back();
+            free_values.pop_back();
+        } else {
+            value = values.size();
+            values.resize(value + 1);
+        }
+        values[value].emplace(t);
+        size_t mask = slots.size() - 1;
+        size_t s = slot_of(index);
+        while(slots[s].index < TOMBSTONE){
+            s = (s + 1) & mask;
+        }
+        used += (slots[s].index == EMPTY);
+        slots[s] = Slot{index, value};
+        count++;
+        return {&*values[value], true};
+    }
+    size_t erase(size_t index){
+        size_t s = find_slot(index);
+        if(s == EMPTY){
+            return 0;
+        }
+        values[slots[s].value].reset();
+        free_values.push_back(slots[s].value);
+        slots[s].index = TOMBSTONE;
+        count--;
+        return 1;
+    }
+    void clear(){
+        slots.clear();
+        values.clear();
+        free_values.clear();
+        used = 0;
+        count = 0;
+    }
+};
@@ -44,7 +44,6 @@ class StorageManager {
         static constexpr uint32_t MAGIC = 0xde0a2Fb;
         uint32_t magic;
         StorageAddress uid;
-        //TODO like type table for all uids?
         void init(Storage &storage){
             if(magic != MAGIC){
                 uid = storage.get_random_address(szeimpl::size(UniqueIDStorage<DataStorageBase, Storage>{storage}));
@@ -74,6 +73,20 @@ public:
         auto ptr = deserialize_ptr<UniqueIDStorage<DataStorageBase, Storage>>(storage, metadata.uid, storage);
         uid.swap(ptr);
     }
+    //init() and opens every registered storage as U on threads workers, nested storages after the ones
+    //they depend on. returns per-instance load times, see UniqueIDStorage::load_all
+    template<CUniqueID<UniqueIDName::Instance> U,
+             typename Depends = typename UniqueIDStorage<DataStorageBase, Storage>::NoDependencies>
+    auto init(size_t threads, Depends &&depends = {}){
+        init();
+        return uid->template load_all<U>(threads, std::forward<Depends>(depends));
+    }
+    //every storage created by the factory registered for its type in TypeRegistry<DataStorageBase>
+    auto init(size_t threads, const typename UniqueIDStorage<DataStorageBase, Storage>::Dependencies &depends =
+              typename UniqueIDStorage<DataStorageBase, Storage>::NoDependencies{}){
+        init();
+        return uid->load_all(threads, depends);
+    }
     Storage &getStorage() { return storage; }
     UniqueIDStorage<DataStorageBase, Storage> &getUIDStorage() { return *uid.get(); }
 };
@@ -82,10 +95,10 @@ public:
 
 //Factory to create DataStorage instance from id
 
-//We don't keep DataStorage full description in VirtFileCatalog, only it's id(and type?)
-//We have to be able to create Instance from id and type -> Factory to create an instance from id and type
-//We need to have type as a factory to create, id is mapped onto DataStorage::serializeImpl result or an instance
-//Factory utilizes deserializeImpl to create instance
-//We also need to be able to create instance for StorageManager, so DataStorage implementation has to have no link to StorageManager, but DataStorage might(?)
+//We don't keep DataStorage full description in VirtFileCatalog, only it's id
+//UniqueIDStorage keeps the type id next to the address of every instance, TypeRegistry<DataStorageBase> maps it
+//onto a factory, which utilizes deserializeImpl to create the instance -> getInstance(id) without a type
+//DataStorage implementation registers itself, e.g. static TypeRegistrar<DataStorageBase, MyStorage> with
+//MyStorage::TYPE_NAME, or TypeRegistrar<DataStorageBase, SimpleFileStorage<32>> registrar{"SimpleFileStorage32"}
 //Factory to fetch the local storage of already instantiated -> therefore DataStorage is a singletone with a keys(id, type)
 
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <unordered_map>
+
+#include <storage/Utils.hpp>
+#include <storage/DataStorage.hpp>
+#include <storage/SerializeImpl.hpp>
+#include <storage/Serialize.hpp>
+
+/*
+String dictionary - interns repeated strings (exchange, ticker, resolution) as dense 32-bit ids.
+Ids are assigned in insertion order and never reused, so they stay valid for the lifetime of the dictionary
+and can be stored in place of the string. Serialized as the strings in id order.
+*/
+class StringDictionary{
+public:
+    using Id = uint32_t;
+private:
+    //transparent, so lookups by std::string_view don't build a std::string
+    struct Hash{
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const{
+            return std::hash<std::string_view>{}(s);
+        }
+    };
+    std::unordered_map<std::string, Id, Hash, std::equal_to<>> ids;
+    std::vector<const std::string *> strings; //id -> key in ids, nodes are never moved
+public:
+    StringDictionary() {}
+    StringDictionary(const StringDictionary &other): StringDictionary() {
+        for(auto *s: other.strings){
+            intern(*s);
+        }
+    }
+    StringDictionary(StringDictionary &&other) = default;
+    StringDictionary &operator=(StringDictionary other){
+        ids.swap(other.ids);
+        strings.swap(other.strings);
+        return *this;
+    }
+
+    size_t size() const{
+        return strings.size();
+    }
+    //id of the string, added if missing
+    Id intern(std::string_view s){
+        auto it = ids.find(s);
+        if(it != ids.end()){
+            return it->second;
+        }
+        //largest id stays unused, so the number of strings fits in Id as well
+        ASSERT_ON(strings.size() >= std::numeric_limits<Id>::max());
+        Id id = static_cast<Id>(strings.size());
+        auto [new_it, inserted] = ids.emplace(std::string{s}, id);
+        strings.push_back(&new_it->first);
+        return id;
+    }
+    //id of the string if it was interned
+    std::optional<Id> find(std::string_view s) const{
+        auto it = ids.find(s);
+        if(it == ids.end()){
+            return std::nullopt;
+        }
+        return it->second;
+    }
+    const std::string &str(Id id) const{
+        ASSERT_ON(id >= strings.size());
+        return *strings[id];
+    }
+
+    Result serializeImpl(StorageBuffer<> &buffer) const {
+        size_t offset = 0;
+        SerializeSequentially(buffer, offset, strings.size());
+        for(auto *s: strings){
+            SerializeSequentially(buffer, offset, *s);
+        }
+        return Result::Success;
+    }
+    static StringDictionary deserializeImpl(const StorageBufferRO<> &buffer) {
+        StringDictionary dict;
+        size_t offset = 0;
+        auto buf = buffer;
+
+        auto [num] = DeserializeSequentially<size_t>(buf, offset);
+        dict.ids.reserve(num);
+        dict.strings.reserve(num);
+        for(size_t i = 0; i < num; i++){
+            auto [s] = DeserializeSequentially<std::string>(buf, offset);
+            dict.intern(s);
+        }
+        return dict;
+    }
+    size_t getSizeImpl() const {
+        size_t sum = szeimpl::size(strings.size());
+        for(auto *s: strings){
+            sum += szeimpl::size(*s);
+        }
+        return sum;
+    }
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+#include <string>
+#include <concepts>
+#include <type_traits>
+#include <utility>
+
+/*
+Type fingerprint - constexpr 64-bit id of a type, stored next to serialized data
+to tell types apart when reading it back.
+
+stable_type_fingerprint<T>() is derived from an explicit name, T::TYPE_NAME, so it doesn't change
+between compilers, standard libraries or builds, nor when members are added. Persisted data uses it.
+Arithmetic types are named by kind and size, std::string by "string". Class templates with type
+parameters mix in the fingerprints of their arguments. Types without a stable name all get
+UNNAMED_FINGERPRINT and are not told apart.
+
+type_name<T>() comes from __PRETTY_FUNCTION__, it differs between gcc and clang for some types
+(e.g. integer aliases) and changes when a type moves, so it is only used within one process.
+*/
+
+template <typename T>
+constexpr std::string_view type_name(){
+#if defined(__clang__)
+    constexpr std::string_view prefix{"[T = "};
+    constexpr std::string_view suffix{"]"};
+#elif defined(__GNUC__)
+    constexpr std::string_view prefix{"with T = "};
+    constexpr std::string_view suffix{"; "};
+#else
+#error "Unsupported compiler"
+#endif
+    constexpr std::string_view function{__PRETTY_FUNCTION__};
+    constexpr auto start = function.find(prefix) + prefix.size();
+    constexpr auto end_suffix = function.find(suffix, start);
+    constexpr auto end = end_suffix == std::string_view::npos ? function.rfind(']') : end_suffix;
+    static_assert(start < end);
+    return function.substr(start, end - start);
+}
+
+constexpr uint64_t fnv1a64(std::string_view s, uint64_t hash = 0xcbf29ce484222325ULL){
+    for(char c: s){
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+constexpr uint64_t fingerprint_mix(uint64_t hash, uint64_t v){
+    //splitmix64 finalizer over combined value
+    uint64_t z = hash ^ (v + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2));
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+//explicit stable name of a type, e.g. static constexpr std::string_view TYPE_NAME = "MyStorage";
+template<typename U>
+concept CStableTypeName = requires {
+    { U::TYPE_NAME } -> std::convertible_to<std::string_view>;
+};
+
+constexpr uint64_t UNNAMED_FINGERPRINT = fnv1a64("");
+
+template<typename T>
+constexpr uint64_t stable_type_fingerprint();
+
+namespace fingerprint_detail{
+
+struct any_field{
+    template<typename U>
+    constexpr operator U() const;
+};
+
+template<typename T, size_t ...I>
+constexpr bool brace_constructible(std::index_sequence<I...>){
+    return requires{ T{(I, any_field{})...}; };
+}
+
+//number of fields of an aggregate, brace elision counts nested aggregates member-wise
+template<typename T, size_t N = 0>
+constexpr size_t aggregate_field_count(){
+    if constexpr (N > 64){
+        return N;
+    } else if constexpr (brace_constructible<T>(std::make_index_sequence<N + 1>{})){
+        return aggregate_field_count<T, N + 1>();
+    } else {
+        return N;
+    }
+}
+
+template<typename T>
+struct type_arguments{
+    static constexpr uint64_t mix(uint64_t hash){
+        return hash;
+    }
+};
+template<template<typename...> typename C, typename ...Args>
+struct type_arguments<C<Args...>>{
+    static constexpr uint64_t mix(uint64_t hash){
+        ((hash = fingerprint_mix(hash, stable_type_fingerprint<Args>())), ...);
+        return hash;
+    }
+};
+
+}
+
+template<typename T>
+constexpr uint64_t stable_type_fingerprint(){
+    using U = std::remove_cvref_t<T>;
+    if constexpr (std::is_same_v<U, std::string>){
+        return fnv1a64("string");
+    } else if constexpr (std::is_same_v<U, bool>){
+        return fnv1a64("bool");
+    } else if constexpr (std::is_same_v<U, char>){
+        //signedness of char differs between platforms
+        return fnv1a64("char");
+    } else if constexpr (std::is_floating_point_v<U>){
+        return fingerprint_mix(fnv1a64("float"), sizeof(U));
+    } else if constexpr (std::is_integral_v<U>){
+        return fingerprint_mix(fnv1a64(std::is_signed_v<U> ? "int" : "uint"), sizeof(U));
+    } else if constexpr (std::is_enum_v<U>){
+        return fingerprint_mix(fnv1a64("enum"), sizeof(U));
+    } else if constexpr (CStableTypeName<U>){
+        return fingerprint_detail::type_arguments<U>::mix(fnv1a64(U::TYPE_NAME));
+    } else {
+        return fingerprint_detail::type_arguments<U>::mix(UNNAMED_FINGERPRINT);
+    }
+}
+
+//fingerprint of the compiler generated name, within one process only
+template<typename T>
+constexpr uint64_t type_name_fingerprint(){
+    return fnv1a64(type_name<std::remove_cvref_t<T>>());
+}
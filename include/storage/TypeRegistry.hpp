@@ -0,0 +1,117 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <shared_mutex>
+#include <string_view>
+#include <typeindex>
+#include <unordered_map>
+
+#include <storage/Utils.hpp>
+#include <storage/StorageUtils.hpp>
+#include <storage/SerializeImpl.hpp>
+#include <storage/TypeFingerprint.hpp>
+
+/*
+Type registry - stable ids of types derived from T mapped to factories, which read an instance
+back from its serialized form. UniqueIDStorage keeps the type id of every instance next to its
+address, so an instance is created from its id alone and only the registration instantiates
+the deserializer of a type, not every call site.
+Type id is fnv1a64 of an explicit name: U::TYPE_NAME, or the name passed to add<U>(name) for types
+which can't have one. Compiler generated names differ between compilers and versions, so they are
+not used. Renaming a type keeps its id as long as the name stays.
+*/
+
+template<typename T>
+class TypeRegistry{
+public:
+    using TypeId = uint64_t;
+    static constexpr TypeId UNKNOWN = 0;
+    using Factory = T *(*)(const StorageBufferRO<> &buffer, uint32_t id);
+private:
+    struct Type{
+        Factory factory;
+        std::string name;
+    };
+    mutable std::shared_mutex mutex;
+    std::unordered_map<TypeId, Type> types;
+    std::unordered_map<std::type_index, TypeId> named; //registered with add<U>(name)
+public:
+    //registry used by UniqueIDStorage<T>
+    static TypeRegistry &global(){
+        static TypeRegistry registry;
+        return registry;
+    }
+    static constexpr TypeId name_id(std::string_view name){
+        return fnv1a64(name);
+    }
+    //id of U::TYPE_NAME, UNKNOWN if U has no stable name
+    template<typename U>
+    static constexpr TypeId type_id(){
+        if constexpr (CStableTypeName<U>){
+            return name_id(U::TYPE_NAME);
+        } else {
+            return UNKNOWN;
+        }
+    }
+    //also types registered with add<U>(name)
+    template<typename U>
+    TypeId id_of() const{
+        if constexpr (CStableTypeName<U>){
+            return type_id<U>();
+        } else {
+            std::shared_lock lock{mutex};
+            auto it = named.find(std::type_index{typeid(U)});
+            return it == named.end() ? UNKNOWN : it->second;
+        }
+    }
+    //reads U from buffer, U::deserializeImpl(buffer, id)
+    template<typename U>
+    static T *make(const StorageBufferRO<> &buffer, uint32_t id){
+        return new U{szeimpl::d<U>(buffer, id)};
+    }
+
+    //registering a type again is a no-op
+    template<typename U>
+    requires std::is_base_of_v<T, U> && CStableTypeName<U>
+    TypeId add(){
+        return add<U>(U::TYPE_NAME);
+    }
+    template<typename U>
+    requires std::is_base_of_v<T, U>
+    TypeId add(std::string_view name){
+        ASSERT_ON_MSG(CStableTypeName<U> && name_id(name) != type_id<U>(), "type has another name");
+        std::unique_lock lock{mutex};
+        auto [it, inserted] = types.try_emplace(name_id(name), Type{&make<U>, std::string{name}});
+        ASSERT_ON_MSG(!inserted && (it->second.name != name || it->second.factory != &make<U>), "type id collision");
+        auto [nit, ninserted] = named.try_emplace(std::type_index{typeid(U)}, it->first);
+        ASSERT_ON_MSG(nit->second != it->first, "type is registered with another name");
+        return it->first;
+    }
+    //nullptr if the type is not registered
+    Factory find(TypeId id) const{
+        std::shared_lock lock{mutex};
+        auto it = types.find(id);
+        return it == types.end() ? nullptr : it->second.factory;
+    }
+    std::string name(TypeId id) const{
+        std::shared_lock lock{mutex};
+        auto it = types.find(id);
+        return it == types.end() ? std::string{} : it->second.name;
+    }
+    size_t size() const{
+        std::shared_lock lock{mutex};
+        return types.size();
+    }
+};
+
+//registers U in the global registry of T, e.g. as a static object next to the type
+template<typename T, typename U>
+struct TypeRegistrar{
+    TypeRegistrar() requires CStableTypeName<U> {
+        TypeRegistry<T>::global().template add<U>();
+    }
+    explicit TypeRegistrar(std::string_view name){
+        TypeRegistry<T>::global().template add<U>(name);
+    }
+};
@@ -4,111 +4,572 @@
 #include <tuple>
 #include <cstdint>
 #include <map>
+#include <string>
+#include <algorithm>
+#include <bit>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <chrono>
+#include <thread>
+#include <exception>
+#include <unordered_map>
+#include <condition_variable>
+#include <memory_resource>
 #include <memory>
 #include <functional>
 
+#include <storage/Arena.hpp>
 #include <storage/StorageUtils.hpp>
 #include <storage/SerializeImpl.hpp>
 #include <storage/UniqueIDInterface.hpp>
+#include <storage/TypeRegistry.hpp>
 #include <storage/DataStorage.hpp>
 
 class DataStorageBase;
 
 /************************************************************************/
 
+/*
+Instances by id. Ids are dense (generateID), so the table is indexed by id: a directory of
+fixed size chunks of slots, chunks are never moved or freed while the storage lives.
+Every slot has one atomic state word - load state, pinned/used bits and the number of Ref handles.
+getInstance() of a loaded instance is one load of the state word and of the pointer, no lock.
+First use loads the instance from its address by exactly one thread: it moves the slot to LOADING,
+copies the serialized bytes under the mutex and deserializes them without it, other threads
+wait on the state word. So different instances are loaded in parallel, see load_all().
+Writers (register, delete, serialize) take the mutex.
+Instances handed out by getInstance() or registered from outside are pinned, references to them
+may be kept anywhere. Instances used through acquire() handles are evicted by evict_idle()
+once no handle holds them and they were not used since the previous evict_idle() call.
+Type id of every instance is kept next to its address, getInstance(id)/acquire(id)/load_all()
+without a type create it through TypeRegistry<T>, versions with U read it as U.
+The table is stored as a versioned schema block. Tables written before it had one, without
+type ids, are read with unknown types.
+*/
 template<typename T, CStorage Storage, UniqueIDName IDName = UniqueIDName::Instance>
 requires CUniqueID<T, IDName>
 class UniqueIDStorage {
+    using Registry = TypeRegistry<T>;
+    using TypeId = typename Registry::TypeId;
+    using Factory = typename Registry::Factory;
+    //slot state: ABSENT/UNLOADED/LOADED/LOADING | PINNED | USED | handles * REF
+    static constexpr uint64_t STATE_MASK = 3;
+    static constexpr uint64_t ABSENT = 0;
+    static constexpr uint64_t UNLOADED = 1;
+    static constexpr uint64_t LOADED = 2;
+    static constexpr uint64_t LOADING = 3;
+    static constexpr uint64_t PINNED = 4;
+    static constexpr uint64_t USED = 8;
+    static constexpr uint64_t REF = 16;
+    static constexpr uint32_t SCHEMA_VERSION = 1;
+    static constexpr size_t CHUNK_BITS = 10;
+    static constexpr size_t CHUNK_SIZE = 1UL << CHUNK_BITS;
+
+    struct Slot{
+        std::atomic<uint64_t> state{ABSENT};
+        std::atomic<T *> ptr{nullptr};
+        StorageAddress address; //under mutex
+        TypeId type{Registry::UNKNOWN}; //under mutex
+    };
+    struct Chunk{
+        Slot slots[CHUNK_SIZE];
+    };
+    struct Directory{
+        size_t size;
+        std::atomic<Chunk *> *chunks;
+    };
+
     Storage &storage;
-    std::map<uint32_t, std::pair<StorageAddress, std::unique_ptr<T>>> m;
-    //std::map<std::string, uint32_t> types;
-    //TODO use typeid(variable).name() to store actual type and perform type check
+    std::pmr::memory_resource *resource;
+    std::atomic<Directory *> directory{nullptr};
+    //replaced directories are kept, readers may still use them
+    std::vector<Directory *> directories;
+    size_t count{0};
+    mutable std::mutex mutex;
+    //names of types registered or read with the table, for errors about types which are not registered
+    std::unordered_map<TypeId, std::string> type_names;
     uint32_t max_id{UniqueIDInterface<IDName>::DEFAULT};
+
+    Slot *find(uint32_t id) const{
+        auto *dir = directory.load(std::memory_order_acquire);
+        size_t c = id >> CHUNK_BITS;
+        if(dir == nullptr || c >= dir->size){
+            return nullptr;
+        }
+        auto *chunk = dir->chunks[c].load(std::memory_order_acquire);
+        return chunk ? &chunk->slots[id & (CHUNK_SIZE - 1)] : nullptr;
+    }
+    //under mutex
+    Slot &slot(uint32_t id){
+        auto *dir = directory.load(std::memory_order_relaxed);
+        size_t c = id >> CHUNK_BITS;
+        if(dir == nullptr || c >= dir->size){
+            size_t size = std::bit_ceil(c + 1);
+            auto *chunks = static_cast<std::atomic<Chunk *> *>(
+                resource->allocate(size * sizeof(std::atomic<Chunk *>), alignof(std::atomic<Chunk *>)));
+            for(size_t i = 0; i < size; i++){
+                new (&chunks[i]) std::atomic<Chunk *>{dir && i < dir->size ? dir->chunks[i].load(std::memory_order_relaxed) : nullptr};
+            }
+            dir = new (resource->allocate(sizeof(Directory), alignof(Directory))) Directory{size, chunks};
+            directories.push_back(dir);
+            directory.store(dir, std::memory_order_release);
+        }
+        auto *chunk = dir->chunks[c].load(std::memory_order_relaxed);
+        if(chunk == nullptr){
+            chunk = new (resource->allocate(sizeof(Chunk), alignof(Chunk))) Chunk{};
+            dir->chunks[c].store(chunk, std::memory_order_release);
+        }
+        return chunk->slots[id & (CHUNK_SIZE - 1)];
+    }
+    //calls f(id, slot) for registered ids in id order, under mutex
+    template<typename F>
+    void for_each(F &&f) const{
+        auto *dir = directory.load(std::memory_order_relaxed);
+        for(size_t c = 0; dir && c < dir->size; c++){
+            auto *chunk = dir->chunks[c].load(std::memory_order_relaxed);
+            for(size_t i = 0; chunk && i < CHUNK_SIZE; i++){
+                if((chunk->slots[i].state.load(std::memory_order_relaxed) & STATE_MASK) != ABSENT){
+                    f(static_cast<uint32_t>((c << CHUNK_BITS) + i), chunk->slots[i]);
+                }
+            }
+        }
+    }
+    //under mutex
+    std::string type_name_of(TypeId type) const{
+        auto it = type_names.find(type);
+        return it != type_names.end() ? it->second : Registry::global().name(type);
+    }
+    //reads the instance from its address with factory, or the factory of its type if nullptr,
+    //unless it is loaded. waits if another thread loads it
+    void load(uint32_t id, Slot &s, Factory factory){
+        auto state = s.state.load(std::memory_order_acquire);
+        while((state & STATE_MASK) != LOADED){
+            ASSERT_ON((state & STATE_MASK) == ABSENT);
+            if((state & STATE_MASK) == LOADING){
+                s.state.wait(state, std::memory_order_acquire);
+                state = s.state.load(std::memory_order_acquire);
+                continue;
+            }
+            //UNLOADED -> LOADING, other bits are kept. the winner loads it
+            if(!s.state.compare_exchange_weak(state, state + (LOADING - UNLOADED), std::memory_order_acquire)){
+                continue;
+            }
+            T *ptr = nullptr;
+            try{
+                //storage is not thread safe, only the copy of the bytes is done under the mutex
+                std::vector<std::byte> bytes;
+                {
+                    std::lock_guard lock{mutex};
+                    ASSERT_ON(s.address.is_null());
+                    if(factory == nullptr){
+                        factory = Registry::global().find(s.type);
+                        ASSERT_ON_MSG(factory == nullptr, "type is not registered: " + type_name_of(s.type));
+                    }
+                    auto buffer = storage.readb(s.address);
+                    ScopeDestructor sd{[this, &buffer](){ storage.commit(buffer); }};
+                    bytes.assign(buffer.template get<std::byte>(), buffer.template get<std::byte>() + s.address.size);
+                }
+                ptr = factory(StorageBufferRO<>{bytes.data(), bytes.size()}, id);
+            } catch(...){
+                s.state.fetch_sub(LOADING - UNLOADED, std::memory_order_release);
+                s.state.notify_all();
+                throw;
+            }
+            s.ptr.store(ptr, std::memory_order_release);
+            s.state.fetch_sub(LOADING - LOADED, std::memory_order_release);
+            s.state.notify_all();
+            return;
+        }
+    }
+    //loaded and pinned instance, its reference escapes so it is never evicted
+    T &pinned(uint32_t id, Factory factory){
+        auto *s = find(id);
+        ASSERT_ON(s == nullptr);
+        auto state = s->state.load(std::memory_order_acquire);
+        while(true){
+            if((state & STATE_MASK) == LOADED){
+                if((state & PINNED) || s->state.compare_exchange_weak(state, state | PINNED, std::memory_order_acquire)){
+                    return *s->ptr.load(std::memory_order_acquire);
+                }
+                continue;
+            }
+            load(id, *s, factory);
+            //may be evicted again before it is pinned
+            state = s->state.load(std::memory_order_acquire);
+        }
+    }
+    //loaded instance with one more handle
+    Slot *referenced(uint32_t id, Factory factory){
+        auto *s = find(id);
+        ASSERT_ON(s == nullptr);
+        auto state = s->state.load(std::memory_order_acquire);
+        while(true){
+            if((state & STATE_MASK) == LOADED){
+                if(s->state.compare_exchange_weak(state, (state + REF) | USED, std::memory_order_acquire)){
+                    return s;
+                }
+                continue;
+            }
+            load(id, *s, factory);
+            //may be evicted again before the handle is taken
+            state = s->state.load(std::memory_order_acquire);
+        }
+    }
 public:
+    static constexpr std::string_view TYPE_NAME = "UniqueIDStorage";
     static constexpr size_t UNKNOWN_ID = 0;
-    UniqueIDStorage(Storage &storage): storage(storage) {}
 
-    void registerInstance(const UniqueIDInterface<IDName> &u){
-        T *t_ptr = static_cast<T *>(&(const_cast<std::add_lvalue_reference_t<std::remove_const_t<std::remove_reference_t<decltype(u)>>>>(u)));
+    //instance held by acquire(), cannot be evicted while the handle lives
+    template<typename U>
+    class Ref{
+        Slot *slot{nullptr};
+    public:
+        Ref() {}
+        explicit Ref(Slot *slot): slot(slot) {}
+        Ref(Ref &&other): slot(std::exchange(other.slot, nullptr)) {}
+        Ref &operator=(Ref other){
+            std::swap(slot, other.slot);
+            return *this;
+        }
+        ~Ref(){
+            if(slot){
+                slot->state.fetch_sub(REF, std::memory_order_release);
+            }
+        }
+        U &operator*() const{
+            return static_cast<U &>(*slot->ptr.load(std::memory_order_acquire));
+        }
+        U *operator->() const{
+            return &**this;
+        }
+        explicit operator bool() const{
+            return slot != nullptr;
+        }
+    };
+
+    UniqueIDStorage(Storage &storage, std::pmr::memory_resource *resource = deserialize_resource()):
+        storage(storage), resource(resource) {}
+    UniqueIDStorage(UniqueIDStorage &&other):
+        storage(other.storage), resource(other.resource), directory(other.directory.exchange(nullptr)),
+        directories(std::move(other.directories)), count(std::exchange(other.count, 0)),
+        type_names(std::move(other.type_names)), max_id(other.max_id) {
+        other.directories.clear();
+    }
+    ~UniqueIDStorage(){
+        auto *dir = directory.load();
+        for(size_t c = 0; dir && c < dir->size; c++){
+            if(auto *chunk = dir->chunks[c].load()){
+                for(auto &s: chunk->slots){
+                    delete s.ptr.load();
+                }
+                chunk->~Chunk();
+                resource->deallocate(chunk, sizeof(Chunk), alignof(Chunk));
+            }
+        }
+        for(auto *d: directories){
+            resource->deallocate(d->chunks, d->size * sizeof(std::atomic<Chunk *>), alignof(std::atomic<Chunk *>));
+            resource->deallocate(d, sizeof(Directory), alignof(Directory));
+        }
+    }
+
+    //takes ownership, type id of U is kept for loading it back without a type
+    template<CUniqueID<IDName> U>
+    void registerInstance(const U &u){
+        T *t_ptr = static_cast<T *>(const_cast<U *>(&u));
         ASSERT_ON(t_ptr == nullptr);
         auto id = u.UniqueIDInstance::getUniqueID();
-        auto it = m.find(id);
-        if(it != m.end()){
-            ASSERT_ON(it->second.second.get() != nullptr);
-            it->second.second.reset(t_ptr);
-        } else {
-            m.emplace(id, std::make_pair(StorageAddress{}, std::unique_ptr<T>(t_ptr)));
+        std::lock_guard lock{mutex};
+        auto &s = slot(id);
+        auto state = s.state.load(std::memory_order_relaxed);
+        ASSERT_ON((state & STATE_MASK) == LOADED || (state & STATE_MASK) == LOADING);
+        if((state & STATE_MASK) == ABSENT){
+            s.address.reset();
+            count++;
         }
+        if constexpr(std::is_base_of_v<T, U>){
+            s.type = Registry::global().template id_of<U>();
+            if constexpr(CStableTypeName<U>){
+                type_names.try_emplace(s.type, U::TYPE_NAME);
+            } else if(s.type != Registry::UNKNOWN){
+                type_names.try_emplace(s.type, Registry::global().name(s.type));
+            }
+        }
+        //owner keeps references to it, so it is never evicted
+        s.ptr.store(t_ptr, std::memory_order_release);
+        s.state.store(LOADED | PINNED, std::memory_order_release);
     }
     template<CUniqueID<IDName> U> //requires derived 
     U &getInstance(const UniqueIDInterface<IDName> &u){
-        auto id = u.UniqueIDInstance::getUniqueID();
-        auto it = m.find(id);
-        ASSERT_ON(it == m.end());
-        auto &t_ptr = it->second.second;
-        if(t_ptr.get() == nullptr){
-            //read it from address
-            auto addr = it->second.first;
-            ASSERT_ON(addr.is_null());
-            auto new_ptr = deserialize_ptr<U>(storage, addr, id);
-            t_ptr.swap(new_ptr);
-        }
-        return *t_ptr.get();
+        return static_cast<U &>(pinned(u.getUniqueID(), &Registry::template make<U>));
+    }
+    //created by the registered factory of its type
+    T &getInstance(const UniqueIDInterface<IDName> &u){
+        return pinned(u.getUniqueID(), nullptr);
+    }
+    //handle to the instance, loaded on first use, evictable when no handle holds it
+    template<CUniqueID<IDName> U>
+    Ref<U> acquire(const UniqueIDInterface<IDName> &u){
+        return Ref<U>{referenced(u.getUniqueID(), &Registry::template make<U>)};
+    }
+    Ref<T> acquire(const UniqueIDInterface<IDName> &u){
+        return Ref<T>{referenced(u.getUniqueID(), nullptr)};
+    }
+    //type id kept for the instance, TypeRegistry::UNKNOWN if it was not registered with its type
+    //or the type has no stable name
+    TypeId type_of(const UniqueIDInterface<IDName> &u) const{
+        std::lock_guard lock{mutex};
+        auto *s = find(u.getUniqueID());
+        return s ? s->type : Registry::UNKNOWN;
+    }
+    //evicts loaded instances without handles which were not used since the previous call, returns their number
+    size_t evict_idle(){
+        std::lock_guard lock{mutex};
+        size_t evicted = 0;
+        for_each([&](uint32_t, Slot &s){
+            auto state = s.state.load(std::memory_order_relaxed);
+            while((state & STATE_MASK) == LOADED && !(state & PINNED) && state < REF){
+                if(state & USED){
+                    //second chance
+                    if(s.state.compare_exchange_weak(state, state & ~USED, std::memory_order_relaxed)){
+                        break;
+                    }
+                } else if(s.state.compare_exchange_weak(state, UNLOADED, std::memory_order_acquire)){
+                    delete s.ptr.exchange(nullptr, std::memory_order_relaxed);
+                    evicted++;
+                    break;
+                }
+            }
+        });
+        return evicted;
+    }
+    struct LoadTiming{
+        uint32_t id;
+        std::chrono::nanoseconds time;
+    };
+    //no instance needs another one loaded first
+    struct NoDependencies{
+        std::vector<uint32_t> operator()(uint32_t) const{
+            return {};
+        }
+    };
+    using Dependencies = std::function<std::vector<uint32_t>(uint32_t)>;
+    /*
+    Loads every registered instance which is not loaded yet as U, on threads workers (0 - one per cpu).
+    depends(id) returns ids which have to be loaded before id, e.g. the storage a nested storage lives in.
+    Returns the load time of every instance, in load order.
+    */
+    template<CUniqueID<IDName> U, typename Depends = NoDependencies>
+    std::vector<LoadTiming> load_all(size_t threads = 0, Depends &&depends = {}){
+        return load_all(threads, depends, &Registry::template make<U>);
+    }
+    //every instance created by the registered factory of its type
+    std::vector<LoadTiming> load_all(size_t threads = 0, const Dependencies &depends = NoDependencies{}){
+        return load_all(threads, depends, nullptr);
+    }
+private:
+    template<typename Depends>
+    std::vector<LoadTiming> load_all(size_t threads, Depends &depends, Factory factory){
+        std::vector<uint32_t> ids;
+        {
+            std::lock_guard lock{mutex};
+            for_each([&](uint32_t id, const Slot &s){
+                if((s.state.load(std::memory_order_relaxed) & STATE_MASK) == UNLOADED){
+                    ids.push_back(id);
+                }
+            });
+        }
+        //dependency graph, an instance is ready once everything it depends on is loaded
+        std::unordered_map<uint32_t, size_t> index;
+        for(size_t i = 0; i < ids.size(); i++){
+            index.emplace(ids[i], i);
+        }
+        std::vector<size_t> waiting(ids.size(), 0);
+        std::vector<std::vector<size_t>> dependents(ids.size());
+        std::vector<size_t> ready;
+        for(size_t i = 0; i < ids.size(); i++){
+            for(uint32_t dep: depends(ids[i])){
+                auto *s = find(dep);
+                ASSERT_ON_MSG(s == nullptr || (s->state.load(std::memory_order_relaxed) & STATE_MASK) == ABSENT, "unknown dependency");
+                auto it = index.find(dep);
+                if(it != index.end()){
+                    dependents[it->second].push_back(i);
+                    waiting[i]++;
+                }
+            }
+            if(waiting[i] == 0){
+                ready.push_back(i);
+            }
+        }
+
+        std::vector<LoadTiming> timings;
+        timings.reserve(ids.size());
+        std::mutex queue_mutex;
+        std::condition_variable cv;
+        size_t running = 0;
+        std::exception_ptr error;
+        auto worker = [&](){
+            std::unique_lock lock{queue_mutex};
+            while(true){
+                cv.wait(lock, [&](){ return !ready.empty() || running == 0 || error; });
+                //nothing ready and nothing running - done, or the rest waits on a cycle
+                if(error || ready.empty()){
+                    cv.notify_all();
+                    return;
+                }
+                size_t i = ready.back();
+                ready.pop_back();
+                running++;
+                lock.unlock();
+
+                std::exception_ptr e;
+                auto start = std::chrono::steady_clock::now();
+                try{
+                    load(ids[i], *find(ids[i]), factory);
+                } catch(...){
+                    e = std::current_exception();
+                }
+                auto time = std::chrono::steady_clock::now() - start;
+
+                lock.lock();
+                running--;
+                if(e){
+                    error = e;
+                } else {
+                    timings.push_back(LoadTiming{ids[i], std::chrono::duration_cast<std::chrono::nanoseconds>(time)});
+                    for(size_t d: dependents[i]){
+                        if(--waiting[d] == 0){
+                            ready.push_back(d);
+                        }
+                    }
+                }
+                cv.notify_all();
+            }
+        };
+        if(threads == 0){
+            threads = std::max(1U, std::thread::hardware_concurrency());
+        }
+        threads = std::min(threads, ids.size());
+        std::vector<std::thread> workers;
+        for(size_t t = 1; t < threads; t++){
+            workers.emplace_back(worker);
+        }
+        worker();
+        for(auto &w: workers){
+            w.join();
+        }
+        if(error){
+            std::rethrow_exception(error);
+        }
+        ASSERT_ON_MSG(timings.size() != ids.size(), "dependency cycle");
+        LOG("UniqueIDStorage: loaded %lu instances on %lu threads", timings.size(), threads);
+        return timings;
+    }
+public:
+    bool is_loaded(const UniqueIDInterface<IDName> &u) const{
+        auto *s = find(u.getUniqueID());
+        return s && (s->state.load(std::memory_order_acquire) & STATE_MASK) == LOADED;
     }
     void registerInstanceAddress(const UniqueIDInterface<IDName> &u, const StorageAddress &addr){
         auto id = u.UniqueIDInstance::getUniqueID();
-        auto it = m.find(id);
-        ASSERT_ON(it == m.end());
-        it->second.first = addr;
+        std::lock_guard lock{mutex};
+        auto *s = find(id);
+        ASSERT_ON(s == nullptr || (s->state.load(std::memory_order_relaxed) & STATE_MASK) == ABSENT);
+        s->address = addr;
     }
+    //instance must not be held by acquire() handles, references from getInstance() become invalid
     void deleteInstance(const UniqueIDInterface<IDName> &u){
-        m.erase(u.getUniqueID());
+        std::lock_guard lock{mutex};
+        auto *s = find(u.getUniqueID());
+        if(s == nullptr || (s->state.load(std::memory_order_relaxed) & STATE_MASK) == ABSENT){
+            return;
+        }
+        auto state = s->state.load(std::memory_order_acquire);
+        ASSERT_ON((state & STATE_MASK) == LOADING);
+        ASSERT_ON_MSG(state >= REF, "instance is held by a handle");
+        s->state.store(ABSENT, std::memory_order_release);
+        delete s->ptr.exchange(nullptr, std::memory_order_acq_rel);
+        s->address.reset();
+        count--;
     }
     uint32_t generateID(){
+        std::lock_guard lock{mutex};
         ASSERT_ON(max_id == std::numeric_limits<decltype(max_id)>::max());
         return ++max_id;
     }
 
-    using RemovedUPTR = std::pair<uint32_t, StorageAddress>;
-    RemovedUPTR remove_uptr(const typename decltype(m)::value_type &p) const{
-        return {p.first, p.second.first};
+    //id, address, type id
+    using RemovedUPTR = std::tuple<uint32_t, StorageAddress, TypeId>;
+    using Records = std::vector<RemovedUPTR>;
+    using TypeNames = std::vector<std::pair<TypeId, std::string>>;
+    //names of the types of stored instances, under mutex
+    TypeNames stored_types() const{
+        TypeNames types;
+        for_each([&](uint32_t, const Slot &s){
+            if(s.type != Registry::UNKNOWN && std::find_if(types.begin(), types.end(), [&](auto &t){ return t.first == s.type; }) == types.end()){
+                types.emplace_back(s.type, type_name_of(s.type));
+            }
+        });
+        return types;
     }
 
+private:
+    //under mutex
+    Records records() const{
+        Records r;
+        r.reserve(count);
+        for_each([&](uint32_t id, const Slot &s){
+            r.emplace_back(id, s.address, s.type);
+        });
+        return r;
+    }
+    //under mutex
+    void add_record(const RemovedUPTR &record){
+        auto &s = slot(std::get<0>(record));
+        ASSERT_ON((s.state.load(std::memory_order_relaxed) & STATE_MASK) != ABSENT);
+        s.address = std::get<1>(record);
+        s.type = std::get<2>(record);
+        s.state.store(UNLOADED, std::memory_order_relaxed);
+        count++;
+    }
+public:
+    //schema block: max id, records, type table
     Result serializeImpl(StorageBuffer<> &buffer) const {
         ASSERT_ON(getSizeImpl() > buffer.allocated());
+        std::lock_guard lock{mutex};
         size_t offset = 0;
-
-        SerializeSequentially(buffer, offset, max_id, m.size());
-
-        for(const auto &it: m){
-            auto it_r_uptr = remove_uptr(it);
-            SerializeSequentially(buffer, offset, it_r_uptr);
-        }
-        return Result::Success;
+        return SerializeSchema<UniqueIDStorage>(buffer, offset, SCHEMA_VERSION, max_id, records(), stored_types());
     }
     static UniqueIDStorage<T, Storage> deserializeImpl(const StorageBufferRO<> &buffer, Storage &storage) {
         UniqueIDStorage<T, Storage> uid{storage};
 
         size_t offset = 0;
         auto buf = buffer;
-        auto [max_id, num] = DeserializeSequentially<decltype(uid.max_id), typename decltype(m)::size_type>(buf, offset);
+        std::lock_guard lock{uid.mutex};
+        if(szeimpl::d<uint64_t>(buffer) != stable_type_fingerprint<UniqueIDStorage>()){
+            //unversioned table: max id, count, (id, address)...
+            LOG("UniqueIDStorage: reading a table without schema, types are unknown");
+            auto [max_id, num] = DeserializeSequentially<decltype(uid.max_id), size_t>(buf, offset);
+            uid.max_id = max_id;
+            for(size_t i = 0; i < num; i++){
+                auto [val] = DeserializeSequentially<std::pair<uint32_t, StorageAddress>>(buf, offset);
+                uid.add_record(RemovedUPTR{val.first, val.second, Registry::UNKNOWN});
+            }
+            return uid;
+        }
+        auto [header, max_id, records, types] = DeserializeSchema<UniqueIDStorage, decltype(uid.max_id), Records, TypeNames>(buf, offset);
         uid.max_id = max_id;
-
-        for(size_t i = 0; i < num; i++){
-            auto [val] = DeserializeSequentially<RemovedUPTR>(buf, offset);
-            uid.m.emplace(val.first, std::make_pair(val.second, std::unique_ptr<T>{}));
+        for(auto &record: records){
+            uid.add_record(record);
         }
+        uid.type_names.insert(types.begin(), types.end());
         return uid;
     }
     static UniqueIDStorage<T, Storage> deserializeImpl(const StorageBufferRO<> &buffer) { throw std::bad_function_call("Not implemented"); };
     size_t getSizeImpl() const {
-        typename decltype(m)::size_type s{0};
-        size_t sum = szeimpl::size(max_id) + szeimpl::size(s);
-        for(const auto &e: m){
-            auto e_r_uptr = remove_uptr(e);
-            sum += szeimpl::size(e_r_uptr);
-        }
-        return sum;
+        std::lock_guard lock{mutex};
+        return SchemaSize<UniqueIDStorage>(max_id, records(), stored_types());
     }
 };
 
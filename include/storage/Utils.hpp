@@ -68,7 +68,7 @@ uint8_t MostSignificantBitSet(T v){
   if(v == 0)
 	return 0;
   uint8_t LeadingZeros = __builtin_clzll(v);
-  constexpr uint8_t BitWidth = sizeof(T);
+  constexpr uint8_t BitWidth = sizeof(unsigned long long) * 8;
   return BitWidth - LeadingZeros - 1;
 #else
 #error "Unsupported CLZ command"
@@ -51,15 +51,16 @@ commands: lookup (1 or N) key and return either
 - or entry if no next key
 
 when deserializing, need to match serialized type and new type.
-for this we need to keep a string description of the objects and compare to this
-this is a part of objectstorage class
+TypedObject keeps stable_type_fingerprint<T>() of the catalog type next to it and compares on load
 
 */
 
 #include <type_traits>
 #include <typeinfo>
 #include <string>
-#include <map>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
 
 #include <storage/DataStorage.hpp>
 #include <storage/Serialize.hpp>
@@ -67,74 +68,458 @@ this is a part of objectstorage class
 #include <storage/SimpleStorage.hpp>
 #include <storage/StorageManager.hpp>
 #include <storage/StorageManagerDecl.hpp>
+#include <storage/StringDictionary.hpp>
 
 template <CSerializable ...Keys>
 using MultiLevelKey = std::tuple<Keys...>;
 
+//one level of the catalog trie: hashed children of a key, Child is the next level node or the value
+template <typename K, typename Child>
+class KeyMapNode;
+
+//node or value reached after N more keys
+template <typename Node, size_t N>
+struct key_map_prefix{
+    using type = typename key_map_prefix<typename Node::ChildType, N - 1>::type;
+};
+template <typename Node>
+struct key_map_prefix<Node, 0>{
+    using type = Node;
+};
+template <typename Node, size_t N>
+using key_map_prefix_t = typename key_map_prefix<Node, N>::type;
+
+template <typename Value, typename ...Keys>
+struct key_map_root;
+template <typename Value, typename K>
+struct key_map_root<Value, K>{
+    using type = KeyMapNode<K, Value>;
+};
+template <typename Value, typename K, typename ...Rest>
+struct key_map_root<Value, K, Rest...>{
+    using type = KeyMapNode<K, typename key_map_root<Value, Rest...>::type>;
+};
+
+template <typename K, typename Child>
+class KeyMapNode{
+public:
+    using Key = std::remove_cv_t<K>;
+    using ChildType = Child;
+    static constexpr bool LEAF = !requires{ typename Child::ChildType; };
+private:
+    using Map = std::unordered_map<Key, Child>;
+    using Entry = typename Map::value_type;
+    Map children;
+    //children sorted by key, rebuilt on first ordered access after a change
+    mutable std::vector<Entry *> order;
+    mutable bool is_ordered{true};
+public:
+    KeyMapNode() {}
+    KeyMapNode(const KeyMapNode &other): children(other.children), is_ordered(other.children.empty()) {}
+    KeyMapNode(KeyMapNode &&other):
+        children(std::move(other.children)), order(std::move(other.order)), is_ordered(other.is_ordered) {
+        other.order.clear();
+        other.is_ordered = true;
+    }
+    KeyMapNode &operator=(KeyMapNode other){
+        children.swap(other.children);
+        order.swap(other.order);
+        std::swap(is_ordered, other.is_ordered);
+        return *this;
+    }
+
+    bool empty() const{
+        return children.empty();
+    }
+    size_t size() const{
+        return children.size();
+    }
+
+    //node or value after the given keys, nullptr if missing
+    template <typename ...Rest>
+    key_map_prefix_t<Child, sizeof...(Rest)> *find(const Key &k, const Rest&... rest){
+        auto it = children.find(k);
+        if(it == children.end()){
+            return nullptr;
+        }
+        if constexpr(sizeof...(Rest) == 0){
+            return &it->second;
+        } else {
+            return it->second.find(rest...);
+        }
+    }
+    //last argument is the value, existing value is kept. returns whether it was added
+    template <typename ...Rest>
+    bool add(const Key &k, const Rest&... rest){
+        if constexpr(LEAF){
+            static_assert(sizeof...(Rest) == 1);
+            auto [it, inserted] = children.try_emplace(k, rest...);
+            is_ordered = is_ordered && !inserted;
+            return inserted;
+        } else {
+            auto [it, inserted] = children.try_emplace(k);
+            is_ordered = is_ordered && !inserted;
+            bool added = it->second.add(rest...);
+            if(inserted && !added){
+                children.erase(it);
+                order.clear();
+                is_ordered = children.empty();
+            }
+            return added;
+        }
+    }
+    //empty nodes on the way are removed. returns whether the entry was found
+    template <typename ...Rest>
+    bool del(const Key &k, const Rest&... rest){
+        auto it = children.find(k);
+        if(it == children.end()){
+            return false;
+        }
+        if constexpr(sizeof...(Rest) != 0){
+            if(!it->second.del(rest...)){
+                return false;
+            }
+            if(!it->second.empty()){
+                return true;
+            }
+        }
+        children.erase(it);
+        order.clear();
+        is_ordered = children.empty();
+        return true;
+    }
+    //calls f(const Key &, const Child &) in hash table order
+    template <typename F>
+    void for_each(F &&f) const{
+        for(auto &[k, child]: children){
+            f(k, child);
+        }
+    }
+    //(key, child) pairs in key order, less has to be the same on every call
+    template <typename Less = std::less<Key>>
+    const std::vector<Entry *> &ordered(Less less = {}) const{
+        if(!is_ordered){
+            order.clear();
+            order.reserve(children.size());
+            for(auto &e: const_cast<Map &>(children)){
+                order.push_back(&e);
+            }
+            std::sort(order.begin(), order.end(), [&](const Entry *a, const Entry *b){ return less(a->first, b->first); });
+            is_ordered = true;
+        }
+        return order;
+    }
+};
+
+//std::string keys are stored in the catalog as StringDictionary ids
+template <typename K>
+inline constexpr bool is_interned_key_v = std::is_same_v<std::remove_cv_t<K>, std::string>;
+template <typename K>
+using stored_key_t = std::conditional_t<is_interned_key_v<K>, StringDictionary::Id, std::remove_cv_t<K>>;
+
+//conversion between catalog keys and their stored form, owns the dictionary of interned levels
+template <typename ...Keys>
+class CatalogKeyCodec{
+public:
+    static constexpr size_t LEVELS = sizeof...(Keys);
+    static constexpr bool INTERNED = (is_interned_key_v<Keys> || ...);
+    using Key = std::tuple<std::remove_cv_t<Keys>...>;
+    template <size_t I>
+    using LevelKey = std::tuple_element_t<I, Key>;
+    using StoredKey = std::tuple<stored_key_t<Keys>...>;
+    template <size_t I>
+    using LevelStoredKey = std::tuple_element_t<I, StoredKey>;
+private:
+    template <size_t ...I>
+    static std::tuple<LevelStoredKey<I>...> stored_prefix_type(std::index_sequence<I...>);
+
+    template <size_t I, typename T>
+    bool find_stored(const T &k, LevelStoredKey<I> &stored) const{
+        if constexpr(is_interned_key_v<LevelKey<I>>){
+            auto id = dict.find(k);
+            if(!id){
+                return false;
+            }
+            stored = *id;
+        } else {
+            stored = k;
+        }
+        return true;
+    }
+    template <size_t ...I, typename P, typename ...Prefix>
+    bool find_stored_impl(P &stored, std::index_sequence<I...>, const Prefix&... prefix) const{
+        return (find_stored<I>(prefix, std::get<I>(stored)) && ...);
+    }
+    template <size_t I>
+    LevelStoredKey<I> intern_key(const LevelKey<I> &k){
+        if constexpr(is_interned_key_v<LevelKey<I>>){
+            return dict.intern(k);
+        } else {
+            return k;
+        }
+    }
+    template <size_t ...I>
+    StoredKey intern_impl(std::index_sequence<I...>, const Keys&... keys){
+        return StoredKey{intern_key<I>(keys)...};
+    }
+    template <size_t ...I>
+    void decode_impl(Key &key, const StoredKey &stored, std::index_sequence<I...>) const{
+        (set_key<I>(key, std::get<I>(stored)), ...);
+    }
+public:
+    //stored form of the first N keys
+    template <size_t N>
+    using StoredPrefix = decltype(stored_prefix_type(std::make_index_sequence<N>{}));
+
+    StringDictionary dict;
+
+    //false if a string key was never interned, so nothing is stored under it
+    template <typename ...Prefix>
+    bool find_stored(StoredPrefix<sizeof...(Prefix)> &stored, const Prefix&... prefix) const{
+        return find_stored_impl(stored, std::index_sequence_for<Prefix...>{}, prefix...);
+    }
+    StoredKey intern(const Keys&... keys){
+        return intern_impl(std::index_sequence_for<Keys...>{}, keys...);
+    }
+    template <size_t I>
+    void set_key(Key &key, const LevelStoredKey<I> &stored) const{
+        if constexpr(is_interned_key_v<LevelKey<I>>){
+            std::get<I>(key) = dict.str(stored);
+        } else {
+            std::get<I>(key) = stored;
+        }
+    }
+    void decode(Key &key, const StoredKey &stored) const{
+        decode_impl(key, stored, std::index_sequence_for<Keys...>{});
+    }
+    //interned levels are ordered by string, not by id
+    template <size_t I>
+    auto level_less() const{
+        if constexpr(is_interned_key_v<LevelKey<I>>){
+            return [this](StringDictionary::Id a, StringDictionary::Id b){ return dict.str(a) < dict.str(b); };
+        } else {
+            return std::less<LevelKey<I>>{};
+        }
+    }
+    //three-way comparison of the first N levels of stored keys or prefixes
+    template <size_t N, size_t I = 0, typename A, typename B>
+    int compare(const A &a, const B &b) const{
+        if constexpr(I == N){
+            return 0;
+        } else {
+            const auto &x = std::get<I>(a);
+            const auto &y = std::get<I>(b);
+            if(x != y){
+                if constexpr(is_interned_key_v<LevelKey<I>>){
+                    return dict.str(x) < dict.str(y) ? -1 : 1;
+                } else {
+                    return x < y ? -1 : 1;
+                }
+            }
+            return compare<N, I + 1>(a, b);
+        }
+    }
+};
+
+/*
+Catalog trie, one level per key. Every level is a hash table, so exact lookup is one hash probe per key.
+Prefix lookups (folder listing, all entries under a prefix) visit only the subtree of the prefix,
+children of a level are sorted lazily, so iteration is in key order.
+String keys are interned in a per-catalog dictionary: the trie holds and compares 32-bit ids,
+every distinct string is kept and serialized once.
+*/
 template <CSerializable Value, CSerializable ...Keys>
     requires std::is_default_constructible_v<Value>
 class SimpleMultiLevelKeyMap {
-    std::map<MultiLevelKey<Keys...>, Value> m;
-
+public:
+    using Codec = CatalogKeyCodec<Keys...>;
+    static constexpr size_t LEVELS = sizeof...(Keys);
+    //full key passed to scan()
+    using Key = typename Codec::Key;
+    //key of level I
+    template <size_t I>
+    using LevelKey = typename Codec::template LevelKey<I>;
+private:
+    static constexpr bool INTERNED = Codec::INTERNED;
+    using StoredKey = typename Codec::StoredKey;
+    template <size_t N>
+    using StoredPrefix = typename Codec::template StoredPrefix<N>;
+
+    using Root = typename key_map_root<Value, stored_key_t<Keys>...>::type;
+    Codec codec;
+    Root root;
+    size_t count{0};
+
+    template <size_t I, typename Node, typename F>
+    void walk(Node &node, Key &key, F &f) const{
+        for(auto *e: node.ordered(codec.template level_less<I>())){
+            codec.template set_key<I>(key, e->first);
+            if constexpr(I + 1 == LEVELS){
+                f(static_cast<const Key &>(key), e->second);
+            } else {
+                walk<I + 1>(e->second, key, f);
+            }
+        }
+    }
+    //node or value after the prefix, nullptr if missing
+    template <typename ...Prefix>
+    auto *prefix_node(const Prefix&... prefix){
+        if constexpr(sizeof...(Prefix) == 0){
+            return &root;
+        } else {
+            StoredPrefix<sizeof...(Prefix)> stored;
+            decltype(std::apply([&](const auto&... k){ return root.find(k...); }, stored)) node = nullptr;
+            if(codec.find_stored(stored, prefix...)){
+                node = std::apply([&](const auto&... k){ return root.find(k...); }, stored);
+            }
+            return node;
+        }
+    }
 public:
     SimpleMultiLevelKeyMap() {}
     ~SimpleMultiLevelKeyMap() {}
 
+    size_t size() const{
+        return count;
+    }
+    //distinct strings of all string keys
+    const StringDictionary &dictionary() const{
+        return codec.dict;
+    }
+    //stored form of keys, used by secondary indexes
+    const Codec &key_codec() const{
+        return codec;
+    }
+
+    //existing entry is kept
     Result add(const Keys&... keys, const Value &value){
-        m.emplace(std::make_tuple(keys...), value);
+        auto stored = codec.intern(keys...);
+        count += std::apply([&](const auto&... k){ return root.add(k..., value); }, stored);
         return Result::Success;
     }
+    bool has(const Keys&... keys){
+        return prefix_node(keys...) != nullptr;
+    }
     std::pair<bool, Value> get(const Keys&... keys){
-        auto it = m.find(std::make_tuple(keys...));
-        if(it == m.end()){
+        auto *v = prefix_node(keys...);
+        if(v == nullptr){
             return std::make_pair(false, Value{});
         }
-        return std::make_pair(true, it->second);
+        return std::make_pair(true, *v);
     }
-    Value &getRef(const Keys&... keys){
-        auto it = m.find(std::make_tuple(keys...));
-        if(it == m.end()){
-            return std::make_pair(false, Value{});
-        }
-        return std::make_pair(true, it->second);
+    std::pair<bool, Value *> getRef(const Keys&... keys){
+        auto *v = prefix_node(keys...);
+        return std::make_pair(v != nullptr, v);
     }
     void del(const Keys&... keys){
-        m.erase(std::make_tuple(keys...));
+        StoredPrefix<LEVELS> stored;
+        if(codec.find_stored(stored, keys...)){
+            count -= std::apply([&](const auto&... k){ return root.del(k...); }, stored);
+        }
     }
-    //CSerializableImpl
-    Result serializeImpl(StorageBuffer<> &buffer) const {
-		size_t offset = 0;
-        SerializeSequentially(buffer, offset, m.size());
 
-		for(auto it: m){
-            SerializeSequentially(buffer, offset, it);
-		}
+    //keys of the next level under the prefix in key order, i.e. folder listing. no prefix = first level
+    template <typename ...Prefix>
+    std::vector<LevelKey<sizeof...(Prefix)>> list(const Prefix&... prefix){
+        constexpr size_t I = sizeof...(Prefix);
+        static_assert(I < LEVELS, "prefix has to leave at least one level");
+        std::vector<LevelKey<I>> keys;
+        if(auto *node = prefix_node(prefix...)){
+            keys.reserve(node->size());
+            Key key;
+            for(auto *e: node->ordered(codec.template level_less<I>())){
+                codec.template set_key<I>(key, e->first);
+                keys.push_back(std::get<I>(key));
+            }
+        }
+        return keys;
+    }
+    //calls f(const Key &, Value &) in key order for every entry under the prefix
+    template <typename F, typename ...Prefix>
+    void scan(F &&f, const Prefix&... prefix){
+        static_assert(sizeof...(Prefix) <= LEVELS);
+        auto *node = prefix_node(prefix...);
+        if(node == nullptr){
+            return;
+        }
+        Key key{};
+        [&]<size_t ...I>(std::index_sequence<I...>){
+            ((std::get<I>(key) = prefix), ...);
+        }(std::index_sequence_for<Prefix...>{});
+        if constexpr(sizeof...(Prefix) == LEVELS){
+            f(static_cast<const Key &>(key), *node);
+        } else {
+            walk<sizeof...(Prefix)>(*node, key, f);
+        }
+    }
+    //calls f(const Key &, const Value &)
+    template <typename F, typename ...Prefix>
+    void scan(F &&f, const Prefix&... prefix) const{
+        //lookups don't change the trie, only the lazily sorted order
+        const_cast<SimpleMultiLevelKeyMap &>(*this).scan([&](const Key &key, const Value &value){ f(key, value); }, prefix...);
+    }
+
+    //CSerializableImpl: [dictionary if there are string keys], count, (stored keys, value)...
+    Result serializeImpl(StorageBuffer<> &buffer) const {
+        size_t offset = 0;
+        if constexpr(INTERNED){
+            SerializeSequentially(buffer, offset, codec.dict);
+        }
+        SerializeSequentially(buffer, offset, count);
+        scan_stored([&](const StoredKey &key, const Value &value){
+            SerializeSequentially(buffer, offset, std::make_pair(key, value));
+        });
         return Result::Success;
     }
     static SimpleMultiLevelKeyMap<Value, Keys...>
     deserializeImpl(const StorageBufferRO<> &buffer) {
         SimpleMultiLevelKeyMap<Value, Keys...> smlmk;
-		size_t offset = 0;
-		auto buf = buffer;
-
-		auto [num] = DeserializeSequentially<typename decltype(smlmk.m)::size_type>(buf, offset);
-		for(size_t i = 0; i < num; i++){
-			auto [val] = DeserializeSequentially<typename decltype(smlmk.m)::value_type>(buf, offset);
-			smlmk.m.emplace(val);
-		}
+        size_t offset = 0;
+        auto buf = buffer;
+
+        if constexpr(INTERNED){
+            auto [dict] = DeserializeSequentially<StringDictionary>(buf, offset);
+            smlmk.codec.dict = std::move(dict);
+        }
+        auto [num] = DeserializeSequentially<size_t>(buf, offset);
+        for(size_t i = 0; i < num; i++){
+            //ids refer to the dictionary above, no strings are hashed
+            auto [val] = DeserializeSequentially<std::pair<StoredKey, Value>>(buf, offset);
+            smlmk.count += std::apply([&](const auto&... k){ return smlmk.root.add(k..., val.second); }, val.first);
+        }
         return smlmk;
     }
     size_t getSizeImpl() const {
         size_t sum = 0;
-        sum += szeimpl::size(m.size());
-        for(auto &e: m){
-            sum += szeimpl::size(e);
+        if constexpr(INTERNED){
+            sum += szeimpl::size(codec.dict);
         }
+        sum += szeimpl::size(count);
+        scan_stored([&](const StoredKey &key, const Value &value){
+            sum += szeimpl::size(std::make_pair(key, value));
+        });
         return sum;
     }
+private:
+    //f(const StoredKey &, const Value &) for every entry, in no particular order
+    template <size_t I = 0, typename Node, typename F>
+    static void walk_stored(const Node &node, StoredKey &key, F &f){
+        node.for_each([&](const auto &k, const auto &child){
+            std::get<I>(key) = k;
+            if constexpr(I + 1 == LEVELS){
+                f(static_cast<const StoredKey &>(key), child);
+            } else {
+                walk_stored<I + 1>(child, key, f);
+            }
+        });
+    }
+    template <typename F>
+    void scan_stored(F &&f) const{
+        StoredKey key{};
+        walk_stored(root, key, f);
+    }
 };
 
-
 /*
 VFC - per DataStorage instance - to organize all entries
     Value - StorageAddress, ObjectAddress
@@ -155,17 +540,20 @@ class VirtualFileCatalogImpl{
     using MLKM = SimpleMultiLevelKeyMap<Value, Keys...>;
     MLKM mlkm;
 public:
+    static constexpr std::string_view TYPE_NAME = "VirtualFileCatalog";
     VirtualFileCatalogImpl(MLKM &&mlkm):
-        mlkm(mlkm) {}
+        mlkm(std::move(mlkm)) {}
     VirtualFileCatalogImpl() = default;
     ~VirtualFileCatalogImpl() = default;
 
     Result add(const Keys&... keys, const Value &value){
         return mlkm.add(keys..., value);
     }
-    bool has (const Keys&... keys){
-        //TODO
-        return false;
+    bool has(const Keys&... keys){
+        return mlkm.has(keys...);
+    }
+    size_t size() const{
+        return mlkm.size();
     }
     std::pair<bool, Value> get(const Keys&... keys){
         return mlkm.get(keys...);
@@ -174,12 +562,22 @@ public:
     std::pair<bool, Value> get(const Keys&... keys){
         return static_cast<T>(mlkm.get(keys...));
     }*/
-    std::pair<bool, Value &> getRef(const Keys&... keys){
+    std::pair<bool, Value *> getRef(const Keys&... keys){
         return mlkm.getRef(keys...);
     }
     void del(const Keys&... keys){
         mlkm.del(keys...);
     }
+    //folder listing: keys of the next level under the prefix
+    template <typename ...Prefix>
+    auto list(const Prefix&... prefix){
+        return mlkm.list(prefix...);
+    }
+    //f(const MLKM::Key &, Value &) for every entry under the prefix, in key order
+    template <typename F, typename ...Prefix>
+    void scan(F &&f, const Prefix&... prefix){
+        mlkm.scan(std::forward<F>(f), prefix...);
+    }
 
     Result serializeImpl(StorageBuffer<> &buffer) const {
         Result res = Result::Success;
@@ -200,8 +598,7 @@ public:
     }
     static VirtualFileCatalogImpl deserializeImpl(const StorageBufferRO<> &buffer) { throw std::bad_function_call(); }
     size_t getSizeImpl() const {
-        std::string type_name{typeid(decltype(*this)).name()};
-        return szeimpl::size(mlkm) + szeimpl::size(type_name);
+        return szeimpl::size(mlkm);
     }
 };
 
@@ -0,0 +1,123 @@
+#include "gtest/gtest.h"
+
+#include <vector>
+
+#include <storage/Aggregates.hpp>
+#include <storage/ColumnarStorage.hpp>
+#include <storage/SimpleStorage.hpp>
+
+namespace{
+
+constexpr size_t MEMORYSIZE = 24;
+
+struct Trade{
+    uint64_t time;
+    double price;
+    uint64_t volume;
+};
+
+using TestStorage = SimpleRamStorage<MEMORYSIZE>;
+//small chunks, so aggregates combine many partial results
+using TradeColumns = ColumnarSequenceStorage<Trade, TestStorage, 100>;
+
+Trade make_trade(uint64_t i){
+    return Trade{i * 10, static_cast<double>(100 + (i * 37) % 50), 1 + i % 5};
+}
+
+TEST(AggregatesTest, Kernels){
+    //odd size covers the scalar tail of the vector loops
+    std::vector<double> v;
+    for(int i = 0; i < 1003; i++){
+        v.push_back((i * 7919) % 1000 - 500);
+    }
+    std::span<const double> s{v};
+    EXPECT_EQ(aggregate::sum(s), aggregate::sum_sw(s));
+    EXPECT_EQ(aggregate::min(s), -500.0);
+    EXPECT_EQ(aggregate::max(s), 499.0);
+    EXPECT_EQ(aggregate::min(s.subspan(0, 0)), std::numeric_limits<double>::infinity());
+    EXPECT_EQ(aggregate::dot(s, s), aggregate::dot_sw(s, s));
+    for(auto cmp: {aggregate::Cmp::Less, aggregate::Cmp::LessEqual, aggregate::Cmp::Greater,
+                   aggregate::Cmp::GreaterEqual, aggregate::Cmp::Equal, aggregate::Cmp::NotEqual}){
+        EXPECT_EQ(aggregate::count_where(s, cmp, 17.0), aggregate::count_sw(s, cmp, 17.0));
+    }
+
+    std::vector<uint32_t> u{5, 3, 9, 1};
+    EXPECT_EQ(aggregate::sum(std::span<const uint32_t>{u}), 18UL);
+    EXPECT_EQ(aggregate::max(std::span<const uint32_t>{u}), 9U);
+    EXPECT_EQ(aggregate::count_where(std::span<const uint32_t>{u}, aggregate::Cmp::Greater, 3U), 2UL);
+}
+
+TEST(AggregatesTest, Resample){
+    std::vector<uint64_t> time{0, 5, 9, 10, 25, 27};
+    std::vector<double> price{3, 5, 4, 7, 2, 1};
+    std::vector<uint64_t> volume{1, 1, 1, 2, 3, 4};
+    std::vector<aggregate::OHLC> bars;
+    //fed in two parts, bucket 0 is split between them
+    aggregate::resample(std::span<const uint64_t>{time}.subspan(0, 2), std::span<const double>{price}.subspan(0, 2),
+                        std::span<const uint64_t>{volume}.subspan(0, 2), 10, bars);
+    aggregate::resample(std::span<const uint64_t>{time}.subspan(2), std::span<const double>{price}.subspan(2),
+                        std::span<const uint64_t>{volume}.subspan(2), 10, bars);
+    ASSERT_EQ(bars.size(), 3UL);
+    EXPECT_EQ(bars[0].time, 0UL);
+    EXPECT_EQ(bars[0].open, 3.0);
+    EXPECT_EQ(bars[0].high, 5.0);
+    EXPECT_EQ(bars[0].low, 3.0);
+    EXPECT_EQ(bars[0].close, 4.0);
+    EXPECT_EQ(bars[0].volume, 3.0);
+    EXPECT_EQ(bars[1].time, 10UL);
+    EXPECT_EQ(bars[1].close, 7.0);
+    EXPECT_EQ(bars[2].time, 20UL);
+    EXPECT_EQ(bars[2].low, 1.0);
+    EXPECT_EQ(bars[2].volume, 7.0);
+    EXPECT_THROW(aggregate::resample(std::span<const uint64_t>{time}, std::span<const double>{price},
+                                     std::span<const uint64_t>{volume}, 0, bars), std::logic_error);
+}
+
+TEST(AggregatesTest, ColumnAggregates){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    TradeColumns seq(storage);
+    std::vector<Trade> trades;
+    for(uint64_t i = 0; i < 1234; i++){
+        trades.push_back(make_trade(i));
+    }
+    seq.append_range(trades);
+
+    size_t start = 150, end = 1100;
+    double price = 0, lo = 1e9, hi = 0, notional = 0;
+    uint64_t volume = 0;
+    size_t above = 0;
+    for(size_t i = start; i < end; i++){
+        price += trades[i].price;
+        lo = std::min(lo, trades[i].price);
+        hi = std::max(hi, trades[i].price);
+        volume += trades[i].volume;
+        notional += trades[i].price * trades[i].volume;
+        above += trades[i].price > 120;
+    }
+    //threads are spread over chunks, results must not depend on their number
+    for(size_t threads: {1, 4}){
+        EXPECT_EQ(aggregate::column_sum<1>(seq, start, end, threads), price);
+        EXPECT_EQ(aggregate::column_sum<2>(seq, start, end, threads), volume);
+        EXPECT_EQ(aggregate::column_min<1>(seq, start, end, threads), lo);
+        EXPECT_EQ(aggregate::column_max<1>(seq, start, end, threads), hi);
+        EXPECT_EQ(aggregate::column_count_where<1>(seq, start, end, aggregate::Cmp::Greater, 120.0, threads), above);
+        auto vwap = aggregate::column_vwap<1, 2>(seq, start, end, threads);
+        EXPECT_EQ(vwap.notional, notional);
+        EXPECT_DOUBLE_EQ(vwap.value(), notional / volume);
+    }
+
+    //bars of 1000 time units are 100 records, chunks of 100 records are shifted by start
+    auto bars = aggregate::column_resample<0, 1, 2>(seq, start, end, 1000, 4);
+    ASSERT_EQ(bars.size(), 10UL);
+    EXPECT_EQ(bars[0].time, 1000UL);
+    EXPECT_EQ(bars[0].open, trades[start].price);
+    EXPECT_EQ(bars[9].time, 10000UL);
+    EXPECT_EQ(bars[9].close, trades[end - 1].price);
+    double bar_volume = 0;
+    for(auto &bar: bars){
+        bar_volume += bar.volume;
+    }
+    EXPECT_EQ(bar_volume, static_cast<double>(volume));
+}
+
+}
@@ -0,0 +1,53 @@
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <storage/Checksum.hpp>
+
+#include "gtest/gtest.h"
+
+namespace{
+
+TEST(Checksum, CRC32CKnownValues){
+    const std::string s{"123456789"};
+    EXPECT_EQ(crc32c::value(s.data(), s.size()), 0xE3069283U);
+    EXPECT_EQ(crc32c::extend_sw(0, s.data(), s.size()), 0xE3069283U);
+    EXPECT_EQ(crc32c::value(s.data(), 0), 0U);
+
+    std::vector<unsigned char> zeros(32, 0);
+    EXPECT_EQ(crc32c::value(zeros.data(), zeros.size()), 0x8A9136AAU);
+}
+
+TEST(Checksum, CRC32CExtend){
+    std::vector<unsigned char> data(1000);
+    for(size_t i = 0; i < data.size(); i++){
+        data[i] = i * 7 + 3;
+    }
+    for(size_t split: {0UL, 1UL, 7UL, 8UL, 13UL, 512UL, 999UL}){
+        auto crc = crc32c::extend(crc32c::value(data.data(), split), data.data() + split, data.size() - split);
+        EXPECT_EQ(crc, crc32c::value(data.data(), data.size()));
+        EXPECT_EQ(crc, crc32c::extend_sw(0, data.data(), data.size()));
+    }
+}
+
+TEST(Checksum, CRC32CCombine){
+    std::vector<unsigned char> data(5000);
+    for(size_t i = 0; i < data.size(); i++){
+        data[i] = i * 13 + 1;
+    }
+    auto whole = crc32c::value(data.data(), data.size());
+    for(size_t split: {0UL, 1UL, 8UL, 100UL, 1536UL, 4999UL, 5000UL}){
+        auto crc_a = crc32c::value(data.data(), split);
+        auto crc_b = crc32c::value(data.data() + split, data.size() - split);
+        EXPECT_EQ(crc32c::combine(crc_a, crc_b, data.size() - split), whole);
+    }
+    //changed range folded into the crc of the whole message
+    auto changed = data;
+    for(size_t i = 1000; i < 1100; i++){
+        changed[i] ^= 0x5A;
+    }
+    auto delta = crc32c::value(data.data() + 1000, 100) ^ crc32c::value(changed.data() + 1000, 100);
+    EXPECT_EQ(whole ^ crc32c::shift(delta, data.size() - 1100), crc32c::value(changed.data(), changed.size()));
+}
+
+}
@@ -0,0 +1,140 @@
+#include "gtest/gtest.h"
+
+#include <filesystem>
+#include <vector>
+
+#include <storage/ColumnarStorage.hpp>
+#include <storage/SimpleStorage.hpp>
+
+namespace{
+
+constexpr size_t MEMORYSIZE = 24;
+
+struct Bar{
+    uint64_t time;
+    double open;
+    double close;
+    uint32_t volume;
+    uint8_t flags;
+
+    bool operator==(const Bar &other) const = default;
+};
+
+const std::string filename{"/tmp/ColumnarStorage.test"};
+
+using TestStorage = SimpleRamStorage<MEMORYSIZE>;
+//small chunks, so tests cross chunk boundaries
+using BarColumns = ColumnarSequenceStorage<Bar, TestStorage, 100>;
+
+static_assert(BarColumns::COLUMNS == 5);
+static_assert(std::is_same_v<BarColumns::Column<3>, uint32_t>);
+
+Bar make_bar(uint64_t i){
+    return Bar{i, 1.0 * i, 2.0 * i, static_cast<uint32_t>(i * 10), static_cast<uint8_t>(i % 3)};
+}
+
+TEST(ColumnarStorageTest, AggregateTie){
+    Bar b = make_bar(7);
+    auto fields = aggregate_tie(b);
+    std::get<3>(fields) = 5;
+    EXPECT_EQ(b.volume, 5U);
+    EXPECT_EQ(std::get<0>(fields), 7UL);
+    static_assert(std::is_same_v<aggregate_fields_t<Bar>, std::tuple<uint64_t, double, double, uint32_t, uint8_t>>);
+}
+
+TEST(ColumnarStorageTest, AppendGetRow){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    BarColumns seq(storage);
+
+    for(uint64_t i = 0; i < 250; i++){
+        EXPECT_EQ(seq.append(make_bar(i)), i);
+    }
+    EXPECT_EQ(seq.size(), 250UL);
+    for(uint64_t i = 0; i < 250; i++){
+        EXPECT_EQ(seq.get(i), make_bar(i));
+    }
+    auto row = seq.row(123);
+    EXPECT_EQ(row.get<2>(), 246.0);
+    EXPECT_EQ(row.get<4>(), 0);
+    Bar b = row;
+    EXPECT_EQ(b, make_bar(123));
+}
+
+TEST(ColumnarStorageTest, ScanColumns){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    BarColumns seq(storage);
+
+    std::vector<Bar> bars;
+    for(uint64_t i = 0; i < 1000; i++){
+        bars.push_back(make_bar(i));
+    }
+    seq.append(make_bar(0));
+    EXPECT_EQ(seq.append_range(std::span<const Bar>{bars}.subspan(1)), 1UL);
+    EXPECT_EQ(seq.size(), 1000UL);
+
+    double close = 0;
+    uint64_t volume = 0;
+    size_t calls = 0;
+    size_t next = 50;
+    seq.scan_columns<2, 3>(50, 950, [&](size_t first, std::span<const double> c, std::span<const uint32_t> v){
+        EXPECT_EQ(first, next);
+        EXPECT_EQ(c.size(), v.size());
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(c.data() - first % 100) % BarColumns::COLUMN_ALIGN, 0UL);
+        next += c.size();
+        calls++;
+        for(size_t j = 0; j < c.size(); j++){
+            close += c[j];
+            volume += v[j];
+        }
+    });
+    EXPECT_EQ(next, 950UL);
+    EXPECT_EQ(calls, 10UL);
+    //sum of i in [50, 950)
+    uint64_t sum = (949 * 950 - 49 * 50) / 2;
+    EXPECT_EQ(close, 2.0 * sum);
+    EXPECT_EQ(volume, 10 * sum);
+
+    size_t rows = 0;
+    seq.scan(990, 2000, [&](size_t index, const BarColumns::RowView &row){
+        EXPECT_EQ(row.value(), make_bar(index));
+        rows++;
+    });
+    EXPECT_EQ(rows, 10UL);
+}
+
+TEST(ColumnarStorageTest, ChecksummedReopen){
+    using Storage = CheckedFileStorage<MEMORYSIZE>;
+    using Columns = ColumnarSequenceStorage<Bar, Storage, 100>;
+    std::filesystem::remove(std::filesystem::path{filename});
+
+    StorageAddress addr;
+    {
+        Storage storage{FileRMA<MEMORYSIZE>{filename}};
+        Columns seq(storage);
+        for(uint64_t i = 0; i < 333; i++){
+            seq.append(make_bar(i));
+            if(i % 50 == 0){
+                EXPECT_EQ(seq.get(i), make_bar(i));
+            }
+        }
+        seq.flush();
+        addr = serialize<StorageAddress>(storage, seq);
+    }
+    {
+        Storage storage{FileRMA<MEMORYSIZE>{filename}};
+        auto seq = deserialize<Columns>(storage, addr, storage);
+        EXPECT_GT(storage.scrub(1000, [](const StorageAddress &){ EXPECT_TRUE(false); }), 0UL);
+        EXPECT_EQ(seq.size(), 333UL);
+        uint64_t sum = 0;
+        seq.scan_columns<0>(0, seq.size(), [&](size_t, std::span<const uint64_t> time){
+            for(auto t: time){
+                sum += t;
+            }
+        });
+        EXPECT_EQ(sum, 332UL * 333 / 2);
+        seq.append(make_bar(333));
+        EXPECT_EQ(seq.get(333), make_bar(333));
+    }
+}
+
+}
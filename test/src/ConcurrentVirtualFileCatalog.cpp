@@ -0,0 +1,180 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <storage/ConcurrentVirtualFileCatalog.hpp>
+#include <storage/SimpleStorage.hpp>
+
+namespace{
+
+constexpr size_t MEMORYSIZE = 24;
+
+using TestStorage = SimpleRamStorage<MEMORYSIZE>;
+using Map = ConcurrentMultiLevelKeyMap<uint64_t, std::string, uint32_t>;
+
+const std::vector<std::string> exchanges{"NYSE", "LSE", "CME", "EUREX"};
+
+uint64_t value(const std::string &exchange, uint32_t ticker){
+    return exchange.size() * 100000 + ticker;
+}
+
+TEST(ConcurrentVirtualFileCatalogTest, AddGetDel){
+    Map map;
+    auto reader = map.reader();
+    EXPECT_FALSE(reader.has("NYSE", 1));
+    EXPECT_FALSE(reader.get("NYSE", 1).first);
+
+    //random order splits leaves and inner nodes in the middle
+    std::vector<std::pair<std::string, uint32_t>> keys;
+    for(auto &e: exchanges){
+        for(uint32_t t = 0; t < 3000; t++){
+            keys.emplace_back(e, t);
+        }
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937{3});
+    std::map<std::pair<std::string, uint32_t>, uint64_t> expected;
+    for(auto &[e, t]: keys){
+        map.add(e, t, value(e, t));
+        expected[{e, t}] = value(e, t);
+    }
+    //existing entry is kept
+    map.add("NYSE", 5, 0);
+    EXPECT_EQ(map.size(), expected.size());
+    EXPECT_EQ(reader.get("NYSE", 5), std::make_pair(true, value("NYSE", 5)));
+
+    for(size_t i = 0; i < keys.size(); i += 2){
+        EXPECT_EQ(map.del(keys[i].first, keys[i].second), Result::Success);
+        expected.erase(keys[i]);
+    }
+    EXPECT_EQ(map.del(keys[0].first, keys[0].second), Result::Failure);
+    EXPECT_EQ(map.size(), expected.size());
+    for(size_t i = 0; i < keys.size(); i++){
+        EXPECT_EQ(reader.has(keys[i].first, keys[i].second), i % 2 == 1);
+    }
+
+    //scan is in key order
+    auto it = expected.begin();
+    reader.scan([&](const Map::Key &key, uint64_t v){
+        ASSERT_NE(it, expected.end());
+        EXPECT_EQ(std::get<0>(key), it->first.first);
+        EXPECT_EQ(std::get<1>(key), it->first.second);
+        EXPECT_EQ(v, it->second);
+        ++it;
+    });
+    EXPECT_EQ(it, expected.end());
+
+    size_t lse = 0;
+    reader.scan([&](const Map::Key &key, uint64_t){
+        EXPECT_EQ(std::get<0>(key), "LSE");
+        lse++;
+    }, std::string{"LSE"});
+    EXPECT_EQ(lse, std::count_if(expected.begin(), expected.end(), [](auto &e){ return e.first.first == "LSE"; }));
+    EXPECT_EQ(reader.list(), (std::vector<std::string>{"CME", "EUREX", "LSE", "NYSE"}));
+    EXPECT_TRUE(reader.list(std::string{"NASDAQ"}).empty());
+
+    for(auto &[e, t]: keys){
+        map.del(e, t);
+    }
+    EXPECT_EQ(map.size(), 0UL);
+    EXPECT_TRUE(reader.list().empty());
+    //no reader is pinned, everything retired is freed
+    EXPECT_EQ(map.pending_reclaim(), 0UL);
+}
+
+TEST(ConcurrentVirtualFileCatalogTest, PinnedReaderKeepsSnapshot){
+    Map map;
+    for(uint32_t t = 0; t < 100; t++){
+        map.add("NYSE", t, t);
+    }
+    auto reader = map.reader();
+    size_t seen = 0;
+    reader.scan([&](const Map::Key &key, uint64_t v){
+        //writer publishes new roots while the reader walks the old one
+        if(seen == 0){
+            for(uint32_t t = 100; t < 200; t++){
+                map.add("NYSE", t, t);
+            }
+            map.del("NYSE", 50);
+            EXPECT_GT(map.pending_reclaim(), 0UL);
+        }
+        EXPECT_EQ(std::get<1>(key), v);
+        seen++;
+    });
+    EXPECT_EQ(seen, 100UL);
+    EXPECT_EQ(map.size(), 199UL);
+
+    map.add("NYSE", 1000, 1000);
+    EXPECT_EQ(map.pending_reclaim(), 0UL);
+}
+
+TEST(ConcurrentVirtualFileCatalogTest, ConcurrentReaders){
+    Map map;
+    constexpr uint32_t STABLE = 2000;
+    for(uint32_t t = 0; t < STABLE; t++){
+        map.add("NYSE", t, value("NYSE", t));
+    }
+    std::atomic<bool> done{false};
+    std::atomic<size_t> errors{0};
+    std::vector<std::thread> readers;
+    for(int r = 0; r < 4; r++){
+        readers.emplace_back([&, r]{
+            auto reader = map.reader();
+            std::mt19937 rng(r);
+            while(!done.load()){
+                uint32_t t = rng() % STABLE;
+                auto [found, v] = reader.get("NYSE", t);
+                errors += !found || v != value("NYSE", t);
+                auto [added, w] = reader.get("LSE", t);
+                errors += added && w != value("LSE", t);
+            }
+        });
+    }
+    //writer churns another exchange while readers resolve the stable one
+    for(int round = 0; round < 3; round++){
+        for(uint32_t t = 0; t < STABLE; t++){
+            map.add("LSE", t, value("LSE", t));
+        }
+        for(uint32_t t = 0; t < STABLE; t++){
+            map.del("LSE", t);
+        }
+    }
+    done = true;
+    for(auto &t: readers){
+        t.join();
+    }
+    EXPECT_EQ(errors.load(), 0UL);
+    EXPECT_EQ(map.size(), STABLE);
+}
+
+TEST(ConcurrentVirtualFileCatalogTest, Serialize){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    Map map;
+    for(auto &e: exchanges){
+        for(uint32_t t = 0; t < 1500; t++){
+            map.add(e, t * 7 % 1500, value(e, t * 7 % 1500));
+        }
+    }
+    auto addr = serialize<StorageAddress>(storage, map);
+    auto res = deserialize<Map>(storage, addr);
+    EXPECT_EQ(res.size(), map.size());
+    auto reader = res.reader();
+    for(auto &e: exchanges){
+        for(uint32_t t = 0; t < 1500; t++){
+            EXPECT_EQ(reader.get(e, t), std::make_pair(true, value(e, t)));
+        }
+    }
+    EXPECT_EQ(reader.list(), (std::vector<std::string>{"CME", "EUREX", "LSE", "NYSE"}));
+    //tree built on load takes path copied updates
+    res.add("CME", 5000, 1);
+    res.del("CME", 0);
+    EXPECT_TRUE(reader.has("CME", 5000));
+    EXPECT_FALSE(reader.has("CME", 0));
+    EXPECT_EQ(res.size(), map.size());
+}
+
+}
@@ -0,0 +1,272 @@
+#include "gtest/gtest.h"
+
+#include <filesystem>
+
+#include <storage/FixedSizeObjectStorage.hpp>
+#include <storage/SimpleStorage.hpp>
+
+namespace{
+
+constexpr size_t MEMORYSIZE = 16;
+constexpr size_t OBJSTORAGE_MEM_ALLOC = 1024;
+
+struct TestObj{
+    int a;
+    bool operator==(const TestObj &other) const{
+        return a == other.a;
+    }
+};
+
+struct Tick{
+    uint64_t time;
+    double price;
+    uint32_t volume;
+};
+
+struct SerializedObj{
+    int a{0};
+    bool operator==(const SerializedObj &other) const{
+        return a == other.a;
+    }
+    Result serializeImpl(StorageBuffer<> &buffer) const {
+        return szeimpl::s(a, buffer);
+    }
+    static SerializedObj deserializeImpl(const StorageBufferRO<> &buffer) {
+        return SerializedObj{szeimpl::d<int>(buffer)};
+    }
+    constexpr size_t getSizeImpl() const {
+        return sizeof(a);
+    }
+};
+
+const std::string filename{"/tmp/FixedSizeObjectStorage.test"};
+
+using TestStorage = SimpleRamStorage<MEMORYSIZE>;
+using TestObjectStorage = FixedSizeObjectStorage<TestObj, TestStorage>;
+
+static_assert(CObjectStorage<TestObjectStorage, TestObj, TestStorage, std::numeric_limits<size_t>::max()>);
+
+TEST(FixedSizeObjectStorageTest, SimplePutGetCheck){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    TestObjectStorage os(storage);
+    
+    auto index0 = os.put(TestObj{1});
+    EXPECT_EQ(index0, 0);
+    EXPECT_EQ(os.get<ObjectStorageAccess::Once>(index0), TestObj{1});
+}
+
+TEST(FixedSizeObjectStorageTest, SimplePutGetRef){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    auto base = storage.get_random_address(OBJSTORAGE_MEM_ALLOC);
+    TestObjectStorage os(storage, base);
+    
+    auto index0 = os.put(TestObj{1});
+    auto &v1 = os.getRef(index0);
+    EXPECT_EQ(v1, TestObj{1});
+    v1.a = 3;
+    const auto &v1c = os.getCRef(index0);
+    EXPECT_EQ(v1c, TestObj{3});
+    EXPECT_EQ(v1c, v1);
+}
+
+TEST(FixedSizeObjectStorageTest, MultiplePutAcrossBuckets){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    TestObjectStorage os(storage);
+    
+    for(int i = 0; i < 1000; i++){
+        EXPECT_EQ(os.put(TestObj{i}), i);
+    }
+    EXPECT_EQ(os.size(), 1000);
+    for(int i = 0; i < 1000; i++){
+        EXPECT_EQ(os.get(i), TestObj{i});
+    }
+}
+
+TEST(FixedSizeObjectStorageTest, PutIndexReverseOrder){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    TestObjectStorage os(storage);
+    
+    for(int i = 99; i >= 0; i--){
+        os.put(TestObj{i * 2}, i);
+    }
+    EXPECT_EQ(os.size(), 100);
+    for(int i = 0; i < 100; i++){
+        EXPECT_TRUE(os.has(i));
+        EXPECT_EQ(os.get(i), TestObj{i * 2});
+    }
+    EXPECT_FALSE(os.has(100));
+}
+
+TEST(FixedSizeObjectStorageTest, SimplePutOverwriteGet){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    TestObjectStorage os(storage);
+    
+    auto index0 = os.put<ObjectStorageAccess::Keep>(TestObj{1});
+    os.put(TestObj{2}, index0);
+    EXPECT_EQ(os.size(), 1);
+    EXPECT_EQ(os.get(index0), TestObj{2});
+}
+
+TEST(FixedSizeObjectStorageTest, MultiplePutClearRange){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    TestObjectStorage os(storage);
+    
+    for(int i = 0; i < 40; i++){
+        os.put(TestObj{i});
+    }
+    os.clear(10, 29);
+    EXPECT_EQ(os.size(), 20);
+    for(int i = 0; i < 40; i++){
+        EXPECT_EQ(os.has(i), i < 10 || i >= 30);
+    }
+    //cleared slots are reused by index
+    os.put(TestObj{100}, 15);
+    EXPECT_EQ(os.get(15), TestObj{100});
+    EXPECT_EQ(os.put(TestObj{41}), 40);
+}
+
+TEST(FixedSizeObjectStorageTest, ForeachEmpty){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    TestObjectStorage os(storage);
+    
+    os.put(TestObj{0}, 0);
+    os.put(TestObj{3}, 3);
+    auto fi = [](size_t index){ return TestObj{static_cast<int>(index) + 10}; };
+    EXPECT_EQ(os.for_each_empty(0, 4, fi), 3);
+    EXPECT_EQ(os.get(0), TestObj{0});
+    EXPECT_EQ(os.get(1), TestObj{11});
+    EXPECT_EQ(os.get(4), TestObj{14});
+
+    int sum = 0;
+    auto f = [&](size_t index, TestObj &obj){ sum += obj.a; };
+    os.for_each(0, 4, f);
+    EXPECT_EQ(sum, 0 + 11 + 12 + 3 + 14);
+}
+
+TEST(FixedSizeObjectStorageTest, MultiplePutClearSerializeDeserialize){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    StorageAddress os_addr;
+    
+    {
+        TestObjectStorage os(storage);
+        for(int i = 0; i < 100; i++){
+            os.put(TestObj{i});
+        }
+        os.clear(1);
+        os.clear(50, 59);
+
+        os_addr = serialize<StorageAddress>(storage, os);
+    }
+    {
+        auto os = deserialize<TestObjectStorage>(storage, os_addr, storage);
+
+        EXPECT_EQ(os.size(), 89);
+        EXPECT_FALSE(os.has(1));
+        EXPECT_FALSE(os.has(55));
+        for(int i = 0; i < 100; i++){
+            if(os.has(i)){
+                EXPECT_EQ(os.get(i), TestObj{i});
+            }
+        }
+        EXPECT_EQ(os.put(TestObj{100}), 100);
+        EXPECT_EQ(os.get(100), TestObj{100});
+    }
+}
+
+TEST(FixedSizeObjectStorageTest, InPlaceRef){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    FixedSizeObjectStorage<Tick, TestStorage> os(storage);
+    
+    for(uint64_t i = 0; i < 100; i++){
+        os.put(Tick{i, 1.5, 10});
+    }
+    auto &t = os.getRef(42);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(&t) % alignof(Tick), 0UL);
+    EXPECT_EQ(&t, &os.getRef(42));
+    t.volume = 20;
+    EXPECT_EQ(os.get(42).volume, 20);
+    EXPECT_EQ(os.getCRef(42).volume, 20);
+    EXPECT_EQ(os.get(41).volume, 10);
+}
+
+TEST(FixedSizeObjectStorageTest, SerializedObjRefCommit){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    FixedSizeObjectStorage<SerializedObj, TestStorage> os(storage);
+    
+    auto index0 = os.put(SerializedObj{1});
+    os.getRef(index0).a = 5;
+    EXPECT_EQ(os.get(index0), SerializedObj{5});
+    EXPECT_EQ(Result::Success, os.commit(index0));
+
+    auto os2 = deserialize<FixedSizeObjectStorage<SerializedObj, TestStorage>>(storage,
+        serialize<StorageAddress>(storage, os), storage);
+    EXPECT_EQ(os2.get(index0), SerializedObj{5});
+}
+
+TEST(FixedSizeObjectStorageTest, InPlaceRefCommitReopen){
+    using Storage = CheckedFileStorage<20>;
+    using TickStorage = FixedSizeObjectStorage<Tick, Storage>;
+    std::filesystem::remove(std::filesystem::path{filename});
+
+    StorageAddress os_addr;
+    {
+        Storage storage{FileRMA<20>{filename}};
+        TickStorage os(storage);
+        for(uint64_t i = 0; i < 100; i++){
+            os.put(Tick{i, 1.5, 10});
+        }
+        for(uint64_t i = 0; i < 100; i += 2){
+            os.getRef(i).price = 2.5;
+            EXPECT_EQ(Result::Success, os.commit(i));
+        }
+        os_addr = serialize<StorageAddress>(storage, os);
+    }
+    {
+        Storage storage{FileRMA<20>{filename}};
+        auto os = deserialize<TickStorage>(storage, os_addr, storage);
+        EXPECT_GT(storage.scrub(1000, [](const StorageAddress &){ EXPECT_TRUE(false); }), 0UL);
+        for(uint64_t i = 0; i < 100; i++){
+            const auto &t = os.getCRef(i);
+            EXPECT_EQ(t.time, i);
+            EXPECT_EQ(t.price, i % 2 ? 1.5 : 2.5);
+        }
+    }
+}
+
+template<typename T>
+void for_each_commit_reopen(auto make, auto change){
+    using Storage = CheckedFileStorage<20>;
+    using ObjStorage = FixedSizeObjectStorage<T, Storage>;
+    std::filesystem::remove(std::filesystem::path{filename});
+
+    StorageAddress os_addr;
+    {
+        Storage storage{FileRMA<20>{filename}};
+        ObjStorage os(storage);
+        for(int i = 0; i < 100; i++){
+            os.put(make(i));
+        }
+        auto f = [&](size_t, T &t){ change(t); };
+        os.for_each(10, 59, f);
+        os_addr = serialize<StorageAddress>(storage, os);
+    }
+    {
+        Storage storage{FileRMA<20>{filename}};
+        auto os = deserialize<ObjStorage>(storage, os_addr, storage);
+        EXPECT_GT(storage.scrub(1000, [](const StorageAddress &){ EXPECT_TRUE(false); }), 0UL);
+        for(int i = 0; i < 100; i++){
+            T expected = make(i);
+            if(i >= 10 && i <= 59){
+                change(expected);
+            }
+            EXPECT_EQ(os.get(i), expected) << i;
+        }
+    }
+}
+
+TEST(FixedSizeObjectStorageTest, ForeachCommitReopen){
+    for_each_commit_reopen<TestObj>([](int i){ return TestObj{i}; }, [](TestObj &t){ t.a += 1000; });
+    for_each_commit_reopen<SerializedObj>([](int i){ return SerializedObj{i}; }, [](SerializedObj &t){ t.a *= 3; });
+}
+
+}
@@ -0,0 +1,115 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <storage/IndexedVirtualFileCatalog.hpp>
+#include <storage/SimpleStorage.hpp>
+
+namespace{
+
+constexpr size_t MEMORYSIZE = 24;
+
+using TestStorage = SimpleRamStorage<MEMORYSIZE>;
+//exchange, ticker, resolution -> address, indexed by value and resolution
+using Indexes = CatalogIndexes<true, 2>;
+using Map = IndexedMultiLevelKeyMap<Indexes, StorageAddress, std::string, uint32_t, std::string>;
+using Catalog = IndexedVirtualFileCatalog<TestStorage, Indexes, StorageAddress, std::string, uint32_t, std::string>;
+using Key = Map::Key;
+
+const std::vector<std::string> exchanges{"NYSE", "LSE"};
+const std::vector<std::string> resolutions{"1m", "1h", "1d"};
+
+//every entry has its own 100 byte block, blocks of one exchange are adjacent
+StorageAddress address(size_t exchange, uint32_t ticker, size_t resolution){
+    return StorageAddress{(exchange * 1000 + ticker * 3 + resolution) * 100, 100};
+}
+
+void fill(Map &map){
+    for(size_t e = 0; e < exchanges.size(); e++){
+        for(uint32_t t = 0; t < 300; t++){
+            for(size_t r = 0; r < resolutions.size(); r++){
+                map.add(exchanges[e], t, resolutions[r], address(e, t, r));
+            }
+        }
+    }
+}
+
+TEST(IndexedVirtualFileCatalogTest, ReverseLookup){
+    Map map;
+    fill(map);
+    EXPECT_EQ(map.size(), 1800UL);
+
+    EXPECT_EQ(map.keys_of(address(1, 7, 2)), (std::vector<Key>{{"LSE", 7, "1d"}}));
+    EXPECT_TRUE(map.keys_of(StorageAddress{1, 100}).empty());
+    //address range of tickers 10 and 11 of NYSE
+    EXPECT_EQ(map.keys_in(address(0, 10, 0).addr, address(0, 12, 0).addr),
+              (std::vector<Key>{{"NYSE", 10, "1m"}, {"NYSE", 10, "1h"}, {"NYSE", 10, "1d"},
+                                {"NYSE", 11, "1m"}, {"NYSE", 11, "1h"}, {"NYSE", 11, "1d"}}));
+    EXPECT_EQ(map.count_with<2>("1h"), 600UL);
+    EXPECT_EQ(map.count_with<2>("1w"), 0UL);
+    auto hourly = map.keys_with<2>("1h");
+    EXPECT_TRUE(std::all_of(hourly.begin(), hourly.end(), [](const Key &k){ return std::get<2>(k) == "1h"; }));
+
+    //existing entry is kept, index is unchanged
+    map.add("NYSE", 1, "1m", StorageAddress{5, 1});
+    EXPECT_TRUE(map.keys_of(StorageAddress{5, 1}).empty());
+
+    //set moves the entry in the value index
+    map.set("NYSE", 1, "1m", StorageAddress{5, 1});
+    EXPECT_EQ(map.keys_of(StorageAddress{5, 1}), (std::vector<Key>{{"NYSE", 1, "1m"}}));
+    EXPECT_TRUE(map.keys_of(address(0, 1, 0)).empty());
+    map.set("NYSE", 1000, "1w", StorageAddress{7, 1});
+    EXPECT_EQ(map.count_with<2>("1w"), 1UL);
+
+    map.del("NYSE", 1000, "1w");
+    map.del("NYSE", 1000, "1w");
+    EXPECT_EQ(map.count_with<2>("1w"), 0UL);
+    EXPECT_TRUE(map.keys_of(StorageAddress{7, 1}).empty());
+    EXPECT_EQ(map.size(), 1800UL);
+}
+
+TEST(IndexedVirtualFileCatalogTest, DropStorageRange){
+    Map map;
+    fill(map);
+    //everything stored in the LSE part
+    EXPECT_EQ(map.del_in(address(1, 0, 0).addr, address(2, 0, 0).addr), 900UL);
+    EXPECT_EQ(map.size(), 900UL);
+    EXPECT_EQ(map.list(), (std::vector<std::string>{"NYSE"}));
+    EXPECT_EQ(map.count_with<2>("1m"), 300UL);
+    EXPECT_TRUE(map.keys_in(address(1, 0, 0).addr, address(2, 0, 0).addr).empty());
+}
+
+TEST(IndexedVirtualFileCatalogTest, SerializeDeserialize){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    StorageAddress addr;
+    {
+        Catalog catalog{storage};
+        auto &map = catalog.get().get();
+        fill(map);
+        map.del("LSE", 5, "1m");
+        map.set("LSE", 6, "1m", StorageAddress{5, 1});
+        serialize(storage, catalog, addr);
+    }
+    {
+        auto catalog = deserialize<Catalog>(storage, addr, storage, storage);
+        auto &map = catalog.get().get();
+        EXPECT_EQ(map.size(), 1799UL);
+        auto [found, value] = map.get("LSE", 7, "1h");
+        EXPECT_TRUE(found);
+        EXPECT_EQ(value.addr, address(1, 7, 1).addr);
+        EXPECT_EQ(map.keys_of(StorageAddress{5, 1}), (std::vector<Key>{{"LSE", 6, "1m"}}));
+        EXPECT_EQ(map.keys_of(address(1, 7, 1)), (std::vector<Key>{{"LSE", 7, "1h"}}));
+        EXPECT_TRUE(map.keys_of(address(1, 5, 0)).empty());
+        EXPECT_EQ(map.count_with<2>("1m"), 599UL);
+        EXPECT_EQ(map.keys_with<2>("1d").size(), 600UL);
+
+        //indexes keep being maintained after load
+        map.del("NYSE", 0, "1d");
+        EXPECT_EQ(map.count_with<2>("1d"), 599UL);
+        EXPECT_TRUE(map.keys_of(address(0, 0, 2)).empty());
+    }
+}
+
+}
@@ -859,4 +859,26 @@ TEST_F(IntervalMapTest, InsertOnOverlappingOutsideDifferentValue){
 
 //TODO test has()
 
+TEST(IntervalMapRangeTest, Intersecting){
+    IntervalMap<size_t, size_t> im;
+    EXPECT_TRUE(im.intersecting(0, 100).empty());
+    im.insert(5, 10, 1);
+    im.insert(20, 30, 2);
+    im.insert(40, 40, 3);
+
+    auto starts = [&](size_t start, size_t end){
+        std::vector<size_t> v;
+        for(auto &[iv_start, iv]: im.intersecting(start, end)){
+            v.push_back(iv_start);
+        }
+        return v;
+    };
+    EXPECT_EQ(starts(0, 4), std::vector<size_t>{});
+    EXPECT_EQ(starts(0, 5), std::vector<size_t>{5});
+    EXPECT_EQ(starts(10, 20), (std::vector<size_t>{5, 20}));
+    EXPECT_EQ(starts(11, 19), std::vector<size_t>{});
+    EXPECT_EQ(starts(25, 100), (std::vector<size_t>{20, 40}));
+    EXPECT_EQ(starts(41, 100), std::vector<size_t>{});
+}
+
 }
@@ -0,0 +1,96 @@
+#include "gtest/gtest.h"
+
+#include <storage/ObjectCache.hpp>
+
+namespace{
+
+constexpr size_t OBJ_SIZE = 1000;
+
+std::shared_ptr<const int> make(int v){
+    return std::make_shared<const int>(v);
+}
+
+TEST(ObjectCacheTest, InsertFind){
+    ObjectCache<int> cache{1UL << 20};
+    EXPECT_EQ(cache.find(1), nullptr);
+    cache.insert(1, make(10), OBJ_SIZE);
+    auto v = cache.find(1);
+    ASSERT_NE(v, nullptr);
+    EXPECT_EQ(*v, 10);
+    //same instance for every reader
+    EXPECT_EQ(v, cache.find(1));
+
+    cache.insert(1, make(11), OBJ_SIZE);
+    EXPECT_EQ(*cache.find(1), 11);
+    EXPECT_EQ(*v, 10);
+    cache.erase(1);
+    EXPECT_EQ(cache.find(1), nullptr);
+
+    auto m = cache.metrics();
+    EXPECT_EQ(m.hits, 3);
+    EXPECT_EQ(m.misses, 2);
+    EXPECT_EQ(m.entries, 0);
+    EXPECT_EQ(m.bytes, 0);
+    EXPECT_DOUBLE_EQ(m.hit_rate(), 0.6);
+}
+
+TEST(ObjectCacheTest, BudgetIsRespected){
+    constexpr size_t BUDGET = 100 * OBJ_SIZE;
+    ObjectCache<int> cache{BUDGET};
+    for(int i = 0; i < 1000; i++){
+        cache.find(i);
+        cache.insert(i, make(i), OBJ_SIZE);
+        EXPECT_LE(cache.metrics().bytes, BUDGET);
+    }
+    auto m = cache.metrics();
+    EXPECT_GT(m.entries, 50);
+    EXPECT_LE(m.entries, 100);
+    EXPECT_EQ(m.entries + m.evictions, 1000);
+
+    cache.set_budget(10 * OBJ_SIZE);
+    EXPECT_LE(cache.metrics().bytes, 10 * OBJ_SIZE);
+    EXPECT_LE(cache.metrics().entries, 10);
+}
+
+TEST(ObjectCacheTest, TooLargeRejected){
+    ObjectCache<int> cache{OBJ_SIZE};
+    cache.insert(1, make(1), 2 * OBJ_SIZE);
+    EXPECT_EQ(cache.find(1), nullptr);
+    EXPECT_EQ(cache.metrics().rejections, 1);
+}
+
+TEST(ObjectCacheTest, HotObjectsSurviveScan){
+    constexpr size_t BUDGET = 100 * OBJ_SIZE;
+    ObjectCache<int> cache{BUDGET};
+    auto access = [&](int i){
+        if(!cache.find(i)){
+            cache.insert(i, make(i), OBJ_SIZE);
+        }
+    };
+    for(int round = 0; round < 10; round++){
+        for(int i = 0; i < 50; i++){
+            access(i);
+        }
+    }
+    //one pass over many cold objects
+    for(int i = 1000; i < 11000; i++){
+        access(i);
+    }
+    cache.reset_metrics();
+    for(int i = 0; i < 50; i++){
+        access(i);
+    }
+    EXPECT_GT(cache.metrics().hit_rate(), 0.9);
+}
+
+TEST(ObjectCacheTest, CopyStartsEmpty){
+    ObjectCache<int> cache{1UL << 20};
+    cache.insert(1, make(1), OBJ_SIZE);
+    auto copy = cache;
+    EXPECT_EQ(copy.metrics().entries, 0);
+    EXPECT_EQ(copy.metrics().budget, 1UL << 20);
+    auto moved = std::move(cache);
+    EXPECT_EQ(*moved.find(1), 1);
+}
+
+}
@@ -169,4 +169,107 @@ TEST(ObjectInstanceStorageTest, AddRangeDelRange){
     test_nonempty_ranges(ois, {});
 }
 
+
+TEST(ObjectInstanceStorageTest, AddRangeMerge){
+    ObjectInstanceStorage<TestObject> ois;
+    auto create_obj = [](size_t start, size_t offset){
+        return TestObject{(int)start, (int)offset};
+    };
+
+    ois.add_range(10, 20, create_obj);
+    ois.add(25, TestObject{99, 99});
+    //overlapping range replaces objects in [15, 30], single 25 included
+    ois.add_range(15, 30, create_obj);
+    EXPECT_EQ(ois.ranges(), 1UL);
+    test_nonempty_ranges(ois, {{10, 14, 10, 10}, {15, 30, 15, 15}});
+
+    //adjacent ranges are merged as well, even small ones
+    ois.add_range(31, 40, create_obj);
+    ois.add_range(41, 42, create_obj);
+    ois.add_range(5, 9, create_obj);
+    EXPECT_EQ(ois.ranges(), 1UL);
+    test_empty_ranges(ois, {{0, 4}, {43, 50}});
+    test_nonempty_ranges(ois, {{5, 9, 5, 5}, {10, 14, 10, 10}, {15, 30, 15, 15}, {31, 40, 31, 31}, {41, 42, 41, 41}});
+
+    //range over two ranges and the gap between them
+    ois.add_range(60, 70, create_obj);
+    ois.del_range(20, 24);
+    EXPECT_EQ(ois.ranges(), 2UL);
+    ois.add_range(40, 65, create_obj);
+    EXPECT_EQ(ois.ranges(), 1UL);
+    test_empty_ranges(ois, {{20, 24}});
+    test_nonempty_ranges(ois, {{25, 30, 15, 15}, {40, 65, 40, 40}, {66, 70, 60, 60}});
+
+    //replace inside of a range
+    ois.add(50, TestObject{1, 2});
+    test_nonempty(ois, {{50, 50, 1, 2}});
+
+    ois.del_range(0, 100);
+    EXPECT_EQ(ois.ranges(), 0UL);
+    test_empty_ranges(ois, {{0, 100}});
+}
+
+TEST(ObjectInstanceStorageTest, AcrossSlabs){
+    ObjectInstanceStorage<TestObject> ois;
+    auto create_obj = [](size_t start, size_t offset){
+        return TestObject{(int)start, (int)offset};
+    };
+
+    ois.add_range(200, 1000, create_obj);
+    ois.add(5000, TestObject{7, 7});
+    EXPECT_EQ(ois.ranges(), 1UL);
+    test_empty_ranges(ois, {{0, 199}, {1001, 4999}, {5001, 6000}});
+    test_nonempty_ranges(ois, {{200, 1000, 200, 200}});
+    test_nonempty(ois, {{5000, 5000, 7, 7}});
+
+    //whole slabs in the middle are released, the range stays
+    ois.del_range(300, 900);
+    EXPECT_EQ(ois.ranges(), 1UL);
+    test_empty_ranges(ois, {{300, 900}});
+    test_nonempty_ranges(ois, {{200, 299, 200, 200}, {901, 1000, 200, 200}});
+
+    ois.add_range(250, 950, create_obj);
+    test_nonempty_ranges(ois, {{200, 249, 200, 200}, {250, 950, 250, 250}, {951, 1000, 200, 200}});
+
+    ois.del_range(0, 4999);
+    EXPECT_EQ(ois.ranges(), 0UL);
+    test_nonempty(ois, {{5000, 5000, 7, 7}});
+}
+
+struct Counted{
+    static inline int alive = 0;
+    std::unique_ptr<size_t> v;
+    explicit Counted(size_t v): v(std::make_unique<size_t>(v)) { alive++; }
+    Counted(Counted &&other): v(std::move(other.v)) { alive++; }
+    ~Counted(){ alive--; }
+};
+
+TEST(ObjectInstanceStorageTest, InPlaceLifetime){
+    {
+        ObjectInstanceStorage<Counted> ois;
+        auto create_obj = [](size_t start, size_t offset){
+            return Counted{start + offset};
+        };
+        ois.add_range(0, 99, create_obj);
+        EXPECT_EQ(Counted::alive, 100);
+        ois.del_range(10, 19);
+        EXPECT_EQ(Counted::alive, 90);
+        //move-only objects are moved into the merged slab
+        ois.add_range(100, 199, create_obj);
+        EXPECT_EQ(Counted::alive, 190);
+        EXPECT_EQ(*ois.get(50).second->v, 50UL);
+        EXPECT_EQ(*ois.get(150).second->v, 150UL);
+        EXPECT_FALSE(ois.has(15));
+        ois.add(15, Counted{1500});
+        EXPECT_EQ(*ois.get(15).second->v, 1500UL);
+        EXPECT_EQ(Counted::alive, 191);
+        ois.clear();
+        EXPECT_EQ(Counted::alive, 0);
+
+        ois.add_range(0, 199, create_obj);
+    }
+    //slabs are destroyed with the storage
+    EXPECT_EQ(Counted::alive, 0);
+}
+
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <storage/ObjectStorage.hpp>
 #include <storage/SimpleObjectStorage.hpp>
+#include <storage/FixedSizeObjectStorage.hpp>
 #include <storage/SimpleStorage.hpp>
 
 namespace{
@@ -45,5 +46,7 @@ TYPED_TEST_P(ObjectStorageTest, SimplePutGetCheck){
 REGISTER_TYPED_TEST_SUITE_P(ObjectStorageTest, SimplePutGetCheck);
 using SimpleSimpleObjList = ParamWrapper<SimpleObjectStorage, TestObj>;
 INSTANTIATE_TYPED_TEST_SUITE_P(SimpleObjectStorageSimpleTestObj, ObjectStorageTest, SimpleSimpleObjList);
+using FixedSizeSimpleObjList = ParamWrapper<FixedSizeObjectStorage, TestObj>;
+INSTANTIATE_TYPED_TEST_SUITE_P(FixedSizeObjectStorageSimpleTestObj, ObjectStorageTest, FixedSizeSimpleObjList);
 
 }
\ No newline at end of file
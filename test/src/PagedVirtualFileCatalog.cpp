@@ -0,0 +1,176 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <storage/PagedVirtualFileCatalog.hpp>
+#include <storage/SimpleStorage.hpp>
+
+namespace{
+
+constexpr size_t MEMORYSIZE = 24;
+
+using TestStorage = SimpleRamStorage<MEMORYSIZE>;
+using Map = PagedMultiLevelKeyMap<TestStorage, uint64_t, std::string, uint32_t>;
+using Catalog = PagedVirtualFileCatalog<TestStorage, uint64_t, std::string, uint32_t>;
+
+const std::vector<std::string> exchanges{"NYSE", "LSE", "CME", "EUREX"};
+constexpr uint32_t TICKERS = 1000;
+
+//exchanges x tickers in random order
+std::vector<std::pair<std::string, uint32_t>> shuffled_keys(){
+    std::vector<std::pair<std::string, uint32_t>> keys;
+    for(auto &e: exchanges){
+        for(uint32_t t = 0; t < TICKERS; t++){
+            keys.emplace_back(e, t);
+        }
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937{7});
+    return keys;
+}
+
+uint64_t value(const std::string &exchange, uint32_t ticker){
+    return exchange.size() * 100000 + ticker;
+}
+
+TEST(PagedVirtualFileCatalogTest, AddGetDel){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    Map map{storage};
+    EXPECT_FALSE(map.has("NYSE", 1));
+    EXPECT_TRUE(map.list().empty());
+
+    for(auto &[e, t]: shuffled_keys()){
+        EXPECT_EQ(map.add(e, t, value(e, t)), Result::Success);
+    }
+    map.add("NYSE", 5, 0);
+    EXPECT_EQ(map.size(), exchanges.size() * TICKERS);
+    EXPECT_GT(map.page_count(), exchanges.size() * TICKERS / Map::PAGE_ENTRIES);
+    EXPECT_EQ(map.get("NYSE", 5), std::make_pair(true, value("NYSE", 5)));
+    EXPECT_EQ(map.get("EUREX", TICKERS - 1), std::make_pair(true, value("EUREX", TICKERS - 1)));
+    EXPECT_FALSE(map.get("NYSE", TICKERS).first);
+    EXPECT_FALSE(map.has("ASX", 1));
+
+    EXPECT_EQ(map.list(), (std::vector<std::string>{"CME", "EUREX", "LSE", "NYSE"}));
+    auto tickers = map.list("LSE");
+    ASSERT_EQ(tickers.size(), TICKERS);
+    EXPECT_TRUE(std::is_sorted(tickers.begin(), tickers.end()));
+
+    uint32_t next = 0;
+    map.scan([&](const Map::Key &key, const uint64_t &v){
+        EXPECT_EQ(std::get<0>(key), "LSE");
+        EXPECT_EQ(std::get<1>(key), next++);
+        EXPECT_EQ(v, value("LSE", std::get<1>(key)));
+    }, std::string{"LSE"});
+    EXPECT_EQ(next, TICKERS);
+
+    EXPECT_EQ(map.set("CME", 3, 42), Result::Success);
+    EXPECT_EQ(map.set("CME", TICKERS, 42), Result::Failure);
+    EXPECT_EQ(map.get("CME", 3).second, 42UL);
+
+    //emptied pages are removed
+    size_t pages = map.page_count();
+    for(uint32_t t = 0; t < TICKERS; t++){
+        map.del("CME", t);
+    }
+    map.del("CME", 0);
+    EXPECT_LT(map.page_count(), pages);
+    EXPECT_EQ(map.size(), (exchanges.size() - 1) * TICKERS);
+    EXPECT_EQ(map.list(), (std::vector<std::string>{"EUREX", "LSE", "NYSE"}));
+    EXPECT_TRUE(map.list("CME").empty());
+}
+
+TEST(PagedVirtualFileCatalogTest, ReopenLazy){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    StorageAddress root;
+    size_t pages = 0;
+    {
+        Catalog catalog{storage};
+        for(auto &[e, t]: shuffled_keys()){
+            catalog.get().add(e, t, value(e, t));
+        }
+        pages = catalog.get().page_count();
+        catalog.sync();
+        root = catalog.address();
+    }
+    {
+        //only the root is read on open, every lookup reads one page
+        Catalog catalog{root, storage};
+        auto &map = catalog.get();
+        EXPECT_EQ(map.size(), exchanges.size() * TICKERS);
+        EXPECT_EQ(map.page_count(), pages);
+        EXPECT_EQ(map.loaded_pages(), 0UL);
+        EXPECT_EQ(map.get("NYSE", 777), std::make_pair(true, value("NYSE", 777)));
+        EXPECT_EQ(map.loaded_pages(), 1UL);
+        EXPECT_FALSE(map.has("ASX", 1));
+        EXPECT_EQ(map.loaded_pages(), 1UL);
+
+        size_t count = 0;
+        map.scan([&](const Map::Key &, const uint64_t &){ count++; }, std::string{"CME"}, uint32_t{10});
+        EXPECT_EQ(count, 1UL);
+        EXPECT_LE(map.loaded_pages(), 2UL);
+
+        map.add("ASX", 1, 5);
+        map.del("NYSE", 777);
+        map.set("LSE", 0, 9);
+        root = catalog.address();
+    }
+    {
+        Catalog catalog{root, storage};
+        auto &map = catalog.get();
+        EXPECT_EQ(map.get("ASX", 1), std::make_pair(true, uint64_t{5}));
+        EXPECT_FALSE(map.has("NYSE", 777));
+        EXPECT_EQ(map.get("LSE", 0).second, 9UL);
+        EXPECT_EQ(map.size(), exchanges.size() * TICKERS);
+        size_t count = 0;
+        map.scan([&](const Map::Key &, const uint64_t &){ count++; });
+        EXPECT_EQ(count, map.size());
+        map.release();
+        EXPECT_EQ(map.loaded_pages(), 0UL);
+    }
+}
+
+TEST(PagedVirtualFileCatalogTest, GrowValueReopen){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    using StringCatalog = PagedVirtualFileCatalog<TestStorage, std::string, std::string, uint32_t>;
+    StorageAddress root;
+    {
+        StringCatalog catalog{storage};
+        for(uint32_t t = 0; t < 10; t++){
+            catalog.get().add("NYSE", t, "short");
+        }
+        catalog.sync();
+        root = catalog.address();
+    }
+    std::string grown(10000, 'x');
+    {
+        //only the value changes, page does not fit its address anymore
+        StringCatalog catalog{root, storage};
+        EXPECT_EQ(catalog.get().set("NYSE", 3, grown), Result::Success);
+    }
+    StringCatalog catalog{root, storage};
+    EXPECT_EQ(catalog.get().get("NYSE", 3), std::make_pair(true, grown));
+    EXPECT_EQ(catalog.get().get("NYSE", 4), std::make_pair(true, std::string{"short"}));
+}
+
+TEST(PagedVirtualFileCatalogTest, NumericKeys){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    using NumericCatalog = PagedVirtualFileCatalog<TestStorage, int, int16_t, uint64_t>;
+    StorageAddress root;
+    {
+        NumericCatalog catalog{storage};
+        for(int i = 2000; i >= -2000; i--){
+            catalog.get().add(static_cast<int16_t>(i % 7), static_cast<uint64_t>(i + 2000), i);
+        }
+        root = catalog.address();
+    }
+    //root is written again when the catalog is closed
+    NumericCatalog catalog{root, storage};
+    auto &map = catalog.get();
+    EXPECT_EQ(map.size(), 4001UL);
+    EXPECT_EQ(map.get(-5, 0), std::make_pair(true, -2000));
+    EXPECT_FALSE(map.has(-3, 0));
+    EXPECT_EQ(map.list(), (std::vector<int16_t>{-6, -5, -4, -3, -2, -1, 0, 1, 2, 3, 4, 5, 6}));
+}
+
+}
@@ -0,0 +1,148 @@
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include <storage/PersistentPtr.hpp>
+#include <storage/SimpleStorage.hpp>
+
+namespace{
+
+constexpr size_t MEMORYSIZE = 20;
+constexpr uint32_t STORAGE_ID = 1;
+
+using TestStorage = SimpleRamStorage<MEMORYSIZE>;
+using Table = PPtrTable<TestStorage>;
+
+struct Node{
+    int value;
+    std::string name;
+    PPtr<Node, TestStorage> next;
+    PPtr<Node, TestStorage> other;
+
+    Result serializeImpl(StorageBuffer<> &buffer) const {
+        size_t offset = 0;
+        return SerializeSequentially(buffer, offset, value, name, next, other);
+    }
+    static Node deserializeImpl(const StorageBufferRO<> &buffer, Table &table) {
+        size_t offset = 0;
+        auto buf = buffer;
+        auto [value, name] = DeserializeSequentially<int, std::string>(buf, offset);
+        auto [next, other] = DeserializeSequentially<PPtr<Node, TestStorage>, PPtr<Node, TestStorage>>(buf, offset, table);
+        return Node{value, name, next, other};
+    }
+    size_t getSizeImpl() const {
+        return szeimpl::size(value) + szeimpl::size(name) + szeimpl::size(next) + szeimpl::size(other);
+    }
+};
+
+constexpr size_t RESERVE = 128;
+
+//ring of n nodes, every node also links to the one halfway around. returns address of the first
+StorageAddress store_ring(TestStorage &storage, int n){
+    Table table;
+    table.attach(STORAGE_ID, storage);
+    std::vector<PPtr<Node, TestStorage>> nodes;
+    for(int i = 0; i < n; i++){
+        nodes.push_back(table.make(STORAGE_ID, Node{i, "node" + std::to_string(i), {}, {}}, RESERVE));
+    }
+    for(int i = 0; i < n; i++){
+        nodes[i].get().next = nodes[(i + 1) % n];
+        nodes[i].get().other = nodes[(i + n / 2) % n];
+    }
+    EXPECT_EQ(table.sync(), static_cast<size_t>(n));
+    EXPECT_EQ(table.sync(), 0UL);
+    return serialize<StorageAddress>(storage, nodes[0]);
+}
+
+TEST(PersistentPtrTest, TraverseCycles){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    constexpr int N = 100;
+    auto addr = store_ring(storage, N);
+
+    Table table;
+    table.attach(STORAGE_ID, storage);
+    auto root = deserialize<PPtr<Node, TestStorage>>(storage, addr, table);
+    EXPECT_FALSE(root.is_swizzled());
+    EXPECT_EQ(root->value, 0);
+    EXPECT_TRUE(root.is_swizzled());
+    EXPECT_EQ(table.loaded(), 1UL);
+
+    //every node is read once, cycles end at already loaded ones
+    std::vector<const Node *> first;
+    const Node *node = &*root;
+    for(int i = 0; i < 2 * N; i++){
+        EXPECT_EQ(node->value, i % N);
+        EXPECT_EQ(node->name, "node" + std::to_string(i % N));
+        if(i < N){
+            first.push_back(node);
+        } else {
+            EXPECT_EQ(node, first[i - N]);
+        }
+        node = &*node->next;
+    }
+    EXPECT_EQ(table.loaded(), static_cast<size_t>(N));
+    //links to the same object get the same instance
+    EXPECT_EQ(&*first[0]->other, first[N / 2]);
+    EXPECT_EQ(&*first[N / 2]->other, first[0]);
+    EXPECT_EQ(table.sync(), 0UL);
+}
+
+TEST(PersistentPtrTest, SyncAndRelease){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    auto addr = store_ring(storage, 10);
+    {
+        Table table;
+        table.attach(STORAGE_ID, storage);
+        auto root = deserialize<PPtr<Node, TestStorage>>(storage, addr, table);
+        root.get().next.get().value = 100;
+        EXPECT_EQ(table.loaded(), 2UL);
+        EXPECT_EQ(table.sync(), 2UL);
+
+        //new node linked into the ring
+        auto added = table.make(STORAGE_ID, Node{11, "added", root->next->next, root}, RESERVE);
+        root.get().next.get().next = added;
+        EXPECT_EQ(table.release(), 3UL);
+        EXPECT_EQ(table.loaded(), 0UL);
+
+        //pointer held outside of the table is swizzled again
+        EXPECT_FALSE(root.is_swizzled());
+        EXPECT_EQ(root->next->value, 100);
+        EXPECT_EQ(root->next->next->name, "added");
+        EXPECT_EQ(root->next->next->next->value, 2);
+        EXPECT_EQ(&*root->next->next->other, &*root);
+    }
+    {
+        Table table;
+        table.attach(STORAGE_ID, storage);
+        auto root = deserialize<PPtr<Node, TestStorage>>(storage, addr, table);
+        EXPECT_EQ(root->next->next->value, 11);
+        auto &third = root->next->next->next;
+        EXPECT_TRUE(third->other->other == third);
+        EXPECT_EQ(third->other->value, 7);
+    }
+}
+
+TEST(PersistentPtrTest, Errors){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    auto addr = store_ring(storage, 4);
+    Table table;
+    auto root = deserialize<PPtr<Node, TestStorage>>(storage, addr, table);
+    EXPECT_THROW(root.get(), std::logic_error);
+    table.attach(STORAGE_ID, storage);
+    EXPECT_EQ(root->value, 0);
+
+    //object is read as one type only
+    EXPECT_THROW(table.load<int>(STORAGE_ID, root.getAddress()), std::logic_error);
+    //not resolvable without a table
+    auto detached = deserialize<PPtr<Node, TestStorage>>(storage, addr);
+    EXPECT_TRUE(detached == root);
+    EXPECT_THROW(detached.get(), std::logic_error);
+    EXPECT_THROW((PPtr<Node, TestStorage>{}.get()), std::logic_error);
+
+    //address is kept for life, so it can not grow over the reserve
+    root.get().name = std::string(RESERVE, 'x');
+    EXPECT_THROW(table.sync(), std::logic_error);
+}
+
+}
@@ -1,155 +1,236 @@
-#include <storage/SequenceStorage.hpp>
+#include "gtest/gtest.h"
 
-/****************************************************/
+#include <filesystem>
+#include <vector>
 
-constexpr std::string diskfolder = "/cygdrive/h/stmp/";
-constexpr std::string ssdfolder = "/cygdrive/g/stmp/";
-constexpr std::string serveraddress = "127.0.0.1";
+#include <storage/SequenceStorage.hpp>
+#include <storage/SimpleStorage.hpp>
 
-StorageManager _storage_manager; //global
+namespace{
 
-using tu = trading::utils;
+constexpr size_t MEMORYSIZE = 24;
 
-class ExampleObject: public Serializable<ExampleObject>{
-public:
-	ExampleObject(ObjectAddress addr);
-	tu::Result synchronizeImpl(const StorageRawBuffer &raw_buffer) override;
-	tu::Result serializeImpl(const StorageRawBuffer &raw_buffer) override;
-	static ExampleObject deserializeImpl(const StorageRawBuffer &raw_buffer) override;
-	constexpr size_t getSizeImpl() override;
+struct Tick{
+    uint64_t time;
+    double price;
+    uint32_t volume;
 };
 
-//Addressing raw data(DataStorage)
-using ExampleMRStorage = MultiRankStorage<MemoryStorage, SSDStorage, DiskStorage, NetworkStorage>;
-
-//Addressing raw bytes
-using ExampleDataStorage = DataStorage<ExampleMRStorage>;
-
-//template<typename T>
-using ExampleObjectStorage = ObjectStorage<ExampleDataStorage, ExampleObject>;
+struct TickTime{
+    uint64_t operator()(const Tick &t) const { return t.time; }
+};
 
+struct SerializedObj{
+    int a{0};
+    Result serializeImpl(StorageBuffer<> &buffer) const {
+        return szeimpl::s(a, buffer);
+    }
+    static SerializedObj deserializeImpl(const StorageBufferRO<> &buffer) {
+        return SerializedObj{szeimpl::d<int>(buffer)};
+    }
+    constexpr size_t getSizeImpl() const {
+        return sizeof(a);
+    }
+};
 
-//StorageAddress
-//ObjectAddress
+const std::string filename{"/tmp/SequenceStorage.test"};
+
+using TestStorage = SimpleRamStorage<MEMORYSIZE>;
+//small chunks, so tests cross chunk boundaries
+using TickSequence = SequenceStorage<Tick, TestStorage, TickTime, 4096>;
+
+TEST(SequenceStorageTest, AppendGet){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    TickSequence seq(storage);
+    EXPECT_EQ(seq.size(), 0UL);
+
+    for(uint64_t i = 0; i < 1000; i++){
+        EXPECT_EQ(seq.append(Tick{i * 10, 1.5 * i, 1}), i);
+    }
+    EXPECT_EQ(seq.size(), 1000UL);
+    for(uint64_t i = 0; i < 1000; i++){
+        auto t = seq.get(i);
+        EXPECT_EQ(t.time, i * 10);
+        EXPECT_EQ(t.price, 1.5 * i);
+    }
+    //append after read of the tail chunk
+    seq.append(Tick{10000, 0, 2});
+    EXPECT_EQ(seq.get(1000).volume, 2U);
+}
 
-void init_storage(){
-	MemoryStorage _memory_storage(MemoryStorage::limit<4, GB>);
-	SSDStorage _ssd_storage(ssdfolder);
-	DiskStorage _disk_storage(diskfolder);
-	NetworkStorage _network_storage(serveraddress);
+TEST(SequenceStorageTest, ChunksAligned){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    TickSequence seq(storage);
+    for(uint64_t i = 0; i < 1000; i++){
+        if(i % TickSequence::CHUNK_RECORDS == 0){
+            //odd-sized allocation before every chunk
+            initialize_zero(storage, storage.get_random_address(13));
+        }
+        seq.append(Tick{i, 0, 1});
+    }
+    size_t spans = 0;
+    for(const auto &span: seq.query(0, 1000)){
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(span.records.data()) % alignof(Tick), 0UL);
+        spans++;
+    }
+    EXPECT_EQ(spans, 1000 / TickSequence::CHUNK_RECORDS + 1);
+}
 
-	ExampleMRStorage _multi_rank_storage(_memory_storage, _ssd_storage, _disk_storage, _network_storage);
+TEST(SequenceStorageTest, AppendRangeScan){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    SequenceStorage<uint64_t, TestStorage, SequenceNoKey, 4096> seq(storage);
+
+    std::vector<uint64_t> values(3000);
+    for(size_t i = 0; i < values.size(); i++){
+        values[i] = i * 3;
+    }
+    seq.append(7);
+    EXPECT_EQ(seq.append_range(values), 1UL);
+    EXPECT_EQ(seq.size(), 3001UL);
+
+    size_t next = 100;
+    seq.scan(100, 2500, [&](size_t index, const uint64_t &v){
+        EXPECT_EQ(index, next++);
+        EXPECT_EQ(v, (index - 1) * 3);
+    });
+    EXPECT_EQ(next, 2500UL);
+
+    //end is clamped to size
+    size_t count = 0;
+    seq.scan(2990, 10000, [&](size_t, const uint64_t &){ count++; });
+    EXPECT_EQ(count, 11UL);
+}
 
-	ExampleDataStorage _data_storage(_multi_rank_storage);
+TEST(SequenceStorageTest, SeekByKey){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    TickSequence seq(storage);
+
+    //every time repeated twice
+    std::vector<Tick> ticks;
+    for(uint64_t i = 0; i < 5000; i++){
+        ticks.push_back(Tick{100 + i / 2 * 10, 0, 0});
+    }
+    seq.append_range(ticks);
+
+    EXPECT_EQ(seq.lower_bound(0), 0UL);
+    EXPECT_EQ(seq.lower_bound(100), 0UL);
+    EXPECT_EQ(seq.lower_bound(101), 2UL);
+    EXPECT_EQ(seq.lower_bound(110), 2UL);
+    EXPECT_EQ(seq.lower_bound(100 + 1234 * 10), 2468UL);
+    EXPECT_EQ(seq.lower_bound(100 + 1234 * 10 - 5), 2468UL);
+    EXPECT_EQ(seq.lower_bound(100 + 2499 * 10), 4998UL);
+    EXPECT_EQ(seq.lower_bound(100 + 2500 * 10), 5000UL);
+
+    std::vector<uint64_t> times;
+    seq.scan_keys(1000, 1030, [&](size_t, const Tick &t){ times.push_back(t.time); });
+    EXPECT_EQ(times, (std::vector<uint64_t>{1000, 1000, 1010, 1010, 1020, 1020}));
+}
 
-	ExampleObjectStorage _example_object_storage(_data_storage);
+TEST(SequenceStorageTest, QueryChunkSpans){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    TickSequence seq(storage);
+    constexpr size_t PER_CHUNK = TickSequence::CHUNK_RECORDS;
+
+    //gaps between chunks, so zone maps decide without reading
+    std::vector<Tick> ticks;
+    for(uint64_t i = 0; i < 10 * PER_CHUNK; i++){
+        ticks.push_back(Tick{(i / PER_CHUNK) * 100000 + i % PER_CHUNK * 10, 0, static_cast<uint32_t>(i)});
+    }
+    seq.append_range(ticks);
+
+    EXPECT_EQ(seq.find_chunk(0), 0UL);
+    EXPECT_EQ(seq.find_chunk(300005), 3UL);
+    EXPECT_EQ(seq.find_chunk(390000), 4UL);
+    EXPECT_EQ(seq.find_chunk(10000000), 10UL);
+    EXPECT_EQ(seq.lower_bound(300005), 3 * PER_CHUNK + 1);
+    EXPECT_EQ(seq.lower_bound(390000), 4 * PER_CHUNK);
+
+    //chunk 2 from the second record, chunks 3 and 4, chunk 5 up to record 7
+    auto range = seq.query(200005, 500070);
+    EXPECT_EQ(range.first(), 2 * PER_CHUNK + 1);
+    EXPECT_EQ(range.last(), 5 * PER_CHUNK + 7);
+    std::vector<size_t> sizes;
+    size_t next = range.first();
+    for(const auto &span: range){
+        EXPECT_EQ(span.first, next);
+        for(size_t j = 0; j < span.records.size(); j++){
+            EXPECT_EQ(span.records[j].volume, span.first + j);
+        }
+        next += span.records.size();
+        sizes.push_back(span.records.size());
+    }
+    EXPECT_EQ(sizes, (std::vector<size_t>{PER_CHUNK - 1, PER_CHUNK, PER_CHUNK, 7}));
+
+    //empty and out of range
+    EXPECT_EQ(seq.query(390000, 399999).size(), 0UL);
+    EXPECT_TRUE(seq.query(390000, 399999).begin() == std::default_sentinel);
+    EXPECT_EQ(seq.query(2000000, 3000000).size(), 0UL);
+    EXPECT_EQ(seq.query(0, 2000000).size(), 10 * PER_CHUNK);
+}
 
-	_storage_manager.register(_example_object_storage);
+TEST(SequenceStorageTest, SerializedRecords){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    SequenceStorage<SerializedObj, TestStorage, SequenceNoKey, 64> seq(storage);
+
+    for(int i = 0; i < 100; i++){
+        seq.append(SerializedObj{i});
+    }
+    EXPECT_EQ(seq.get(57).a, 57);
+    int sum = 0;
+    seq.scan(0, seq.size(), [&](size_t, const SerializedObj &o){ sum += o.a; });
+    EXPECT_EQ(sum, 99 * 100 / 2);
 }
 
-//C++ 20 concepts
-#include <ranges>
-
-template<typename T>
-concept ElementIterable = std::ranges::range<std::ranges::range_value_t<T>>;
-
-void testf(){
-	constexpr std::string seqfolder = "/cygdrive/g/trading/data/finam/";
-	static std::vector<std::string> filenames{
-		"USD000UTSTOM/monthly/USD000UTSTOM_131201_131231.txt",
-	};
-	std::string ticker = "USD000UTSTOM";
-	for(auto f: filenames){
-		ObjectsSequence<ExampleObject> seq;
-		seq.load_from_file(seqfolder + f); // .txt file
-		ElementIterable<ExampleObject> collection = seq.getSequence();
-		for(auto e: collection){
-			StorageKey key(ticker, StorageManager::Precision::Tick);
-			//StorageKey key(ticker, StorageManager::Precision::Custom{"test1"});
-			//DataStorage ds = _storage_manager.get<ObjectStorage<T>>(key);?
-			ObjectAddress addr = e.serialize(key); //just put sequence under this key
-			ObjectAddress position;
-			ObjectAddress addr2 = e.serialize(key, position); //update sequence with this key(add new ticks at the end)
-		}
-	}
-	{
-		StorageKey key(ticker, StorageManager::Precision::Tick);
-		ObjectAddress addr;
-		size_t seq_size = 10000; //limit to sequence size
-		const ObjectsSequence<ExampleObject> seq(seq_size, key, addr);
-		size_t offset = seq.size();
-		ObjectAddress addr2(addr, offset);
-		const ObjectsSequence<ExampleObject> seq2(seq_size, key, addr2);
-
-		ObjectAddress addr3(addr2, seq2.size());
-		ObjectsSequence<ExampleObject> seq3;
-		seq3.deserialize(seq_size, key, addr3);
-		//...change seq3 values
-		seq3.synchronize(key, addr3); //only if we changed values for the sequence
-		//TODO if we added/deleted values, how to synchronize
-		ObjectsSequence<ExampleObject> seq4(seq3);
-		ObjectAddress position(ObjectAddress::LAST);
-		seq4.serialize(key, position);
-		GetStorageManager().sync(); //force write to disk all caches
-	}
-	{
-		StorageKey key(ticker, StorageManager::Precision::Tick);
-		ExampleObjectStorage o_storage = GetStorageManager().GetStorage(key);
-		ObjectAddress o_addr;
-		StorageAddress s_addr = o_storage.GetStorageAddress(o_addr);
-		
-		ExampleDataStorage d_storage = o_storage.GetDataStorage(...)
-		StorageRawBuffer raw_buffer = d_storage.GetRawBuffer(s_addr);
-	}
+TEST(SequenceStorageTest, SerializeDeserialize){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    StorageAddress addr;
+    {
+        TickSequence seq(storage);
+        for(uint64_t i = 0; i < 700; i++){
+            seq.append(Tick{i, 0, static_cast<uint32_t>(i)});
+        }
+        seq.flush();
+        addr = serialize<StorageAddress>(storage, seq);
+    }
+    auto seq = deserialize<TickSequence>(storage, addr, storage);
+    EXPECT_EQ(seq.size(), 700UL);
+    EXPECT_EQ(seq.get(699).volume, 699U);
+    EXPECT_EQ(seq.lower_bound(300), 300UL);
+
+    //appends continue in the last chunk
+    seq.append(Tick{700, 0, 700});
+    EXPECT_EQ(seq.get(700).volume, 700U);
+    EXPECT_THROW(seq.append(Tick{1, 0, 0}), std::logic_error);
+    EXPECT_EQ(seq.size(), 701UL);
 }
 
+TEST(SequenceStorageTest, ChecksummedReopen){
+    using Storage = CheckedFileStorage<MEMORYSIZE>;
+    using Sequence = SequenceStorage<Tick, Storage, TickTime, 4096>;
+    std::filesystem::remove(std::filesystem::path{filename});
+
+    StorageAddress addr;
+    {
+        Storage storage{FileRMA<MEMORYSIZE>{filename}};
+        Sequence seq(storage);
+        for(uint64_t i = 0; i < 1000; i++){
+            seq.append(Tick{i, 0, 1});
+            if(i % 100 == 0){
+                //reads verify the committed tail, following appends take it again
+                EXPECT_EQ(seq.get(i).time, i);
+            }
+        }
+        seq.flush();
+        addr = serialize<StorageAddress>(storage, seq);
+    }
+    {
+        Storage storage{FileRMA<MEMORYSIZE>{filename}};
+        auto seq = deserialize<Sequence>(storage, addr, storage);
+        EXPECT_GT(storage.scrub(1000, [](const StorageAddress &){ EXPECT_TRUE(false); }), 0UL);
+        uint64_t sum = 0;
+        seq.scan(0, seq.size(), [&](size_t, const Tick &t){ sum += t.time; });
+        EXPECT_EQ(sum, 999UL * 1000 / 2);
+    }
+}
 
-void testf2(){
-	constexpr std::string seqfolder = "/cygdrive/g/trading/data/finam/";
-	static std::vector<std::string> filenames{
-		"USD000UTSTOM/monthly/USD000UTSTOM_131201_131231.txt",
-	};
-	std::string ticker = "USD000UTSTOM";
-	for(auto f: filenames){
-		ObjectsSequence<ExampleObject> seq;
-		seq.load_from_file(seqfolder + f); // .txt file
-		ElementIterable<ExampleObject> collection = seq.getSequence();
-		for(auto e: collection){
-			StorageKey key(ticker, StorageManager::Precision::Tick);
-			//StorageKey key(ticker, StorageManager::Precision::Custom{"test1"});
-			//DataStorage ds = _storage_manager.get<ObjectStorage<T>>(key);?
-			ObjectAddress addr = e.serialize(key); //just put sequence under this key
-			ObjectAddress position;
-			ObjectAddress addr2 = e.serialize(key, position); //update sequence with this key(add new ticks at the end)
-		}
-	}
-	{
-		StorageKey key(ticker, StorageManager::Precision::Tick);
-		ObjectAddress addr;
-		size_t seq_size = 10000; //limit to sequence size
-		const ObjectsSequence<ExampleObject> seq(seq_size, key, addr);
-		size_t offset = seq.size();
-		ObjectAddress addr2(addr, offset);
-		const ObjectsSequence<ExampleObject> seq2(seq_size, key, addr2);
-
-		ObjectAddress addr3(addr2, seq2.size());
-		ObjectsSequence<ExampleObject> seq3;
-		seq3.deserialize(seq_size, key, addr3);
-		//...change seq3 values
-		seq3.synchronize(key, addr3); //only if we changed values for the sequence
-		//TODO if we added/deleted values, how to synchronize
-		ObjectsSequence<ExampleObject> seq4(seq3);
-		ObjectAddress position(ObjectAddress::LAST);
-		seq4.serialize(key, position);
-		GetStorageManager().sync(); //force write to disk all caches
-	}
-	{
-		StorageKey key(ticker, StorageManager::Precision::Tick);
-		ExampleObjectStorage o_storage = GetStorageManager().GetStorage(key);
-		ObjectAddress o_addr;
-		StorageAddress s_addr = o_storage.GetStorageAddress(o_addr);
-		
-		ExampleDataStorage d_storage = o_storage.GetDataStorage(...)
-		StorageRawBuffer raw_buffer = d_storage.GetRawBuffer(s_addr);
-	}
 }
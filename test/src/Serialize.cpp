@@ -283,4 +283,121 @@ TEST(SerializeTest, VectorIntSerializeDeserialize){
     }
 }
 
+struct SchemaTestTag{ static constexpr std::string_view TYPE_NAME = "SchemaTestTag"; };
+struct FingerprintTestA{ static constexpr std::string_view TYPE_NAME = "FingerprintTestA"; int a; int b; };
+struct FingerprintTestB{ static constexpr std::string_view TYPE_NAME = "FingerprintTestB"; int a; int b; };
+//new layout of FingerprintTestA
+struct FingerprintTestC{ static constexpr std::string_view TYPE_NAME = "FingerprintTestA"; int a; short b; short c; };
+struct FingerprintTestUnnamed{ int a; };
+template<typename T>
+struct FingerprintTestTemplate{ static constexpr std::string_view TYPE_NAME = "FingerprintTestTemplate"; };
+struct FingerprintTestVersioned{
+    static constexpr std::string_view TYPE_NAME = "FingerprintTestVersioned";
+    static constexpr uint32_t SCHEMA_VERSION = 2;
+    int a;
+};
+
+TEST(SerializeTest, TypeFingerprint){
+    static_assert(stable_type_fingerprint<int>() != stable_type_fingerprint<unsigned int>());
+    static_assert(stable_type_fingerprint<FingerprintTestA>() != stable_type_fingerprint<FingerprintTestB>());
+    static_assert(stable_type_fingerprint<FingerprintTestA>() == stable_type_fingerprint<const FingerprintTestA &>());
+    static_assert(stable_type_fingerprint<std::map<int, int>>() != stable_type_fingerprint<std::map<int, long>>());
+    static_assert(stable_type_fingerprint<FingerprintTestTemplate<int>>() != stable_type_fingerprint<FingerprintTestTemplate<long>>());
+    //by name only, not by compiler spelling or layout
+    static_assert(stable_type_fingerprint<FingerprintTestA>() == fnv1a64("FingerprintTestA"));
+    static_assert(stable_type_fingerprint<FingerprintTestA>() == stable_type_fingerprint<FingerprintTestC>());
+    static_assert(stable_type_fingerprint<int32_t>() == stable_type_fingerprint<int>());
+    static_assert(stable_type_fingerprint<std::string>() == fnv1a64("string"));
+    static_assert(stable_type_fingerprint<FingerprintTestUnnamed>() == UNNAMED_FINGERPRINT);
+    EXPECT_EQ(type_name<int>(), "int");
+}
+
+TEST(SerializeTest, TypedObjectFingerprintMismatch){
+    SimpleRamStorage<MEMORYSIZE> storage{MemoryRMA<MEMORYSIZE>{}};
+
+    TypedObject<FingerprintTestA> to{FingerprintTestA{3, 4}};
+    StorageAddress addr = serialize<StorageAddress>(storage, to);
+
+    auto to_res = deserialize<TypedObject<FingerprintTestA>>(storage, addr);
+    EXPECT_EQ(to_res.get().a, 3);
+    EXPECT_EQ(to_res.get().b, 4);
+    //same layout, different type
+    EXPECT_THROW(deserialize<TypedObject<FingerprintTestB>>(storage, addr), std::invalid_argument);
+    EXPECT_THROW((TypedObject<FingerprintTestA>{FingerprintTestA{}, make_magic<FingerprintTestB>()}), std::invalid_argument);
+    //members added to a type keep it readable
+    auto to_c = deserialize<TypedObject<FingerprintTestC>>(storage, addr);
+    EXPECT_EQ(to_c.get().a, 3);
+}
+
+TEST(SerializeTest, TypedObjectSchemaBlock){
+    SimpleRamStorage<MEMORYSIZE> storage{MemoryRMA<MEMORYSIZE>{}};
+
+    TypedObject<FingerprintTestVersioned> to{FingerprintTestVersioned{7}};
+    TypedObject<FingerprintTestA> to_a{FingerprintTestA{3, 4}};
+    auto addr = storage.get_random_address(szeimpl::size(to) + szeimpl::size(to_a));
+    {
+        auto buffer = storage.writeb(addr);
+        size_t offset = 0;
+        SerializeSequentially(buffer, offset, to, to_a);
+        storage.commit(buffer);
+    }
+
+    auto buffer = storage.readb(addr);
+    StorageBufferRO<> buf = buffer;
+    auto header = PeekSchema(buf);
+    EXPECT_EQ(header.fingerprint, make_magic<FingerprintTestVersioned>());
+    EXPECT_EQ(header.version, 2U);
+    EXPECT_EQ(header.fields, 1U);
+    //versioned object is skipped without reading it
+    size_t offset = 0;
+    SkipSchema(buf, offset);
+    auto [a] = DeserializeSequentially<TypedObject<FingerprintTestA>>(buf, offset);
+    EXPECT_EQ(a.get().b, 4);
+    storage.commit(buffer);
+}
+
+TEST(SerializeTest, SchemaOlderVersion){
+    std::vector<char> mem(1024);
+    StorageBuffer buffer{mem.data(), mem.size(), mem.size()};
+    size_t offset = 0;
+    EXPECT_EQ(SerializeSchema<SchemaTestTag>(buffer, offset, 1, 5, std::string{"abc"}), Result::Success);
+    EXPECT_EQ(offset, SchemaSize<SchemaTestTag>(5, std::string{"abc"}));
+
+    StorageBufferRO<> buf{mem.data(), mem.size()};
+    size_t read_offset = 0;
+    auto [header, a, s, c] = DeserializeSchema<SchemaTestTag, int, std::string, uint64_t>(buf, read_offset);
+    EXPECT_EQ(header.version, 1U);
+    EXPECT_EQ(header.fields, 2U);
+    EXPECT_EQ(a, 5);
+    EXPECT_EQ(s, "abc");
+    EXPECT_EQ(c, 0UL);
+    EXPECT_EQ(read_offset, offset);
+}
+
+TEST(SerializeTest, SchemaNewerVersionSkip){
+    std::vector<char> mem(1024);
+    StorageBuffer buffer{mem.data(), mem.size(), mem.size()};
+    size_t offset = 0;
+    SerializeSchema<SchemaTestTag>(buffer, offset, 3, 5, std::string{"abc"}, 77UL, std::vector<int>{1, 2, 3});
+    SerializeSchema<FingerprintTestA>(buffer, offset, 1, 9);
+    SerializeSchema<SchemaTestTag>(buffer, offset, 1, 8);
+
+    StorageBufferRO<> buf{mem.data(), mem.size()};
+    size_t read_offset = 0;
+    auto [header, a, s] = DeserializeSchema<SchemaTestTag, int, std::string>(buf, read_offset);
+    EXPECT_EQ(header.version, 3U);
+    EXPECT_EQ(a, 5);
+    EXPECT_EQ(s, "abc");
+
+    //unknown block is skipped without deserializing
+    EXPECT_NE(PeekSchema(buf).fingerprint, stable_type_fingerprint<SchemaTestTag>());
+    EXPECT_THROW((DeserializeSchema<SchemaTestTag, int>(buf, read_offset)), std::invalid_argument);
+    SkipSchema(buf, read_offset);
+
+    auto [header2, a2] = DeserializeSchema<SchemaTestTag, int>(buf, read_offset);
+    EXPECT_EQ(header2.version, 1U);
+    EXPECT_EQ(a2, 8);
+    EXPECT_EQ(read_offset, offset);
+}
+
 }
@@ -127,6 +127,13 @@ TEST(SimpleObjectStorageTest, SimplePutGetSerialize){
 
         EXPECT_EQ(os.get<ObjectStorageAccess::Once>(0), TestObj{1});
     }
+    {
+        //written with another layout
+        StorageBuffer buffer = storage.writeb(os_addr.subrange(0, sizeof(uint32_t)));
+        *buffer.get<uint32_t>() ^= 1;
+        storage.commit(buffer);
+        EXPECT_THROW((deserialize<SimpleObjectStorage<TestObj, decltype(storage)>>(storage, os_addr, storage)), std::invalid_argument);
+    }
 }
 
 TEST(SimpleObjectStorageTest, MultiplePutGetCheck){
@@ -461,6 +468,151 @@ TEST(SimpleObjectStorageTest, ForeachIndexEmplace){
     }
 }
 
+TEST(SimpleObjectStorageTest, PutRangeGetRange){
+    SimpleRamStorage<MEMORYSIZE> storage{MemoryRMA<MEMORYSIZE>{}};
+    auto base = storage.get_random_address(OBJSTORAGE_MEM_ALLOC);
+    SimpleObjectStorage<TestObj, decltype(storage)> os(storage, base);
+    
+    std::vector<TestObj> objs;
+    for(int i = 0; i < 10; i++){
+        objs.push_back(TestObj{i});
+    }
+    EXPECT_EQ(os.put_range(objs), 0);
+    EXPECT_EQ(os.size(), 10);
+    EXPECT_EQ(os.put_range(objs), 10);
+    EXPECT_EQ(os.size(), 20);
+    EXPECT_EQ(os.get<ObjectStorageAccess::Once>(13), TestObj{3});
+
+    std::vector<TestObj> out;
+    EXPECT_EQ(os.get_range(5, 14, std::back_inserter(out)), 10);
+    ASSERT_EQ(out.size(), 10);
+    for(int i = 0; i < 10; i++){
+        EXPECT_EQ(out[i], TestObj{(i + 5) % 10});
+    }
+}
+
+TEST(SimpleObjectStorageTest, GetRangeMixed){
+    SimpleRamStorage<MEMORYSIZE> storage{MemoryRMA<MEMORYSIZE>{}};
+    auto base = storage.get_random_address(OBJSTORAGE_MEM_ALLOC);
+    SimpleObjectStorage<TestObj, decltype(storage)> os(storage, base);
+    
+    os.put(TestObj{0});
+    os.put(TestObj{1});
+    std::vector<TestObj> objs{TestObj{2}, TestObj{3}, TestObj{4}};
+    os.put_range(objs);
+    os.put(TestObj{5});
+    os.clear(3);
+    os.getRef(4).a = 40;
+
+    std::vector<TestObj> out;
+    EXPECT_EQ(os.get_range(0, 10, std::back_inserter(out)), 5);
+    EXPECT_EQ(out, (std::vector<TestObj>{TestObj{0}, TestObj{1}, TestObj{2}, TestObj{40}, TestObj{5}}));
+}
+
+TEST(SimpleObjectStorageTest, PutRangeSerializeDeserialize){
+    SimpleRamStorage<MEMORYSIZE> storage{MemoryRMA<MEMORYSIZE>{}};
+    auto base = storage.get_random_address(OBJSTORAGE_MEM_ALLOC);
+    StorageAddress os_addr;
+    
+    {
+        SimpleObjectStorage<TestObj, decltype(storage)> os(storage, base);
+        std::vector<TestObj> objs{TestObj{1}, TestObj{5}, TestObj{10}};
+        os.put_range(objs);
+        os_addr = serialize<StorageAddress>(storage, os);
+    }
+    {
+        auto os = deserialize<SimpleObjectStorage<TestObj, decltype(storage)>>(storage, os_addr, storage);
+
+        EXPECT_EQ(os.size(), 3);
+        EXPECT_EQ(os.get<ObjectStorageAccess::Once>(0), TestObj{1});
+        EXPECT_EQ(os.get<ObjectStorageAccess::Once>(1), TestObj{5});
+        EXPECT_EQ(os.get<ObjectStorageAccess::Once>(2), TestObj{10});
+    }
+}
+
+TEST(SimpleObjectStorageTest, PutAfterDeserialize){
+    SimpleRamStorage<MEMORYSIZE> storage{MemoryRMA<MEMORYSIZE>{}};
+    auto base = storage.get_random_address(OBJSTORAGE_MEM_ALLOC);
+    StorageAddress os_addr;
+
+    {
+        SimpleObjectStorage<TestObj, decltype(storage)> os(storage, base);
+        os.put(TestObj{1});
+        std::vector<TestObj> objs{TestObj{2}, TestObj{3}};
+        os.put_range(objs);
+        os_addr = serialize<StorageAddress>(storage, os);
+    }
+    {
+        //new objects continue after the old ones instead of overwriting them
+        auto os = deserialize<SimpleObjectStorage<TestObj, decltype(storage)>>(storage, os_addr, storage);
+        EXPECT_EQ(os.put(TestObj{4}), 3);
+        std::vector<TestObj> objs{TestObj{5}, TestObj{6}};
+        EXPECT_EQ(os.put_range(objs), 4);
+        os_addr = serialize<StorageAddress>(storage, os);
+    }
+    {
+        auto os = deserialize<SimpleObjectStorage<TestObj, decltype(storage)>>(storage, os_addr, storage);
+        std::vector<TestObj> out;
+        EXPECT_EQ(os.get_range(0, 10, std::back_inserter(out)), 6);
+        EXPECT_EQ(out, (std::vector<TestObj>{TestObj{1}, TestObj{2}, TestObj{3}, TestObj{4}, TestObj{5}, TestObj{6}}));
+    }
+}
+
+TEST(SimpleObjectStorageTest, CachingSharedInstances){
+    SimpleRamStorage<MEMORYSIZE> storage{MemoryRMA<MEMORYSIZE>{}};
+    auto base = storage.get_random_address(OBJSTORAGE_MEM_ALLOC);
+    SimpleObjectStorage<TestObj, decltype(storage)> os(storage, base);
+    
+    auto index0 = os.put(TestObj{1});
+    auto index1 = os.put(TestObj{2});
+    auto shared0 = os.getShared(index0);
+    EXPECT_EQ(*shared0, TestObj{1});
+    EXPECT_EQ(shared0, os.getShared(index0));
+    EXPECT_EQ(os.get<ObjectStorageAccess::Caching>(index1), TestObj{2});
+    EXPECT_EQ(os.get<ObjectStorageAccess::Caching>(index1), TestObj{2});
+
+    auto m = os.cache_metrics();
+    EXPECT_EQ(m.hits, 2);
+    EXPECT_EQ(m.misses, 2);
+    EXPECT_EQ(m.entries, 2);
+
+    //overwritten object is dropped from the cache, readers keep the old instance
+    os.put(TestObj{3}, index0);
+    EXPECT_EQ(*os.getShared(index0), TestObj{3});
+    EXPECT_EQ(*shared0, TestObj{1});
+    os.clear(index1);
+    EXPECT_EQ(os.cache_metrics().entries, 1);
+
+    os.set_cache_size(0);
+    EXPECT_EQ(os.cache_metrics().entries, 0);
+    EXPECT_EQ(os.get<ObjectStorageAccess::Caching>(index0), TestObj{3});
+}
+
+TEST(SimpleObjectStorageTest, ReleaseKept){
+    SimpleRamStorage<MEMORYSIZE> storage{MemoryRMA<MEMORYSIZE>{}};
+    auto base = storage.get_random_address(OBJSTORAGE_MEM_ALLOC);
+    SimpleObjectStorage<TestObj, decltype(storage)> os(storage, base);
+
+    for(int i = 0; i < 10; i++){
+        os.put(TestObj{i});
+    }
+    for(size_t i = 0; i < 10; i++){
+        os.getRef(i).a += 100;
+    }
+    EXPECT_EQ(os.get<ObjectStorageAccess::Keep>(3), TestObj{103});
+    EXPECT_EQ(os.kept(), 10);
+
+    //changes are written back, objects are read from storage again
+    os.release(0, 9);
+    EXPECT_EQ(os.kept(), 0);
+    EXPECT_EQ(os.size(), 10);
+    for(size_t i = 0; i < 10; i++){
+        EXPECT_EQ(os.get<ObjectStorageAccess::Once>(i), TestObj{static_cast<int>(i) + 100});
+    }
+    EXPECT_EQ(os.kept(), 0);
+    os.release(0);
+}
+
 //TODO wrapper for template concept, not implementation
 //TODO access modificators check, especially ::Keep
 
@@ -2,6 +2,12 @@
 #include <cstdio>
 #include <memory>
 #include <filesystem>
+#include <vector>
+#include <cstring>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <algorithm>
 
 #include <storage/SimpleStorage.hpp>
 
@@ -516,8 +522,319 @@ TEST(SimpleStorage, ReadWritePartialAddress){
     EXPECT_EQ(storage.readb(addr4).get<int>()[0], 20);
 }
 
+//flips byte at of the first occurrence of pattern in the file, as if the disk corrupted it
+void corrupt_file(const std::vector<unsigned char> &pattern, size_t at){
+    FileRMA<FILESIZE> raw{filename};
+    StorageBuffer buffer = raw.writeb(0, 1UL << FILESIZE);
+    auto begin = buffer.get<unsigned char>();
+    auto end = begin + buffer.size();
+    auto found = std::search(begin, end, pattern.begin(), pattern.end());
+    ASSERT_NE(found, end);
+    found[at] ^= 0xFF;
+}
+std::vector<unsigned char> sequence_pattern(unsigned char seed, size_t size){
+    std::vector<unsigned char> pattern(size);
+    for(size_t i = 0; i < size; i++){
+        pattern[i] = seed + i;
+    }
+    return pattern;
+}
+
+TEST(SimpleStorage, ChecksumVerifyOnRead){
+    std::filesystem::remove(std::filesystem::path{filename});
+
+    StorageAddress address1, address2;
+    {
+        CheckedFileStorage<FILESIZE> storage{FileRMA<FILESIZE>{filename}};
+        address1 = storage.get_random_address(100);
+        address2 = storage.get_random_address(100);
+        unsigned char seed = 0;
+        for(auto &address: {address1, address2}){
+            StorageBuffer writeb = storage.writeb(address);
+            auto pattern = sequence_pattern(seed, address.size);
+            memcpy(writeb.get(), pattern.data(), pattern.size());
+            EXPECT_EQ(Result::Success, storage.commit(writeb));
+            seed += 100;
+        }
+    }
+    corrupt_file(sequence_pattern(100, 100), 50);
+
+    CheckedFileStorage<FILESIZE> storage{FileRMA<FILESIZE>{filename}};
+    StorageBufferRO readb1 = storage.readb(address1);
+    EXPECT_EQ(readb1.get<unsigned char>()[50], 50);
+    EXPECT_THROW(storage.readb(address2), std::runtime_error);
+    //a part of the extent is verified as the whole extent
+    EXPECT_THROW(storage.readb(address2.subrange(80, 10)), std::runtime_error);
+    //unchanged part of the extent is verified before a write
+    EXPECT_THROW(storage.writeb(address2.subrange(0, 10)), std::runtime_error);
+}
+
+TEST(SimpleStorage, ChecksumPartialWrite){
+    std::filesystem::remove(std::filesystem::path{filename});
+
+    StorageAddress address;
+    {
+        CheckedFileStorage<FILESIZE> storage{FileRMA<FILESIZE>{filename}};
+        address = storage.get_random_address(100);
+        StorageBuffer writeb = storage.writeb(address);
+        auto pattern = sequence_pattern(0, address.size);
+        memcpy(writeb.get(), pattern.data(), pattern.size());
+        EXPECT_EQ(Result::Success, storage.commit(writeb));
+    }
+    {
+        CheckedFileStorage<FILESIZE> storage{FileRMA<FILESIZE>{filename}};
+        StorageBuffer writeb = storage.writeb(address.subrange(10, 10));
+        memset(writeb.get(), 0xF0, 10);
+        EXPECT_EQ(Result::Success, storage.commit(writeb));
+        //modified without commit, reads do not fail
+        StorageBuffer uncommitted = storage.writeb(address.subrange(30, 1));
+        uncommitted.get<unsigned char>()[0] = 0xF1;
+        StorageBufferRO readb = storage.readb(address.subrange(30, 10));
+        EXPECT_EQ(readb.get<unsigned char>()[0], 0xF1);
+        EXPECT_EQ(readb.get<unsigned char>()[1], 31);
+    }
+    {
+        //checksum still covers the whole extent, including both writes
+        CheckedFileStorage<FILESIZE> storage{FileRMA<FILESIZE>{filename}};
+        StorageBufferRO readb = storage.readb(address);
+        EXPECT_EQ(readb.get<unsigned char>()[15], 0xF0);
+        EXPECT_EQ(readb.get<unsigned char>()[30], 0xF1);
+        EXPECT_EQ(readb.get<unsigned char>()[80], 80);
+    }
+    //unchanged block of the extent
+    corrupt_file(sequence_pattern(70, 20), 10);
+    CheckedFileStorage<FILESIZE> storage{FileRMA<FILESIZE>{filename}};
+    EXPECT_THROW(storage.readb(address.subrange(10, 10)), std::runtime_error);
+    EXPECT_EQ(storage.scrub(10, [&address](const StorageAddress &addr){ EXPECT_EQ(addr.addr, address.addr); }), 2UL);
+}
+
+TEST(SimpleStorage, ChecksumScrub){
+    std::filesystem::remove(std::filesystem::path{filename});
+    CheckedFileStorage<FILESIZE> storage{FileRMA<FILESIZE>{filename}};
+
+    std::vector<StorageAddress> addresses;
+    for(size_t n = 0; n < 4; n++){
+        auto address = storage.get_random_address(64);
+        StorageBuffer writeb = storage.writeb(address);
+        memset(writeb.get(), n + 1, address.size);
+        EXPECT_EQ(Result::Success, storage.commit(writeb));
+        addresses.push_back(address);
+    }
+    EXPECT_EQ(Result::Success, storage.checkpoint());
+    corrupt_file(std::vector<unsigned char>(64, 3), 0);
+
+    std::vector<StorageAddress> corrupted;
+    auto on_corrupted = [&corrupted](const StorageAddress &addr){ corrupted.push_back(addr); };
+    //static section is checksummed as well
+    EXPECT_EQ(storage.scrub(3, on_corrupted), 3UL);
+    EXPECT_EQ(storage.scrub(3, on_corrupted), 3UL);
+    ASSERT_EQ(corrupted.size(), 1UL);
+    EXPECT_EQ(corrupted[0].addr, addresses[2].addr);
+    EXPECT_EQ(corrupted[0].size, addresses[2].size);
+}
+
+TEST(SimpleStorage, ChecksumSerializeDeserialize){
+    std::filesystem::remove(std::filesystem::path{filename});
+
+    StorageAddress address1, address2;
+    {
+        CheckedFileStorage<FILESIZE> storage{FileRMA<FILESIZE>{filename}};
+        address1 = storage.get_random_address(100);
+        address2 = storage.get_random_address(100);
+        for(auto &address: {address1, address2}){
+            StorageBuffer writeb = storage.writeb(address);
+            for(size_t i = 0; i < address.size; i++){
+                writeb.get<unsigned char>()[i] = i;
+            }
+            EXPECT_EQ(Result::Success, storage.commit(writeb));
+        }
+        EXPECT_EQ(Result::Success, storage.erase(address2));
+    }
+    {
+        CheckedFileStorage<FILESIZE> storage{FileRMA<FILESIZE>{filename}};
+        StorageBufferRO readb1 = storage.readb(address1);
+        for(size_t i = 0; i < 100; i++){
+            EXPECT_EQ(readb1.get<unsigned char>()[i], i);
+        }
+        EXPECT_EQ(storage.scrub(10), 2UL); //static section and address1
+
+        StorageBuffer writeb = storage.writeb(address1);
+        writeb.get<unsigned char>()[0] = 0xFF;
+        EXPECT_EQ(storage.readb(address1).get<unsigned char>()[0], 0xFF);
+    }
+}
+
+TEST(SimpleStorage, ChecksumBackgroundScrub){
+    std::filesystem::remove(std::filesystem::path{filename});
+    CheckedFileStorage<FILESIZE> storage{FileRMA<FILESIZE>{filename}};
+    std::mutex lock;
+
+    StorageAddress address;
+    {
+        std::lock_guard l{lock};
+        address = storage.get_random_address(64);
+        StorageBuffer writeb = storage.writeb(address);
+        memset(writeb.get(), 1, address.size);
+        EXPECT_EQ(Result::Success, storage.commit(writeb));
+        EXPECT_EQ(Result::Success, storage.checkpoint());
+        corrupt_file(std::vector<unsigned char>(64, 1), 3);
+    }
+
+    std::atomic<size_t> corrupted{0};
+    {
+        BackgroundScrubber scrubber{storage, lock,
+            [&corrupted](const StorageAddress &){ corrupted++; }, std::chrono::milliseconds{1}};
+        for(size_t i = 0; i < 1000 && corrupted == 0; i++){
+            std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        }
+    }
+    EXPECT_GE(corrupted.load(), 1UL);
+}
+
+void write_pattern(auto &storage, const StorageAddress &address, unsigned char seed){
+    StorageBuffer writeb = storage.writeb(address);
+    for(size_t i = 0; i < address.size; i++){
+        writeb.template get<unsigned char>()[i] = seed + i;
+    }
+    EXPECT_EQ(Result::Success, storage.commit(writeb));
+}
+bool check_pattern(auto &storage, const StorageAddress &address, unsigned char seed){
+    StorageBufferRO readb = storage.readb(address);
+    for(size_t i = 0; i < address.size; i++){
+        if(readb.template get<unsigned char>()[i] != static_cast<unsigned char>(seed + i)){
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST(SimpleStorage, ChecksumOnCommit){
+    std::filesystem::remove(std::filesystem::path{filename});
+
+    StorageAddress address1, address2;
+    {
+        CheckedFileStorage<FILESIZE> storage{FileRMA<FILESIZE>{filename}};
+        EXPECT_EQ(Result::Success, storage.checkpoint());
+        address1 = storage.get_random_address(100);
+        address2 = storage.get_random_address(100);
+        write_pattern(storage, address1, 0);
+        write_pattern(storage, address2, 100);
+        //write inside of the extent, its crc follows
+        StorageBuffer writeb = storage.writeb(address1.subrange(10, 10));
+        memset(writeb.get(), 0xF0, 10);
+        EXPECT_EQ(Result::Success, storage.commit(writeb));
+
+        //committed extents are scrubbed before a checkpoint
+        corrupt_file(sequence_pattern(150, 20), 10);
+        std::vector<StorageAddress> corrupted;
+        storage.scrub(10, [&corrupted](const StorageAddress &addr){ corrupted.push_back(addr); });
+        ASSERT_EQ(corrupted.size(), 1UL);
+        EXPECT_EQ(corrupted[0].addr, address2.addr);
+        //whole extent is replaced, nothing to verify
+        write_pattern(storage, address2, 100);
+    }
+    CheckedFileStorage<FILESIZE> storage{FileRMA<FILESIZE>{filename}};
+    EXPECT_EQ(storage.scrub(10, [](const StorageAddress &){ EXPECT_TRUE(false); }), 3UL);
+    StorageBufferRO readb = storage.readb(address1);
+    EXPECT_EQ(readb.get<unsigned char>()[15], 0xF0);
+    EXPECT_EQ(readb.get<unsigned char>()[20], 20);
+    EXPECT_TRUE(check_pattern(storage, address2, 100));
+}
+
+template<typename Storage>
+void checkpoint_replay(){
+    constexpr size_t LOG_FILESIZE = 20;
+    std::filesystem::remove(std::filesystem::path{filename});
+    std::vector<StorageAddress> addresses;
+    {
+        Storage storage{FileRMA<LOG_FILESIZE>{filename}};
+        for(size_t n = 0; n < 300; n++){
+            addresses.push_back(storage.get_random_address(32));
+            write_pattern(storage, addresses.back(), n);
+        }
+    }
+    {
+        //changes are only in the log, storage is never closed
+        auto storage = new Storage{FileRMA<LOG_FILESIZE>{filename}};
+        for(size_t n = 300; n < 310; n++){
+            addresses.push_back(storage->get_random_address(32));
+            write_pattern(*storage, addresses.back(), n);
+        }
+        write_pattern(*storage, addresses[5], 77);
+        EXPECT_EQ(Result::Success, storage->erase(addresses[7]));
+        EXPECT_EQ(Result::Success, storage->checkpoint());
+
+        //not checkpointed
+        write_pattern(*storage, addresses[6], 99);
+        //never closed, as if the process crashed
+        (void)storage;
+    }
+    for(size_t session = 0; session < 3; session++){
+        Storage storage{FileRMA<LOG_FILESIZE>{filename}};
+        for(size_t n = 0; n < addresses.size(); n++){
+            if(n == 7){
+                EXPECT_THROW(storage.readb(addresses[n]), std::logic_error);
+            } else if(n != 6){
+                EXPECT_TRUE(check_pattern(storage, addresses[n], n == 5 ? 77 : n)) << n;
+            }
+        }
+        //enough changes to overflow the log and compact it
+        for(size_t n = 0; n < 200; n++){
+            write_pattern(storage, addresses[n + 10], n + 10);
+            addresses.push_back(storage.get_random_address(32));
+            write_pattern(storage, addresses.back(), addresses.size() - 1);
+            EXPECT_EQ(Result::Success, storage.checkpoint());
+        }
+    }
+}
+
+TEST(SimpleStorage, CheckpointReplay){
+    checkpoint_replay<SimpleFileStorage<20>>();
+}
+
+TEST(SimpleStorage, CheckpointReplayChecksum){
+    checkpoint_replay<CheckedFileStorage<20>>();
+}
+
+TEST(SimpleStorage, ExpandAddress){
+    std::filesystem::remove(std::filesystem::path{filename});
+    StorageAddress unmapped, last, middle, next;
+    {
+        SimpleFileStorage<FILESIZE> storage{FileRMA<FILESIZE>{filename}};
+        //not written yet
+        unmapped = storage.get_random_address(64);
+        auto added = storage.expand_address(unmapped, 64);
+        EXPECT_EQ(added.addr, unmapped.addr + 64);
+        unmapped.size += 64;
+        write_pattern(storage, unmapped, 1);
+
+        //mapped in the middle of the file, moved
+        middle = storage.get_random_address(64);
+        write_pattern(storage, middle, 2);
+        next = storage.get_random_address(64);
+        write_pattern(storage, next, 3);
+        storage.expand_address(middle, 100);
+        EXPECT_TRUE(check_pattern(storage, middle, 2));
+        EXPECT_TRUE(check_pattern(storage, next, 3));
+        middle.size += 100;
+        write_pattern(storage, middle, 4);
+
+        //mapped last, grows in place
+        last = storage.get_random_address(64);
+        write_pattern(storage, last, 5);
+        storage.expand_address(last, 64);
+        EXPECT_TRUE(check_pattern(storage, last, 5));
+        last.size += 64;
+        write_pattern(storage, last, 6);
+    }
+    SimpleFileStorage<FILESIZE> storage{FileRMA<FILESIZE>{filename}};
+    EXPECT_TRUE(check_pattern(storage, unmapped, 1));
+    EXPECT_TRUE(check_pattern(storage, middle, 4));
+    EXPECT_TRUE(check_pattern(storage, next, 3));
+    EXPECT_TRUE(check_pattern(storage, last, 6));
+}
+
 //TODO rw addr+offset, read with size_incomplete
 //TODO write incorrect
-//TODO expand address
 
 }
@@ -70,4 +70,82 @@ TEST(SetOrderedBySizeTest, AddGetSimpleLimitSize){
 }
 
 
-}
\ No newline at end of file
+TEST(ChunkedArrayTest, ResizeKeepsReferences){
+    ChunkedArray<int, 2> arr;
+    arr.resize(3);
+    EXPECT_EQ(arr.size(), 3);
+    EXPECT_EQ(arr[2], 0);
+    int &ref = arr[1];
+    ref = 5;
+    arr.resize(100);
+    EXPECT_EQ(&ref, &arr[1]);
+    EXPECT_EQ(arr[1], 5);
+    arr[99] = 7;
+
+    auto copy = arr;
+    copy[1] = 6;
+    EXPECT_EQ(arr[1], 5);
+    EXPECT_EQ(copy[99], 7);
+}
+
+TEST(ChunkedArrayTest, ShrinkResetsElements){
+    ChunkedArray<int, 2> arr;
+    arr.resize(10);
+    arr[2] = 3;
+    arr[8] = 9;
+    arr.resize(5);
+    arr.resize(10);
+    EXPECT_EQ(arr[2], 3);
+    EXPECT_EQ(arr[8], 0);
+}
+
+TEST(ChunkedArrayTest, SerializeDeserialize){
+    ChunkedArray<StorageAddress, 2> arr;
+    arr.resize(10);
+    for(size_t i = 0; i < 10; i++){
+        arr[i] = StorageAddress{i * 100, i};
+    }
+    arr[3].reset();
+    std::vector<char> data(szeimpl::size(arr));
+    StorageBuffer buffer{data.data(), data.size(), data.size()};
+    EXPECT_EQ(szeimpl::s(arr, buffer), Result::Success);
+
+    auto arr2 = szeimpl::d<ChunkedArray<StorageAddress, 2>>(StorageBufferRO<>{data.data(), data.size()});
+    ASSERT_EQ(arr2.size(), 10);
+    EXPECT_TRUE(arr2[3].is_null());
+    EXPECT_EQ(arr2[9].addr, 900);
+    EXPECT_EQ(arr2[9].size, 9);
+}
+
+TEST(IndexCacheTest, EmplaceFindErase){
+    IndexCache<TestObject1> cache;
+    EXPECT_EQ(cache.find(0), nullptr);
+    for(int i = 0; i < 1000; i++){
+        auto [v, emplaced] = cache.emplace(i, TestObject1{i, -i});
+        EXPECT_TRUE(emplaced);
+        EXPECT_EQ(*v, (TestObject1{i, -i}));
+    }
+    EXPECT_EQ(cache.size(), 1000);
+    EXPECT_FALSE(cache.emplace(10, TestObject1{0, 0}).second);
+    for(int i = 0; i < 1000; i += 2){
+        EXPECT_EQ(cache.erase(i), 1);
+    }
+    EXPECT_EQ(cache.erase(0), 0);
+    EXPECT_EQ(cache.size(), 500);
+    auto *v11 = cache.find(11);
+    for(int i = 1000; i < 2000; i++){
+        cache.emplace(i, TestObject1{i, -i});
+    }
+    //values don't move on rehash
+    EXPECT_EQ(cache.find(11), v11);
+    EXPECT_EQ(v11->first, 11);
+    for(int i = 0; i < 2000; i++){
+        bool has = (i >= 1000) || (i % 2 == 1);
+        EXPECT_EQ(cache.find(i) != nullptr, has);
+    }
+    cache.clear();
+    EXPECT_EQ(cache.size(), 0);
+    EXPECT_EQ(cache.find(11), nullptr);
+}
+
+}
@@ -0,0 +1,262 @@
+#include "gtest/gtest.h"
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <optional>
+#include <algorithm>
+#include <filesystem>
+
+#include <storage/DataStorage.hpp>
+#include <storage/Serialize.hpp>
+#include <storage/SimpleStorage.hpp>
+
+namespace{
+
+constexpr size_t MEMORYSIZE = 24;
+
+using TestStorage = SimpleRamStorage<MEMORYSIZE>;
+
+struct Settings{
+    uint64_t version;
+    std::string name;
+    std::vector<uint64_t> values;
+
+    Result serializeImpl(StorageBuffer<> &buffer) const {
+        size_t offset = 0;
+        return SerializeSequentially(buffer, offset, version, name, values);
+    }
+    static Settings deserializeImpl(const StorageBufferRO<> &buffer) {
+        size_t offset = 0;
+        auto buf = buffer;
+        auto [version, name, values] = DeserializeSequentially<uint64_t, std::string, std::vector<uint64_t>>(buf, offset);
+        return Settings{version, name, values};
+    }
+    size_t getSizeImpl() const {
+        return szeimpl::size(version) + szeimpl::size(name) + szeimpl::size(values);
+    }
+};
+
+//fixed size records, remembers which ones were set
+struct Records{
+    std::vector<uint64_t> values;
+    std::vector<size_t> changed;
+    bool resized = false;
+
+    void set(size_t i, uint64_t value){
+        values[i] = value;
+        changed.push_back(i);
+    }
+    void push_back(uint64_t value){
+        values.push_back(value);
+        resized = true;
+    }
+
+    std::optional<DirtyRanges> dirty_ranges() const {
+        if(resized){
+            return std::nullopt;
+        }
+        DirtyRanges ranges;
+        for(auto i: changed){
+            ranges.emplace_back(sizeof(size_t) + i * sizeof(uint64_t), sizeof(uint64_t));
+        }
+        return ranges;
+    }
+    Result serializeRangeImpl(StorageBuffer<> &buffer, size_t offset) const {
+        memcpy(buffer.get(), values.data() + (offset - sizeof(size_t)) / sizeof(uint64_t), buffer.size());
+        return Result::Success;
+    }
+    void clear_dirty(){
+        changed.clear();
+        resized = false;
+    }
+
+    Result serializeImpl(StorageBuffer<> &buffer) const {
+        size_t offset = 0;
+        return SerializeSequentially(buffer, offset, values);
+    }
+    static Records deserializeImpl(const StorageBufferRO<> &buffer) {
+        size_t offset = 0;
+        auto buf = buffer;
+        auto [values] = DeserializeSequentially<std::vector<uint64_t>>(buf, offset);
+        return Records{values, {}, false};
+    }
+    size_t getSizeImpl() const {
+        return szeimpl::size(values);
+    }
+};
+
+Settings make_settings(size_t n){
+    Settings s{1, "settings", {}};
+    for(size_t i = 0; i < n; i++){
+        s.values.push_back(i * 3);
+    }
+    return s;
+}
+
+TEST(StoredObjectTest, WritesOnlyChangedBlocks){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    constexpr size_t N = 10000;
+    StoredObject<Settings> object{make_settings(N), storage};
+    size_t full = szeimpl::size(object.get());
+    EXPECT_EQ(object.sync(storage), full);
+    EXPECT_EQ(object.sync(storage), 0UL);
+    auto address = object.getAddress();
+
+    //not changed
+    object.get();
+    EXPECT_EQ(object.sync(storage), 0UL);
+    //one field
+    object.get().version = 2;
+    EXPECT_LE(object.sync(storage), 64UL);
+    //a few elements of the container
+    object.get().values[10] = 1;
+    object.get().values[N / 2] = 2;
+    object.get().values[N - 1] = 3;
+    EXPECT_LE(object.sync(storage), 3 * 64UL);
+
+    StoredObject<Settings> loaded{address, storage};
+    EXPECT_EQ(loaded.get().version, 2UL);
+    EXPECT_EQ(loaded.get().values[N / 2], 2UL);
+    EXPECT_EQ(loaded.get().values[N - 1], 3UL);
+    EXPECT_EQ(loaded.get().values[N - 2], (N - 2) * 3);
+    //loaded object writes only changes too
+    loaded.get().values[7] = 7;
+    EXPECT_LE(loaded.sync(storage), 64UL);
+    EXPECT_EQ((StoredObject<Settings>{address, storage}.get().values[7]), 7UL);
+}
+
+TEST(StoredObjectTest, GrowsInPlace){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    //small allocation, so it has to grow
+    StoredObject<Settings, 256> object{make_settings(10), storage};
+    object.sync(storage);
+    auto address = object.getAddress();
+    //something stored after it
+    auto other = serialize<StorageAddress>(storage, make_settings(20));
+
+    object.get().values.resize(1000, 5);
+    object.get().name = "grown";
+    object.sync(storage);
+    EXPECT_EQ(object.getAddress().addr, address.addr);
+    EXPECT_GE(object.getAddress().size, szeimpl::size(object.get()));
+    //appended elements are written, the beginning is unchanged
+    object.get().values.push_back(6);
+    size_t written = object.sync(storage);
+    EXPECT_GT(written, 0UL);
+    EXPECT_LE(written, 3 * 64UL);
+
+    //read back from the grown address
+    StoredObject<Settings> loaded{object.getAddress(), storage};
+    EXPECT_EQ(loaded.get().name, "grown");
+    EXPECT_EQ(loaded.get().values.size(), 1001UL);
+    EXPECT_EQ(loaded.get().values[9], 27UL);
+    EXPECT_EQ(loaded.get().values[1000], 6UL);
+    EXPECT_EQ(deserialize<Settings>(storage, other).values.size(), 20UL);
+}
+
+TEST(StoredObjectTest, BuiltinObject){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    StoredObject<std::vector<uint32_t>> object{std::vector<uint32_t>(5000, 1), storage};
+    object.sync(storage);
+    object.get()[4000] = 2;
+    EXPECT_LE(object.sync(storage), 64UL);
+    auto loaded = deserialize<std::vector<uint32_t>>(storage, object.getAddress());
+    EXPECT_EQ(loaded.size(), 5000UL);
+    EXPECT_EQ(loaded[4000], 2U);
+    EXPECT_EQ(loaded[3999], 1U);
+}
+
+TEST(StoredObjectTest, ChecksumCoversUnchangedBlocks){
+    using Storage = CheckedFileStorage<MEMORYSIZE>;
+    const std::string filename{"/tmp/StoredObject.test"};
+    std::filesystem::remove(std::filesystem::path{filename});
+    StorageAddress address;
+    {
+        Storage storage{FileRMA<MEMORYSIZE>{filename}};
+        StoredObject<Settings, 16 * 1024> object{make_settings(1000), storage};
+        object.sync(storage);
+        address = object.getAddress();
+        object.get().values[10] = 1;
+        EXPECT_LE(object.sync(storage), 64UL);
+    }
+    {
+        //corrupt a block far from the changed one
+        FileRMA<MEMORYSIZE> raw{filename};
+        StorageBuffer buffer = raw.writeb(0, 1UL << MEMORYSIZE);
+        uint64_t values[2] = {800 * 3, 801 * 3};
+        auto pattern = reinterpret_cast<const unsigned char *>(values);
+        auto begin = buffer.get<unsigned char>();
+        auto end = begin + buffer.size();
+        auto found = std::search(begin, end, pattern, pattern + sizeof(values));
+        ASSERT_NE(found, end);
+        found[0] ^= 0xFF;
+    }
+    Storage storage{FileRMA<MEMORYSIZE>{filename}};
+    EXPECT_THROW((StoredObject<Settings>{address, storage}), std::runtime_error);
+}
+
+TEST(StoredObjectTest, DirtyTrackedObject){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    constexpr size_t N = 10000;
+    StoredObject<Records> object{Records{std::vector<uint64_t>(N, 1), {}, false}, storage};
+    EXPECT_EQ(object.sync(storage), szeimpl::size(object.get()));
+    auto address = object.getAddress();
+
+    //only the reported ranges
+    object.get().set(10, 2);
+    object.get().set(N - 1, 3);
+    EXPECT_EQ(object.sync(storage), 2 * sizeof(uint64_t));
+    object.get();
+    EXPECT_EQ(object.sync(storage), 0UL);
+
+    StoredObject<Records> loaded{address, storage};
+    EXPECT_EQ(loaded.get().values[10], 2UL);
+    EXPECT_EQ(loaded.get().values[11], 1UL);
+    EXPECT_EQ(loaded.get().values[N - 1], 3UL);
+    //layout change writes the whole object
+    loaded.get().push_back(4);
+    EXPECT_EQ(loaded.sync(storage), szeimpl::size(loaded.get()));
+    loaded.get().set(0, 5);
+    EXPECT_EQ(loaded.sync(storage), sizeof(uint64_t));
+
+    StoredObject<Records> reloaded{address, storage};
+    EXPECT_EQ(reloaded.get().values.size(), N + 1);
+    EXPECT_EQ(reloaded.get().values[0], 5UL);
+    EXPECT_EQ(reloaded.get().values[N], 4UL);
+}
+
+TEST(StoredObjectTest, SmallObjectRewritten){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    StoredObject<Settings> object{make_settings(4), storage};
+    size_t full = object.sync(storage);
+    EXPECT_EQ(full, szeimpl::size(object.get()));
+    object.get().version = 2;
+    EXPECT_EQ(object.sync(storage), full);
+
+    StoredObject<Settings> loaded{object.getAddress(), storage};
+    loaded.get().values[3] = 1;
+    EXPECT_EQ(loaded.sync(storage), full);
+    StoredObject<Settings> reloaded{object.getAddress(), storage};
+    EXPECT_EQ(reloaded.get().version, 2UL);
+    EXPECT_EQ(reloaded.get().values[3], 1UL);
+}
+
+TEST(StoredObjectTest, AutoStoredObjectSync){
+    TestStorage storage{MemoryRMA<MEMORYSIZE>{}};
+    StorageAddress address;
+    {
+        AutoStoredObject<Settings, TestStorage> object{make_settings(1000), storage};
+        address = object.getAddress();
+    }
+    {
+        AutoStoredObject<Settings, TestStorage> object{address, storage};
+        object.get().values[500] = 1;
+    }
+    AutoStoredObject<Settings, TestStorage> object{address, storage};
+    EXPECT_EQ(object.get().values[500], 1UL);
+    EXPECT_EQ(object.get().values[501], 1503UL);
+}
+
+}
@@ -0,0 +1,50 @@
+#include "gtest/gtest.h"
+
+#include <storage/StringDictionary.hpp>
+#include <storage/SimpleStorage.hpp>
+
+namespace{
+
+constexpr size_t MEMORYSIZE = 20;
+
+TEST(StringDictionaryTest, InternFind){
+    StringDictionary dict;
+    EXPECT_EQ(dict.intern("NYSE"), 0U);
+    EXPECT_EQ(dict.intern("LSE"), 1U);
+    EXPECT_EQ(dict.intern(std::string{"NYSE"}), 0U);
+    EXPECT_EQ(dict.size(), 2UL);
+    EXPECT_EQ(dict.find("LSE"), std::optional<StringDictionary::Id>{1});
+    EXPECT_FALSE(dict.find("CME").has_value());
+    EXPECT_EQ(dict.str(1), "LSE");
+    EXPECT_THROW(dict.str(2), std::logic_error);
+
+    //strings stay valid while the table grows
+    const std::string &first = dict.str(0);
+    for(int i = 0; i < 1000; i++){
+        dict.intern("T" + std::to_string(i));
+    }
+    EXPECT_EQ(first, "NYSE");
+    EXPECT_EQ(dict.str(dict.intern("T500")), "T500");
+
+    StringDictionary copy = dict;
+    EXPECT_EQ(copy.intern("X"), 1002U);
+    EXPECT_EQ(dict.size(), 1002UL);
+    EXPECT_EQ(copy.find("T999"), dict.find("T999"));
+}
+
+TEST(StringDictionaryTest, SerializeDeserialize){
+    SimpleRamStorage<MEMORYSIZE> storage{MemoryRMA<MEMORYSIZE>{}};
+    StringDictionary dict;
+    for(auto s: {"NYSE", "", "a longer string that is not stored inline", "LSE"}){
+        dict.intern(s);
+    }
+    auto addr = serialize<StorageAddress>(storage, dict);
+    auto res = deserialize<StringDictionary>(storage, addr);
+    ASSERT_EQ(res.size(), 4UL);
+    for(StringDictionary::Id id = 0; id < 4; id++){
+        EXPECT_EQ(res.str(id), dict.str(id));
+    }
+    EXPECT_EQ(res.find(""), std::optional<StringDictionary::Id>{1});
+}
+
+}
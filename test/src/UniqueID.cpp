@@ -1,5 +1,9 @@
 
 #include <memory>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 #include <storage/UniqueID.hpp>
 #include <storage/DataStorage.hpp>
@@ -25,14 +29,16 @@ public:
         buffer.get<int>()[0] = a;
         return Result::Success;
     }
+    static inline std::atomic<int> loads{0};
     static TestUIDClass deserializeImpl(const StorageBufferRO<> &buffer, uint32_t id) {
+        loads++;
         TestUIDClass tuc{buffer.get<int>()[0], id};
         return tuc;
     }
     size_t getSizeImpl() const { return sizeof(a); }
 };
 
-constexpr size_t MEMORYSIZE=12;
+constexpr size_t MEMORYSIZE=14;
 
 TEST(UniqueIDTest, SimpleRegisterGet){
     SimpleRamStorage<MEMORYSIZE> storage{MemoryRMA<MEMORYSIZE>{}};
@@ -110,4 +116,284 @@ TEST(UniqueIDTest, UniqueIDPtrSerializeDeserialize){
     }
 }
 
+using TestUIDStorage = UniqueIDStorage<TestUIDClass, SimpleRamStorage<MEMORYSIZE>>;
+
+//storage with instances 1..n stored at their addresses, none loaded
+StorageAddress store_instances(SimpleRamStorage<MEMORYSIZE> &storage, uint32_t n){
+    TestUIDStorage uid_s{storage};
+    for(uint32_t id = 1; id <= n; id++){
+        uid_s.registerInstance(*new TestUIDClass{static_cast<int>(id * 10), id});
+        uid_s.registerInstanceAddress(id, serialize<StorageAddress>(storage, TestUIDClass{static_cast<int>(id * 10), id}));
+    }
+    //ids far apart land in other chunks of the table
+    uid_s.registerInstance(*new TestUIDClass{5, 5000});
+    uid_s.registerInstanceAddress(5000, serialize<StorageAddress>(storage, TestUIDClass{5, 5000}));
+    return serialize<StorageAddress>(storage, uid_s);
+}
+
+TEST(UniqueIDTest, LoadOnceUnderContention){
+    SimpleRamStorage<MEMORYSIZE> storage{MemoryRMA<MEMORYSIZE>{}};
+    constexpr uint32_t N = 100;
+    auto addr = store_instances(storage, N);
+    auto uid_s = deserialize<TestUIDStorage>(storage, addr, storage);
+    EXPECT_FALSE(uid_s.is_loaded(1));
+
+    TestUIDClass::loads = 0;
+    std::vector<std::vector<TestUIDClass *>> seen(4);
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < seen.size(); t++){
+        threads.emplace_back([&, t]{
+            for(uint32_t id = 1; id <= N; id++){
+                seen[t].push_back(&uid_s.getInstance<TestUIDClass>(id));
+            }
+        });
+    }
+    for(auto &t: threads){
+        t.join();
+    }
+    //every instance was read once and all threads got the same one
+    EXPECT_EQ(TestUIDClass::loads.load(), static_cast<int>(N));
+    for(auto &s: seen){
+        EXPECT_EQ(s, seen[0]);
+    }
+    EXPECT_EQ(seen[0][6]->a, 70);
+    EXPECT_EQ(uid_s.getInstance<TestUIDClass>(5000).a, 5);
+    EXPECT_THROW(uid_s.getInstance<TestUIDClass>(4000), std::logic_error);
+    EXPECT_THROW(uid_s.getInstance<TestUIDClass>(1UL << 20), std::logic_error);
+}
+
+TEST(UniqueIDTest, EvictIdle){
+    SimpleRamStorage<MEMORYSIZE> storage{MemoryRMA<MEMORYSIZE>{}};
+    auto addr = store_instances(storage, 3);
+    auto uid_s = deserialize<TestUIDStorage>(storage, addr, storage);
+    TestUIDClass::loads = 0;
+    {
+        auto ref = uid_s.acquire<TestUIDClass>(1);
+        EXPECT_EQ(ref->a, 10);
+        EXPECT_EQ(uid_s.acquire<TestUIDClass>(1)->a, 10);
+        EXPECT_EQ(TestUIDClass::loads.load(), 1);
+        //held by a handle
+        EXPECT_EQ(uid_s.evict_idle(), 0UL);
+        EXPECT_EQ(uid_s.evict_idle(), 0UL);
+        EXPECT_TRUE(uid_s.is_loaded(1));
+    }
+    //references from getInstance() may be kept, so it is never evicted
+    auto &pinned = uid_s.getInstance<TestUIDClass>(2);
+
+    //used since the last call, gets a second chance
+    EXPECT_EQ(uid_s.evict_idle(), 0UL);
+    EXPECT_EQ(uid_s.evict_idle(), 1UL);
+    EXPECT_FALSE(uid_s.is_loaded(1));
+    EXPECT_TRUE(uid_s.is_loaded(2));
+    EXPECT_EQ(pinned.a, 20);
+
+    //read again on next use
+    EXPECT_EQ(uid_s.acquire<TestUIDClass>(1)->a, 10);
+    EXPECT_EQ(TestUIDClass::loads.load(), 3);
+}
+
+TEST(UniqueIDTest, DeleteHeldInstance){
+    SimpleRamStorage<MEMORYSIZE> storage{MemoryRMA<MEMORYSIZE>{}};
+    auto addr = store_instances(storage, 2);
+    auto uid_s = deserialize<TestUIDStorage>(storage, addr, storage);
+    {
+        auto ref = uid_s.acquire<TestUIDClass>(1);
+        EXPECT_THROW(uid_s.deleteInstance(1), std::logic_error);
+        EXPECT_EQ(ref->a, 10);
+    }
+    uid_s.deleteInstance(1);
+    EXPECT_THROW(uid_s.acquire<TestUIDClass>(1), std::logic_error);
+    //not loaded yet
+    uid_s.deleteInstance(2);
+    EXPECT_FALSE(uid_s.is_loaded(2));
+}
+
+TEST(UniqueIDTest, LoadAllInDependencyOrder){
+    SimpleRamStorage<MEMORYSIZE> storage{MemoryRMA<MEMORYSIZE>{}};
+    constexpr uint32_t N = 60;
+    auto addr = store_instances(storage, N);
+    auto uid_s = deserialize<TestUIDStorage>(storage, addr, storage);
+    //already loaded ones are skipped
+    EXPECT_EQ(uid_s.getInstance<TestUIDClass>(5).a, 50);
+
+    TestUIDClass::loads = 0;
+    //chains of 10 nested instances, each one needs the previous one
+    auto depends = [](uint32_t id){
+        return (id % 10 != 1 && id <= N) ? std::vector<uint32_t>{id - 1} : std::vector<uint32_t>{};
+    };
+    auto timings = uid_s.load_all<TestUIDClass>(4, depends);
+    EXPECT_EQ(timings.size(), static_cast<size_t>(N));
+    EXPECT_EQ(TestUIDClass::loads.load(), static_cast<int>(N));
+    std::vector<size_t> position(5001, 0);
+    for(size_t i = 0; i < timings.size(); i++){
+        position[timings[i].id] = i + 1;
+    }
+    EXPECT_EQ(position[5], 0UL);
+    EXPECT_NE(position[5000], 0UL);
+    for(uint32_t id = 1; id <= N; id++){
+        if(id % 10 != 1 && id != 5 && id != 6){
+            EXPECT_LT(position[id - 1], position[id]);
+        }
+        EXPECT_TRUE(uid_s.is_loaded(id));
+    }
+    EXPECT_EQ(uid_s.getInstance<TestUIDClass>(37).a, 370);
+    EXPECT_TRUE(uid_s.load_all<TestUIDClass>(4).empty());
+}
+
+TEST(UniqueIDTest, LoadAllDependencyErrors){
+    SimpleRamStorage<MEMORYSIZE> storage{MemoryRMA<MEMORYSIZE>{}};
+    auto addr = store_instances(storage, 3);
+    {
+        auto uid_s = deserialize<TestUIDStorage>(storage, addr, storage);
+        EXPECT_THROW(uid_s.load_all<TestUIDClass>(2, [](uint32_t id){
+            return id == 1 ? std::vector<uint32_t>{2} : id == 2 ? std::vector<uint32_t>{1} : std::vector<uint32_t>{};
+        }), std::logic_error);
+    }
+    {
+        auto uid_s = deserialize<TestUIDStorage>(storage, addr, storage);
+        EXPECT_THROW(uid_s.load_all<TestUIDClass>(2, [](uint32_t){ return std::vector<uint32_t>{77}; }), std::logic_error);
+    }
+}
+
+TEST(UniqueIDTest, ReadUnversionedTable){
+    SimpleRamStorage<MEMORYSIZE> storage{MemoryRMA<MEMORYSIZE>{}};
+    auto addr1 = serialize<StorageAddress>(storage, TestUIDClass{7, 1});
+    auto addr2 = serialize<StorageAddress>(storage, TestUIDClass{9, 2});
+    //table written before it had a schema: max id, count, (id, address)...
+    std::pair<uint32_t, StorageAddress> r1{1, addr1}, r2{2, addr2};
+    auto addr = storage.get_random_address(SizeAccumulate(uint32_t{2}, size_t{2}, r1, r2));
+    {
+        auto buffer = storage.writeb(addr);
+        size_t offset = 0;
+        SerializeSequentially(buffer, offset, uint32_t{2}, size_t{2}, r1, r2);
+        storage.commit(buffer);
+    }
+    auto uid_s = deserialize<UniqueIDStorage<TestUIDClass, decltype(storage)>>(storage, addr, storage);
+    EXPECT_EQ(uid_s.getInstance<TestUIDClass>(1).a, 7);
+    EXPECT_EQ(uid_s.getInstance<TestUIDClass>(2).a, 9);
+    EXPECT_EQ(uid_s.type_of(2), TypeRegistry<TestUIDClass>::UNKNOWN);
+    EXPECT_EQ(uid_s.generateID(), 3U);
+}
+
+//instances of different types in one storage
+class TestShape: public UniqueIDInstance{
+public:
+    TestShape(uint32_t id): UniqueIDInstance(id) {}
+    virtual ~TestShape(){}
+    virtual int area() const = 0;
+};
+
+template<int SIDES>
+class TestPolygon: public TestShape{
+public:
+    static constexpr std::string_view TYPE_NAME = SIDES == 3 ? "TestTriangle" : SIDES == 4 ? "TestSquare" : "TestPentagon";
+    int side;
+    TestPolygon(int side, uint32_t id): TestShape(id), side(side) {}
+    int area() const override { return SIDES * side; }
+    Result serializeImpl(StorageBuffer<> &buffer) const {
+        buffer.get<int>()[0] = side;
+        return Result::Success;
+    }
+    static TestPolygon deserializeImpl(const StorageBufferRO<> &buffer, uint32_t id = 0) {
+        return TestPolygon{buffer.get<int>()[0], id};
+    }
+    size_t getSizeImpl() const { return sizeof(side); }
+};
+using TestTriangle = TestPolygon<3>;
+using TestSquare = TestPolygon<4>;
+using TestPentagon = TestPolygon<5>;
+using TestShapeStorage = UniqueIDStorage<TestShape, SimpleRamStorage<MEMORYSIZE>>;
+
+//without TYPE_NAME, named on registration
+class TestCircle: public TestShape{
+public:
+    int radius;
+    TestCircle(int radius, uint32_t id): TestShape(id), radius(radius) {}
+    int area() const override { return 3 * radius * radius; }
+    Result serializeImpl(StorageBuffer<> &buffer) const {
+        buffer.get<int>()[0] = radius;
+        return Result::Success;
+    }
+    static TestCircle deserializeImpl(const StorageBufferRO<> &buffer, uint32_t id = 0) {
+        return TestCircle{buffer.get<int>()[0], id};
+    }
+    size_t getSizeImpl() const { return sizeof(radius); }
+};
+
+TypeRegistrar<TestShape, TestTriangle> triangle_registrar;
+TypeRegistrar<TestShape, TestCircle> circle_registrar{"TestCircle"};
+
+template<typename U>
+void store_shape(SimpleRamStorage<MEMORYSIZE> &storage, TestShapeStorage &uid_s, int side, uint32_t id){
+    uid_s.registerInstance(*new U{side, id});
+    uid_s.registerInstanceAddress(id, serialize<StorageAddress>(storage, U{side, id}));
+}
+
+TEST(UniqueIDTest, TypeRegistry){
+    auto &registry = TypeRegistry<TestShape>::global();
+    EXPECT_NE(registry.find(registry.type_id<TestTriangle>()), nullptr);
+    EXPECT_EQ(registry.find(registry.type_id<TestPentagon>()), nullptr);
+    EXPECT_EQ(registry.find(TypeRegistry<TestShape>::UNKNOWN), nullptr);
+    EXPECT_NE(registry.type_id<TestTriangle>(), registry.type_id<TestSquare>());
+    EXPECT_EQ(registry.add<TestSquare>(), registry.type_id<TestSquare>());
+    //registering again is a no-op
+    size_t size = registry.size();
+    registry.add<TestSquare>();
+    EXPECT_EQ(registry.size(), size);
+    EXPECT_EQ(registry.name(registry.type_id<TestSquare>()), "TestSquare");
+    //id depends only on the explicit name
+    EXPECT_EQ(registry.type_id<TestSquare>(), fnv1a64("TestSquare"));
+    EXPECT_EQ(registry.type_id<TestCircle>(), TypeRegistry<TestShape>::UNKNOWN);
+    EXPECT_EQ(registry.id_of<TestCircle>(), fnv1a64("TestCircle"));
+    EXPECT_EQ(registry.name(registry.id_of<TestCircle>()), "TestCircle");
+    EXPECT_THROW(registry.add<TestCircle>("Circle"), std::logic_error);
+    EXPECT_THROW(registry.add<TestSquare>("TestCircle"), std::logic_error);
+}
+
+TEST(UniqueIDTest, LoadByTypeId){
+    SimpleRamStorage<MEMORYSIZE> storage{MemoryRMA<MEMORYSIZE>{}};
+    TypeRegistry<TestShape>::global().add<TestSquare>();
+    StorageAddress addr;
+    {
+        TestShapeStorage uid_s{storage};
+        store_shape<TestTriangle>(storage, uid_s, 2, 1);
+        store_shape<TestSquare>(storage, uid_s, 3, 2);
+        store_shape<TestPentagon>(storage, uid_s, 4, 3);
+        store_shape<TestSquare>(storage, uid_s, 5, 2000);
+        store_shape<TestCircle>(storage, uid_s, 2, 4);
+        addr = serialize<StorageAddress>(storage, uid_s);
+    }
+    {
+        auto uid_s = deserialize<TestShapeStorage>(storage, addr, storage);
+        EXPECT_EQ(uid_s.type_of(2), TypeRegistry<TestShape>::type_id<TestSquare>());
+        EXPECT_EQ(uid_s.getInstance(1).area(), 6);
+        EXPECT_EQ(uid_s.acquire(2)->area(), 12);
+        EXPECT_EQ(uid_s.getInstance(2000).area(), 20);
+        EXPECT_EQ(uid_s.getInstance(4).area(), 12);
+        //type of 3 is not registered
+        EXPECT_THROW(uid_s.getInstance(3), std::logic_error);
+        EXPECT_FALSE(uid_s.is_loaded(3));
+        //read as the given type without the registry
+        EXPECT_EQ(uid_s.getInstance<TestPentagon>(3).area(), 20);
+    }
+    {
+        //names of types read with the table move with it
+        auto uid_s = deserialize<TestShapeStorage>(storage, addr, storage);
+        TestShapeStorage moved{std::move(uid_s)};
+        auto types = moved.stored_types();
+        EXPECT_TRUE(std::any_of(types.begin(), types.end(), [](auto &t){ return t.second == "TestPentagon"; }));
+    }
+    {
+        auto uid_s = deserialize<TestShapeStorage>(storage, addr, storage);
+        EXPECT_THROW(uid_s.load_all(2), std::logic_error);
+        TypeRegistry<TestShape>::global().add<TestPentagon>();
+        //instances of registered types may be loaded by the failed call already
+        auto timings = uid_s.load_all(2);
+        EXPECT_TRUE(std::any_of(timings.begin(), timings.end(), [](auto &t){ return t.id == 3; }));
+        EXPECT_TRUE(uid_s.is_loaded(1) && uid_s.is_loaded(2) && uid_s.is_loaded(2000));
+        EXPECT_EQ(uid_s.getInstance(3).area(), 20);
+        EXPECT_EQ(dynamic_cast<TestSquare &>(uid_s.getInstance(2)).side, 3);
+    }
+}
+
 }
@@ -1,6 +1,8 @@
 
 #include <cstdio>
 #include <memory>
+#include <memory_resource>
+#include <vector>
 
 #include <storage/SimpleStorage.hpp>
 
@@ -406,8 +408,130 @@ TEST(VirtAddressMapping, PutGetIncorrect){
 	}
 }
 
+class CountingResource: public std::pmr::memory_resource{
+	std::pmr::memory_resource *upstream;
+public:
+	size_t allocated{0};
+	CountingResource(std::pmr::memory_resource *upstream): upstream(upstream) {}
+private:
+	void *do_allocate(size_t bytes, size_t alignment) override{
+		allocated += bytes;
+		return upstream->allocate(bytes, alignment);
+	}
+	void do_deallocate(void *p, size_t bytes, size_t alignment) override{
+		upstream->deallocate(p, bytes, alignment);
+	}
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override{
+		return this == &other;
+	}
+};
+
+TEST(VirtAddressMapping, DeserializeIntoArena){
+	VirtAddressMapping vam;
+	std::vector<std::pair<uint64_t, size_t>> offsets;
+	for(uint64_t addr = 0x1000; addr < 0x1000 + 100 * 0x20; addr += 0x20){
+		offsets.emplace_back(addr, vam.alloc(addr, 8));
+	}
+	vam.del(0x1000, 8);
+
+	std::vector<char> mem(szeimpl::size(vam));
+	StorageBuffer buffer{mem.data(), mem.size(), mem.size()};
+	EXPECT_EQ(szeimpl::s(vam, buffer), Result::Success);
+
+	CountingResource default_counter{std::pmr::get_default_resource()};
+	auto prev_default = std::pmr::set_default_resource(&default_counter);
+
+	CountingResource counter{std::pmr::new_delete_resource()};
+	{
+		MetadataArena arena{&counter};
+		StorageBufferRO<> buf{mem.data(), mem.size()};
+		auto vam2 = szeimpl::d<VirtAddressMapping>(arena.resource(), buf);
+		EXPECT_EQ(default_counter.allocated, 0U);
+		EXPECT_GT(counter.allocated, 0U);
+
+		for(size_t i = 1; i < offsets.size(); i++){
+			auto [offset, size] = vam2.lookup(offsets[i].first, 8, true);
+			EXPECT_EQ(offsets[i].second, offset);
+			EXPECT_EQ(size, 8U);
+		}
+		//deleted range is reused for the next allocation
+		EXPECT_EQ(vam2.alloc(0x100000, 8), offsets[0].second);
+	}
+	std::pmr::set_default_resource(prev_default);
+	EXPECT_EQ(default_counter.allocated, 0U);
+	EXPECT_EQ(deserialize_resource(), prev_default);
+}
+
+std::vector<char> serialize_mapping(const VirtAddressMapping &vam){
+	std::vector<char> mem(szeimpl::size(vam));
+	StorageBuffer buffer{mem.data(), mem.size(), mem.size()};
+	EXPECT_EQ(szeimpl::s(vam, buffer), Result::Success);
+	return mem;
+}
+
+TEST(VirtAddressMapping, DeserializeLazy){
+	constexpr size_t N = 1000; //several extent chunks
+	VirtAddressMapping vam;
+	std::vector<std::pair<uint64_t, size_t>> offsets;
+	for(size_t i = 0; i < N; i++){
+		uint64_t addr = 0x1000 + i * 0x20;
+		if(i % 2){
+			offsets.emplace_back(addr, vam.alloc(addr, 8));
+		} else {
+			EXPECT_EQ(vam.alloc_unmapped(addr, 8), Result::Success);
+		}
+	}
+	auto mem = serialize_mapping(vam);
+
+	StorageBufferRO<> buf{mem.data(), mem.size()};
+	auto vam2 = szeimpl::d<VirtAddressMapping>(buf);
+	for(auto [addr, offset1]: offsets){
+		auto [offset2, size2] = vam2.lookup(addr, 8, true);
+		EXPECT_EQ(offset1, offset2);
+		EXPECT_EQ(size2, 8U);
+	}
+
+	//modify few chunks, rest stays in the buffer
+	auto [new_offset, new_size] = vam2.lookup(0x1000, 8);
+	EXPECT_EQ(new_size, 8U);
+	EXPECT_EQ(vam2.del(offsets.back().first, 8), Result::Success);
+	offsets.pop_back();
+	uint64_t new_addr = 0x1000 + N * 0x20 + 0x100;
+	size_t alloc_offset = vam2.alloc(new_addr, 16);
+
+	auto mem2 = serialize_mapping(vam2);
+	StorageBufferRO<> buf2{mem2.data(), mem2.size()};
+	auto vam3 = szeimpl::d<VirtAddressMapping>(buf2);
+	for(auto [addr, offset1]: offsets){
+		auto [offset2, size2] = vam3.lookup(addr, 8, true);
+		EXPECT_EQ(offset1, offset2);
+	}
+	EXPECT_EQ(vam3.lookup(0x1000, 8, true).first, new_offset);
+	EXPECT_EQ(vam3.lookup(new_addr, 16, true).first, alloc_offset);
+}
+
+TEST(VirtAddressMapping, DeserializeCorruptedChunk){
+	VirtAddressMapping vam;
+	std::vector<std::pair<uint64_t, size_t>> offsets;
+	for(uint64_t addr = 0x1000; addr < 0x1000 + 600 * 0x20; addr += 0x20){
+		offsets.emplace_back(addr, vam.alloc(addr, 8));
+	}
+	auto mem = serialize_mapping(vam);
+	//last extent is in the last chunk
+	mem[mem.size() - ExtentArrayView::chunks_for(offsets.size()) * sizeof(uint32_t) - 1] ^= 0x1;
+
+	StorageBufferRO<> buf{mem.data(), mem.size()};
+	auto vam2 = szeimpl::d<VirtAddressMapping>(buf);
+	EXPECT_EQ(vam2.lookup(offsets.front().first, 8, true).first, offsets.front().second);
+	EXPECT_THROW(vam2.lookup(offsets.back().first, 8, true), std::runtime_error);
+	//not copied into a new snapshot either
+	EXPECT_THROW(serialize_mapping(vam2), std::runtime_error);
+
+	mem[10] ^= 0x1;
+	EXPECT_THROW(szeimpl::d<VirtAddressMapping>(buf), std::runtime_error);
+}
+
 //TODO expand
 //TODO del
-//TODO deserialize
 
 }
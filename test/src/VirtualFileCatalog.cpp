@@ -35,6 +35,85 @@ TEST(SimpleMultiLevelKeyMapTest, SimpleSerializeDeserialize) {
   EXPECT_EQ(smlkm_res.get(0, 5, 'L').first, false);
 }
 
+TEST(SimpleMultiLevelKeyMapTest, HasDel) {
+  SimpleMultiLevelKeyMap<int, std::string, uint32_t> smlkm;
+  EXPECT_EQ(smlkm.add("NYSE", 5, 50), Result::Success);
+  smlkm.add("NYSE", 6, 60);
+  smlkm.add("LSE", 5, 500);
+  //existing entry is kept
+  smlkm.add("LSE", 5, 7);
+  EXPECT_EQ(smlkm.size(), 3UL);
+  EXPECT_TRUE(smlkm.has("NYSE", 5));
+  EXPECT_FALSE(smlkm.has("NYSE", 7));
+  EXPECT_FALSE(smlkm.has("CME", 5));
+  EXPECT_EQ(smlkm.get("LSE", 5), std::make_pair(true, 500));
+
+  auto [found, ref] = smlkm.getRef("NYSE", 6);
+  EXPECT_TRUE(found);
+  *ref = 61;
+  EXPECT_EQ(smlkm.get("NYSE", 6).second, 61);
+  EXPECT_FALSE(smlkm.getRef("NYSE", 7).first);
+
+  smlkm.del("NYSE", 5);
+  smlkm.del("NYSE", 5);
+  EXPECT_EQ(smlkm.size(), 2UL);
+  EXPECT_FALSE(smlkm.has("NYSE", 5));
+  smlkm.del("LSE", 5);
+  //empty folder is removed
+  EXPECT_EQ(smlkm.list(), std::vector<std::string>{"NYSE"});
+}
+
+TEST(SimpleMultiLevelKeyMapTest, PrefixListScan) {
+  SimpleRamStorage<MEMORYSIZE> storage{MemoryRMA<MEMORYSIZE>{}};
+  using Map = SimpleMultiLevelKeyMap<uint64_t, std::string, std::string, uint16_t>;
+  Map smlkm;
+  //inserted out of order
+  for (uint16_t r : {60, 1, 3600}) {
+    smlkm.add("NYSE", "MSFT", r, 100 + r);
+    smlkm.add("LSE", "BARC", r, 200 + r);
+    smlkm.add("NYSE", "AAPL", r, 300 + r);
+  }
+  EXPECT_EQ(smlkm.list(), (std::vector<std::string>{"LSE", "NYSE"}));
+  EXPECT_EQ(smlkm.list("NYSE"), (std::vector<std::string>{"AAPL", "MSFT"}));
+  EXPECT_EQ(smlkm.list("NYSE", "MSFT"), (std::vector<uint16_t>{1, 60, 3600}));
+  EXPECT_TRUE(smlkm.list("CME").empty());
+
+  std::vector<Map::Key> keys;
+  smlkm.scan([&](const Map::Key &key, uint64_t &value) {
+    EXPECT_EQ(value, (std::get<1>(key) == "MSFT" ? 100 : 300) + std::get<2>(key));
+    keys.push_back(key);
+  }, std::string{"NYSE"});
+  EXPECT_EQ(keys, (std::vector<Map::Key>{{"NYSE", "AAPL", 1}, {"NYSE", "AAPL", 60}, {"NYSE", "AAPL", 3600},
+                                         {"NYSE", "MSFT", 1}, {"NYSE", "MSFT", 60}, {"NYSE", "MSFT", 3600}}));
+  size_t count = 0;
+  smlkm.scan([&](const Map::Key &, uint64_t &value) {
+    EXPECT_EQ(value, 260UL);
+    count++;
+  }, std::string{"LSE"}, std::string{"BARC"}, uint16_t{60});
+  EXPECT_EQ(count, 1UL);
+
+  //serialized in key order, restored into the trie
+  StorageAddress addr = serialize<StorageAddress>(storage, smlkm);
+  auto smlkm_res = deserialize<Map>(storage, addr);
+  EXPECT_EQ(smlkm_res.size(), 9UL);
+  EXPECT_EQ(smlkm_res.get("LSE", "BARC", 3600), std::make_pair(true, uint64_t{3800}));
+  EXPECT_EQ(smlkm_res.list("NYSE"), (std::vector<std::string>{"AAPL", "MSFT"}));
+
+  //every distinct string is interned once, ordering is by string, not by id
+  EXPECT_EQ(smlkm.dictionary().size(), 5UL);
+  EXPECT_FALSE(smlkm.has("CME", "AAPL", 1));
+  smlkm.del("CME", "AAPL", 1);
+  EXPECT_EQ(smlkm.dictionary().size(), 5UL);
+  EXPECT_EQ(smlkm_res.dictionary().size(), 5UL);
+  EXPECT_EQ(smlkm_res.list("NYSE", "MSFT"), (std::vector<uint16_t>{1, 60, 3600}));
+
+  //copies don't share the sorted order
+  Map copy = smlkm;
+  smlkm.del("NYSE", "AAPL", 1);
+  EXPECT_EQ(copy.list("NYSE", "AAPL"), (std::vector<uint16_t>{1, 60, 3600}));
+  EXPECT_EQ(smlkm.list("NYSE", "AAPL"), (std::vector<uint16_t>{60, 3600}));
+}
+
 using TestVFCType1 = VirtualFileCatalog<SimpleRamStorage<MEMORYSIZE>, int, char>;
 
 TEST(VirtualFileCatalogTest, SimpleCreateLookup) {
@@ -47,6 +126,9 @@ TEST(VirtualFileCatalogTest, SimpleCreateLookup) {
     EXPECT_EQ(vfc1.get('d'), std::make_pair(true, 2));
     EXPECT_EQ(vfc1.get('c'), std::make_pair(true, 3));
     EXPECT_EQ(vfc1.get('e').first, false);
+    EXPECT_TRUE(vfc1.has('c'));
+    EXPECT_FALSE(vfc1.has('e'));
+    EXPECT_EQ(vfc1.list(), (std::vector<char>{'c', 'd'}));
   }
 }
 